@@ -0,0 +1,313 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "allocationcounter.h"
+
+#include <pubsub/baseeventpublisher.h>
+#include <pubsub/table_generator.h>
+
+#include <array>
+#include <chrono>
+#include <random>
+
+#include <benchmark/benchmark.h>
+
+namespace trailofbits {
+namespace {
+/// How many events are emitted at once
+const std::size_t kBatchSize{256U};
+
+/// How many batches are emitted between two table queries
+const std::size_t kBatchesPerQuery{8U};
+
+/// The buffer engines used in the sweep, indexed by the third argument
+const std::array<const char*, 2U> kEngineNameList = {"circular_buffer",
+                                                     "lock_free_ring"};
+
+/// A single synthetic event
+struct SyntheticEvent final {
+  /// Sequential identifier
+  std::int64_t id{0};
+
+  /// A random value
+  std::int64_t value{0};
+
+  /// A random, domain-like name
+  std::string name;
+};
+
+/// The event context emitted by the synthetic publisher
+struct SyntheticEventContext final {
+  /// When the events have been emitted
+  std::chrono::steady_clock::time_point emit_time;
+
+  /// Events, pointing inside the replayed trace
+  std::vector<const SyntheticEvent*> event_list;
+
+  /// Called by the event context pool; the list capacity is kept
+  void reset() {
+    event_list.clear();
+  }
+};
+
+struct SyntheticSubscriptionContext final {};
+
+/// Returns a fixed trace of events; the generator is seeded with a
+/// constant, so that every run replays the same data
+const std::vector<SyntheticEvent>& syntheticTrace() {
+  static const auto kTrace = []() -> std::vector<SyntheticEvent> {
+    const std::array<const char*, 4U> label_list = {
+        "www", "mail", "api", "cdn"};
+
+    const std::array<const char*, 4U> domain_list = {
+        "example.com", "example.org", "test.net", "localdomain"};
+
+    std::mt19937 generator(0x7472616cU);
+    std::uniform_int_distribution<std::int64_t> value_distribution(0, 65535);
+    std::uniform_int_distribution<std::size_t> name_distribution(0U, 3U);
+
+    std::vector<SyntheticEvent> trace(kBatchSize * kBatchesPerQuery);
+    for (auto i = 0U; i < trace.size(); ++i) {
+      auto& event = trace[i];
+
+      event.id = static_cast<std::int64_t>(i);
+      event.value = value_distribution(generator);
+      event.name = std::string(label_list[name_distribution(generator)]) +
+                   std::to_string(event.value % 100) + "." +
+                   domain_list[name_distribution(generator)];
+    }
+
+    return trace;
+  }();
+
+  return kTrace;
+}
+
+using SyntheticPublisherBase =
+    BaseEventPublisher<SyntheticSubscriptionContext, SyntheticEventContext>;
+
+/// A publisher replaying the synthetic trace
+class SyntheticPublisher final : public SyntheticPublisherBase {
+  /// Position of the next event inside the trace
+  std::size_t trace_position{0U};
+
+ public:
+  osquery::Status initialize() noexcept override {
+    return osquery::Status(0);
+  }
+
+  osquery::Status configure(const json11::Json&) noexcept override {
+    return osquery::Status(0);
+  }
+
+  osquery::Status release() noexcept override {
+    return osquery::Status(0);
+  }
+
+  osquery::Status run() noexcept override {
+    const auto& trace = syntheticTrace();
+
+    EventContextRef event_context;
+    auto status = createEventContext(event_context);
+    if (!status.ok()) {
+      return status;
+    }
+
+    for (auto i = 0U; i < kBatchSize; ++i) {
+      event_context->event_list.push_back(&trace[trace_position]);
+      trace_position = (trace_position + 1U) % trace.size();
+    }
+
+    event_context->emit_time = std::chrono::steady_clock::now();
+    emitEvents(event_context);
+
+    return osquery::Status(0);
+  }
+};
+
+// clang-format off
+BEGIN_TABLE(synthetic_events)
+  TABLE_COLUMN(emit_time, osquery::BIGINT_TYPE)
+  TABLE_COLUMN(id, osquery::BIGINT_TYPE)
+  TABLE_COLUMN(value, osquery::INTEGER_TYPE)
+  TABLE_COLUMN(name, osquery::TEXT_TYPE)
+END_TABLE(synthetic_events)
+// clang-format on
+
+/// Converts the synthetic events to table rows, like the real subscribers
+/// do
+class SyntheticSubscriber final
+    : public BaseEventSubscriber<SyntheticPublisherBase> {
+ public:
+  osquery::Status initialize() noexcept override {
+    return osquery::Status(0);
+  }
+
+  void release() noexcept override {}
+
+  osquery::Status configure(SyntheticPublisherBase::SubscriptionContextRef,
+                            const json11::Json&) noexcept override {
+    return osquery::Status(0);
+  }
+
+  osquery::Status callback(
+      osquery::TableRows& new_events,
+      SyntheticPublisherBase::SubscriptionContextRef,
+      SyntheticPublisherBase::EventContextRef event_context) override {
+    EventColumnBatchRef batch;
+    auto status =
+        EventColumnBatch::create(batch, synthetic_eventsTableSchema());
+    if (!status.ok()) {
+      return status;
+    }
+
+    auto emit_time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         event_context->emit_time.time_since_epoch())
+                         .count();
+
+    for (const auto event : event_context->event_list) {
+      auto row = batch->addRow();
+
+      batch->setInteger(row, 0U, static_cast<std::int64_t>(emit_time));
+      batch->setInteger(row, 1U, event->id);
+      batch->setInteger(row, 2U, event->value);
+      batch->setText(row, 3U, event->name);
+    }
+
+    EventColumnBatch::appendTableRows(new_events, batch);
+    return osquery::Status(0);
+  }
+};
+} // namespace
+
+/// Emits batches of synthetic events to a set of subscribers, and queries
+/// their tables; reports the end-to-end events/sec, the emit to generate
+/// latency and the allocations per event.
+///
+/// Arguments: subscriber count, buffer capacity, buffer engine
+static void BM_EndToEnd(benchmark::State& state) {
+  static std::size_t run_counter{0U};
+  ++run_counter;
+
+  auto subscriber_count = static_cast<std::size_t>(state.range(0));
+  auto capacity = static_cast<std::size_t>(state.range(1));
+  const auto engine_name = kEngineNameList.at(
+      static_cast<std::size_t>(state.range(2)));
+
+  SyntheticPublisher publisher;
+
+  json11::Json::object buffer_settings;
+  std::vector<std::string> buffer_name_list;
+
+  for (auto i = 0U; i < subscriber_count; ++i) {
+    auto buffer_name = "synthetic_events_" + std::to_string(run_counter) +
+                       "_" + std::to_string(i);
+
+    auto status = publisher.subscribe(static_cast<SubscriberId>(i),
+                                      std::make_shared<SyntheticSubscriber>(),
+                                      buffer_name);
+
+    if (!status.ok()) {
+      state.SkipWithError(status.getMessage().c_str());
+      return;
+    }
+
+    buffer_settings.insert(
+        {buffer_name,
+         json11::Json::object{{"engine", engine_name},
+                              {"capacity", static_cast<int>(capacity)}}});
+
+    buffer_name_list.push_back(std::move(buffer_name));
+  }
+
+  publisher.configureSubscribers(json11::Json::object{
+      {"pubsub", json11::Json::object{{"buffers", buffer_settings}}}});
+
+  LatencyHistogram latency_histogram;
+  std::size_t emitted_event_count{0U};
+  std::size_t generated_row_count{0U};
+
+  auto initial_allocation_count = allocationCount();
+
+  for (auto _ : state) {
+    for (auto i = 0U; i < kBatchesPerQuery; ++i) {
+      publisher.run();
+      emitted_event_count += kBatchSize;
+    }
+
+    for (const auto& buffer_name : buffer_name_list) {
+      osquery::QueryContext context;
+      auto row_list = generateTableRows(
+          buffer_name, context, synthetic_eventsTableSchema());
+
+      auto generate_time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               std::chrono::steady_clock::now()
+                                   .time_since_epoch())
+                               .count();
+
+      for (const auto& row : row_list) {
+        auto row_data = static_cast<osquery::Row>(*row);
+        auto emit_time = std::stoll(row_data.at("emit_time"));
+
+        latency_histogram.record(
+            static_cast<std::uint64_t>(generate_time - emit_time) / 1000U);
+      }
+
+      generated_row_count += row_list.size();
+    }
+  }
+
+  auto allocation_count = allocationCount() - initial_allocation_count;
+  auto delivered_event_count = emitted_event_count * subscriber_count;
+
+  state.SetItemsProcessed(static_cast<std::int64_t>(emitted_event_count));
+
+  auto latency_summary = latency_histogram.summary();
+  state.counters["p50_us"] = static_cast<double>(latency_summary.p50);
+  state.counters["p99_us"] = static_cast<double>(latency_summary.p99);
+
+  state.counters["allocs_per_event"] =
+      static_cast<double>(allocation_count) /
+      static_cast<double>(std::max(delivered_event_count, std::size_t{1U}));
+
+  state.counters["dropped_rows"] = static_cast<double>(
+      delivered_event_count - std::min(delivered_event_count,
+                                       generated_row_count));
+
+  for (auto i = 0U; i < subscriber_count; ++i) {
+    publisher.unsubscribe(static_cast<SubscriberId>(i));
+  }
+}
+
+/// Sweeps the subscriber counts, buffer sizes and buffer engines
+static void endToEndArguments(benchmark::internal::Benchmark* benchmark) {
+  for (auto engine = 0; engine < static_cast<int>(kEngineNameList.size());
+       ++engine) {
+    for (auto capacity : {4096, 65536}) {
+      for (auto subscriber_count : {1, 2, 4, 8}) {
+        benchmark->Args({subscriber_count, capacity, engine});
+      }
+    }
+  }
+}
+
+BENCHMARK(BM_EndToEnd)
+    ->ArgNames({"subscribers", "capacity", "engine"})
+    ->Apply(endToEndArguments)
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
+} // namespace trailofbits
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <pubsub/eventbufferlibrary.h>
+
+#include <osquery/sql/dynamic_table_row.h>
+
+#include <array>
+
+#include <benchmark/benchmark.h>
+
+namespace trailofbits {
+namespace {
+/// How many rows are saved at once
+const std::size_t kRowsPerSave{64U};
+
+/// The buffer engines used in the sweep, indexed by the first argument
+const std::array<const char*, 3U> kEngineNameList = {
+    "circular_buffer", "lock_free_ring", "shared_log"};
+
+/// Creates a new batch of rows
+EventBatch createEventBatch() {
+  EventBatch event_batch;
+
+  for (auto i = 0U; i < kRowsPerSave; ++i) {
+    osquery::Row row = {{"value", std::to_string(i)}};
+    event_batch.push_back(osquery::TableRowHolder(
+        new osquery::DynamicTableRow(std::move(row))));
+  }
+
+  return event_batch;
+}
+} // namespace
+
+/// Measures the contention on a single event buffer: every thread creates
+/// and saves rows, and the first one also reads them back like a table
+/// query would.
+///
+/// Arguments: buffer engine
+static void BM_EventBufferContention(benchmark::State& state) {
+  auto buffer_name = "contention_benchmark_" + std::to_string(state.range(0));
+
+  // Configuring a buffer with its current settings does nothing, so every
+  // thread can do it
+  EventBufferSettings settings;
+  auto status = EventBufferLibrary::parseSettings(
+      settings,
+      json11::Json::object{
+          {"engine",
+           kEngineNameList.at(static_cast<std::size_t>(state.range(0)))},
+          {"capacity", 65536}});
+
+  auto& event_buffer_library = EventBufferLibrary::instance();
+  if (status.ok()) {
+    status = event_buffer_library.configureBuffer(buffer_name, settings);
+  }
+
+  if (!status.ok()) {
+    state.SkipWithError(status.getMessage().c_str());
+    return;
+  }
+
+  std::size_t saved_row_count{0U};
+
+  for (auto _ : state) {
+    auto event_batch = createEventBatch();
+
+    event_buffer_library.saveEvents(event_batch, buffer_name);
+    saved_row_count += kRowsPerSave;
+
+    if (state.thread_index() == 0) {
+      auto row_list = event_buffer_library.getEvents(buffer_name);
+      benchmark::DoNotOptimize(row_list);
+    }
+  }
+
+  state.SetItemsProcessed(static_cast<std::int64_t>(saved_row_count));
+}
+
+BENCHMARK(BM_EventBufferContention)
+    ->ArgName("engine")
+    ->DenseRange(0, static_cast<int>(kEngineNameList.size()) - 1)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+} // namespace trailofbits
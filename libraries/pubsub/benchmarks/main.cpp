@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "allocationcounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include <benchmark/benchmark.h>
+
+namespace trailofbits {
+namespace {
+/// Incremented by the global operator new
+std::atomic<std::uint64_t> allocation_counter{0U};
+
+/// Counts and performs an allocation
+void* countedAllocation(std::size_t size) {
+  allocation_counter.fetch_add(1U, std::memory_order_relaxed);
+
+  auto ptr = std::malloc(size != 0U ? size : 1U);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+
+  return ptr;
+}
+} // namespace
+
+std::uint64_t allocationCount() {
+  return allocation_counter.load(std::memory_order_relaxed);
+}
+} // namespace trailofbits
+
+void* operator new(std::size_t size) {
+  return trailofbits::countedAllocation(size);
+}
+
+void* operator new[](std::size_t size) {
+  return trailofbits::countedAllocation(size);
+}
+
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+  std::free(ptr);
+}
+
+BENCHMARK_MAIN();
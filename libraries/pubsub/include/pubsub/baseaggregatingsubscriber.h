@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "baseeventsubscriber.h"
+#include "eventaggregator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <limits>
+#include <string>
+
+namespace trailofbits {
+/// Subscribers deriving from this class emit rolling summaries instead of
+/// raw rows: events are counted by the EventAggregator, and one row is
+/// generated for each group at the end of each window. Windows are also
+/// collected by the publisher when no events are received, and the current
+/// one is emitted when the subscriber is released. Settings are read from
+/// the "pubsub.aggregation.<subscriber name>" object
+template <typename EventPublisher>
+class BaseAggregatingSubscriber : public BaseEventSubscriber<EventPublisher> {
+  /// Subscriber name
+  std::string subscriber_name;
+
+  /// The aggregation state
+  EventAggregatorRef aggregator;
+
+ protected:
+  /// Constructor; the schema must contain the aggregation columns (see
+  /// EventAggregator), and must outlive the subscriber
+  BaseAggregatingSubscriber(const std::string& name,
+                            const osquery::TableColumns& schema)
+      : subscriber_name(name) {
+    auto status = EventAggregator::create(aggregator, name, schema);
+    if (!status.ok()) {
+      throw status;
+    }
+  }
+
+  /// Passes the events in the given context to the aggregator
+  virtual osquery::Status aggregate(
+      EventAggregator& event_aggregator,
+      typename EventPublisher::SubscriptionContextRef subscription_context,
+      typename EventPublisher::EventContextRef event_context) = 0;
+
+ public:
+  /// Destructor
+  virtual ~BaseAggregatingSubscriber() override = default;
+
+  /// Saves the rows of the current window, which would otherwise be lost
+  virtual void release() noexcept override {
+    EventBatch rows;
+    aggregator->flush(rows);
+
+    if (!rows.empty()) {
+      EventBufferLibrary::instance().saveEvents(rows, subscriber_name);
+    }
+  }
+
+  /// Applies the aggregation settings; invalid settings are ignored, and
+  /// the current ones are kept
+  virtual osquery::Status configure(
+      typename EventPublisher::SubscriptionContextRef,
+      const json11::Json& configuration) noexcept override {
+    EventAggregatorSettings settings;
+    auto status = EventAggregatorSettings::parse(
+        settings, configuration["pubsub"]["aggregation"][subscriber_name]);
+
+    if (status.ok()) {
+      aggregator->configure(settings);
+    }
+
+    return status;
+  }
+
+  /// Aggregates the new events, and returns the rows of the windows that
+  /// have ended
+  virtual osquery::Status callback(
+      osquery::TableRows& new_events,
+      typename EventPublisher::SubscriptionContextRef subscription_context,
+      typename EventPublisher::EventContextRef event_context) override {
+    auto status = aggregate(*aggregator, subscription_context, event_context);
+    aggregator->collect(new_events, std::time(nullptr));
+
+    return status;
+  }
+
+  /// Returns when the current window ends
+  virtual std::chrono::steady_clock::time_point collectDeadline() noexcept
+      override {
+    auto collection_time = aggregator->collectionTime();
+    if (collection_time == std::numeric_limits<std::time_t>::max()) {
+      return std::chrono::steady_clock::time_point::max();
+    }
+
+    auto remaining_time =
+        std::max(collection_time - std::time(nullptr), std::time_t{0});
+
+    return std::chrono::steady_clock::now() +
+           std::chrono::seconds(remaining_time);
+  }
+
+  /// Returns the rows of the windows that have ended
+  virtual osquery::Status collect(osquery::TableRows& new_events) override {
+    aggregator->collect(new_events, std::time(nullptr));
+    return osquery::Status(0);
+  }
+};
+} // namespace trailofbits
@@ -18,16 +18,54 @@
 
 #include "baseeventsubscriber.h"
 #include "eventbufferlibrary.h"
+#include "eventcontextpool.h"
+#include "eventrowlimiter.h"
 #include "ieventpublisher.h"
+#include "latencyhistogram.h"
+#include "metricsregistry.h"
 #include "subscriberregistry.h"
+#include "workerpool.h"
 
-#include <boost/thread/shared_mutex.hpp>
-
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
 #include <memory>
-#include <unordered_map>
+#include <mutex>
+#include <vector>
 
 namespace trailofbits {
+/// How new events are delivered to the subscribers
+enum class EventDispatchMode {
+  /// Subscribers are called one after the other on the publisher thread
+  Serial,
+
+  /// Subscribers are called concurrently on a worker pool; they receive the
+  /// same event context object, and must not modify it
+  Parallel
+};
+
+/// Dispatch settings, taken from the "pubsub.dispatch" object
+struct EventDispatchSettings final {
+  /// Dispatch mode
+  EventDispatchMode mode{EventDispatchMode::Serial};
+
+  /// Size of the worker pool used in parallel mode; zero means one worker
+  /// for each available core
+  std::size_t worker_count{0U};
+
+  /// Parses the dispatch settings from the given json object; a null object
+  /// will return the default settings
+  static osquery::Status parse(EventDispatchSettings& settings,
+                               const json11::Json& configuration);
+
+  /// Returns true if the settings are the same
+  bool operator==(const EventDispatchSettings& other) const;
+
+  /// Returns true if the settings are different
+  bool operator!=(const EventDispatchSettings& other) const;
+};
+
 /// This is the base class used to build new publishers and provides somes
 /// basic utilities to handle subscription and event handling
 template <typename SubscriptionContext, typename EventContext>
@@ -44,40 +82,413 @@ class BaseEventPublisher : public IEventPublisher {
   using SubscriberType = BaseEventSubscriber<
       BaseEventPublisher<SubscriptionContext, EventContext>>;
 
-  /// The list of subscribers interested in the events emitted by this publisher
-  std::unordered_map<IEventSubscriberRef, SubscriptionContextRef>
-      subscriber_list;
+  /// Publisher-side data for each subscriber; it is shared by all the
+  /// subscription tables that reference the subscriber
+  struct SubscriberData final {
+    /// Subscriber name, which is also the name of its event buffer
+    std::string name;
 
-  /// This mutex protects the subscriber map
-  boost::shared_timed_mutex subscriber_map_mutex;
+    /// How long the subscriber callback takes
+    LatencyHistogramRef callback_latency;
 
- public:
-  virtual void configureSubscribers(
-      const json11::Json& configuration) noexcept override {
-    boost::upgrade_lock<decltype(subscriber_map_mutex)> lock(
-        subscriber_map_mutex);
+    /// How many event contexts have been passed to the subscriber
+    StripedCounterRef received_event_count;
+
+    /// How many rows the subscriber has generated
+    StripedCounterRef emitted_row_count;
+
+    /// How full the event buffer is, as published by the buffer itself
+    EventBufferPressureStateRef buffer_pressure;
+
+    /// True if the event buffer has reached its high watermark, and has not
+    /// gone back below the low one yet
+    std::atomic_bool backpressure{false};
+  };
+
+  /// A single entry in the subscription table
+  struct Subscription final {
+    /// The id assigned by the SubscriberRegistry
+    SubscriberId id;
+
+    /// The subscriber
+    IEventSubscriberRef subscriber;
+
+    /// The subscription context
+    SubscriptionContextRef context;
+
+    /// Publisher-side subscriber data
+    std::shared_ptr<SubscriberData> data;
+
+    /// Samples and rate limits the rows generated by the subscriber; only
+    /// set when the subscriber has limits configured
+    EventRowLimiterRef row_limiter;
+  };
+
+  /// The subscriptions of this publisher; tables are never modified once
+  /// published, so ::emitEvents() can look up the subscribers without
+  /// locking. Saving the generated rows is not lock-free: the
+  /// EventBufferLibrary takes a shared lock to find the buffer, and most
+  /// buffer engines lock their storage
+  struct SubscriptionTable final {
+    /// Subscriptions, sorted by subscriber id
+    std::vector<Subscription> subscription_list;
+
+    /// The worker pool used in parallel dispatch mode
+    WorkerPoolRef dispatch_pool;
+  };
+
+  /// A reference to a subscription table
+  using SubscriptionTableRef = std::shared_ptr<const SubscriptionTable>;
+
+  /// The current subscription table; only accessed through std::atomic_load
+  /// and std::atomic_store
+  SubscriptionTableRef subscription_table{
+      std::make_shared<const SubscriptionTable>()};
+
+  /// This mutex serializes the (rare) subscription table updates
+  std::mutex subscription_table_mutex;
+
+  /// Dispatch settings; protected by the subscription table mutex
+  EventDispatchSettings dispatch_settings;
+
+  /// True if all the subscriber buffers are under backpressure
+  std::atomic_bool backpressure_active{false};
+
+  /// Recycles the event contexts once all the subscribers have released
+  /// them
+  EventContextPool<EventContext> event_context_pool;
+
+  /// Coalescing policy; only accessed by the thread running the publisher
+  EventCoalescingSettings coalescing_settings;
+
+  /// The events held back by the coalescing policy; new events are added
+  /// to this context until it is emitted
+  EventContextRef pending_event_context;
+
+  /// When the pending event context has been emitted for the first time
+  std::chrono::steady_clock::time_point pending_since;
+
+  /// Returns the amount of events in contexts implementing eventCount()
+  template <typename Context>
+  static auto eventCount(const Context& event_context, int)
+      -> decltype(static_cast<std::size_t>(event_context.eventCount())) {
+    return static_cast<std::size_t>(event_context.eventCount());
+  }
+
+  /// Other event contexts are counted as a single event
+  template <typename Context>
+  static std::size_t eventCount(const Context&, long) {
+    return 1U;
+  }
+
+  /// Returns the current subscription table
+  SubscriptionTableRef subscriptionTable() const {
+    return std::atomic_load(&subscription_table);
+  }
+
+  /// Replaces the current subscription table; must be called with the
+  /// subscription table mutex locked
+  void publishSubscriptionTable(SubscriptionTableRef new_table) {
+    std::atomic_store(&subscription_table, std::move(new_table));
+  }
+
+  /// Updates the backpressure state of each subscriber after new events
+  /// have been emitted; only the pressure states published by the buffers
+  /// are read, so no lock is taken
+  void updateBackpressure(const SubscriptionTable& table) {
+    bool backpressure = !table.subscription_list.empty();
+
+    for (const auto& subscription : table.subscription_list) {
+      auto& subscriber_data = *subscription.data;
+
+      auto buffer_pressure =
+          subscriber_data.buffer_pressure->load(std::memory_order_relaxed);
+
+      if (buffer_pressure == EventBufferPressure::High) {
+        subscriber_data.backpressure = true;
+      } else if (buffer_pressure == EventBufferPressure::Low) {
+        subscriber_data.backpressure = false;
+      }
+
+      backpressure = backpressure && subscriber_data.backpressure;
+    }
+
+    if (backpressure_active.exchange(backpressure) != backpressure) {
+      backpressureChanged(backpressure);
+    }
+  }
+
+  /// Applies the "pubsub.buffers.<subscriber name>" settings to the buffer
+  /// of the given subscriber
+  void configureSubscriberBuffer(const std::string& buffer_name,
+                                 const json11::Json& configuration) {
+    const auto& buffer_configuration =
+        configuration["pubsub"]["buffers"][buffer_name];
+
+    EventBufferSettings buffer_settings;
+    auto status = EventBufferLibrary::parseSettings(buffer_settings,
+                                                    buffer_configuration);
+
+    if (status.ok()) {
+      status = EventBufferLibrary::instance().configureBuffer(buffer_name,
+                                                              buffer_settings);
+    }
+
+    if (!status.ok()) {
+      std::cerr << "Failed to configure the event buffer for subscriber \""
+                << buffer_name << "\": " << status.getMessage() << "\n";
+    }
+  }
+
+  /// Applies the "pubsub.limits.<subscriber name>" settings to the given
+  /// subscription; the token buckets are kept if the settings do not change
+  void configureSubscriberLimits(Subscription& subscription,
+                                 const json11::Json& configuration) {
+    const auto& subscriber_name = subscription.data->name;
+
+    EventRowLimiterSettings limiter_settings;
+    auto status = EventRowLimiterSettings::parse(
+        limiter_settings, configuration["pubsub"]["limits"][subscriber_name]);
+
+    if (!status.ok()) {
+      std::cerr << "Invalid limits for subscriber \"" << subscriber_name
+                << "\": " << status.getMessage() << "\n";
+      return;
+    }
+
+    if (!limiter_settings.enabled()) {
+      subscription.row_limiter.reset();
+      return;
+    }
+
+    if (subscription.row_limiter &&
+        subscription.row_limiter->settings() == limiter_settings) {
+      return;
+    }
+
+    status = EventRowLimiter::create(
+        subscription.row_limiter, subscriber_name, limiter_settings);
+
+    if (!status.ok()) {
+      std::cerr << "Failed to create the row limiter for subscriber \""
+                << subscriber_name << "\": " << status.getMessage() << "\n";
+    }
+  }
+
+  /// Applies the "pubsub.dispatch" settings to the given table; the worker
+  /// pool is only replaced when the settings change
+  void configureDispatch(SubscriptionTable& table,
+                         const json11::Json& configuration) {
+    EventDispatchSettings new_settings;
+    auto status = EventDispatchSettings::parse(
+        new_settings, configuration["pubsub"]["dispatch"]);
+
+    if (!status.ok()) {
+      std::cerr << "Invalid dispatch settings: " << status.getMessage()
+                << "\n";
+      return;
+    }
+
+    if (new_settings == dispatch_settings) {
+      return;
+    }
+
+    WorkerPoolRef new_dispatch_pool;
+    if (new_settings.mode == EventDispatchMode::Parallel) {
+      // Invalid thread settings are already reported by the scheduler
+      ThreadSettingsMap thread_settings_map;
+      static_cast<void>(parseThreadSettingsMap(
+          thread_settings_map, configuration["pubsub"]["threads"]));
+
+      status = WorkerPool::create(
+          new_dispatch_pool,
+          new_settings.worker_count,
+          getThreadSettings(thread_settings_map, "pubsub_dispatch"));
+      if (!status.ok()) {
+        std::cerr << "Failed to create the dispatch worker pool: "
+                  << status.getMessage() << "\n";
+        return;
+      }
+    }
+
+    dispatch_settings = new_settings;
+    table.dispatch_pool = std::move(new_dispatch_pool);
+  }
+
+  /// Passes the event context to the given subscriber, and saves the rows
+  /// it generates
+  void dispatchEvents(const Subscription& subscription,
+                      EventContextRef event_context) {
+    auto subscriber_ptr =
+        static_cast<SubscriberType*>(subscription.subscriber.get());
+
+    const auto& subscriber_data = *subscription.data;
+
+    auto start_time = std::chrono::steady_clock::now();
+
+    osquery::TableRows new_events = {};
+    auto status = subscriber_ptr->callback(
+        new_events, subscription.context, event_context);
+
+    subscriber_data.callback_latency->record(std::chrono::steady_clock::now() -
+                                             start_time);
+    subscriber_data.received_event_count->add();
+
+    if (!status.ok()) {
+      std::cerr << "Subscriber returned error: " << status.getMessage()
+                << "\n";
+    }
+
+    saveSubscriberEvents(subscription, new_events);
+  }
+
+  /// Applies the limits of the given subscriber to the rows it has
+  /// generated, and saves them to its buffer
+  void saveSubscriberEvents(const Subscription& subscription,
+                            osquery::TableRows& new_events) {
+    if (new_events.empty()) {
+      return;
+    }
+
+    const auto& subscriber_data = *subscription.data;
+    subscriber_data.emitted_row_count->add(new_events.size());
 
-    for (const auto& p : subscriber_list) {
-      auto& subscriber_ref = p.first;
-      auto& context_ref = p.second;
+    if (subscription.row_limiter) {
+      subscription.row_limiter->apply(new_events);
+    }
+
+    if (!new_events.empty()) {
+      EventBufferLibrary::instance().saveEvents(new_events,
+                                                subscriber_data.name);
+    }
+  }
+
+  /// Saves the rows held back by the subscribers whose collect deadline has
+  /// expired
+  void collectSubscriberEvents() {
+    auto table = subscriptionTable();
+
+    for (const auto& subscription : table->subscription_list) {
+      auto subscriber_ptr =
+          static_cast<SubscriberType*>(subscription.subscriber.get());
 
-      auto subscriber_ptr = static_cast<SubscriberType*>(subscriber_ref.get());
-      auto status = subscriber_ptr->configure(context_ref, configuration);
+      auto deadline = subscriber_ptr->collectDeadline();
+      if (deadline > std::chrono::steady_clock::now()) {
+        continue;
+      }
+
+      osquery::TableRows new_events = {};
+      auto status = subscriber_ptr->collect(new_events);
       if (!status.ok()) {
         std::cerr << "Subscriber returned error: " << status.getMessage()
                   << "\n";
       }
+
+      saveSubscriberEvents(subscription, new_events);
+    }
+  }
+
+  /// Returns when the events held back by the coalescing policy must be
+  /// emitted, or time_point::max() if there are none
+  std::chrono::steady_clock::time_point coalescingDeadline() const {
+    if (!pending_event_context) {
+      return std::chrono::steady_clock::time_point::max();
+    }
+
+    return pending_since + coalescing_settings.max_linger_time;
+  }
+
+  /// Passes the event context to all the subscribers; in parallel mode,
+  /// this function returns once all of them have processed it. The
+  /// subscription table and the buffer pressure states are read without
+  /// locking; the table stays alive until this function returns even if it
+  /// is replaced in the meantime
+  void publishEventContext(EventContextRef event_context) {
+    auto table = subscriptionTable();
+    const auto& subscription_list = table->subscription_list;
+
+    if (!table->dispatch_pool || subscription_list.size() < 2U) {
+      for (const auto& subscription : subscription_list) {
+        dispatchEvents(subscription, event_context);
+      }
+
+      updateBackpressure(*table);
+      return;
+    }
+
+    auto L_dispatchSubscription = [&](std::size_t index) -> void {
+      dispatchEvents(subscription_list.at(index), event_context);
+    };
+
+    table->dispatch_pool->parallelFor(subscription_list.size(),
+                                      L_dispatchSubscription);
+
+    updateBackpressure(*table);
+  }
+
+ public:
+  /// Each subscriber is configured on a copy of its subscription context,
+  /// which replaces the previous one once the new subscription table is
+  /// published; the subscription context must be copy constructible
+  virtual void configureSubscribers(
+      const json11::Json& configuration) noexcept override {
+    std::lock_guard<std::mutex> lock(subscription_table_mutex);
+
+    try {
+      auto new_table =
+          std::make_shared<SubscriptionTable>(*subscriptionTable());
+      configureDispatch(*new_table, configuration);
+
+      for (auto& subscription : new_table->subscription_list) {
+        subscription.context =
+            std::make_shared<SubscriptionContext>(*subscription.context);
+
+        auto subscriber_ptr =
+            static_cast<SubscriberType*>(subscription.subscriber.get());
+
+        auto status =
+            subscriber_ptr->configure(subscription.context, configuration);
+        if (!status.ok()) {
+          std::cerr << "Subscriber returned error: " << status.getMessage()
+                    << "\n";
+        }
+
+        configureSubscriberBuffer(subscription.data->name, configuration);
+        configureSubscriberLimits(subscription, configuration);
+      }
+
+      publishSubscriptionTable(std::move(new_table));
+
+    } catch (const std::bad_alloc&) {
+      std::cerr << "Failed to configure the subscribers: memory allocation "
+                   "failure\n";
     }
   }
 
   /// This method is used by subscribers to register to new event data
   /// from this publisher
-  virtual osquery::Status subscribe(IEventSubscriberRef subscriber) override {
-    boost::unique_lock<decltype(subscriber_map_mutex)> lock(
-        subscriber_map_mutex);
+  virtual osquery::Status subscribe(
+      SubscriberId subscriber_id,
+      IEventSubscriberRef subscriber,
+      const std::string& subscriber_name) override {
+    std::lock_guard<std::mutex> lock(subscription_table_mutex);
 
     try {
-      if (subscriber_list.count(subscriber) != 0U) {
+      auto new_table =
+          std::make_shared<SubscriptionTable>(*subscriptionTable());
+      auto& subscription_list = new_table->subscription_list;
+
+      auto L_compareId = [](const Subscription& subscription,
+                            SubscriberId id) -> bool {
+        return subscription.id < id;
+      };
+
+      auto it = std::lower_bound(subscription_list.begin(),
+                                 subscription_list.end(),
+                                 subscriber_id,
+                                 L_compareId);
+
+      if (it != subscription_list.end() && it->id == subscriber_id) {
         throw std::logic_error("Trying to register the same subscriber twice");
       }
 
@@ -86,8 +497,33 @@ class BaseEventPublisher : public IEventPublisher {
         return status;
       }
 
-      auto subscription_context = std::make_shared<SubscriptionContext>();
-      subscriber_list.insert({subscriber, subscription_context});
+      auto subscriber_data = std::make_shared<SubscriberData>();
+      subscriber_data->name = subscriber_name;
+
+      auto& metrics_registry = MetricsRegistry::instance();
+      subscriber_data->callback_latency = metrics_registry.histogram(
+          "subscriber", subscriber_name, "callback_latency");
+      subscriber_data->received_event_count = metrics_registry.counter(
+          "subscriber", subscriber_name, "received_events");
+      subscriber_data->emitted_row_count = metrics_registry.counter(
+          "subscriber", subscriber_name, "emitted_rows");
+
+      subscriber_data->buffer_pressure =
+          EventBufferLibrary::instance().pressureState(subscriber_name);
+
+      if (!subscriber_data->buffer_pressure) {
+        return osquery::Status(1, "Memory allocation failure");
+      }
+
+      Subscription subscription = {subscriber_id,
+                                   subscriber,
+                                   std::make_shared<SubscriptionContext>(),
+                                   std::move(subscriber_data),
+                                   nullptr};
+
+      subscription_list.insert(it, std::move(subscription));
+      publishSubscriptionTable(std::move(new_table));
+
       return osquery::Status(0);
 
     } catch (const std::bad_alloc&) {
@@ -97,73 +533,147 @@ class BaseEventPublisher : public IEventPublisher {
 
   /// This method unsubscribes the specified subscriber, and is typically
   /// used by the SubscriberRegistry class
-  virtual void unsubscribe(IEventSubscriberRef subscriber) override {
-    boost::unique_lock<decltype(subscriber_map_mutex)> lock(
-        subscriber_map_mutex);
+  virtual void unsubscribe(SubscriberId subscriber_id) override {
+    std::lock_guard<std::mutex> lock(subscription_table_mutex);
+
+    auto new_table = std::make_shared<SubscriptionTable>(*subscriptionTable());
+    auto& subscription_list = new_table->subscription_list;
+
+    auto L_matchId = [subscriber_id](const Subscription& subscription)
+        -> bool { return subscription.id == subscriber_id; };
 
-    auto it = subscriber_list.find(subscriber);
-    if (it == subscriber_list.end()) {
+    auto it = std::find_if(
+        subscription_list.begin(), subscription_list.end(), L_matchId);
+
+    if (it == subscription_list.end()) {
       throw std::logic_error("Trying to unregister a missing subscriber");
     }
 
-    subscriber_list.erase(it);
+    auto subscriber = it->subscriber;
+    subscription_list.erase(it);
+
+    publishSubscriptionTable(std::move(new_table));
     subscriber->release();
   }
 
   /// Returns the amount of active subscribers
   virtual std::size_t subscriptionCount() noexcept override {
-    boost::upgrade_lock<decltype(subscriber_map_mutex)> lock(
-        subscriber_map_mutex);
-    return subscriber_list.size();
+    return subscriptionTable()->subscription_list.size();
+  }
+
+  /// Returns true if all the subscriber buffers are under backpressure
+  virtual bool backpressure() noexcept override {
+    return backpressure_active;
+  }
+
+  /// Sets the coalescing policy; pending events are emitted right away
+  /// when coalescing gets disabled
+  virtual void configureCoalescing(
+      const EventCoalescingSettings& settings) noexcept override {
+    coalescing_settings = settings;
+
+    if (!coalescing_settings.enabled()) {
+      flushEvents(true);
+    }
+  }
+
+  /// Returns when the pending events must be emitted, or when the next
+  /// subscriber has rows to collect
+  virtual std::chrono::steady_clock::time_point flushDeadline() noexcept
+      override {
+    auto deadline = coalescingDeadline();
+
+    auto table = subscriptionTable();
+    for (const auto& subscription : table->subscription_list) {
+      auto subscriber_ptr =
+          static_cast<SubscriberType*>(subscription.subscriber.get());
+
+      deadline = std::min(deadline, subscriber_ptr->collectDeadline());
+    }
+
+    return deadline;
+  }
+
+  /// Emits the pending events if their deadline has expired, then collects
+  /// the rows that the subscribers were holding back. Forcing the flush only
+  /// affects the coalesced events
+  virtual void flushEvents(bool force) noexcept override {
+    if (pending_event_context &&
+        (force || std::chrono::steady_clock::now() >= coalescingDeadline())) {
+      auto event_context = std::move(pending_event_context);
+      publishEventContext(std::move(event_context));
+    }
+
+    collectSubscriberEvents();
+  }
+
+  /// Returns the callback latency of each subscriber
+  virtual LatencySummaryMap subscriberLatency() noexcept override {
+    auto table = subscriptionTable();
+
+    LatencySummaryMap latency_map;
+    for (const auto& subscription : table->subscription_list) {
+      const auto& subscriber_data = *subscription.data;
+      latency_map.insert(
+          {subscriber_data.name, subscriber_data.callback_latency->summary()});
+    }
+
+    return latency_map;
   }
 
  protected:
   /// Utility function used by the actual publisher implementation to create
-  /// a container for new events
-  osquery::Status createEventContext(EventContextRef& event_context) const {
-    try {
-      event_context = std::make_shared<EventContext>();
+  /// a container for new events; containers are taken from a pool, and are
+  /// reset before being reused. While the coalescing policy is holding back
+  /// events, the pending container is returned instead, so that new events
+  /// are appended to it
+  osquery::Status createEventContext(EventContextRef& event_context) {
+    if (pending_event_context) {
+      event_context = pending_event_context;
       return osquery::Status(0);
-
-    } catch (const std::bad_alloc&) {
-      return osquery::Status(1, "Memory allocation failure");
     }
+
+    return event_context_pool.acquire(event_context);
+  }
+
+  /// Called from ::emitEvents() when the backpressure state changes; the
+  /// publisher may react by shedding load until it is released
+  virtual void backpressureChanged(bool active) noexcept {
+    static_cast<void>(active);
   }
 
   /// Utility function used by the actual publisher implementation to emit
-  /// new events
+  /// new events. When coalescing is enabled, the events are held back until
+  /// the batch is large enough or the linger time has expired; event
+  /// contexts can implement an eventCount() method, otherwise each one is
+  /// counted as a single event
   void emitEvents(EventContextRef event_context) {
-    boost::upgrade_lock<decltype(subscriber_map_mutex)> lock(
-        subscriber_map_mutex);
-
-    for (const auto& p : subscriber_list) {
-      auto& subscriber_ref = p.first;
-      auto& context_ref = p.second;
-
-      auto subscriber_ptr = static_cast<SubscriberType*>(subscriber_ref.get());
+    if (!coalescing_settings.enabled()) {
+      publishEventContext(std::move(event_context));
+      return;
+    }
 
-      osquery::TableRows new_events = {};
-      auto status =
-          subscriber_ptr->callback(new_events, context_ref, event_context);
+    if (event_context != pending_event_context) {
+      // The context was not created with ::createEventContext(); it can't
+      // be merged with the pending one
+      flushEvents(true);
 
-      if (!status.ok()) {
-        std::cerr << "Subscriber returned error: " << status.getMessage()
-                  << "\n";
+      if (eventCount(*event_context, 0) == 0U) {
+        return;
       }
 
-      if (!new_events.empty()) {
-        auto buffer_name =
-            SubscriberRegistry::instance().subscriberName(subscriber_ref);
-
-        if (buffer_name.empty()) {
-          std::cerr << "Failed to acquire the subscriber name\n";
-          continue;
-        }
+      pending_event_context = std::move(event_context);
+      pending_since = std::chrono::steady_clock::now();
+    }
 
-        EventBufferLibrary::instance().saveEvents(new_events, buffer_name);
-      }
+    if (eventCount(*pending_event_context, 0) >=
+        coalescing_settings.max_batch_size) {
+      flushEvents(true);
+    } else {
+      flushEvents(false);
     }
   }
+
 };
 
 } // namespace trailofbits
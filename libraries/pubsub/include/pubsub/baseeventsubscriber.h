@@ -21,6 +21,8 @@
 
 #include <osquery/sdk/sdk.h>
 
+#include <chrono>
+
 namespace trailofbits {
 /// Event subscribers use this as a base class
 template <typename EventPublisher>
@@ -37,5 +39,18 @@ class BaseEventSubscriber : public IEventSubscriber {
       osquery::TableRows& new_events,
       typename EventPublisher::SubscriptionContextRef subscription_context,
       typename EventPublisher::EventContextRef event_context) = 0;
+
+  /// Returns when ::collect() must be called, or time_point::max() if the
+  /// subscriber is not holding back any rows
+  virtual std::chrono::steady_clock::time_point collectDeadline() noexcept {
+    return std::chrono::steady_clock::time_point::max();
+  }
+
+  /// Called by the publisher once the collect deadline has expired, even if
+  /// no new events have been received; returns the rows that were held back
+  virtual osquery::Status collect(osquery::TableRows& new_events) {
+    static_cast<void>(new_events);
+    return osquery::Status(0);
+  }
 };
 } // namespace trailofbits
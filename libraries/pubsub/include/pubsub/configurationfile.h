@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <ctime>
 #include <memory>
 
@@ -33,7 +34,12 @@ using ConfigurationFileRef = std::shared_ptr<ConfigurationFile>;
 using ConfigurationFileHandle = std::uint64_t;
 
 /// The configuration file is used to load and monitor a single json-based
-/// configuration file
+/// configuration file.
+///
+/// A watcher thread waits for inotify events on the parent folder and
+/// publishes each new configuration as an immutable snapshot; checking for
+/// changes does not touch the file system. If inotify is not available, the
+/// modification time is polled instead
 class ConfigurationFile final {
   struct PrivateData;
 
@@ -43,20 +49,29 @@ class ConfigurationFile final {
   /// Private constructor; use ::create() instead
   ConfigurationFile(const std::string& configuration_file_path);
 
-  /// Reloads the configuration from disk
+  /// Reloads the configuration from disk; a new snapshot is only published
+  /// if the file is valid and its contents have changed
   void updateConfiguration();
 
+  /// Watcher thread entry point
+  void watcherThread();
+
  public:
   /// Factory method
   static osquery::Status create(ConfigurationFileRef& configuration_file,
                                 const std::string& configuration_file_path);
 
-  /// Destructor
-  ConfigurationFile() = default;
+  /// Destructor; stops the watcher thread
+  ~ConfigurationFile();
 
   /// Creates a new handle that can be used to acquire new configurations
   ConfigurationFileHandle getHandle();
 
+  /// Returns the generation of the current configuration; it changes each
+  /// time a new configuration is published, and can be compared without
+  /// taking any lock before calling ::configurationChanged()
+  std::uint64_t generation() const;
+
   /// Returns true if the configuration has been changed
   bool configurationChanged(ConfigurationFileHandle handle);
 
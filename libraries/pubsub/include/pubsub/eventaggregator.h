@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "eventbufferlibrary.h"
+
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace trailofbits {
+/// Aggregation settings, taken from the "pubsub.aggregation.<subscriber
+/// name>" object
+struct EventAggregatorSettings final {
+  /// Window size, in seconds
+  std::size_t window_size{60U};
+
+  /// How many groups are counted exactly in each window; past this limit,
+  /// only the most frequent groups are kept (see EventAggregator)
+  std::size_t max_group_count{10000U};
+
+  /// Parses the settings from the given json object; a null object will
+  /// return the default settings
+  static osquery::Status parse(EventAggregatorSettings& settings,
+                               const json11::Json& configuration);
+
+  /// Returns true if the settings are the same
+  bool operator==(const EventAggregatorSettings& other) const;
+
+  /// Returns true if the settings are different
+  bool operator!=(const EventAggregatorSettings& other) const;
+};
+
+class EventAggregator;
+
+/// A reference to an EventAggregator object
+using EventAggregatorRef = std::unique_ptr<EventAggregator>;
+
+/// Counts events by group over fixed time windows, and generates one row
+/// for each group when a window ends. The table schema must contain the
+/// window_start, window_end, count and count_error columns; all the other
+/// columns that are not hidden are used as the group key.
+///
+/// Memory is bounded by the max group count: when a new group does not fit,
+/// it replaces the least frequent one and inherits its count (the
+/// space-saving algorithm). Counts are then overestimated by at most the
+/// value reported in the count_error column, and the most frequent groups
+/// are always kept
+class EventAggregator final {
+  struct PrivateData;
+
+  /// Private class data
+  std::unique_ptr<PrivateData> d;
+
+  /// Private constructor; use the ::create() static function instead
+  EventAggregator(const std::string& name, const osquery::TableColumns& schema);
+
+  /// Converts the groups of the current window to rows; must be called
+  /// with the mutex locked
+  void closeWindow();
+
+ public:
+  /// Factory function used to create EventAggregator objects; the schema
+  /// must outlive the aggregator
+  static osquery::Status create(EventAggregatorRef& obj,
+                                const std::string& name,
+                                const osquery::TableColumns& schema);
+
+  /// Destructor
+  ~EventAggregator();
+
+  /// Applies the given settings; the current window is closed if they
+  /// have changed
+  void configure(const EventAggregatorSettings& settings);
+
+  /// Returns the names of the columns used as the group key, in the same
+  /// order as the table schema
+  const std::vector<std::string>& keyColumns() const;
+
+  /// Counts an event; the key values must follow the order of ::keyColumns().
+  /// Events that are older than the current window are counted in it
+  void add(const std::vector<std::string>& key_values,
+           std::time_t event_time,
+           std::uint64_t count = 1U);
+
+  /// Moves the rows of the windows that have ended before the given time
+  /// to the given list
+  void collect(EventBatch& rows, std::time_t current_time);
+
+  /// Closes the current window, and moves all the rows to the given list
+  void flush(EventBatch& rows);
+
+  /// Returns when ::collect() will have new rows to return: the end of the
+  /// current window, zero if rows are already waiting, or
+  /// std::numeric_limits<std::time_t>::max() if there is nothing to collect
+  std::time_t collectionTime() const;
+
+  /// Returns how many groups are in the current window
+  std::size_t groupCount() const;
+
+  /// Disable the copy constructor
+  EventAggregator(const EventAggregator& other) = delete;
+
+  /// Disable the assignment operator
+  EventAggregator& operator=(const EventAggregator& other) = delete;
+};
+} // namespace trailofbits
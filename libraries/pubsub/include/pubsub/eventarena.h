@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace trailofbits {
+/// A monotonic memory arena, used to allocate the contents of an event
+/// context.
+///
+/// Memory is handed out from large chunks and is never released on
+/// deallocation; ::reset() rewinds the arena in constant time, keeping the
+/// chunks for the next batch. This class is not thread safe
+class EventArena final {
+  struct PrivateData;
+
+  /// Private class data
+  std::unique_ptr<PrivateData> d;
+
+ public:
+  /// Default size of each chunk
+  static const std::size_t kDefaultChunkSize{64U * 1024U};
+
+  /// Default amount of memory kept by ::reset()
+  static const std::size_t kDefaultMaxRetainedSize{16U * 1024U * 1024U};
+
+  /// Constructor; chunks larger than max_retained_size are freed on reset
+  explicit EventArena(std::size_t chunk_size = kDefaultChunkSize,
+                      std::size_t max_retained_size = kDefaultMaxRetainedSize);
+
+  /// Destructor
+  ~EventArena();
+
+  /// Allocates the given amount of bytes; throws std::bad_alloc on failure
+  void* allocate(std::size_t size, std::size_t alignment);
+
+  /// Releases all allocations at once; objects allocated from the arena
+  /// must have been destroyed
+  void reset();
+
+  /// Returns the amount of bytes allocated since the last reset
+  std::size_t usedSize() const;
+
+  /// Returns the amount of memory owned by the arena
+  std::size_t reservedSize() const;
+
+  /// Disable the copy constructor
+  EventArena(const EventArena& other) = delete;
+
+  /// Disable the assignment operator
+  EventArena& operator=(const EventArena& other) = delete;
+};
+
+/// A standard allocator that takes its memory from an EventArena
+template <typename T>
+class ArenaAllocator {
+  template <typename U>
+  friend class ArenaAllocator;
+
+  /// The arena used for all allocations
+  EventArena* arena{nullptr};
+
+ public:
+  /// The allocated type
+  using value_type = T;
+
+  /// Constructor
+  explicit ArenaAllocator(EventArena& arena_) noexcept : arena(&arena_) {}
+
+  /// Converting constructor, used when rebinding the allocator
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) noexcept
+      : arena(other.arena) {}
+
+  /// Allocates storage for the given amount of objects
+  T* allocate(std::size_t count) {
+    if (count > static_cast<std::size_t>(-1) / sizeof(T)) {
+      throw std::bad_alloc();
+    }
+
+    return static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T)));
+  }
+
+  /// Memory is only released when the arena is reset
+  void deallocate(T*, std::size_t) noexcept {}
+
+  /// Returns true if both allocators use the same arena
+  template <typename U>
+  bool operator==(const ArenaAllocator<U>& other) const noexcept {
+    return arena == other.arena;
+  }
+
+  /// Returns true if the allocators use different arenas
+  template <typename U>
+  bool operator!=(const ArenaAllocator<U>& other) const noexcept {
+    return arena != other.arena;
+  }
+};
+
+/// A string allocated from an EventArena
+using ArenaString =
+    std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+
+/// A vector allocated from an EventArena
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+} // namespace trailofbits
@@ -16,6 +16,9 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <map>
 #include <memory>
 
 #pragma clang diagnostic push
@@ -24,11 +27,169 @@
 #pragma clang diagnostic pop
 #include <osquery/extensions.h>
 
+#include <json11.hpp>
+
 namespace trailofbits {
 /// An event batch is just a list of rows that will get returned to osquery
 /// during the ::generate() table callback
 using EventBatch = std::vector<osquery::TableRowHolder>;
 
+/// The storage engines that can be used to back an event buffer
+enum class EventBufferEngine {
+  /// A boost::circular_buffer protected by a mutex
+  CircularBuffer,
+
+  /// A bounded, lock-free ring of pre-sized slots; publishers never block
+  /// while appending new rows
+  LockFreeRing,
+
+  /// An append-only log shared by multiple consumers; rows are not removed
+  /// when they are read, and each consumer has its own read cursor
+  SharedLog
+};
+
+/// What to do with new rows when an event buffer is full
+enum class EventBufferOverflowPolicy {
+  /// Discard the oldest rows to make room for the new ones
+  DropOldest,
+
+  /// Keep the buffer as it is and discard the new rows
+  DropNewest,
+
+  /// Move the oldest rows to the on-disk segment log; they are returned
+  /// before the ones in memory the next time the buffer is drained
+  SpillToDisk
+};
+
+/// Event buffer settings
+struct EventBufferSettings final {
+  /// The storage engine
+  EventBufferEngine engine{EventBufferEngine::CircularBuffer};
+
+  /// How many rows can be stored in memory
+  std::size_t capacity{4096U};
+
+  /// Approximate amount of memory (in bytes) the rows can use; zero means
+  /// that only the capacity is enforced
+  std::size_t max_memory{0U};
+
+  /// What to do when the buffer is full
+  EventBufferOverflowPolicy overflow_policy{
+      EventBufferOverflowPolicy::DropOldest};
+
+  /// Where rows are saved when the overflow policy is set to SpillToDisk,
+  /// or when the buffer is persistent
+  std::string spill_directory;
+
+  /// If true, the rows still in memory are saved to the spill directory
+  /// when the buffer is flushed, and rows found on disk at startup are
+  /// returned the next time the buffer is drained
+  bool persistent{false};
+
+  /// Spilled rows are stored in segment files that are rotated once they
+  /// reach this size, in bytes
+  std::size_t segment_size{16U * 1024U * 1024U};
+
+  /// Maximum disk space (in bytes) used by the spilled rows; the oldest
+  /// segments are removed when it is exceeded. Zero means no limit
+  std::size_t max_disk_usage{256U * 1024U * 1024U};
+
+  /// How often spilled rows are synced to the disk, in milliseconds
+  std::size_t sync_interval{1000U};
+
+  /// Fill level (as a percentage) at or above which the buffer reports a
+  /// high pressure to its publisher
+  std::size_t high_watermark{90U};
+
+  /// Fill level (as a percentage) at or below which the buffer reports a
+  /// low pressure to its publisher
+  std::size_t low_watermark{50U};
+
+  /// Shared log consumers that have not read the buffer for this many
+  /// seconds are forgotten, and no longer hold back the pressure; zero means
+  /// that they are kept until the consumer limit is reached
+  std::size_t consumer_timeout{3600U};
+
+  /// Returns true if the settings are the same
+  bool operator==(const EventBufferSettings& other) const;
+
+  /// Returns true if the settings are different
+  bool operator!=(const EventBufferSettings& other) const;
+};
+
+/// Event buffer counters
+struct EventBufferStatistics final {
+  /// How many rows are currently stored in the buffer
+  std::size_t row_count{0U};
+
+  /// How many of the stored rows have not been read yet; for shared logs,
+  /// this is counted from the slowest consumer
+  std::size_t unread_row_count{0U};
+
+  /// The maximum amount of rows that can be stored in the buffer
+  std::size_t capacity{0U};
+
+  /// Approximate amount of memory used by the rows, in bytes
+  std::size_t memory_usage{0U};
+
+  /// How many rows have been overwritten because the buffer was full
+  std::uint64_t overwritten_row_count{0U};
+
+  /// How many new rows have been discarded because the buffer was full
+  std::uint64_t rejected_row_count{0U};
+
+  /// How many rows have been moved to disk because the buffer was full
+  std::uint64_t spilled_row_count{0U};
+
+  /// How many rows are currently waiting on disk
+  std::size_t pending_spilled_row_count{0U};
+
+  /// Disk space used by the spilled rows, in bytes
+  std::size_t disk_usage{0U};
+};
+
+/// How full a buffer is, relative to its watermarks
+enum class EventBufferPressure {
+  /// At or below the low watermark
+  Low,
+
+  /// Between the two watermarks
+  Normal,
+
+  /// At or above the high watermark
+  High
+};
+
+/// The pressure of a buffer, as last published by the buffer itself; it
+/// is updated whenever rows are saved or read, so it can be polled without
+/// taking any lock
+using EventBufferPressureState = std::atomic<EventBufferPressure>;
+
+/// A reference to a pressure state
+using EventBufferPressureStateRef = std::shared_ptr<EventBufferPressureState>;
+
+/// Name of the hidden column used to select the consumer that is reading
+/// a table
+extern const char kConsumerColumnName[];
+
+/// Name of the hidden column containing the row sequence number
+extern const char kSequenceColumnName[];
+
+/// Describes how rows are read from an event buffer
+struct EventReadRequest final {
+  /// Each consumer has its own read cursor; only used by shared logs
+  std::string consumer;
+
+  /// If true, reading starts from start_sequence instead of the cursor
+  bool has_start_sequence{false};
+
+  /// First sequence number to return
+  std::uint64_t start_sequence{0U};
+};
+
+/// Event buffer statistics, organized by buffer name
+using EventBufferStatisticsMap = std::map<std::string, EventBufferStatistics>;
+
 /// This singleton is used to create or acquire existing event buffers
 class EventBufferLibrary final {
   struct PrivateData;
@@ -52,6 +213,40 @@ class EventBufferLibrary final {
   /// Returns the events stored into the specifed buffer
   EventBatch getEvents(const std::string& buffer_name);
 
+  /// Returns the events stored into the specified buffer; shared logs only
+  /// return the rows that the consumer has not read yet, and keep them for
+  /// the other consumers
+  EventBatch getEvents(const std::string& buffer_name,
+                       const EventReadRequest& request);
+
+  /// Changes the settings for the specified buffer; rows that have already
+  /// been saved are moved to the new buffer. Nothing is done if the settings
+  /// have not changed
+  osquery::Status configureBuffer(const std::string& buffer_name,
+                                  const EventBufferSettings& settings);
+
+  /// Parses the buffer settings from the given json object; a null object
+  /// will return the default settings
+  static osquery::Status parseSettings(EventBufferSettings& settings,
+                                       const json11::Json& configuration);
+
+  /// Returns the statistics for all the active buffers
+  EventBufferStatisticsMap statistics();
+
+  /// Returns how full the specified buffer is. Buffers that spill to disk
+  /// are measured against their max_disk_usage, the other ones against their
+  /// capacity
+  EventBufferPressure pressure(const std::string& buffer_name);
+
+  /// Returns the pressure state of the specified buffer; the same object is
+  /// kept when the buffer is reconfigured, so publishers can acquire it once
+  /// and read it on every batch
+  EventBufferPressureStateRef pressureState(const std::string& buffer_name);
+
+  /// Saves the rows held in memory by persistent buffers to disk; this is
+  /// called before the extension exits
+  void flush();
+
   /// Disable the copy constructor
   EventBufferLibrary(const EventBufferLibrary& other) = delete;
 
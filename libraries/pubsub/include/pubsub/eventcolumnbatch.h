@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wsign-conversion"
+#include <osquery/sdk/sdk.h>
+#pragma clang diagnostic pop
+
+namespace trailofbits {
+class EventColumnBatch;
+
+/// A reference to an EventColumnBatch object
+using EventColumnBatchRef = std::shared_ptr<EventColumnBatch>;
+
+/// A batch of rows stored column by column, bound to a table schema. Values
+/// are kept in their native type and all strings share a single text pool,
+/// so that adding a row never allocates a map or a string per column.
+///
+/// Rows are only converted to osquery::Row objects when osquery reads them;
+/// see ::appendTableRows()
+class EventColumnBatch final {
+ public:
+  /// Cell types
+  enum class CellType : std::uint8_t { Null, Integer, Text };
+
+  /// Returned by ::columnIndex() when the column does not exist
+  static const std::size_t kInvalidColumn =
+      std::numeric_limits<std::size_t>::max();
+
+ private:
+  /// A single value
+  struct Cell final {
+    /// Value type; null cells are omitted from the materialized row
+    CellType type{CellType::Null};
+
+    /// Text length
+    std::uint32_t length{0U};
+
+    /// The integer value, or the text offset inside the pool
+    std::uint64_t value{0U};
+  };
+
+  /// The table schema; schemas are static objects generated by the
+  /// BEGIN_TABLE/END_TABLE macros
+  const osquery::TableColumns* schema{nullptr};
+
+  /// Cells, organized by column
+  std::vector<std::vector<Cell>> column_list;
+
+  /// Storage for all the text cells
+  std::string text_pool;
+
+  /// How many rows are in the batch
+  std::size_t row_count{0U};
+
+  /// Private constructor; use ::create() instead
+  explicit EventColumnBatch(const osquery::TableColumns& schema);
+
+  /// Returns the specified cell
+  Cell& cell(std::size_t row, std::size_t column);
+
+  /// Returns the specified cell
+  const Cell& cell(std::size_t row, std::size_t column) const;
+
+ public:
+  /// Factory method; the schema must outlive the batch
+  static osquery::Status create(EventColumnBatchRef& obj,
+                                const osquery::TableColumns& schema);
+
+  /// Returns the index of the given column, or kInvalidColumn
+  static std::size_t columnIndex(const osquery::TableColumns& schema,
+                                 const std::string& name);
+
+  /// Adds a new row, with all its cells set to null
+  std::size_t addRow();
+
+  /// Copies all the cells of a row into another one; text is not duplicated
+  void copyRow(std::size_t destination_row, std::size_t source_row);
+
+  /// Sets an integer cell
+  void setInteger(std::size_t row, std::size_t column, std::int64_t value);
+
+  /// Sets a text cell
+  void setText(std::size_t row,
+               std::size_t column,
+               const char* value,
+               std::size_t length);
+
+  /// Sets a text cell
+  void setText(std::size_t row, std::size_t column, const std::string& value);
+
+  /// Sets a text cell from a null-terminated string
+  void setText(std::size_t row, std::size_t column, const char* value);
+
+  /// Returns the type of the specified cell
+  CellType cellType(std::size_t row, std::size_t column) const;
+
+  /// Returns the value of an integer cell
+  std::int64_t integerValue(std::size_t row, std::size_t column) const;
+
+  /// Returns the value of a text cell
+  std::string textValue(std::size_t row, std::size_t column) const;
+
+  /// Returns the value of a cell as it appears in the osquery::Row
+  std::string stringValue(std::size_t row, std::size_t column) const;
+
+  /// Converts the given row to an osquery::Row
+  osquery::Row materializeRow(std::size_t row) const;
+
+  /// How many rows are in the batch
+  std::size_t rowCount() const;
+
+  /// Approximate amount of memory used by the batch, in bytes
+  std::size_t memoryUsage() const;
+
+  /// Returns the table schema
+  const osquery::TableColumns& tableSchema() const;
+
+  /// Appends one lazily materialized table row for each row in the batch;
+  /// the rows share ownership of the batch, which must not be modified
+  /// afterwards
+  static void appendTableRows(osquery::TableRows& table_rows,
+                              const EventColumnBatchRef& batch);
+
+  /// Disable the copy constructor
+  EventColumnBatch(const EventColumnBatch& other) = delete;
+
+  /// Disable the assignment operator
+  EventColumnBatch& operator=(const EventColumnBatch& other) = delete;
+};
+} // namespace trailofbits
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <osquery/status.h>
+
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace trailofbits {
+/// Recycles the event context objects created by a publisher, so that a new
+/// one is not allocated for each batch.
+///
+/// Contexts are returned to the pool once the last reference is dropped;
+/// event contexts that implement a reset() method have it called at that
+/// point (i.e.: to rewind their EventArena), while the others are replaced
+/// by a default constructed object
+template <typename EventContext>
+class EventContextPool final {
+  struct PrivateData final {
+    /// Idle event contexts, ready to be reused
+    std::vector<std::unique_ptr<EventContext>> idle_context_list;
+
+    /// Maximum amount of idle contexts to keep
+    std::size_t max_idle_context_count{0U};
+
+    /// This mutex protects the idle context list
+    std::mutex mutex;
+  };
+
+  /// Private class data; it is shared with the context deleters, so that
+  /// contexts outliving the pool are simply destroyed
+  std::shared_ptr<PrivateData> d;
+
+  /// Resets event contexts that implement a reset() method
+  template <typename Context>
+  static auto resetEventContext(Context& event_context, int)
+      -> decltype(event_context.reset(), void()) {
+    event_context.reset();
+  }
+
+  /// Resets event contexts by replacing them with a new object
+  template <typename Context>
+  static void resetEventContext(Context& event_context, long) {
+    event_context = Context();
+  }
+
+  /// Shared pointer deleter, returning the context to the pool
+  struct Recycler final {
+    /// The pool that allocated the context
+    std::weak_ptr<PrivateData> pool_data;
+
+    /// Resets the event context and puts it back in the idle list, unless
+    /// the pool is gone or already full
+    void operator()(EventContext* event_context) const noexcept {
+      std::unique_ptr<EventContext> context_ptr(event_context);
+
+      auto pool = pool_data.lock();
+      if (!pool) {
+        return;
+      }
+
+      try {
+        resetEventContext(*context_ptr, 0);
+
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        if (pool->idle_context_list.size() < pool->max_idle_context_count) {
+          pool->idle_context_list.push_back(std::move(context_ptr));
+        }
+
+      } catch (...) {
+        // The context is destroyed instead of being recycled
+      }
+    }
+  };
+
+ public:
+  /// Default amount of idle contexts kept by the pool
+  static const std::size_t kDefaultMaxIdleContextCount{4U};
+
+  /// Constructor
+  explicit EventContextPool(
+      std::size_t max_idle_context_count = kDefaultMaxIdleContextCount)
+      : d(std::make_shared<PrivateData>()) {
+    d->max_idle_context_count = max_idle_context_count;
+  }
+
+  /// Returns an idle event context, or allocates a new one when the pool is
+  /// empty
+  osquery::Status acquire(std::shared_ptr<EventContext>& event_context) const {
+    try {
+      std::unique_ptr<EventContext> context_ptr;
+
+      {
+        std::lock_guard<std::mutex> lock(d->mutex);
+
+        if (!d->idle_context_list.empty()) {
+          context_ptr = std::move(d->idle_context_list.back());
+          d->idle_context_list.pop_back();
+        }
+      }
+
+      if (!context_ptr) {
+        context_ptr.reset(new EventContext());
+      }
+
+      // The deleter is invoked if the shared_ptr constructor throws
+      event_context = std::shared_ptr<EventContext>(
+          context_ptr.release(), Recycler{std::weak_ptr<PrivateData>(d)});
+
+      return osquery::Status(0);
+
+    } catch (const std::bad_alloc&) {
+      return osquery::Status(1, "Memory allocation failure");
+    }
+  }
+
+  /// Returns the amount of idle contexts
+  std::size_t idleContextCount() const {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    return d->idle_context_list.size();
+  }
+
+  /// Disable the copy constructor
+  EventContextPool(const EventContextPool& other) = delete;
+
+  /// Disable the assignment operator
+  EventContextPool& operator=(const EventContextPool& other) = delete;
+};
+} // namespace trailofbits
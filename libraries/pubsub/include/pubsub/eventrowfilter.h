@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "eventbufferlibrary.h"
+
+#include <memory>
+#include <vector>
+
+namespace trailofbits {
+class EventRowFilter;
+
+/// A reference to an EventRowFilter object
+using EventRowFilterRef = std::unique_ptr<EventRowFilter>;
+
+/// Evaluates the EQUALS, LIKE, GT, GE, LT and LE query constraints on the
+/// buffered rows, so that rows that can't match the query never leave the
+/// extension. Filtering is conservative: osquery still applies all the
+/// constraints on the rows that are returned, so anything that can't be
+/// evaluated here is always kept
+class EventRowFilter final {
+  /// A single constraint
+  struct Predicate final {
+    /// Column name
+    std::string column_name;
+
+    /// Declared column type; decides how values are compared
+    osquery::ColumnType column_type{osquery::TEXT_TYPE};
+
+    /// Constraint operator
+    osquery::ConstraintOperator constraint_operator{osquery::EQUALS};
+
+    /// Constraint value
+    std::string value;
+  };
+
+  /// All the constraints, grouped by column
+  std::vector<Predicate> predicate_list;
+
+  /// Private constructor; use ::create() instead
+  EventRowFilter() = default;
+
+  /// Returns true if the given value satisfies the predicate
+  static bool evaluate(const Predicate& predicate, const std::string& value);
+
+ public:
+  /// Factory method; only the constraints on the schema columns are used
+  static osquery::Status create(EventRowFilterRef& obj,
+                                const osquery::QueryContext& context,
+                                const osquery::TableColumns& schema);
+
+  /// Returns true if there are no constraints to evaluate
+  bool empty() const;
+
+  /// Returns true if the row may satisfy the query constraints
+  bool matches(const osquery::TableRow& row) const;
+
+  /// Removes the rows that can't satisfy the query constraints
+  void apply(EventBatch& rows) const;
+
+  /// Returns true if the value matches the given SQL LIKE pattern; the
+  /// comparison is case insensitive for ASCII characters, and '_' matches
+  /// a single UTF-8 character
+  static bool matchLikePattern(const std::string& value,
+                               const std::string& pattern);
+
+  /// Disable the copy constructor
+  EventRowFilter(const EventRowFilter& other) = delete;
+
+  /// Disable the assignment operator
+  EventRowFilter& operator=(const EventRowFilter& other) = delete;
+};
+
+/// Removes the rows that can't satisfy the constraints in the given query
+/// context; used by the generate() method of the BEGIN_TABLE tables
+void filterEventRows(EventBatch& rows,
+                     const osquery::QueryContext& context,
+                     const osquery::TableColumns& schema);
+} // namespace trailofbits
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "eventbufferlibrary.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+namespace trailofbits {
+/// Row limiter settings, taken from the "pubsub.limits.<subscriber name>"
+/// object
+struct EventRowLimiterSettings final {
+  /// The column used to group the rows (i.e.: source_address); when empty,
+  /// all the rows share the same key
+  std::string key_column;
+
+  /// Fraction of the keys whose rows are kept, between 0 and 1. Keys are
+  /// selected by hash, so the same keys are always kept
+  double sample_rate{1.0};
+
+  /// How many rows per second are kept for each key; zero disables the rate
+  /// limiting
+  double rate{0.0};
+
+  /// How many rows each key can emit in a single burst; defaults to the rate
+  std::size_t burst{0U};
+
+  /// How many keys are tracked; when the limit is reached, new keys share
+  /// a single token bucket
+  std::size_t max_key_count{4096U};
+
+  /// Returns true if the settings can drop rows
+  bool enabled() const;
+
+  /// Parses the settings from the given json object; a null object will
+  /// return the default settings
+  static osquery::Status parse(EventRowLimiterSettings& settings,
+                               const json11::Json& configuration);
+
+  /// Returns true if the settings are the same
+  bool operator==(const EventRowLimiterSettings& other) const;
+
+  /// Returns true if the settings are different
+  bool operator!=(const EventRowLimiterSettings& other) const;
+};
+
+class EventRowLimiter;
+
+/// A reference to an EventRowLimiter object
+using EventRowLimiterRef = std::shared_ptr<EventRowLimiter>;
+
+/// A pipeline stage placed between a subscriber and its event buffer; rows
+/// are sampled and then rate limited with a token bucket for each key, so
+/// that a single noisy key can't fill the buffer. The amount of work and
+/// memory used for each row is bounded by the max key count
+class EventRowLimiter final {
+  struct PrivateData;
+
+  /// Private class data
+  std::unique_ptr<PrivateData> d;
+
+  /// Private constructor; use the ::create() static function instead
+  EventRowLimiter(const std::string& subscriber_name,
+                  const EventRowLimiterSettings& settings);
+
+ public:
+  /// Factory function used to create EventRowLimiter objects; dropped rows
+  /// are reported to the metrics registry under the subscriber name
+  static osquery::Status create(EventRowLimiterRef& obj,
+                                const std::string& subscriber_name,
+                                const EventRowLimiterSettings& settings);
+
+  /// Destructor
+  ~EventRowLimiter();
+
+  /// Returns the settings used to create the limiter
+  const EventRowLimiterSettings& settings() const;
+
+  /// Removes the rows that are not sampled or that are over the rate limit
+  void apply(EventBatch& rows);
+
+  /// Same as above, using the given time to refill the token buckets
+  void apply(EventBatch& rows, std::chrono::steady_clock::time_point now);
+
+  /// Returns how many keys are currently tracked
+  std::size_t keyCount() const;
+
+  /// Returns true if rows with the given key are kept by the sampling
+  bool isSampled(const std::string& key) const;
+
+  /// Disable the copy constructor
+  EventRowLimiter(const EventRowLimiter& other) = delete;
+
+  /// Disable the assignment operator
+  EventRowLimiter& operator=(const EventRowLimiter& other) = delete;
+};
+} // namespace trailofbits
@@ -17,20 +17,53 @@
 #pragma once
 
 #include "ieventsubscriber.h"
+#include "latencyhistogram.h"
 
 #include <osquery/extensions.h>
 
+#include <chrono>
 #include <memory>
 
 namespace trailofbits {
+/// Coalescing policy for the events emitted by a publisher, taken from the
+/// "pubsub.scheduler.coalescing.<publisher name>" object; consecutive
+/// batches are merged until either limit is reached
+struct EventCoalescingSettings final {
+  /// Pending events are emitted once there are at least this many of them;
+  /// zero disables coalescing
+  std::size_t max_batch_size{0U};
+
+  /// Pending events are never held for longer than this
+  std::chrono::milliseconds max_linger_time{0};
+
+  /// Returns true if coalescing is enabled
+  bool enabled() const {
+    return max_batch_size > 1U && max_linger_time.count() > 0;
+  }
+
+  /// Returns true if the settings are the same
+  bool operator==(const EventCoalescingSettings& other) const {
+    return max_batch_size == other.max_batch_size &&
+           max_linger_time == other.max_linger_time;
+  }
+
+  /// Returns true if the settings are different
+  bool operator!=(const EventCoalescingSettings& other) const {
+    return !(*this == other);
+  }
+};
+
 /// Common base class for event publishers
 class IEventPublisher {
  public:
-  /// Subscribers the specified object to events emitted by this publisher
-  virtual osquery::Status subscribe(IEventSubscriberRef subscriber) = 0;
+  /// Subscribers the specified object to events emitted by this publisher;
+  /// the subscriber name is also the name of its event buffer
+  virtual osquery::Status subscribe(SubscriberId subscriber_id,
+                                    IEventSubscriberRef subscriber,
+                                    const std::string& subscriber_name) = 0;
 
-  /// Unsubscribes the specified object
-  virtual void unsubscribe(IEventSubscriberRef subscriber) = 0;
+  /// Unsubscribes the specified subscriber
+  virtual void unsubscribe(SubscriberId subscriber_id) = 0;
 
   /// One-time initialization
   virtual osquery::Status initialize() noexcept = 0;
@@ -52,6 +85,50 @@ class IEventPublisher {
   /// Returns the amount of active subscribers
   virtual std::size_t subscriptionCount() noexcept = 0;
 
+  /// Returns the callback latency of each subscriber, organized by
+  /// subscriber name
+  virtual LatencySummaryMap subscriberLatency() noexcept = 0;
+
+  /// Returns true if the buffers of all the subscribers have reached their
+  /// high watermark; it is released once they all go back below their low
+  /// watermark. Publishers should shed load while this is set, since most
+  /// of the rows they generate would be dropped
+  virtual bool backpressure() noexcept = 0;
+
+  /// Returns a descriptor that becomes readable when ::run() has work to
+  /// do; publishers returning -1 are serviced by a dedicated thread that
+  /// calls ::run() in a loop
+  virtual int readinessDescriptor() noexcept {
+    return -1;
+  }
+
+  /// Sets the coalescing policy; called by the scheduler, from the thread
+  /// running the publisher, each time the configuration changes
+  virtual void configureCoalescing(
+      const EventCoalescingSettings& settings) noexcept {
+    static_cast<void>(settings);
+  }
+
+  /// Returns when the pending (coalesced) events must be emitted, or when a
+  /// subscriber has held back rows to collect; time_point::max() if there
+  /// are none
+  virtual std::chrono::steady_clock::time_point flushDeadline() noexcept {
+    return std::chrono::steady_clock::time_point::max();
+  }
+
+  /// Emits the pending events once their deadline has expired, or right
+  /// away when force is set, and collects the rows held back by the
+  /// subscribers; called by the scheduler after ::run()
+  virtual void flushEvents(bool force) noexcept {
+    static_cast<void>(force);
+  }
+
+  /// Called by the scheduler when it is shutting down, possibly from
+  /// another thread; publishers that block inside ::run() should return
+  /// as soon as possible. ::run() is then called once more to drain the
+  /// events that are already available
+  virtual void interrupt() noexcept {}
+
   /// Destructor
   virtual ~IEventPublisher() = default;
 };
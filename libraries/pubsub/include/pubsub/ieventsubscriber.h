@@ -20,9 +20,14 @@
 
 #include <osquery/extensions.h>
 
+#include <cstdint>
 #include <memory>
 
 namespace trailofbits {
+/// Dense subscriber identifier, assigned by the SubscriberRegistry in
+/// registration order
+using SubscriberId = std::uint32_t;
+
 /// Common base class for event subscribers
 class IEventSubscriber {
  public:
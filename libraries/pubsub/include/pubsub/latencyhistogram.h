@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace trailofbits {
+/// A lock-free latency histogram, with microsecond resolution.
+///
+/// Values are stored in log-linear buckets: each power of two range is
+/// split into 8 sub-buckets, so the reported percentiles are within 12.5%
+/// of the actual value. Recording a value never blocks
+class LatencyHistogram final {
+ public:
+  /// Values below this threshold get their own bucket
+  static const std::size_t kLinearBucketCount{16U};
+
+  /// How many sub-buckets are used for each power of two
+  static const std::size_t kSubBucketCount{8U};
+
+  /// Amount of buckets; the last one also contains every larger value
+  static const std::size_t kBucketCount{kLinearBucketCount +
+                                        (40U - 4U) * kSubBucketCount};
+
+  /// A point in time summary of the histogram
+  struct Summary final {
+    /// How many values have been recorded
+    std::uint64_t count{0U};
+
+    /// Sum of all the recorded values, in microseconds
+    std::uint64_t total{0U};
+
+    /// Largest recorded value, in microseconds
+    std::uint64_t max{0U};
+
+    /// Median, in microseconds
+    std::uint64_t p50{0U};
+
+    /// 90th percentile, in microseconds
+    std::uint64_t p90{0U};
+
+    /// 99th percentile, in microseconds
+    std::uint64_t p99{0U};
+  };
+
+  /// Constructor
+  LatencyHistogram() = default;
+
+  /// Records a new value, in microseconds
+  void record(std::uint64_t value);
+
+  /// Records a new value
+  void record(std::chrono::steady_clock::duration value);
+
+  /// Returns a summary of the recorded values
+  Summary summary() const;
+
+  /// Returns the bucket used to store the given value
+  static std::size_t bucketIndex(std::uint64_t value);
+
+  /// Returns the smallest value stored by the given bucket
+  static std::uint64_t bucketLowerBound(std::size_t bucket_index);
+
+  /// Disable the copy constructor
+  LatencyHistogram(const LatencyHistogram& other) = delete;
+
+  /// Disable the assignment operator
+  LatencyHistogram& operator=(const LatencyHistogram& other) = delete;
+
+ private:
+  /// Bucket counters
+  std::array<std::atomic<std::uint64_t>, kBucketCount> bucket_list{};
+
+  /// Sum of all the recorded values
+  std::atomic<std::uint64_t> total{0U};
+
+  /// Largest recorded value
+  std::atomic<std::uint64_t> max{0U};
+};
+
+/// A reference to a latency histogram
+using LatencyHistogramRef = std::shared_ptr<LatencyHistogram>;
+
+/// Latency summaries, organized by name
+using LatencySummaryMap = std::map<std::string, LatencyHistogram::Summary>;
+} // namespace trailofbits
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wsign-conversion"
+#include <osquery/sdk/sdk.h>
+#pragma clang diagnostic pop
+#include <osquery/sql/dynamic_table_row.h>
+
+namespace trailofbits {
+/// Base class for rows that are only converted to an osquery::Row when
+/// osquery actually reads them. Derived classes only have to implement
+/// ::materialize()
+class LazyTableRow : public osquery::TableRow {
+  /// The materialized row, created the first time a column is accessed
+  mutable std::unique_ptr<osquery::DynamicTableRow> materialized_row;
+
+  /// Returns the materialized row, creating it if necessary
+  osquery::DynamicTableRow& materializedRow() const {
+    if (!materialized_row) {
+      materialized_row.reset(new osquery::DynamicTableRow(materialize()));
+    }
+
+    return *materialized_row;
+  }
+
+ protected:
+  /// Builds the row data
+  virtual osquery::Row materialize() const = 0;
+
+ public:
+  /// Constructor
+  LazyTableRow() = default;
+
+  /// Destructor
+  virtual ~LazyTableRow() override = default;
+
+  /// Returns the value of a single column; returns false if the column is
+  /// not set. Derived classes can avoid materializing the whole row
+  virtual bool columnValue(std::string& value,
+                           const std::string& column_name) const {
+    auto row_data = materialize();
+
+    auto it = row_data.find(column_name);
+    if (it == row_data.end()) {
+      return false;
+    }
+
+    value = std::move(it->second);
+    return true;
+  }
+
+  /// Returns the approximate amount of memory used by the row without
+  /// materializing it; zero means that the size is not known
+  virtual std::size_t estimatedSize() const {
+    return 0U;
+  }
+
+  virtual int get_rowid(sqlite_int64 default_value,
+                        sqlite_int64* pRowid) const override {
+    return materializedRow().get_rowid(default_value, pRowid);
+  }
+
+  virtual int get_column(sqlite3_context* ctx,
+                         sqlite3_vtab* pVtab,
+                         int col) override {
+    return materializedRow().get_column(ctx, pVtab, col);
+  }
+
+  virtual osquery::Status serialize(osquery::JSON& doc,
+                                    rapidjson::Value& obj) const override {
+    return materializedRow().serialize(doc, obj);
+  }
+
+  virtual osquery::TableRowHolder clone() const override {
+    return osquery::TableRowHolder(
+        new osquery::DynamicTableRow(materialize()));
+  }
+
+  virtual operator osquery::Row() const override {
+    return materialize();
+  }
+
+  /// Disable the copy constructor
+  LazyTableRow(const LazyTableRow& other) = delete;
+
+  /// Disable the assignment operator
+  LazyTableRow& operator=(const LazyTableRow& other) = delete;
+};
+
+/// Returns the value of a single column; lazy rows are not materialized
+inline bool getColumnValue(std::string& value,
+                           const osquery::TableRow& row,
+                           const std::string& column_name) {
+  auto lazy_row = dynamic_cast<const LazyTableRow*>(&row);
+  if (lazy_row != nullptr) {
+    return lazy_row->columnValue(value, column_name);
+  }
+
+  auto row_data = static_cast<osquery::Row>(row);
+
+  auto it = row_data.find(column_name);
+  if (it == row_data.end()) {
+    return false;
+  }
+
+  value = std::move(it->second);
+  return true;
+}
+} // namespace trailofbits
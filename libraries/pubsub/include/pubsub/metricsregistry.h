@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "latencyhistogram.h"
+#include "table_generator.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace trailofbits {
+/// A counter split into cache line sized slots; each thread adds to its own
+/// slot, so that concurrent updates do not contend on the same memory.
+/// Reading the value adds all the slots together
+class StripedCounter final {
+ public:
+  /// Amount of slots
+  static const std::size_t kSlotCount{16U};
+
+  /// Constructor
+  StripedCounter() = default;
+
+  /// Adds the given value to the counter
+  void add(std::uint64_t value = 1U);
+
+  /// Returns the current value
+  std::uint64_t value() const;
+
+  /// Disable the copy constructor
+  StripedCounter(const StripedCounter& other) = delete;
+
+  /// Disable the assignment operator
+  StripedCounter& operator=(const StripedCounter& other) = delete;
+
+ private:
+  /// A single slot, aligned to avoid false sharing
+  struct alignas(64) Slot final {
+    /// Slot value
+    std::atomic<std::uint64_t> value{0U};
+  };
+
+  /// Counter slots
+  std::array<Slot, kSlotCount> slot_list{};
+};
+
+/// A reference to a striped counter
+using StripedCounterRef = std::shared_ptr<StripedCounter>;
+
+/// The value of a single metric
+struct MetricValue final {
+  /// The kind of object that is measured (i.e.: publisher, subscriber)
+  std::string component;
+
+  /// Name of the object that is measured
+  std::string name;
+
+  /// Metric name
+  std::string metric;
+
+  /// True if this is a latency histogram; false for counters
+  bool histogram{false};
+
+  /// Counter value, or how many values have been recorded by the histogram
+  std::uint64_t value{0U};
+
+  /// Histogram summary; only valid for histograms
+  LatencyHistogram::Summary summary;
+};
+
+/// A list of metric values
+using MetricValueList = std::vector<MetricValue>;
+
+/// This singleton holds the counters and histograms used to monitor the
+/// pubsub runtime. Metrics are created the first time they are requested;
+/// callers are expected to keep the returned references instead of looking
+/// them up each time
+class MetricsRegistry final {
+  struct PrivateData;
+
+  /// Private class data
+  std::unique_ptr<PrivateData> d;
+
+  /// Private constructor; use ::instance() instead
+  MetricsRegistry();
+
+ public:
+  /// Returns an instance of the class
+  static MetricsRegistry& instance();
+
+  /// Destructor
+  ~MetricsRegistry();
+
+  /// Returns the specified counter
+  StripedCounterRef counter(const std::string& component,
+                            const std::string& name,
+                            const std::string& metric);
+
+  /// Returns the specified latency histogram
+  LatencyHistogramRef histogram(const std::string& component,
+                                const std::string& name,
+                                const std::string& metric);
+
+  /// Returns the current value of all the metrics
+  MetricValueList values() const;
+
+  /// Disable the copy constructor
+  MetricsRegistry(const MetricsRegistry& other) = delete;
+
+  /// Disable the assignment operator
+  MetricsRegistry& operator=(const MetricsRegistry& other) = delete;
+};
+
+/// Generates the rows for the pubsub_metrics table; event buffer counters
+/// are included as well
+osquery::TableRows generateMetricsTableRows(
+    const std::string& table_name,
+    const osquery::QueryContext& context,
+    const osquery::TableColumns& schema);
+} // namespace trailofbits
+
+// clang-format off
+#define REGISTER_PUBSUB_METRICS_TABLE() \
+  BEGIN_TABLE(pubsub_metrics) \
+    TABLE_COLUMN(component, osquery::TEXT_TYPE) \
+    TABLE_COLUMN(name, osquery::TEXT_TYPE) \
+    TABLE_COLUMN(metric, osquery::TEXT_TYPE) \
+    TABLE_COLUMN(value, osquery::BIGINT_TYPE) \
+    TABLE_COLUMN(total, osquery::BIGINT_TYPE) \
+    TABLE_COLUMN(p50, osquery::BIGINT_TYPE) \
+    TABLE_COLUMN(p90, osquery::BIGINT_TYPE) \
+    TABLE_COLUMN(p99, osquery::BIGINT_TYPE) \
+    TABLE_COLUMN(max, osquery::BIGINT_TYPE) \
+  END_CUSTOM_TABLE(pubsub_metrics, generateMetricsTableRows)
+// clang-format on
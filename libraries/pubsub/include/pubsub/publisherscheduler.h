@@ -16,13 +16,58 @@
 
 #pragma once
 
+#include "configurationfile.h"
 #include "ieventpublisher.h"
 
 #include <atomic>
+#include <chrono>
+#include <map>
 #include <memory>
 #include <vector>
 
 namespace trailofbits {
+/// How publishers are scheduled
+enum class PublisherSchedulerMode {
+  /// Each publisher gets a dedicated thread that calls ::run() in a loop
+  Threads,
+
+  /// A single epoll reactor waits on the publisher readiness descriptors,
+  /// and ready publishers are run on a shared worker pool. Publishers
+  /// without a readiness descriptor still get a dedicated thread
+  Reactor
+};
+
+/// Scheduler settings, taken from the "pubsub.scheduler" object
+struct PublisherSchedulerSettings final {
+  /// Scheduling mode
+  PublisherSchedulerMode mode{PublisherSchedulerMode::Threads};
+
+  /// Size of the worker pool used in reactor mode; zero means one worker
+  /// for each available core
+  std::size_t worker_count{0U};
+};
+
+/// How long PublisherScheduler::stop() waits for the publishers by default
+const std::chrono::milliseconds kDefaultPublisherShutdownTimeout(5000);
+
+/// Publisher counters
+struct PublisherStatistics final {
+  /// How many times ::run() has been called
+  std::uint64_t run_count{0U};
+
+  /// CPU time spent inside ::configure() and ::run(), in microseconds
+  std::uint64_t cpu_time{0U};
+
+  /// True if the publisher is serviced by the reactor
+  bool reactor{false};
+
+  /// True if the publisher has been halted after an error
+  bool halted{false};
+};
+
+/// Publisher statistics, organized by publisher name
+using PublisherStatisticsMap = std::map<std::string, PublisherStatistics>;
+
 class PublisherScheduler;
 
 /// A reference to a PublisherScheduler instance
@@ -39,6 +84,11 @@ class PublisherScheduler final {
   /// Private constructor; use ::create() instead
   PublisherScheduler(std::vector<IEventPublisherRef> publisher_list);
 
+  /// Registers the publishers that have a readiness descriptor with the
+  /// reactor, and starts it
+  osquery::Status startReactor(const PublisherSchedulerSettings& settings,
+                               ConfigurationFileRef configuration_file);
+
  public:
   /// Creates a new instance of this class
   static osquery::Status create(
@@ -48,11 +98,28 @@ class PublisherScheduler final {
   /// Destructor
   ~PublisherScheduler();
 
-  /// Starts the publisher threads
+  /// Starts the publisher threads; the scheduler and thread settings are
+  /// read from the configuration file at this time
   osquery::Status start(ConfigurationFileRef configuration_file);
 
-  /// Terminates the publishers
-  void stop();
+  /// Terminates the publishers. Each publisher is interrupted, run one
+  /// last time to drain the events it has already received, and flushed;
+  /// publisher threads that are still busy after `timeout` are detached
+  void stop(
+      std::chrono::milliseconds timeout = kDefaultPublisherShutdownTimeout);
+
+  /// Parses the scheduler settings from the given json object; a null
+  /// object will return the default settings
+  static osquery::Status parseSettings(PublisherSchedulerSettings& settings,
+                                       const json11::Json& configuration);
+
+  /// Parses the coalescing settings of a single publisher from the given
+  /// json object; a null object disables coalescing
+  static osquery::Status parseCoalescingSettings(
+      EventCoalescingSettings& settings, const json11::Json& configuration);
+
+  /// Returns the counters for all the scheduled publishers
+  PublisherStatisticsMap statistics() const;
 
   /// Disable the copy constructor
   PublisherScheduler(const PublisherScheduler& other) = delete;
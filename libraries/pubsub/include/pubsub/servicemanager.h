@@ -17,6 +17,8 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
+#include <future>
 #include <memory>
 #include <thread>
 
@@ -27,6 +29,8 @@
 
 #include <osquery/extensions.h>
 
+#include "threadsettings.h"
+
 namespace trailofbits {
 class IService;
 
@@ -40,8 +44,17 @@ using ThreadRef = std::shared_ptr<std::thread>;
 struct ServiceDescriptor final {
   IServiceRef service_ref;
   ThreadRef thread_ref;
+
+  /// Becomes ready once the service has returned from ::run()
+  std::shared_future<void> completion;
+
+  /// Kernel id of the service thread
+  pid_t thread_id{0};
 };
 
+/// How long ServiceManager::stop() waits for the services by default
+const std::chrono::milliseconds kDefaultServiceShutdownTimeout(5000);
+
 /// This singleton is used to manage services
 class ServiceManager final {
   /// True if the services must terminate
@@ -53,9 +66,17 @@ class ServiceManager final {
   /// Service list mutex
   std::mutex service_list_mutex;
 
+  /// Thread settings, organized by service name; protected by the service
+  /// list mutex
+  ThreadSettingsMap thread_settings_map;
+
   /// Private constructor; use ::instance() instead
   ServiceManager();
 
+  /// Starts the thread of an initialized service; the caller must own
+  /// the service list mutex
+  osquery::Status startService(IServiceRef service_ref);
+
  public:
   /// Returns an instance of the class
   static ServiceManager& instance();
@@ -88,12 +109,13 @@ class ServiceManager final {
         return status;
       }
 
-      auto thread_ref =
-          std::make_shared<std::thread>(std::bind(&T::run, &(*service_ref)));
-
-      service_list.push_back({service_ref, thread_ref});
+      status = startService(service_ref);
+      if (!status) {
+        service_ref->release();
+        service_ref.reset();
+      }
 
-      return osquery::Status(0);
+      return status;
 
     } catch (const std::bad_alloc&) {
       if (service_ref) {
@@ -104,8 +126,15 @@ class ServiceManager final {
     }
   }
 
-  /// Stops all services
-  void stop();
+  /// Applies the given thread settings to the running services, and saves
+  /// them for the services created later; services without settings keep
+  /// their current ones
+  void configureThreads(const ThreadSettingsMap& settings_map);
+
+  /// Stops all services, waiting at most `timeout` for them to return
+  /// from ::run(); services that miss the deadline are detached
+  void stop(
+      std::chrono::milliseconds timeout = kDefaultServiceShutdownTimeout);
 
   /// Disable the copy constructor
   ServiceManager(const ServiceManager& other) = delete;
@@ -119,10 +148,22 @@ class IService {
   /// True if the service should terminate
   std::atomic_bool* terminate{nullptr};
 
+  /// An eventfd that becomes readable when the service must terminate
+  int wakeup_fd{-1};
+
  protected:
   /// Returns true if the service should terminate
   bool shouldTerminate() const;
 
+  /// Returns a descriptor that becomes readable when the service must
+  /// terminate; services blocking on other descriptors should also poll
+  /// this one, so that they can be stopped without waiting for a timeout
+  int wakeupDescriptor() const;
+
+  /// Sleeps for the given amount of time, returning early (and true) if
+  /// the service is asked to terminate
+  bool waitForTermination(std::chrono::milliseconds timeout) const;
+
  public:
   /// Constructor
   IService() = default;
@@ -139,13 +180,17 @@ class IService {
   /// This is the service entry point
   virtual void run() = 0;
 
+  /// Returns the service name; it is used as thread name and to look up the
+  /// "pubsub.threads" settings
+  virtual std::string name() const = 0;
+
   /// Disable the copy constructor
   IService(const IService& other) = delete;
 
   /// Disable the assignment operator
   IService& operator=(const IService& other) = delete;
 
-  /// Allow the service manager to set the pointer to the termination flag
+  /// Allow the service manager to set the termination flag and descriptor
   friend class ServiceManager;
 };
 } // namespace trailofbits
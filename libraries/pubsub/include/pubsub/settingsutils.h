@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <string>
+
+#include <osquery/extensions.h>
+
+#include <json11.hpp>
+
+namespace trailofbits {
+/// Reads an optional unsigned integer from the given JSON object; `value`
+/// is left untouched when the setting is missing. Fractional, negative and
+/// out of range values (including the ones outside of [minimum, maximum])
+/// are rejected
+osquery::Status getSizeSetting(
+    std::size_t& value,
+    const json11::Json& configuration,
+    const std::string& name,
+    std::size_t minimum = 0U,
+    std::size_t maximum = std::numeric_limits<std::size_t>::max());
+
+/// Reads an optional non-negative number from the given JSON object;
+/// `value` is left untouched when the setting is missing
+osquery::Status getNumberSetting(double& value,
+                                 const json11::Json& configuration,
+                                 const std::string& name);
+} // namespace trailofbits
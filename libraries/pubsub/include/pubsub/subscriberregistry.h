@@ -19,7 +19,6 @@
 #include "baseeventsubscriber.h"
 
 #include <memory>
-#include <unordered_map>
 #include <vector>
 
 namespace trailofbits {
@@ -41,7 +40,7 @@ class SubscriberRegistry final {
 
  public:
   /// Returns the name for the specified subscriber
-  std::string subscriberName(IEventSubscriberRef subscriber);
+  std::string subscriberName(SubscriberId subscriber_id);
 
   /// Destructor
   ~SubscriberRegistry();
@@ -1,22 +1,29 @@
 #pragma once
 
 #include "eventbufferlibrary.h"
+#include "eventcolumnbatch.h"
+#include "eventrowfilter.h"
 
 #include <osquery/sdk/sdk.h>
 
+namespace trailofbits {
+/// Returns the rows buffered for the given table. The hidden "consumer"
+/// and "sequence" columns select the read cursor and the replay position,
+/// and the remaining constraints are used to filter the rows
+osquery::TableRows generateTableRows(const std::string& table_name,
+                                     const osquery::QueryContext& context,
+                                     const osquery::TableColumns& schema);
+} // namespace trailofbits
+
+// clang-format off
+#define DECLARE_TABLE_SCHEMA(name) \
+  const osquery::TableColumns& name ## TableSchema()
+// clang-format on
+
 // clang-format off
 #define BEGIN_TABLE(name) \
-  class name ## TablePlugin final : public osquery::TablePlugin { \
-   public: \
-    name ## TablePlugin() = default; \
-    virtual ~name ## TablePlugin() override; \
-    \
-	virtual osquery::TableRows generate(osquery::QueryContext&) override { \
-      return EventBufferLibrary::instance().getEvents(#name); \
-    } \
-    \
-    virtual osquery::TableColumns columns() const override { \
-      static const osquery::TableColumns schema = {
+  const osquery::TableColumns& name ## TableSchema() { \
+    static const osquery::TableColumns schema = {
 // clang-format on
 
 // clang-format off
@@ -26,8 +33,37 @@
 
 // clang-format off
 #define END_TABLE(name) \
-      }; \
-      return schema; \
+      std::make_tuple(kConsumerColumnName, \
+                      osquery::TEXT_TYPE, \
+                      osquery::ColumnOptions::HIDDEN), \
+      std::make_tuple(kSequenceColumnName, \
+                      osquery::BIGINT_TYPE, \
+                      osquery::ColumnOptions::HIDDEN) \
+  END_CUSTOM_TABLE(name, generateTableRows)
+// clang-format on
+
+// Tables that are not backed by an event buffer can use END_CUSTOM_TABLE
+// with their own generator function, which has the same signature as
+// generateTableRows
+
+// clang-format off
+#define END_CUSTOM_TABLE(name, generator) \
+    }; \
+    return schema; \
+  } \
+  \
+  class name ## TablePlugin final : public osquery::TablePlugin { \
+   public: \
+    name ## TablePlugin() = default; \
+    virtual ~name ## TablePlugin() override; \
+    \
+    virtual osquery::TableRows generate(osquery::QueryContext& context) \
+        override { \
+      return generator(#name, context, name ## TableSchema()); \
+    } \
+    \
+    virtual osquery::TableColumns columns() const override { \
+      return name ## TableSchema(); \
     } \
   }; \
   \
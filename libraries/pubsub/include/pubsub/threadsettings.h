@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include <osquery/extensions.h>
+
+#include <json11.hpp>
+
+namespace trailofbits {
+/// Scheduling policy of a thread
+enum class ThreadSchedulingPolicy {
+  /// The policy inherited from the parent thread is left untouched
+  Inherit,
+
+  /// SCHED_OTHER
+  Other,
+
+  /// SCHED_BATCH
+  Batch,
+
+  /// SCHED_IDLE
+  Idle,
+
+  /// SCHED_FIFO; requires CAP_SYS_NICE
+  Fifo,
+
+  /// SCHED_RR; requires CAP_SYS_NICE
+  RoundRobin
+};
+
+/// Thread settings, taken from the "pubsub.threads.<thread name>" object
+struct ThreadSettings final {
+  /// The name shown by ps and top; truncated to 15 characters. When empty,
+  /// the thread keeps its current name
+  std::string name;
+
+  /// The CPUs the thread is allowed to run on; empty means any CPU
+  std::vector<unsigned int> cpu_list;
+
+  /// If not negative, the thread is only allowed to run on the CPUs of this
+  /// NUMA node (combined with cpu_list, if both are set)
+  int numa_node{-1};
+
+  /// Scheduling policy
+  ThreadSchedulingPolicy policy{ThreadSchedulingPolicy::Inherit};
+
+  /// Static priority, between 1 and 99; only used by the fifo and rr
+  /// policies
+  int priority{0};
+
+  /// True if the nice value must be changed
+  bool set_nice{false};
+
+  /// Nice value, between -20 and 19; negative values require CAP_SYS_NICE
+  int nice{0};
+
+  /// Parses the settings from the given json object; a null object will
+  /// return the default settings
+  static osquery::Status parse(ThreadSettings& settings,
+                               const json11::Json& configuration);
+
+  /// Parses a list of CPUs in the kernel format (i.e.: "0,2-3")
+  static osquery::Status parseCpuList(std::vector<unsigned int>& cpu_list,
+                                      const std::string& value);
+};
+
+/// Thread settings, organized by thread name
+using ThreadSettingsMap = std::map<std::string, ThreadSettings>;
+
+/// Parses the "pubsub.threads" object
+osquery::Status parseThreadSettingsMap(ThreadSettingsMap& settings_map,
+                                       const json11::Json& configuration);
+
+/// Returns the settings for the given thread; threads without settings are
+/// only renamed. The thread name is also the default for the `name` value
+ThreadSettings getThreadSettings(const ThreadSettingsMap& settings_map,
+                                 const std::string& thread_name);
+
+/// Returns the kernel id of the calling thread
+pid_t currentThreadId();
+
+/// Applies the settings to the given thread; all the settings are attempted
+/// even when one of them fails, and the first error is returned
+osquery::Status applyThreadSettings(const ThreadSettings& settings,
+                                    pthread_t thread,
+                                    pid_t thread_id);
+
+/// Applies the settings to the calling thread
+osquery::Status applyThreadSettings(const ThreadSettings& settings);
+
+/// Starts a new thread that applies the given settings before calling the
+/// function; returns once they have been applied, so that they are in
+/// effect before the caller moves on (i.e.: before dropping privileges).
+/// Failing to apply the settings is not fatal and is only logged. The
+/// kernel id of the new thread is stored in thread_id, if not null.
+/// Throws std::system_error like the std::thread constructor
+std::thread startThread(const ThreadSettings& settings,
+                        std::function<void()> function,
+                        pid_t* thread_id = nullptr);
+} // namespace trailofbits
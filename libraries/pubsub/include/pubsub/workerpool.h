@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "threadsettings.h"
+
+#include <functional>
+#include <memory>
+
+#include <osquery/extensions.h>
+
+namespace trailofbits {
+class WorkerPool;
+
+/// A reference to a WorkerPool instance
+using WorkerPoolRef = std::shared_ptr<WorkerPool>;
+
+/// A small pool of worker threads.
+///
+/// Each worker has its own task queue; tasks submitted from a worker are
+/// pushed to its own queue, while the other ones are distributed in a
+/// round-robin fashion. Idle workers steal tasks from the other queues
+class WorkerPool final {
+  struct PrivateData;
+
+  /// Private class data
+  std::unique_ptr<PrivateData> d;
+
+  /// Private constructor; use ::create() instead
+  WorkerPool(std::size_t worker_count, const ThreadSettings& thread_settings);
+
+  /// Worker thread entry point
+  void workerThread(std::size_t worker_index);
+
+  /// Acquires the next task for the given worker; returns false if all the
+  /// queues are empty
+  bool acquireTask(std::function<void()>& task, std::size_t worker_index);
+
+ public:
+  /// A unit of work
+  using Task = std::function<void()>;
+
+  /// Factory method; a worker_count of zero will start one worker for
+  /// each available core. The thread settings are applied to all the
+  /// workers
+  static osquery::Status create(WorkerPoolRef& obj,
+                                std::size_t worker_count = 0U,
+                                const ThreadSettings& thread_settings = {});
+
+  /// Destructor; waits for the pending tasks to complete
+  ~WorkerPool();
+
+  /// Queues the given task
+  osquery::Status submit(Task task);
+
+  /// Calls `function` once for each index in [0, count), and returns when
+  /// all the calls have completed. Index zero runs on the calling thread;
+  /// the other ones are queued, and are run by the caller as well if they
+  /// can't be
+  void parallelFor(std::size_t count,
+                   const std::function<void(std::size_t)>& function);
+
+  /// Returns the amount of worker threads
+  std::size_t workerCount() const;
+
+  /// Returns true if the caller is running inside one of the workers
+  bool isWorkerThread() const;
+
+  /// Disable the copy constructor
+  WorkerPool(const WorkerPool& other) = delete;
+
+  /// Disable the assignment operator
+  WorkerPool& operator=(const WorkerPool& other) = delete;
+};
+} // namespace trailofbits
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "eventbufferutils.h"
+
+#include <pubsub/baseeventpublisher.h>
+
+namespace trailofbits {
+osquery::Status EventDispatchSettings::parse(
+    EventDispatchSettings& settings, const json11::Json& configuration) {
+  settings = {};
+
+  if (configuration.is_null()) {
+    return osquery::Status(0);
+  }
+
+  if (!configuration.is_object()) {
+    return osquery::Status(1, "The dispatch configuration must be an object");
+  }
+
+  const auto& mode_obj = configuration["mode"];
+  if (!mode_obj.is_null()) {
+    const auto& mode = mode_obj.string_value();
+
+    if (mode == "serial") {
+      settings.mode = EventDispatchMode::Serial;
+    } else if (mode == "parallel") {
+      settings.mode = EventDispatchMode::Parallel;
+    } else {
+      return osquery::Status(1, "Invalid 'mode' value: " + mode);
+    }
+  }
+
+  return getSizeSetting(settings.worker_count, configuration, "worker_count");
+}
+
+bool EventDispatchSettings::operator==(
+    const EventDispatchSettings& other) const {
+  return mode == other.mode && worker_count == other.worker_count;
+}
+
+bool EventDispatchSettings::operator!=(
+    const EventDispatchSettings& other) const {
+  return !(*this == other);
+}
+} // namespace trailofbits
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "circulareventbuffer.h"
+#include "eventbufferutils.h"
+
+#include <osquery/logger.h>
+
+namespace trailofbits {
+CircularEventBuffer::CircularEventBuffer(
+    const EventBufferSettings& settings_,
+    EventSegmentLogRef segment_log_,
+    EventBufferPressureStateRef pressure_state_)
+    : settings(settings_),
+      segment_log(std::move(segment_log_)),
+      pressure_state(std::move(pressure_state_)) {
+  data.set_capacity(settings.capacity);
+}
+
+void CircularEventBuffer::updatePressure() {
+  updatePressureState(
+      *pressure_state,
+      settings,
+      data.size(),
+      getRowLimit(settings, data.capacity(), average_row_size),
+      segment_log ? segment_log->diskUsage() : 0U);
+}
+
+osquery::Status CircularEventBuffer::create(
+    IEventBufferRef& obj,
+    const EventBufferSettings& settings,
+    const std::string& buffer_name,
+    EventBufferPressureStateRef pressure_state) {
+  obj.reset();
+
+  if (settings.capacity == 0U) {
+    return osquery::Status(1, "Invalid buffer capacity");
+  }
+
+  EventSegmentLogRef segment_log;
+  auto status = createSegmentLog(segment_log, settings, buffer_name);
+  if (!status.ok()) {
+    return status;
+  }
+
+  try {
+    if (!pressure_state) {
+      pressure_state = std::make_shared<EventBufferPressureState>(
+          EventBufferPressure::Low);
+    }
+
+    auto ptr = new CircularEventBuffer(
+        settings, std::move(segment_log), std::move(pressure_state));
+    obj.reset(ptr);
+
+    return osquery::Status(0);
+
+  } catch (const std::bad_alloc&) {
+    return osquery::Status(1, "Memory allocation failure");
+  }
+}
+
+void CircularEventBuffer::save(EventBatch& events) {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  if (!events.empty()) {
+    average_row_size = updateAverageRowSize(average_row_size,
+                                            estimateRowSize(*events.front()));
+  }
+
+  auto row_limit = getRowLimit(settings, data.capacity(), average_row_size);
+  EventBatch evicted_rows;
+
+  for (auto& row : events) {
+    if (data.size() >= row_limit &&
+        settings.overflow_policy == EventBufferOverflowPolicy::DropNewest) {
+      ++rejected_row_count;
+      continue;
+    }
+
+    while (data.size() >= row_limit) {
+      if (settings.overflow_policy == EventBufferOverflowPolicy::SpillToDisk) {
+        evicted_rows.push_back(std::move(data.front()));
+      } else {
+        ++overwritten_row_count;
+      }
+
+      data.pop_front();
+    }
+
+    data.push_back(std::move(row));
+  }
+
+  events.clear();
+
+  if (!evicted_rows.empty()) {
+    auto evicted_row_count = evicted_rows.size();
+
+    std::size_t dropped_row_count = 0U;
+    auto status = segment_log->append(evicted_rows, dropped_row_count);
+    if (status.ok()) {
+      spilled_row_count += evicted_row_count;
+      overwritten_row_count += dropped_row_count;
+
+    } else {
+      LOG(ERROR) << status.getMessage();
+      overwritten_row_count += evicted_row_count;
+    }
+  }
+
+  updatePressure();
+}
+
+EventBatch CircularEventBuffer::get() {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  // Spilled rows are always older than the ones we have in memory
+  EventBatch event_batch;
+  if (segment_log) {
+    auto status = segment_log->read(event_batch);
+    if (!status.ok()) {
+      LOG(ERROR) << status.getMessage();
+    }
+  }
+
+  event_batch.reserve(event_batch.size() + data.size());
+
+  std::move(data.begin(), data.end(), std::back_inserter(event_batch));
+  data.clear();
+
+  updatePressure();
+  return event_batch;
+}
+
+EventBatch CircularEventBuffer::read(const EventReadRequest& request) {
+  auto event_batch = get();
+  setRowConsumer(event_batch, request.consumer);
+
+  return event_batch;
+}
+
+EventBufferStatistics CircularEventBuffer::statistics() {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  EventBufferStatistics buffer_statistics;
+  buffer_statistics.row_count = data.size();
+  buffer_statistics.unread_row_count = buffer_statistics.row_count;
+  buffer_statistics.capacity =
+      getRowLimit(settings, data.capacity(), average_row_size);
+
+  buffer_statistics.memory_usage = data.size() * average_row_size;
+  buffer_statistics.overwritten_row_count = overwritten_row_count;
+  buffer_statistics.rejected_row_count = rejected_row_count;
+  buffer_statistics.spilled_row_count = spilled_row_count;
+
+  if (segment_log) {
+    buffer_statistics.pending_spilled_row_count = segment_log->rowCount();
+    buffer_statistics.disk_usage = segment_log->diskUsage();
+  }
+
+  return buffer_statistics;
+}
+
+void CircularEventBuffer::flush() {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  if (!segment_log || !segment_log->isPersistent()) {
+    return;
+  }
+
+  EventBatch event_batch;
+  event_batch.reserve(data.size());
+
+  std::move(data.begin(), data.end(), std::back_inserter(event_batch));
+  data.clear();
+
+  std::size_t dropped_row_count = 0U;
+  auto status = segment_log->append(event_batch, dropped_row_count);
+  overwritten_row_count += dropped_row_count;
+
+  if (status.ok()) {
+    status = segment_log->sync();
+  }
+
+  if (!status.ok()) {
+    LOG(ERROR) << status.getMessage();
+  }
+
+  updatePressure();
+}
+} // namespace trailofbits
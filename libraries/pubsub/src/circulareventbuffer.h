@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "eventsegmentlog.h"
+#include "ieventbuffer.h"
+
+#include <boost/circular_buffer.hpp>
+
+#include <mutex>
+
+namespace trailofbits {
+/// An event buffer backed by a mutex-protected boost::circular_buffer
+class CircularEventBuffer final : public IEventBuffer {
+  /// Buffer settings
+  EventBufferSettings settings;
+
+  /// The row storage
+  boost::circular_buffer<osquery::TableRowHolder> data;
+
+  /// Where rows are moved when the overflow policy is set to SpillToDisk,
+  /// or when a persistent buffer is flushed
+  EventSegmentLogRef segment_log;
+
+  /// Mutex protecting the row storage, the segment log and the counters
+  std::mutex mutex;
+
+  /// Running average of the row size, sampled once per batch
+  std::size_t average_row_size{0U};
+
+  /// How many rows have been overwritten because the buffer was full
+  std::uint64_t overwritten_row_count{0U};
+
+  /// How many new rows have been discarded because the buffer was full
+  std::uint64_t rejected_row_count{0U};
+
+  /// How many rows have been moved to disk because the buffer was full
+  std::uint64_t spilled_row_count{0U};
+
+  /// Where the buffer publishes how full it is
+  EventBufferPressureStateRef pressure_state;
+
+  /// Private constructor; use ::create() instead
+  CircularEventBuffer(const EventBufferSettings& settings,
+                      EventSegmentLogRef segment_log,
+                      EventBufferPressureStateRef pressure_state);
+
+  /// Publishes the current fill level; the mutex must be held
+  void updatePressure();
+
+ public:
+  /// Factory method; a private pressure state is allocated when none is
+  /// given
+  static osquery::Status create(
+      IEventBufferRef& obj,
+      const EventBufferSettings& settings,
+      const std::string& buffer_name,
+      EventBufferPressureStateRef pressure_state = nullptr);
+
+  /// Destructor
+  virtual ~CircularEventBuffer() override = default;
+
+  /// Appends the given events to the buffer; the batch is cleared
+  virtual void save(EventBatch& events) override;
+
+  /// Removes and returns all the events stored in the buffer
+  virtual EventBatch get() override;
+
+  /// Same as ::get(); this engine only supports a single consumer, and all
+  /// of them read from the same rows
+  virtual EventBatch read(const EventReadRequest& request) override;
+
+  /// Returns the buffer counters
+  virtual EventBufferStatistics statistics() override;
+
+  /// Moves the rows held in memory to disk if the buffer is persistent
+  virtual void flush() override;
+
+  /// Disable the copy constructor
+  CircularEventBuffer(const CircularEventBuffer& other) = delete;
+
+  /// Disable the assignment operator
+  CircularEventBuffer& operator=(const CircularEventBuffer& other) = delete;
+};
+} // namespace trailofbits
@@ -14,8 +14,14 @@
  * limitations under the License.
  */
 
+#include <array>
+#include <atomic>
+#include <cerrno>
 #include <chrono>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <thread>
 #include <unordered_map>
 
 #include <pubsub/configurationfile.h>
@@ -24,32 +30,48 @@
 #include <boost/filesystem/operations.hpp>
 #include <boost/thread/shared_mutex.hpp>
 
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
 namespace boostfs = boost::filesystem;
 
 namespace trailofbits {
 namespace {
-/// Configuration update interval
+/// Configuration update interval, used when inotify is not available
 const std::chrono::milliseconds kConfigurationUpdateInterval{5000};
 
-/// The data associated with an handle; contains the configuration and when it
-/// was updated
-struct ConfigurationFileHandleInfo final {
-  /// Timestamp for this configuration
-  std::time_t current_config_timestamp{0U};
+/// The inotify events that may signal a configuration change; editors often
+/// replace the file instead of writing it in place
+const std::uint32_t kConfigurationWatchMask =
+    IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_MOVED_FROM;
+
+/// An immutable configuration, as published by the watcher thread
+struct ConfigurationSnapshot final {
+  /// Incremented each time a new configuration is published
+  std::uint64_t generation{0U};
 
   /// Configuration
   json11::Json configuration;
 };
 
+/// A reference to a configuration snapshot
+using ConfigurationSnapshotRef = std::shared_ptr<const ConfigurationSnapshot>;
+
+/// The data associated with an handle; contains the last configuration that
+/// has been acknowledged by the handle owner
+struct ConfigurationFileHandleInfo final {
+  /// Generation of the acknowledged configuration
+  std::atomic<std::uint64_t> generation{0U};
+
+  /// Configuration
+  ConfigurationSnapshotRef snapshot;
+};
+
 /// A reference to a handle data object
 using ConfigurationFileHandleInfoRef =
     std::shared_ptr<ConfigurationFileHandleInfo>;
-
-/// Generates a new configuration handle
-ConfigurationFileHandle generateHandle() {
-  static std::uint64_t handle_generator{0U};
-  return handle_generator++;
-}
 } // namespace
 
 /// Private class data
@@ -57,51 +79,101 @@ struct ConfigurationFile::PrivateData final {
   /// Configuration file path
   std::string configuration_file_path;
 
-  /// The modification time of the configuration file
-  std::time_t current_config_timestamp{0U};
+  /// Name of the configuration file, used to filter the inotify events
+  std::string configuration_file_name;
+
+  /// The current configuration; always accessed with std::atomic_load and
+  /// std::atomic_store
+  ConfigurationSnapshotRef snapshot;
 
-  /// When the last modification time update has happened
-  std::chrono::time_point<std::chrono::system_clock>
-      last_configuration_update{};
+  /// Generation of the current snapshot; used to check for changes without
+  /// touching the snapshot
+  std::atomic<std::uint64_t> generation{0U};
 
-  /// Mutex used to protect access to the internal variables
+  /// The modification time of the configuration file; only used when
+  /// inotify is not available
+  std::time_t current_config_timestamp{0U};
+
+  /// Mutex used to protect the handle map
   boost::shared_timed_mutex mutex;
 
   /// Maps handles to their data structures
   std::unordered_map<ConfigurationFileHandle, ConfigurationFileHandleInfoRef>
       handle_map;
 
-  /// Configuration
-  json11::Json configuration;
+  /// Used to generate new handles; protected by the mutex
+  ConfigurationFileHandle handle_generator{0U};
+
+  /// The inotify descriptor, or -1 if the file is polled
+  int inotify_fd{-1};
+
+  /// An eventfd descriptor used to stop the watcher thread
+  int wakeup_fd{-1};
+
+  /// The watcher thread
+  std::thread watcher_thread;
 };
 
 ConfigurationFile::ConfigurationFile(const std::string& configuration_file_path)
     : d(new PrivateData) {
   d->configuration_file_path = configuration_file_path;
-}
+  d->snapshot = std::make_shared<ConfigurationSnapshot>();
 
-void ConfigurationFile::updateConfiguration() {
-  auto current_time = std::chrono::system_clock::now();
+  boostfs::path path(configuration_file_path);
+  d->configuration_file_name = path.filename().string();
 
-  auto next_update_time =
-      std::chrono::time_point_cast<std::chrono::milliseconds>(
-          d->last_configuration_update) +
-      kConfigurationUpdateInterval;
+  auto parent_path = path.parent_path().string();
+  if (parent_path.empty()) {
+    parent_path = ".";
+  }
 
-  if (next_update_time >
-      std::chrono::time_point_cast<std::chrono::milliseconds>(current_time)) {
-    return;
+  d->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (d->wakeup_fd == -1) {
+    throw osquery::Status(1, "Failed to create the eventfd descriptor");
   }
 
-  std::unique_lock<decltype(d->mutex)> lock(d->mutex);
-  d->last_configuration_update = current_time;
+  d->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (d->inotify_fd != -1 &&
+      inotify_add_watch(
+          d->inotify_fd, parent_path.c_str(), kConfigurationWatchMask) == -1) {
+    close(d->inotify_fd);
+    d->inotify_fd = -1;
+  }
+
+  if (d->inotify_fd == -1) {
+    std::cerr << "Failed to watch the configuration file with inotify ("
+              << std::strerror(errno) << "); falling back to polling\n";
+  }
+
+  // Load the initial configuration before the handles are created
+  updateConfiguration();
+
+  try {
+    d->watcher_thread = std::thread(&ConfigurationFile::watcherThread, this);
 
+  } catch (const std::system_error&) {
+    if (d->inotify_fd != -1) {
+      close(d->inotify_fd);
+    }
+
+    close(d->wakeup_fd);
+    throw osquery::Status(1, "Failed to start the configuration watcher");
+  }
+}
+
+void ConfigurationFile::updateConfiguration() {
+  boost::system::error_code error_code;
   auto new_config_timestamp =
-      boostfs::last_write_time(d->configuration_file_path);
-  if (d->current_config_timestamp == new_config_timestamp) {
+      boostfs::last_write_time(d->configuration_file_path, error_code);
+
+  if (error_code) {
+    // The file may be in the middle of being replaced; wait for the next
+    // notification
     return;
   }
 
+  d->current_config_timestamp = new_config_timestamp;
+
   std::ifstream json_file(d->configuration_file_path);
   std::string json_data((std::istreambuf_iterator<char>(json_file)),
                         std::istreambuf_iterator<char>());
@@ -116,8 +188,95 @@ void ConfigurationFile::updateConfiguration() {
     return;
   }
 
-  d->configuration = std::move(new_configuration);
-  d->current_config_timestamp = new_config_timestamp;
+  auto current_snapshot = std::atomic_load(&d->snapshot);
+  if (current_snapshot->generation != 0U &&
+      current_snapshot->configuration == new_configuration) {
+    return;
+  }
+
+  auto new_snapshot = std::make_shared<ConfigurationSnapshot>();
+  new_snapshot->generation = current_snapshot->generation + 1U;
+  new_snapshot->configuration = std::move(new_configuration);
+
+  std::atomic_store(&d->snapshot,
+                    ConfigurationSnapshotRef(std::move(new_snapshot)));
+
+  d->generation.store(current_snapshot->generation + 1U,
+                      std::memory_order_release);
+}
+
+void ConfigurationFile::watcherThread() {
+  // inotify_event structures must be properly aligned
+  alignas(inotify_event) std::array<char, 4096U> event_buffer;
+
+  for (;;) {
+    std::array<pollfd, 2U> descriptor_list = {
+        {{d->wakeup_fd, POLLIN, 0}, {d->inotify_fd, POLLIN, 0}}};
+
+    auto descriptor_count = d->inotify_fd != -1 ? 2U : 1U;
+    auto timeout = d->inotify_fd != -1
+                       ? -1
+                       : static_cast<int>(kConfigurationUpdateInterval.count());
+
+    auto poll_result = poll(descriptor_list.data(), descriptor_count, timeout);
+    if (poll_result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      std::cerr << "The configuration watcher has failed: "
+                << std::strerror(errno) << "\n";
+      break;
+    }
+
+    if (descriptor_list[0].revents != 0) {
+      break;
+    }
+
+    if (d->inotify_fd == -1) {
+      boost::system::error_code error_code;
+      auto new_config_timestamp =
+          boostfs::last_write_time(d->configuration_file_path, error_code);
+
+      if (!error_code &&
+          new_config_timestamp != d->current_config_timestamp) {
+        updateConfiguration();
+      }
+
+      continue;
+    }
+
+    if ((descriptor_list[1].revents & POLLIN) == 0) {
+      continue;
+    }
+
+    bool configuration_changed = false;
+
+    for (;;) {
+      auto read_size =
+          read(d->inotify_fd, event_buffer.data(), event_buffer.size());
+      if (read_size <= 0) {
+        break;
+      }
+
+      for (auto event_ptr = event_buffer.data();
+           event_ptr < event_buffer.data() + read_size;) {
+        auto event = reinterpret_cast<const inotify_event*>(event_ptr);
+
+        if ((event->mask & IN_Q_OVERFLOW) != 0U ||
+            (event->len != 0U &&
+             d->configuration_file_name == event->name)) {
+          configuration_changed = true;
+        }
+
+        event_ptr += sizeof(inotify_event) + event->len;
+      }
+    }
+
+    if (configuration_changed) {
+      updateConfiguration();
+    }
+  }
 }
 
 osquery::Status ConfigurationFile::create(
@@ -138,24 +297,40 @@ osquery::Status ConfigurationFile::create(
   }
 }
 
+ConfigurationFile::~ConfigurationFile() {
+  std::uint64_t counter{1U};
+  if (write(d->wakeup_fd, &counter, sizeof(counter)) != sizeof(counter)) {
+    std::cerr << "Failed to stop the configuration watcher\n";
+  }
+
+  d->watcher_thread.join();
+
+  if (d->inotify_fd != -1) {
+    close(d->inotify_fd);
+  }
+
+  close(d->wakeup_fd);
+}
+
 ConfigurationFileHandle ConfigurationFile::getHandle() {
   std::unique_lock<decltype(d->mutex)> lock(d->mutex);
 
-  auto handle = generateHandle();
+  auto handle = d->handle_generator++;
   auto handle_info = std::make_shared<ConfigurationFileHandleInfo>();
   d->handle_map.insert({handle, std::move(handle_info)});
 
   return handle;
 }
 
-bool ConfigurationFile::configurationChanged(ConfigurationFileHandle handle) {
-  updateConfiguration();
+std::uint64_t ConfigurationFile::generation() const {
+  return d->generation.load(std::memory_order_acquire);
+}
 
+bool ConfigurationFile::configurationChanged(ConfigurationFileHandle handle) {
   ConfigurationFileHandleInfoRef handle_info;
-  bool configuration_changed = false;
 
   {
-    boost::upgrade_lock<decltype(d->mutex)> read_lock(d->mutex);
+    boost::shared_lock<decltype(d->mutex)> read_lock(d->mutex);
 
     auto it = d->handle_map.find(handle);
     if (it == d->handle_map.end()) {
@@ -163,27 +338,28 @@ bool ConfigurationFile::configurationChanged(ConfigurationFileHandle handle) {
     }
 
     handle_info = it->second;
+  }
 
-    if (handle_info->current_config_timestamp != d->current_config_timestamp) {
-      configuration_changed = true;
-      handle_info->configuration = d->configuration;
-      handle_info->current_config_timestamp = d->current_config_timestamp;
-    }
+  auto generation = d->generation.load(std::memory_order_acquire);
+  if (handle_info->generation == generation) {
+    return false;
   }
 
-  return configuration_changed;
+  handle_info->snapshot = std::atomic_load(&d->snapshot);
+  handle_info->generation = handle_info->snapshot->generation;
+
+  return true;
 }
 
 json11::Json ConfigurationFile::getConfiguration(
     ConfigurationFileHandle handle) {
-  boost::upgrade_lock<decltype(d->mutex)> read_lock(d->mutex);
+  boost::shared_lock<decltype(d->mutex)> read_lock(d->mutex);
 
   auto it = d->handle_map.find(handle);
-  if (it == d->handle_map.end()) {
+  if (it == d->handle_map.end() || !it->second->snapshot) {
     return json11::Json();
   }
 
-  auto handle_info = it->second;
-  return handle_info->configuration;
+  return it->second->snapshot->configuration;
 }
 } // namespace trailofbits
@@ -0,0 +1,383 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "eventbufferutils.h"
+
+#include <pubsub/eventaggregator.h>
+#include <pubsub/eventcolumnbatch.h>
+#include <pubsub/metricsregistry.h>
+
+#include <limits>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <utility>
+
+namespace trailofbits {
+namespace {
+/// The columns filled by the aggregator
+const std::string kWindowStartColumn{"window_start"};
+const std::string kWindowEndColumn{"window_end"};
+const std::string kCountColumn{"count"};
+const std::string kCountErrorColumn{"count_error"};
+
+/// A single group
+struct EventGroup final {
+  /// The encoded key, as stored in the group index
+  std::string encoded_key;
+
+  /// Key values
+  std::vector<std::string> key_values;
+
+  /// How many events have been counted
+  std::uint64_t count{0U};
+
+  /// Max overestimation of the count; only set for groups that have
+  /// replaced another one
+  std::uint64_t count_error{0U};
+};
+
+/// Encodes the key values into a single string; values are length-prefixed
+/// so that different keys can't be confused
+void encodeKey(std::string& encoded_key,
+               const std::vector<std::string>& key_values) {
+  encoded_key.clear();
+
+  for (const auto& value : key_values) {
+    encoded_key.append(std::to_string(value.size()));
+    encoded_key.push_back(':');
+    encoded_key.append(value);
+  }
+}
+} // namespace
+
+osquery::Status EventAggregatorSettings::parse(
+    EventAggregatorSettings& settings, const json11::Json& configuration) {
+  settings = {};
+
+  if (configuration.is_null()) {
+    return osquery::Status(0);
+  }
+
+  if (!configuration.is_object()) {
+    return osquery::Status(1,
+                           "The aggregation configuration must be an object");
+  }
+
+  auto status =
+      getSizeSetting(settings.window_size, configuration, "window_size", 1U);
+  if (!status.ok()) {
+    return status;
+  }
+
+  return getSizeSetting(
+      settings.max_group_count, configuration, "max_group_count", 1U);
+}
+
+bool EventAggregatorSettings::operator==(
+    const EventAggregatorSettings& other) const {
+  return window_size == other.window_size &&
+         max_group_count == other.max_group_count;
+}
+
+bool EventAggregatorSettings::operator!=(
+    const EventAggregatorSettings& other) const {
+  return !(*this == other);
+}
+
+/// Private class data
+struct EventAggregator::PrivateData final {
+  /// The table schema
+  const osquery::TableColumns* schema{nullptr};
+
+  /// Names of the key columns
+  std::vector<std::string> key_column_list;
+
+  /// Schema indexes of the key columns
+  std::vector<std::size_t> key_column_index_list;
+
+  /// Schema indexes of the aggregation columns
+  std::size_t window_start_column{0U};
+  std::size_t window_end_column{0U};
+  std::size_t count_column{0U};
+  std::size_t count_error_column{0U};
+
+  /// Settings
+  EventAggregatorSettings settings;
+
+  /// Mutex protecting the aggregation state
+  mutable std::mutex mutex;
+
+  /// True if a window has been opened
+  bool window_open{false};
+
+  /// Start of the current window
+  std::time_t window_start{0};
+
+  /// Groups in the current window
+  std::vector<EventGroup> group_list;
+
+  /// Maps the encoded keys to the group list
+  std::unordered_map<std::string, std::size_t> group_index;
+
+  /// Groups sorted by count, used to find the least frequent one
+  std::set<std::pair<std::uint64_t, std::size_t>> count_index;
+
+  /// Buffer used to encode the keys
+  std::string encoded_key;
+
+  /// Rows of the windows that have ended
+  EventBatch completed_rows;
+
+  /// How many groups have been replaced because the max group count was
+  /// reached
+  StripedCounterRef evicted_group_count;
+};
+
+EventAggregator::EventAggregator(const std::string& name,
+                                 const osquery::TableColumns& schema)
+    : d(new PrivateData) {
+  d->schema = &schema;
+
+  const std::pair<const std::string&, std::size_t&> aggregation_column_list[] =
+      {{kWindowStartColumn, d->window_start_column},
+       {kWindowEndColumn, d->window_end_column},
+       {kCountColumn, d->count_column},
+       {kCountErrorColumn, d->count_error_column}};
+
+  for (const auto& p : aggregation_column_list) {
+    const auto& column_name = p.first;
+    auto& column_index = p.second;
+
+    column_index = EventColumnBatch::columnIndex(schema, column_name);
+    if (column_index == EventColumnBatch::kInvalidColumn) {
+      throw osquery::Status(
+          1, "The table schema has no '" + column_name + "' column");
+    }
+  }
+
+  // Hidden columns (such as the consumer and sequence columns added by the
+  // END_TABLE macro) are not part of the key
+  for (std::size_t i = 0U; i < schema.size(); ++i) {
+    const auto& column_name = std::get<0>(schema.at(i));
+    auto column_options = static_cast<int>(std::get<2>(schema.at(i)));
+
+    if (column_name == kWindowStartColumn || column_name == kWindowEndColumn ||
+        column_name == kCountColumn || column_name == kCountErrorColumn ||
+        (column_options & static_cast<int>(osquery::ColumnOptions::HIDDEN)) !=
+            0) {
+      continue;
+    }
+
+    d->key_column_list.push_back(column_name);
+    d->key_column_index_list.push_back(i);
+  }
+
+  d->evicted_group_count =
+      MetricsRegistry::instance().counter("subscriber", name, "evicted_groups");
+}
+
+void EventAggregator::closeWindow() {
+  if (!d->window_open) {
+    return;
+  }
+
+  d->window_open = false;
+
+  if (d->group_list.empty()) {
+    return;
+  }
+
+  EventColumnBatchRef batch;
+  auto status = EventColumnBatch::create(batch, *d->schema);
+  if (!status.ok()) {
+    return;
+  }
+
+  auto window_start = static_cast<std::int64_t>(d->window_start);
+  auto window_end =
+      window_start + static_cast<std::int64_t>(d->settings.window_size);
+
+  for (const auto& group : d->group_list) {
+    auto row = batch->addRow();
+
+    batch->setInteger(row, d->window_start_column, window_start);
+    batch->setInteger(row, d->window_end_column, window_end);
+    batch->setInteger(
+        row, d->count_column, static_cast<std::int64_t>(group.count));
+    batch->setInteger(row,
+                      d->count_error_column,
+                      static_cast<std::int64_t>(group.count_error));
+
+    for (std::size_t i = 0U; i < d->key_column_index_list.size(); ++i) {
+      batch->setText(row, d->key_column_index_list[i], group.key_values[i]);
+    }
+  }
+
+  EventColumnBatch::appendTableRows(d->completed_rows, batch);
+
+  d->group_list.clear();
+  d->group_index.clear();
+  d->count_index.clear();
+}
+
+osquery::Status EventAggregator::create(EventAggregatorRef& obj,
+                                        const std::string& name,
+                                        const osquery::TableColumns& schema) {
+  try {
+    auto ptr = new EventAggregator(name, schema);
+    obj.reset(ptr);
+
+    return osquery::Status(0);
+
+  } catch (const std::bad_alloc&) {
+    return osquery::Status(1, "Memory allocation failure");
+
+  } catch (const osquery::Status& status) {
+    return status;
+  }
+}
+
+EventAggregator::~EventAggregator() {}
+
+void EventAggregator::configure(const EventAggregatorSettings& settings) {
+  std::lock_guard<std::mutex> lock(d->mutex);
+
+  if (settings == d->settings) {
+    return;
+  }
+
+  closeWindow();
+  d->settings = settings;
+}
+
+const std::vector<std::string>& EventAggregator::keyColumns() const {
+  return d->key_column_list;
+}
+
+void EventAggregator::add(const std::vector<std::string>& key_values,
+                          std::time_t event_time,
+                          std::uint64_t count) {
+  if (key_values.size() != d->key_column_list.size()) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(d->mutex);
+
+  auto window_size = static_cast<std::time_t>(d->settings.window_size);
+  auto event_window = event_time - (event_time % window_size);
+
+  if (d->window_open && event_window > d->window_start) {
+    closeWindow();
+  }
+
+  if (!d->window_open) {
+    d->window_open = true;
+    d->window_start = event_window;
+  }
+
+  encodeKey(d->encoded_key, key_values);
+
+  std::size_t group_index = 0U;
+
+  auto it = d->group_index.find(d->encoded_key);
+  if (it != d->group_index.end()) {
+    group_index = it->second;
+
+  } else if (d->group_list.size() < d->settings.max_group_count) {
+    group_index = d->group_list.size();
+
+    EventGroup group;
+    group.encoded_key = d->encoded_key;
+    group.key_values = key_values;
+
+    d->group_list.push_back(std::move(group));
+    d->group_index.insert({d->encoded_key, group_index});
+    d->count_index.insert({0U, group_index});
+
+  } else {
+    // Replace the least frequent group; the new one inherits its count,
+    // which becomes the error bound
+    group_index = d->count_index.begin()->second;
+
+    auto& group = d->group_list[group_index];
+    d->group_index.erase(group.encoded_key);
+
+    group.encoded_key = d->encoded_key;
+    group.key_values = key_values;
+    group.count_error = group.count;
+
+    d->group_index.insert({d->encoded_key, group_index});
+    d->evicted_group_count->add();
+  }
+
+  auto& group = d->group_list[group_index];
+
+  d->count_index.erase({group.count, group_index});
+  group.count += count;
+  d->count_index.insert({group.count, group_index});
+}
+
+void EventAggregator::collect(EventBatch& rows, std::time_t current_time) {
+  std::lock_guard<std::mutex> lock(d->mutex);
+
+  auto window_end =
+      d->window_start + static_cast<std::time_t>(d->settings.window_size);
+
+  if (d->window_open && current_time >= window_end) {
+    closeWindow();
+  }
+
+  if (d->completed_rows.empty()) {
+    return;
+  }
+
+  rows.reserve(rows.size() + d->completed_rows.size());
+  for (auto& row : d->completed_rows) {
+    rows.push_back(std::move(row));
+  }
+
+  d->completed_rows.clear();
+}
+
+void EventAggregator::flush(EventBatch& rows) {
+  {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    closeWindow();
+  }
+
+  collect(rows, 0);
+}
+
+std::time_t EventAggregator::collectionTime() const {
+  std::lock_guard<std::mutex> lock(d->mutex);
+
+  if (!d->completed_rows.empty()) {
+    return 0;
+  }
+
+  if (!d->window_open || d->group_list.empty()) {
+    return std::numeric_limits<std::time_t>::max();
+  }
+
+  return d->window_start + static_cast<std::time_t>(d->settings.window_size);
+}
+
+std::size_t EventAggregator::groupCount() const {
+  std::lock_guard<std::mutex> lock(d->mutex);
+  return d->group_list.size();
+}
+} // namespace trailofbits
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <pubsub/eventarena.h>
+
+#include <algorithm>
+#include <cstdint>
+
+namespace trailofbits {
+namespace {
+/// A single block of memory owned by the arena
+struct ArenaChunk final {
+  /// Chunk memory
+  std::unique_ptr<std::uint8_t[]> buffer;
+
+  /// Chunk size
+  std::size_t size{0U};
+};
+} // namespace
+
+/// Private class data
+struct EventArena::PrivateData final {
+  /// Default size for new chunks
+  std::size_t chunk_size{0U};
+
+  /// How much memory is kept when the arena is reset
+  std::size_t max_retained_size{0U};
+
+  /// The chunks owned by this arena
+  std::vector<ArenaChunk> chunk_list;
+
+  /// The chunk currently used for allocations
+  std::size_t current_chunk{0U};
+
+  /// How many bytes of the current chunk have been used
+  std::size_t current_offset{0U};
+
+  /// Bytes allocated from the chunks before the current one
+  std::size_t previous_chunks_used_size{0U};
+};
+
+EventArena::EventArena(std::size_t chunk_size, std::size_t max_retained_size)
+    : d(new PrivateData) {
+  d->chunk_size = std::max(chunk_size, static_cast<std::size_t>(64U));
+  d->max_retained_size = max_retained_size;
+}
+
+EventArena::~EventArena() {}
+
+void* EventArena::allocate(std::size_t size, std::size_t alignment) {
+  if (size == 0U) {
+    size = 1U;
+  }
+
+  // Try the current chunk first, then move to the next ones
+  while (d->current_chunk < d->chunk_list.size()) {
+    auto& chunk = d->chunk_list[d->current_chunk];
+
+    auto address = reinterpret_cast<std::uintptr_t>(chunk.buffer.get()) +
+                   d->current_offset;
+
+    auto padding = (alignment - (address % alignment)) % alignment;
+
+    if (d->current_offset + padding + size <= chunk.size) {
+      auto ptr = chunk.buffer.get() + d->current_offset + padding;
+      d->current_offset += padding + size;
+
+      return ptr;
+    }
+
+    d->previous_chunks_used_size += d->current_offset;
+    d->current_offset = 0U;
+    ++d->current_chunk;
+  }
+
+  // Allocations larger than a chunk get their own
+  ArenaChunk new_chunk;
+  new_chunk.size = std::max(d->chunk_size, size + alignment);
+  new_chunk.buffer.reset(new std::uint8_t[new_chunk.size]);
+
+  d->chunk_list.push_back(std::move(new_chunk));
+  d->current_chunk = d->chunk_list.size() - 1U;
+
+  return allocate(size, alignment);
+}
+
+void EventArena::reset() {
+  d->current_chunk = 0U;
+  d->current_offset = 0U;
+  d->previous_chunks_used_size = 0U;
+
+  if (reservedSize() <= d->max_retained_size) {
+    return;
+  }
+
+  // Keep the first chunks, up to the configured limit
+  std::size_t retained_size = 0U;
+  std::size_t retained_chunk_count = 0U;
+
+  for (const auto& chunk : d->chunk_list) {
+    if (retained_size + chunk.size > d->max_retained_size) {
+      break;
+    }
+
+    retained_size += chunk.size;
+    ++retained_chunk_count;
+  }
+
+  d->chunk_list.resize(retained_chunk_count);
+}
+
+std::size_t EventArena::usedSize() const {
+  return d->previous_chunks_used_size + d->current_offset;
+}
+
+std::size_t EventArena::reservedSize() const {
+  std::size_t reserved_size = 0U;
+  for (const auto& chunk : d->chunk_list) {
+    reserved_size += chunk.size;
+  }
+
+  return reserved_size;
+}
+} // namespace trailofbits
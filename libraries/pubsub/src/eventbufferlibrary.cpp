@@ -14,65 +14,163 @@
  * limitations under the License.
  */
 
+#include "circulareventbuffer.h"
+#include "eventbufferutils.h"
+#include "lockfreeeventbuffer.h"
+#include "sharedlogeventbuffer.h"
+
 #include <pubsub/eventbufferlibrary.h>
 
 #include <osquery/logger.h>
 
-#include <boost/circular_buffer.hpp>
 #include <boost/thread/shared_mutex.hpp>
 
 namespace trailofbits {
 namespace {
-/// This is the maximum amount of rows that will be saved in each buffer
-const std::size_t kCircularBufferSize = 4096U;
+/// A map of event buffer objects, organized by subscriber name
+using EventBufferMap = std::unordered_map<std::string, IEventBufferRef>;
+
+/// A map of buffer settings, organized by subscriber name
+using EventBufferSettingsMap =
+    std::unordered_map<std::string, EventBufferSettings>;
 
-using CircularBuffer = boost::circular_buffer<osquery::TableRowHolder>;
+/// A map of pressure states, organized by subscriber name; states are
+/// never removed, so that publishers can keep their references
+using EventBufferPressureStateMap =
+    std::unordered_map<std::string, EventBufferPressureStateRef>;
 
-/// An event buffer object
-struct EventBuffer final {
-  CircularBuffer data;
-  std::mutex mutex;
+/// Drop counters for a single buffer, as they were the last time the buffer
+/// has been drained
+struct EventBufferDropCounters final {
+  std::uint64_t overwritten_row_count{0U};
+  std::uint64_t rejected_row_count{0U};
 };
 
-/// A reference to an event buffer object
-using EventBufferRef = std::shared_ptr<EventBuffer>;
+/// A map of drop counters, organized by subscriber name
+using EventBufferDropCountersMap =
+    std::unordered_map<std::string, EventBufferDropCounters>;
+
+/// Creates a new event buffer using the given settings
+osquery::Status createEventBuffer(IEventBufferRef& event_buffer,
+                                  const EventBufferSettings& settings,
+                                  const std::string& buffer_name,
+                                  EventBufferPressureStateRef pressure_state) {
+  switch (settings.engine) {
+  case EventBufferEngine::CircularBuffer:
+    return CircularEventBuffer::create(
+        event_buffer, settings, buffer_name, std::move(pressure_state));
 
-/// A map of event buffer objects, organized by publisher name
-using EventBufferMap = std::unordered_map<std::string, EventBufferRef>;
+  case EventBufferEngine::LockFreeRing:
+    return LockFreeEventBuffer::create(
+        event_buffer, settings, buffer_name, std::move(pressure_state));
+
+  case EventBufferEngine::SharedLog:
+    return SharedLogEventBuffer::create(
+        event_buffer, settings, buffer_name, std::move(pressure_state));
+  }
+
+  return osquery::Status(1, "Invalid event buffer engine");
+}
+
+/// Returns the pressure state of the given buffer, creating it if necessary;
+/// the caller must hold the buffer map mutex in exclusive mode
+EventBufferPressureStateRef acquirePressureState(
+    const std::string& buffer_name,
+    EventBufferPressureStateMap& pressure_state_map) {
+  auto& pressure_state = pressure_state_map[buffer_name];
+  if (!pressure_state) {
+    pressure_state =
+        std::make_shared<EventBufferPressureState>(EventBufferPressure::Low);
+  }
+
+  return pressure_state;
+}
 
 /// Returns a named buffer object
-EventBufferRef getEventBuffer(const std::string& buffer_name,
-                              EventBufferMap& buffer_map,
-                              boost::shared_timed_mutex& mutex) {
-  boost::upgrade_lock<boost::shared_timed_mutex> read_lock(mutex);
+IEventBufferRef getEventBuffer(const std::string& buffer_name,
+                               EventBufferMap& buffer_map,
+                               const EventBufferSettingsMap& settings_map,
+                               EventBufferPressureStateMap& pressure_state_map,
+                               boost::shared_timed_mutex& mutex) {
+  {
+    boost::shared_lock<boost::shared_timed_mutex> read_lock(mutex);
 
-  auto it = buffer_map.find(buffer_name);
-  if (it != buffer_map.end()) {
-    return it->second;
+    auto it = buffer_map.find(buffer_name);
+    if (it != buffer_map.end()) {
+      return it->second;
+    }
   }
 
   try {
-    boost::upgrade_to_unique_lock<boost::shared_timed_mutex> read_write_lock(
-        read_lock);
+    boost::unique_lock<boost::shared_timed_mutex> read_write_lock(mutex);
+
+    auto it = buffer_map.find(buffer_name);
+    if (it != buffer_map.end()) {
+      return it->second;
+    }
+
+    EventBufferSettings settings;
 
-    auto event_buffer = std::make_shared<EventBuffer>();
-    event_buffer->data.set_capacity(kCircularBufferSize);
+    auto settings_it = settings_map.find(buffer_name);
+    if (settings_it != settings_map.end()) {
+      settings = settings_it->second;
+    }
+
+    IEventBufferRef event_buffer;
+    auto status = createEventBuffer(
+        event_buffer,
+        settings,
+        buffer_name,
+        acquirePressureState(buffer_name, pressure_state_map));
+    if (!status.ok()) {
+      LOG(ERROR) << "Failed to create the event buffer named \""
+                 << buffer_name << "\": " << status.getMessage() << "\n";
+
+      return IEventBufferRef();
+    }
 
     buffer_map.insert({buffer_name, event_buffer});
     return event_buffer;
 
   } catch (const std::bad_alloc&) {
-    return EventBufferRef();
+    return IEventBufferRef();
   }
 }
 } // namespace
 
+const char kConsumerColumnName[] = "consumer";
+const char kSequenceColumnName[] = "sequence";
+
 /// Private class data
 struct EventBufferLibrary::PrivateData final {
   EventBufferMap buffer_map;
+  EventBufferSettingsMap settings_map;
+  EventBufferPressureStateMap pressure_state_map;
   boost::shared_timed_mutex buffer_map_mutex;
+
+  /// Used to report how many rows have been dropped between two reads
+  EventBufferDropCountersMap drop_counters_map;
+  std::mutex drop_counters_map_mutex;
 };
 
+bool EventBufferSettings::operator==(const EventBufferSettings& other) const {
+  return engine == other.engine && capacity == other.capacity &&
+         max_memory == other.max_memory &&
+         overflow_policy == other.overflow_policy &&
+         spill_directory == other.spill_directory &&
+         persistent == other.persistent &&
+         segment_size == other.segment_size &&
+         max_disk_usage == other.max_disk_usage &&
+         sync_interval == other.sync_interval &&
+         high_watermark == other.high_watermark &&
+         low_watermark == other.low_watermark &&
+         consumer_timeout == other.consumer_timeout;
+}
+
+bool EventBufferSettings::operator!=(const EventBufferSettings& other) const {
+  return !(*this == other);
+}
+
 EventBufferLibrary::EventBufferLibrary() : d(new PrivateData) {}
 
 EventBufferLibrary& EventBufferLibrary::instance() {
@@ -84,8 +182,11 @@ EventBufferLibrary::~EventBufferLibrary() {}
 
 void EventBufferLibrary::saveEvents(EventBatch& events,
                                     const std::string& buffer_name) {
-  auto event_buffer_ref =
-      getEventBuffer(buffer_name, d->buffer_map, d->buffer_map_mutex);
+  auto event_buffer_ref = getEventBuffer(buffer_name,
+                                         d->buffer_map,
+                                         d->settings_map,
+                                         d->pressure_state_map,
+                                         d->buffer_map_mutex);
   if (!event_buffer_ref) {
     LOG(ERROR) << "Failed to acquire the event buffer named \"" << buffer_name
                << "\"\n";
@@ -93,16 +194,20 @@ void EventBufferLibrary::saveEvents(EventBatch& events,
     return;
   }
 
-  std::lock_guard<std::mutex> lock(event_buffer_ref->mutex);
-
-  std::move(
-      events.begin(), events.end(), std::back_inserter(event_buffer_ref->data));
-  events.clear();
+  event_buffer_ref->save(events);
 }
 
 EventBatch EventBufferLibrary::getEvents(const std::string& buffer_name) {
-  auto event_buffer_ref =
-      getEventBuffer(buffer_name, d->buffer_map, d->buffer_map_mutex);
+  return getEvents(buffer_name, EventReadRequest());
+}
+
+EventBatch EventBufferLibrary::getEvents(const std::string& buffer_name,
+                                         const EventReadRequest& request) {
+  auto event_buffer_ref = getEventBuffer(buffer_name,
+                                         d->buffer_map,
+                                         d->settings_map,
+                                         d->pressure_state_map,
+                                         d->buffer_map_mutex);
   if (!event_buffer_ref) {
     LOG(ERROR) << "Failed to acquire the event buffer named \"" << buffer_name
                << "\"\n";
@@ -110,18 +215,335 @@ EventBatch EventBufferLibrary::getEvents(const std::string& buffer_name) {
     return {};
   }
 
-  std::lock_guard<std::mutex> lock(event_buffer_ref->mutex);
+  auto event_batch = event_buffer_ref->read(request);
 
-  EventBatch event_batch;
-  event_batch.reserve(event_buffer_ref->data.size());
+  // Let the user know if the buffer could not keep up with the publisher
+  auto buffer_statistics = event_buffer_ref->statistics();
 
-  auto start = event_buffer_ref->data.begin();
-  auto element_count = static_cast<int>(event_buffer_ref->data.size());
-  auto end = std::next(start, element_count);
+  EventBufferDropCounters last_drop_counters;
 
-  std::move(start, end, std::back_inserter(event_batch));
-  event_buffer_ref->data.clear();
+  {
+    std::lock_guard<std::mutex> lock(d->drop_counters_map_mutex);
+
+    auto& drop_counters = d->drop_counters_map[buffer_name];
+    last_drop_counters = drop_counters;
+
+    drop_counters.overwritten_row_count =
+        buffer_statistics.overwritten_row_count;
+    drop_counters.rejected_row_count = buffer_statistics.rejected_row_count;
+  }
+
+  // The counters start from zero again when the buffer is reconfigured
+  auto dropped_row_count = (buffer_statistics.overwritten_row_count +
+                            buffer_statistics.rejected_row_count);
+
+  auto last_dropped_row_count = (last_drop_counters.overwritten_row_count +
+                                 last_drop_counters.rejected_row_count);
+
+  if (dropped_row_count > last_dropped_row_count) {
+    LOG(WARNING) << "The event buffer named \"" << buffer_name
+                 << "\" has dropped "
+                 << (dropped_row_count - last_dropped_row_count)
+                 << " rows since it was last read; consider increasing its "
+                    "capacity or querying it more often";
+  }
 
   return event_batch;
 }
+
+osquery::Status EventBufferLibrary::configureBuffer(
+    const std::string& buffer_name, const EventBufferSettings& settings) {
+  {
+    boost::shared_lock<decltype(d->buffer_map_mutex)> lock(
+        d->buffer_map_mutex);
+
+    auto it = d->settings_map.find(buffer_name);
+    auto current_settings =
+        (it != d->settings_map.end()) ? it->second : EventBufferSettings();
+
+    if (current_settings == settings) {
+      return osquery::Status(0);
+    }
+  }
+
+  // Drain the current buffer first, so that the new one will not find the
+  // segments it has written to disk
+  IEventBufferRef old_event_buffer;
+
+  {
+    boost::shared_lock<decltype(d->buffer_map_mutex)> lock(
+        d->buffer_map_mutex);
+
+    auto it = d->buffer_map.find(buffer_name);
+    if (it != d->buffer_map.end()) {
+      old_event_buffer = it->second;
+    }
+  }
+
+  EventBatch pending_events;
+  if (old_event_buffer) {
+    pending_events = old_event_buffer->get();
+  }
+
+  auto pressure_state = pressureState(buffer_name);
+  if (!pressure_state) {
+    if (old_event_buffer) {
+      old_event_buffer->save(pending_events);
+    }
+
+    return osquery::Status(1, "Memory allocation failure");
+  }
+
+  IEventBufferRef new_event_buffer;
+  auto status = createEventBuffer(
+      new_event_buffer, settings, buffer_name, std::move(pressure_state));
+  if (!status.ok()) {
+    if (old_event_buffer) {
+      old_event_buffer->save(pending_events);
+    }
+
+    return status;
+  }
+
+  try {
+    boost::unique_lock<decltype(d->buffer_map_mutex)> lock(
+        d->buffer_map_mutex);
+
+    d->settings_map[buffer_name] = settings;
+
+    auto it = d->buffer_map.find(buffer_name);
+    if (it != d->buffer_map.end()) {
+      old_event_buffer = std::move(it->second);
+      it->second = new_event_buffer;
+
+    } else {
+      d->buffer_map.insert({buffer_name, new_event_buffer});
+    }
+
+  } catch (const std::bad_alloc&) {
+    return osquery::Status(1, "Memory allocation failure");
+  }
+
+  // Publishers that acquired the old buffer right before the swap may still
+  // be writing to it; what we can't see here is lost, as it would have been
+  // if the buffer had been drained by a query
+  if (old_event_buffer) {
+    auto last_events = old_event_buffer->get();
+    old_event_buffer.reset();
+
+    std::move(last_events.begin(),
+              last_events.end(),
+              std::back_inserter(pending_events));
+  }
+
+  new_event_buffer->save(pending_events);
+
+  {
+    std::lock_guard<std::mutex> lock(d->drop_counters_map_mutex);
+    d->drop_counters_map.erase(buffer_name);
+  }
+
+  return osquery::Status(0);
+}
+
+osquery::Status EventBufferLibrary::parseSettings(
+    EventBufferSettings& settings, const json11::Json& configuration) {
+  settings = {};
+
+  if (configuration.is_null()) {
+    return osquery::Status(0);
+  }
+
+  if (!configuration.is_object()) {
+    return osquery::Status(1, "The buffer configuration must be an object");
+  }
+
+  const auto& engine_obj = configuration["engine"];
+  if (!engine_obj.is_null()) {
+    const auto& engine = engine_obj.string_value();
+
+    if (engine == "circular_buffer") {
+      settings.engine = EventBufferEngine::CircularBuffer;
+    } else if (engine == "lock_free_ring") {
+      settings.engine = EventBufferEngine::LockFreeRing;
+    } else if (engine == "shared_log") {
+      settings.engine = EventBufferEngine::SharedLog;
+    } else {
+      return osquery::Status(1, "Invalid 'engine' value: " + engine);
+    }
+  }
+
+  auto status =
+      getSizeSetting(settings.capacity, configuration, "capacity", 1U);
+  if (!status.ok()) {
+    return status;
+  }
+
+  status = getSizeSetting(settings.max_memory, configuration, "max_memory");
+  if (!status.ok()) {
+    return status;
+  }
+
+  const auto& overflow_policy_obj = configuration["overflow_policy"];
+  if (!overflow_policy_obj.is_null()) {
+    const auto& overflow_policy = overflow_policy_obj.string_value();
+
+    if (overflow_policy == "drop_oldest") {
+      settings.overflow_policy = EventBufferOverflowPolicy::DropOldest;
+    } else if (overflow_policy == "drop_newest") {
+      settings.overflow_policy = EventBufferOverflowPolicy::DropNewest;
+    } else if (overflow_policy == "spill_to_disk") {
+      settings.overflow_policy = EventBufferOverflowPolicy::SpillToDisk;
+    } else {
+      return osquery::Status(
+          1, "Invalid 'overflow_policy' value: " + overflow_policy);
+    }
+  }
+
+  settings.spill_directory = configuration["spill_directory"].string_value();
+
+  if (settings.overflow_policy == EventBufferOverflowPolicy::SpillToDisk &&
+      settings.spill_directory.empty()) {
+    return osquery::Status(1,
+                           "The 'spill_to_disk' overflow policy requires the "
+                           "'spill_directory' value");
+  }
+
+  const auto& persistent_obj = configuration["persistent"];
+  if (!persistent_obj.is_null()) {
+    if (!persistent_obj.is_bool()) {
+      return osquery::Status(1, "The 'persistent' value must be a boolean");
+    }
+
+    settings.persistent = persistent_obj.bool_value();
+  }
+
+  if (settings.persistent && settings.spill_directory.empty()) {
+    return osquery::Status(
+        1, "Persistent buffers require the 'spill_directory' value");
+  }
+
+  if (settings.engine == EventBufferEngine::SharedLog &&
+      (settings.persistent ||
+       settings.overflow_policy == EventBufferOverflowPolicy::SpillToDisk)) {
+    return osquery::Status(
+        1, "The 'shared_log' engine can't be spilled to disk or persisted");
+  }
+
+  status = getSizeSetting(
+      settings.segment_size, configuration, "segment_size", 1U);
+  if (!status.ok()) {
+    return status;
+  }
+
+  status =
+      getSizeSetting(settings.max_disk_usage, configuration, "max_disk_usage");
+  if (!status.ok()) {
+    return status;
+  }
+
+  status =
+      getSizeSetting(settings.sync_interval, configuration, "sync_interval");
+  if (!status.ok()) {
+    return status;
+  }
+
+  status =
+      getSizeSetting(settings.high_watermark, configuration, "high_watermark");
+  if (!status.ok()) {
+    return status;
+  }
+
+  status =
+      getSizeSetting(settings.low_watermark, configuration, "low_watermark");
+  if (!status.ok()) {
+    return status;
+  }
+
+  status = getSizeSetting(
+      settings.consumer_timeout, configuration, "consumer_timeout");
+  if (!status.ok()) {
+    return status;
+  }
+
+  if (settings.high_watermark > 100U ||
+      settings.low_watermark >= settings.high_watermark) {
+    return osquery::Status(1,
+                           "The watermarks must be percentages, and the "
+                           "'low_watermark' value must be lower than the "
+                           "'high_watermark' one");
+  }
+
+  return osquery::Status(0);
+}
+
+EventBufferStatisticsMap EventBufferLibrary::statistics() {
+  std::vector<std::pair<std::string, IEventBufferRef>> buffer_list;
+
+  {
+    boost::shared_lock<decltype(d->buffer_map_mutex)> lock(
+        d->buffer_map_mutex);
+
+    buffer_list.assign(d->buffer_map.begin(), d->buffer_map.end());
+  }
+
+  EventBufferStatisticsMap statistics_map;
+  for (const auto& p : buffer_list) {
+    statistics_map.insert({p.first, p.second->statistics()});
+  }
+
+  return statistics_map;
+}
+
+EventBufferPressure EventBufferLibrary::pressure(
+    const std::string& buffer_name) {
+  boost::shared_lock<decltype(d->buffer_map_mutex)> lock(d->buffer_map_mutex);
+
+  auto it = d->pressure_state_map.find(buffer_name);
+  if (it == d->pressure_state_map.end()) {
+    return EventBufferPressure::Low;
+  }
+
+  return it->second->load(std::memory_order_relaxed);
+}
+
+EventBufferPressureStateRef EventBufferLibrary::pressureState(
+    const std::string& buffer_name) {
+  {
+    boost::shared_lock<decltype(d->buffer_map_mutex)> lock(
+        d->buffer_map_mutex);
+
+    auto it = d->pressure_state_map.find(buffer_name);
+    if (it != d->pressure_state_map.end()) {
+      return it->second;
+    }
+  }
+
+  try {
+    boost::unique_lock<decltype(d->buffer_map_mutex)> lock(
+        d->buffer_map_mutex);
+
+    return acquirePressureState(buffer_name, d->pressure_state_map);
+
+  } catch (const std::bad_alloc&) {
+    return nullptr;
+  }
+}
+
+void EventBufferLibrary::flush() {
+  std::vector<IEventBufferRef> buffer_list;
+
+  {
+    boost::shared_lock<decltype(d->buffer_map_mutex)> lock(
+        d->buffer_map_mutex);
+
+    for (const auto& p : d->buffer_map) {
+      buffer_list.push_back(p.second);
+    }
+  }
+
+  for (auto& event_buffer : buffer_list) {
+    event_buffer->flush();
+  }
+}
 } // namespace trailofbits
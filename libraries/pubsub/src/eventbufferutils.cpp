@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "eventbufferutils.h"
+
+#include "sharedtablerow.h"
+
+#include <pubsub/lazytablerow.h>
+
+#include <algorithm>
+
+namespace trailofbits {
+namespace {
+/// Approximate overhead of a row object, excluding its columns
+const std::size_t kRowOverhead = 64U;
+
+/// Approximate overhead of a single column (map node and string objects)
+const std::size_t kColumnOverhead = 96U;
+} // namespace
+
+std::size_t estimateRowSize(const osquery::TableRow& row) {
+  // Avoid materializing rows that can report their own size
+  auto lazy_row = dynamic_cast<const LazyTableRow*>(&row);
+  if (lazy_row != nullptr) {
+    auto row_size = lazy_row->estimatedSize();
+    if (row_size != 0U) {
+      return row_size;
+    }
+  }
+
+  auto row_data = static_cast<osquery::Row>(row);
+
+  auto row_size = kRowOverhead;
+  for (const auto& p : row_data) {
+    row_size += kColumnOverhead + p.first.size() + p.second.size();
+  }
+
+  return row_size;
+}
+
+std::size_t updateAverageRowSize(std::size_t average_row_size,
+                                 std::size_t row_size) {
+  if (average_row_size == 0U) {
+    return row_size;
+  }
+
+  return ((average_row_size * 7U) + row_size) / 8U;
+}
+
+std::size_t getRowLimit(const EventBufferSettings& settings,
+                        std::size_t capacity,
+                        std::size_t average_row_size) {
+  if (settings.max_memory == 0U || average_row_size == 0U) {
+    return capacity;
+  }
+
+  auto memory_row_limit = settings.max_memory / average_row_size;
+  return std::max<std::size_t>(1U, std::min(capacity, memory_row_limit));
+}
+
+void updatePressureState(EventBufferPressureState& pressure_state,
+                         const EventBufferSettings& settings,
+                         std::size_t unread_row_count,
+                         std::size_t row_limit,
+                         std::size_t disk_usage) {
+  // Spilling buffers are always full in memory; what matters is how much
+  // room is left on disk
+  std::size_t fill_level = 0U;
+
+  if (settings.overflow_policy == EventBufferOverflowPolicy::SpillToDisk) {
+    if (settings.max_disk_usage != 0U) {
+      fill_level = static_cast<std::size_t>(
+          (static_cast<double>(disk_usage) * 100.0) /
+          static_cast<double>(settings.max_disk_usage));
+    }
+
+  } else if (row_limit != 0U) {
+    fill_level = (unread_row_count * 100U) / row_limit;
+  }
+
+  auto pressure = EventBufferPressure::Normal;
+  if (fill_level >= settings.high_watermark) {
+    pressure = EventBufferPressure::High;
+  } else if (fill_level <= settings.low_watermark) {
+    pressure = EventBufferPressure::Low;
+  }
+
+  // Only write when crossing a watermark, so that publishers polling the
+  // state do not keep losing the cache line
+  if (pressure_state.load(std::memory_order_relaxed) != pressure) {
+    pressure_state.store(pressure, std::memory_order_relaxed);
+  }
+}
+
+void setRowConsumer(EventBatch& events, const std::string& consumer) {
+  if (consumer.empty()) {
+    return;
+  }
+
+  auto shared_consumer = std::make_shared<const std::string>(consumer);
+
+  for (auto& row : events) {
+    row.reset(new SharedTableRow(
+        SharedTableRowData(row.release()), 0U, false, shared_consumer));
+  }
+}
+
+osquery::Status createSegmentLog(EventSegmentLogRef& segment_log,
+                                 const EventBufferSettings& settings,
+                                 const std::string& buffer_name) {
+  segment_log.reset();
+
+  if (settings.overflow_policy != EventBufferOverflowPolicy::SpillToDisk &&
+      !settings.persistent) {
+    return osquery::Status(0);
+  }
+
+  return EventSegmentLog::create(
+      segment_log, settings.spill_directory, buffer_name, settings);
+}
+} // namespace trailofbits
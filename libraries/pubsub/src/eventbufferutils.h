@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "eventsegmentlog.h"
+
+#include <pubsub/eventbufferlibrary.h>
+#include <pubsub/settingsutils.h>
+
+namespace trailofbits {
+/// Returns the approximate amount of memory used by the given row
+std::size_t estimateRowSize(const osquery::TableRow& row);
+
+/// Updates the running average of the row size with a new sample
+std::size_t updateAverageRowSize(std::size_t average_row_size,
+                                 std::size_t row_size);
+
+/// Returns how many rows can be kept in memory with the given settings
+std::size_t getRowLimit(const EventBufferSettings& settings,
+                        std::size_t capacity,
+                        std::size_t average_row_size);
+
+/// Publishes the pressure of a buffer. Buffers that spill to disk are
+/// measured against their max_disk_usage, the other ones against their row
+/// limit
+void updatePressureState(EventBufferPressureState& pressure_state,
+                         const EventBufferSettings& settings,
+                         std::size_t unread_row_count,
+                         std::size_t row_limit,
+                         std::size_t disk_usage);
+
+/// Adds the consumer column to rows read from buffers that only support a
+/// single consumer, so that they still satisfy the query constraints
+void setRowConsumer(EventBatch& events, const std::string& consumer);
+
+/// Creates the segment log used to spill or persist rows; no log is created
+/// when the settings do not need one
+osquery::Status createSegmentLog(EventSegmentLogRef& segment_log,
+                                 const EventBufferSettings& settings,
+                                 const std::string& buffer_name);
+} // namespace trailofbits
@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pubsub/eventcolumnbatch.h>
+#include <pubsub/lazytablerow.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace trailofbits {
+namespace {
+/// A table row that is converted from its batch only when osquery reads it
+class ColumnarTableRow final : public LazyTableRow {
+  /// The batch containing the row data
+  EventColumnBatchRef batch;
+
+  /// Row index inside the batch
+  std::size_t row_index{0U};
+
+ protected:
+  virtual osquery::Row materialize() const override {
+    return batch->materializeRow(row_index);
+  }
+
+ public:
+  /// Constructor
+  ColumnarTableRow(EventColumnBatchRef batch_, std::size_t row_index_)
+      : batch(std::move(batch_)), row_index(row_index_) {}
+
+  /// Destructor
+  virtual ~ColumnarTableRow() override = default;
+
+  virtual bool columnValue(std::string& value,
+                           const std::string& column_name) const override {
+    auto column =
+        EventColumnBatch::columnIndex(batch->tableSchema(), column_name);
+
+    if (column == EventColumnBatch::kInvalidColumn) {
+      return false;
+    }
+
+    auto cell_type = batch->cellType(row_index, column);
+    if (cell_type == EventColumnBatch::CellType::Null) {
+      return false;
+    }
+
+    value = batch->stringValue(row_index, column);
+    return true;
+  }
+
+  virtual std::size_t estimatedSize() const override {
+    return sizeof(ColumnarTableRow) +
+           batch->memoryUsage() / std::max<std::size_t>(batch->rowCount(), 1U);
+  }
+};
+} // namespace
+
+const std::size_t EventColumnBatch::kInvalidColumn;
+
+EventColumnBatch::EventColumnBatch(const osquery::TableColumns& schema_)
+    : schema(&schema_), column_list(schema_.size()) {}
+
+EventColumnBatch::Cell& EventColumnBatch::cell(std::size_t row,
+                                               std::size_t column) {
+  return column_list.at(column).at(row);
+}
+
+const EventColumnBatch::Cell& EventColumnBatch::cell(
+    std::size_t row, std::size_t column) const {
+  return column_list.at(column).at(row);
+}
+
+osquery::Status EventColumnBatch::create(EventColumnBatchRef& obj,
+                                         const osquery::TableColumns& schema) {
+  obj.reset();
+
+  try {
+    auto ptr = new EventColumnBatch(schema);
+    obj.reset(ptr);
+
+    return osquery::Status(0);
+
+  } catch (const std::bad_alloc&) {
+    return osquery::Status(1, "Memory allocation failure");
+  }
+}
+
+std::size_t EventColumnBatch::columnIndex(const osquery::TableColumns& schema,
+                                          const std::string& name) {
+  for (std::size_t i = 0U; i < schema.size(); ++i) {
+    if (std::get<0>(schema[i]) == name) {
+      return i;
+    }
+  }
+
+  return kInvalidColumn;
+}
+
+std::size_t EventColumnBatch::addRow() {
+  for (auto& column : column_list) {
+    column.emplace_back();
+  }
+
+  return row_count++;
+}
+
+void EventColumnBatch::copyRow(std::size_t destination_row,
+                               std::size_t source_row) {
+  for (auto& column : column_list) {
+    column.at(destination_row) = column.at(source_row);
+  }
+}
+
+void EventColumnBatch::setInteger(std::size_t row,
+                                  std::size_t column,
+                                  std::int64_t value) {
+  auto& current_cell = cell(row, column);
+  current_cell.type = CellType::Integer;
+  current_cell.length = 0U;
+  current_cell.value = static_cast<std::uint64_t>(value);
+}
+
+void EventColumnBatch::setText(std::size_t row,
+                               std::size_t column,
+                               const char* value,
+                               std::size_t length) {
+  auto& current_cell = cell(row, column);
+  current_cell.type = CellType::Text;
+  current_cell.length = static_cast<std::uint32_t>(length);
+  current_cell.value = text_pool.size();
+
+  text_pool.append(value, length);
+}
+
+void EventColumnBatch::setText(std::size_t row,
+                               std::size_t column,
+                               const std::string& value) {
+  setText(row, column, value.data(), value.size());
+}
+
+void EventColumnBatch::setText(std::size_t row,
+                               std::size_t column,
+                               const char* value) {
+  setText(row, column, value, std::strlen(value));
+}
+
+EventColumnBatch::CellType EventColumnBatch::cellType(
+    std::size_t row, std::size_t column) const {
+  return cell(row, column).type;
+}
+
+std::int64_t EventColumnBatch::integerValue(std::size_t row,
+                                            std::size_t column) const {
+  const auto& current_cell = cell(row, column);
+  if (current_cell.type != CellType::Integer) {
+    return 0;
+  }
+
+  return static_cast<std::int64_t>(current_cell.value);
+}
+
+std::string EventColumnBatch::textValue(std::size_t row,
+                                        std::size_t column) const {
+  const auto& current_cell = cell(row, column);
+  if (current_cell.type != CellType::Text) {
+    return std::string();
+  }
+
+  return text_pool.substr(static_cast<std::size_t>(current_cell.value),
+                          current_cell.length);
+}
+
+std::string EventColumnBatch::stringValue(std::size_t row,
+                                          std::size_t column) const {
+  switch (cellType(row, column)) {
+  case CellType::Integer:
+    return std::to_string(integerValue(row, column));
+
+  case CellType::Text:
+    return textValue(row, column);
+
+  case CellType::Null:
+    break;
+  }
+
+  return std::string();
+}
+
+osquery::Row EventColumnBatch::materializeRow(std::size_t row) const {
+  osquery::Row row_data;
+
+  for (std::size_t column = 0U; column < column_list.size(); ++column) {
+    if (cellType(row, column) == CellType::Null) {
+      continue;
+    }
+
+    row_data.insert(
+        {std::get<0>(schema->at(column)), stringValue(row, column)});
+  }
+
+  return row_data;
+}
+
+std::size_t EventColumnBatch::rowCount() const {
+  return row_count;
+}
+
+std::size_t EventColumnBatch::memoryUsage() const {
+  return sizeof(EventColumnBatch) + text_pool.capacity() +
+         column_list.size() * row_count * sizeof(Cell);
+}
+
+const osquery::TableColumns& EventColumnBatch::tableSchema() const {
+  return *schema;
+}
+
+void EventColumnBatch::appendTableRows(osquery::TableRows& table_rows,
+                                       const EventColumnBatchRef& batch) {
+  table_rows.reserve(table_rows.size() + batch->rowCount());
+
+  for (std::size_t i = 0U; i < batch->rowCount(); ++i) {
+    table_rows.push_back(
+        osquery::TableRowHolder(new ColumnarTableRow(batch, i)));
+  }
+}
+} // namespace trailofbits
@@ -0,0 +1,282 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pubsub/eventrowfilter.h>
+#include <pubsub/lazytablerow.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+
+namespace trailofbits {
+namespace {
+/// The constraints that can be evaluated inside the extension
+const osquery::ConstraintOperator kSupportedOperatorList[] = {
+    osquery::EQUALS,
+    osquery::GREATER_THAN,
+    osquery::GREATER_THAN_OR_EQUALS,
+    osquery::LESS_THAN,
+    osquery::LESS_THAN_OR_EQUALS,
+    osquery::LIKE};
+
+/// Returns true if values of this column type are compared as numbers
+bool isNumericColumnType(osquery::ColumnType column_type) {
+  switch (column_type) {
+  case osquery::INTEGER_TYPE:
+  case osquery::BIGINT_TYPE:
+  case osquery::UNSIGNED_BIGINT_TYPE:
+  case osquery::DOUBLE_TYPE:
+    return true;
+
+  default:
+    return false;
+  }
+}
+
+/// Converts the whole string to a number
+bool parseNumber(double& number, const std::string& value) {
+  if (value.empty()) {
+    return false;
+  }
+
+  errno = 0;
+  char* end_ptr = nullptr;
+  number = std::strtod(value.c_str(), &end_ptr);
+
+  return errno == 0 && end_ptr == value.c_str() + value.size();
+}
+
+/// Lowercases a single ASCII character; LIKE ignores the case of ASCII
+/// characters only
+char toLowerAscii(char c) {
+  if (c >= 'A' && c <= 'Z') {
+    return static_cast<char>(c - 'A' + 'a');
+  }
+
+  return c;
+}
+
+/// Returns the index following the UTF-8 character that starts at `index`;
+/// like SQLite, the continuation bytes are consumed without validating the
+/// sequence
+std::size_t nextUtf8Character(const std::string& value, std::size_t index) {
+  ++index;
+
+  while (index < value.size() &&
+         (static_cast<unsigned char>(value[index]) & 0xC0U) == 0x80U) {
+    ++index;
+  }
+
+  return index;
+}
+
+/// Returns the result of a comparison, as an operator would report it
+bool compareResult(osquery::ConstraintOperator constraint_operator,
+                   int comparison) {
+  switch (constraint_operator) {
+  case osquery::EQUALS:
+    return comparison == 0;
+
+  case osquery::GREATER_THAN:
+    return comparison > 0;
+
+  case osquery::GREATER_THAN_OR_EQUALS:
+    return comparison >= 0;
+
+  case osquery::LESS_THAN:
+    return comparison < 0;
+
+  case osquery::LESS_THAN_OR_EQUALS:
+    return comparison <= 0;
+
+  default:
+    return true;
+  }
+}
+} // namespace
+
+bool EventRowFilter::evaluate(const Predicate& predicate,
+                              const std::string& value) {
+  if (predicate.constraint_operator == osquery::LIKE) {
+    return matchLikePattern(value, predicate.value);
+  }
+
+  if (isNumericColumnType(predicate.column_type)) {
+    double row_number = 0.0;
+    double constraint_number = 0.0;
+
+    // Let SQLite decide what happens with values that are not numbers
+    if (!parseNumber(row_number, value) ||
+        !parseNumber(constraint_number, predicate.value)) {
+      return true;
+    }
+
+    auto comparison = (row_number < constraint_number)
+                          ? -1
+                          : ((row_number > constraint_number) ? 1 : 0);
+
+    return compareResult(predicate.constraint_operator, comparison);
+  }
+
+  return compareResult(predicate.constraint_operator,
+                       value.compare(predicate.value));
+}
+
+osquery::Status EventRowFilter::create(EventRowFilterRef& obj,
+                                       const osquery::QueryContext& context,
+                                       const osquery::TableColumns& schema) {
+  obj.reset();
+
+  try {
+    EventRowFilterRef filter(new EventRowFilter());
+
+    for (const auto& column : schema) {
+      const auto& column_name = std::get<0>(column);
+
+      auto constraint_it = context.constraints.find(column_name);
+      if (constraint_it == context.constraints.end() ||
+          !constraint_it->second.exists()) {
+        continue;
+      }
+
+      for (auto constraint_operator : kSupportedOperatorList) {
+        for (const auto& value :
+             constraint_it->second.getAll(constraint_operator)) {
+          Predicate predicate;
+          predicate.column_name = column_name;
+          predicate.column_type = std::get<1>(column);
+          predicate.constraint_operator = constraint_operator;
+          predicate.value = value;
+
+          filter->predicate_list.push_back(std::move(predicate));
+        }
+      }
+    }
+
+    obj = std::move(filter);
+    return osquery::Status(0);
+
+  } catch (const std::bad_alloc&) {
+    return osquery::Status(1, "Memory allocation failure");
+  }
+}
+
+bool EventRowFilter::empty() const {
+  return predicate_list.empty();
+}
+
+bool EventRowFilter::matches(const osquery::TableRow& row) const {
+  std::string value;
+  const std::string* current_column_name = nullptr;
+  bool value_found = false;
+
+  for (const auto& predicate : predicate_list) {
+    // Predicates are grouped by column; only fetch each value once
+    if (current_column_name == nullptr ||
+        *current_column_name != predicate.column_name) {
+      current_column_name = &predicate.column_name;
+      value_found = getColumnValue(value, row, predicate.column_name);
+    }
+
+    // NULL values never satisfy a comparison
+    if (!value_found || !evaluate(predicate, value)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void EventRowFilter::apply(EventBatch& rows) const {
+  if (empty()) {
+    return;
+  }
+
+  auto new_end = std::remove_if(
+      rows.begin(), rows.end(), [this](const osquery::TableRowHolder& row) {
+        return !matches(*row);
+      });
+
+  rows.erase(new_end, rows.end());
+}
+
+bool EventRowFilter::matchLikePattern(const std::string& value,
+                                      const std::string& pattern) {
+  std::size_t value_index = 0U;
+  std::size_t pattern_index = 0U;
+
+  // Where to resume when the last '%' has to consume one more character
+  auto wildcard_pattern_index = std::string::npos;
+  std::size_t wildcard_value_index = 0U;
+
+  while (value_index < value.size()) {
+    if (pattern_index < pattern.size()) {
+      auto pattern_char = pattern[pattern_index];
+
+      if (pattern_char == '%') {
+        wildcard_pattern_index = pattern_index;
+        wildcard_value_index = value_index;
+        ++pattern_index;
+        continue;
+      }
+
+      // SQLite matches '_' against a whole UTF-8 character
+      if (pattern_char == '_') {
+        ++pattern_index;
+        value_index = nextUtf8Character(value, value_index);
+        continue;
+      }
+
+      if (toLowerAscii(pattern_char) == toLowerAscii(value[value_index])) {
+        ++pattern_index;
+        ++value_index;
+        continue;
+      }
+    }
+
+    if (wildcard_pattern_index == std::string::npos) {
+      return false;
+    }
+
+    wildcard_value_index = nextUtf8Character(value, wildcard_value_index);
+
+    pattern_index = wildcard_pattern_index + 1U;
+    value_index = wildcard_value_index;
+  }
+
+  while (pattern_index < pattern.size() && pattern[pattern_index] == '%') {
+    ++pattern_index;
+  }
+
+  return pattern_index == pattern.size();
+}
+
+void filterEventRows(EventBatch& rows,
+                     const osquery::QueryContext& context,
+                     const osquery::TableColumns& schema) {
+  if (rows.empty() || context.constraints.empty()) {
+    return;
+  }
+
+  EventRowFilterRef filter;
+  auto status = EventRowFilter::create(filter, context, schema);
+  if (!status.ok()) {
+    return;
+  }
+
+  filter->apply(rows);
+}
+} // namespace trailofbits
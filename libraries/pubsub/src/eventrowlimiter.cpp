@@ -0,0 +1,370 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "eventbufferutils.h"
+
+#include <pubsub/eventrowlimiter.h>
+#include <pubsub/lazytablerow.h>
+#include <pubsub/metricsregistry.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+namespace trailofbits {
+namespace {
+/// 2^53; hashes are reduced to 53 bits so that they can be compared with
+/// the sample rate without losing precision
+const double kSampleHashRange = 9007199254740992.0;
+
+/// Upper bound of the default burst, which is derived from the rate
+const double kMaxDefaultBurst = 4294967295.0;
+
+/// Bounds of the interval between two prunings of the token buckets
+const std::chrono::milliseconds kMinPruneInterval(100);
+const std::chrono::milliseconds kMaxPruneInterval(1000);
+
+/// A token bucket
+struct TokenBucket final {
+  /// Available tokens; each row consumes one
+  double tokens{0.0};
+
+  /// When the bucket has been refilled for the last time
+  std::chrono::steady_clock::time_point last_update;
+};
+
+/// FNV-1a hash, followed by the MurmurHash3 finalizer so that similar keys
+/// (i.e.: addresses in the same subnet) are spread over the whole range.
+/// Unlike std::hash, the result does not depend on the standard library, so
+/// all the hosts sample the same keys
+std::uint64_t hashKey(const std::string& key) {
+  std::uint64_t hash = 14695981039346656037ULL;
+
+  for (auto c : key) {
+    hash ^= static_cast<std::uint8_t>(c);
+    hash *= 1099511628211ULL;
+  }
+
+  hash ^= hash >> 33U;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33U;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33U;
+
+  return hash;
+}
+} // namespace
+
+bool EventRowLimiterSettings::enabled() const {
+  return sample_rate < 1.0 || rate > 0.0;
+}
+
+osquery::Status EventRowLimiterSettings::parse(
+    EventRowLimiterSettings& settings, const json11::Json& configuration) {
+  settings = {};
+
+  if (configuration.is_null()) {
+    return osquery::Status(0);
+  }
+
+  if (!configuration.is_object()) {
+    return osquery::Status(1, "The limits configuration must be an object");
+  }
+
+  settings.key_column = configuration["key_column"].string_value();
+
+  auto status =
+      getNumberSetting(settings.sample_rate, configuration, "sample_rate");
+  if (!status.ok()) {
+    return status;
+  }
+
+  if (settings.sample_rate > 1.0) {
+    return osquery::Status(
+        1, "The 'sample_rate' value must be between 0 and 1");
+  }
+
+  status = getNumberSetting(settings.rate, configuration, "rate");
+  if (!status.ok()) {
+    return status;
+  }
+
+  // By default, the bucket holds one second worth of rows
+  settings.burst =
+      static_cast<std::size_t>(std::min(settings.rate, kMaxDefaultBurst));
+
+  status = getSizeSetting(settings.burst, configuration, "burst");
+  if (!status.ok()) {
+    return status;
+  }
+
+  if (settings.rate > 0.0 && settings.burst == 0U) {
+    settings.burst = 1U;
+  }
+
+  status = getSizeSetting(
+      settings.max_key_count, configuration, "max_key_count", 1U);
+  if (!status.ok()) {
+    return status;
+  }
+
+  return osquery::Status(0);
+}
+
+bool EventRowLimiterSettings::operator==(
+    const EventRowLimiterSettings& other) const {
+  return key_column == other.key_column && sample_rate == other.sample_rate &&
+         rate == other.rate && burst == other.burst &&
+         max_key_count == other.max_key_count;
+}
+
+bool EventRowLimiterSettings::operator!=(
+    const EventRowLimiterSettings& other) const {
+  return !(*this == other);
+}
+
+/// Private class data
+struct EventRowLimiter::PrivateData final {
+  /// Settings
+  EventRowLimiterSettings settings;
+
+  /// Keys whose (reduced) hash is below this value are sampled
+  double sample_threshold{kSampleHashRange};
+
+  /// Mutex protecting the token buckets
+  mutable std::mutex mutex;
+
+  /// A token bucket for each key
+  std::unordered_map<std::string, TokenBucket> bucket_map;
+
+  /// The bucket shared by the keys that could not be tracked
+  TokenBucket overflow_bucket;
+
+  /// How long an empty bucket takes to fill up again; the buckets are not
+  /// pruned more often than this
+  std::chrono::steady_clock::duration prune_interval;
+
+  /// When the buckets can be pruned again
+  std::chrono::steady_clock::time_point next_prune_time;
+
+  /// Rows dropped by the sampling
+  StripedCounterRef sampled_out_row_count;
+
+  /// Rows dropped by the rate limiting
+  StripedCounterRef rate_limited_row_count;
+
+  /// Refills the given bucket, and takes a token from it if possible
+  bool consumeToken(TokenBucket& bucket,
+                    std::chrono::steady_clock::time_point now) const;
+
+  /// Removes the buckets that are full again, as they are no different
+  /// from new ones; does nothing if the buckets have been pruned less than
+  /// a refill interval ago
+  void pruneBuckets(std::chrono::steady_clock::time_point now);
+
+  /// Returns the bucket for the given key
+  TokenBucket& getBucket(const std::string& key,
+                         std::chrono::steady_clock::time_point now);
+};
+
+bool EventRowLimiter::PrivateData::consumeToken(
+    TokenBucket& bucket, std::chrono::steady_clock::time_point now) const {
+  if (now > bucket.last_update) {
+    std::chrono::duration<double> elapsed_time = now - bucket.last_update;
+
+    bucket.tokens =
+        std::min(static_cast<double>(settings.burst),
+                 bucket.tokens + elapsed_time.count() * settings.rate);
+
+    bucket.last_update = now;
+  }
+
+  if (bucket.tokens < 1.0) {
+    return false;
+  }
+
+  bucket.tokens -= 1.0;
+  return true;
+}
+
+void EventRowLimiter::PrivateData::pruneBuckets(
+    std::chrono::steady_clock::time_point now) {
+  // Scanning the whole map for every unseen key would serialize the
+  // publishers on the mutex while the map is full
+  if (now < next_prune_time) {
+    return;
+  }
+
+  next_prune_time = now + prune_interval;
+
+  auto burst = static_cast<double>(settings.burst);
+
+  for (auto it = bucket_map.begin(); it != bucket_map.end();) {
+    const auto& bucket = it->second;
+
+    std::chrono::duration<double> elapsed_time = now - bucket.last_update;
+    if (bucket.tokens + elapsed_time.count() * settings.rate >= burst) {
+      it = bucket_map.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+TokenBucket& EventRowLimiter::PrivateData::getBucket(
+    const std::string& key, std::chrono::steady_clock::time_point now) {
+  auto it = bucket_map.find(key);
+  if (it != bucket_map.end()) {
+    return it->second;
+  }
+
+  if (bucket_map.size() >= settings.max_key_count) {
+    pruneBuckets(now);
+
+    if (bucket_map.size() >= settings.max_key_count) {
+      return overflow_bucket;
+    }
+  }
+
+  TokenBucket bucket;
+  bucket.tokens = static_cast<double>(settings.burst);
+  bucket.last_update = now;
+
+  return bucket_map.insert({key, bucket}).first->second;
+}
+
+EventRowLimiter::EventRowLimiter(const std::string& subscriber_name,
+                                 const EventRowLimiterSettings& settings)
+    : d(new PrivateData) {
+  d->settings = settings;
+  d->sample_threshold = settings.sample_rate * kSampleHashRange;
+
+  d->overflow_bucket.tokens = static_cast<double>(settings.burst);
+  d->overflow_bucket.last_update = std::chrono::steady_clock::now();
+
+  if (settings.rate > 0.0) {
+    std::chrono::duration<double> refill_time(
+        static_cast<double>(settings.burst) / settings.rate);
+
+    if (refill_time < kMinPruneInterval) {
+      d->prune_interval = kMinPruneInterval;
+    } else if (refill_time > kMaxPruneInterval) {
+      d->prune_interval = kMaxPruneInterval;
+    } else {
+      d->prune_interval =
+          std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+              refill_time);
+    }
+  }
+
+  auto& metrics_registry = MetricsRegistry::instance();
+
+  d->sampled_out_row_count = metrics_registry.counter(
+      "subscriber", subscriber_name, "sampled_out_rows");
+
+  d->rate_limited_row_count = metrics_registry.counter(
+      "subscriber", subscriber_name, "rate_limited_rows");
+}
+
+osquery::Status EventRowLimiter::create(
+    EventRowLimiterRef& obj,
+    const std::string& subscriber_name,
+    const EventRowLimiterSettings& settings) {
+  try {
+    auto ptr = new EventRowLimiter(subscriber_name, settings);
+    obj.reset(ptr);
+
+    return osquery::Status(0);
+
+  } catch (const std::bad_alloc&) {
+    return osquery::Status(1, "Memory allocation failure");
+
+  } catch (const osquery::Status& status) {
+    return status;
+  }
+}
+
+EventRowLimiter::~EventRowLimiter() {}
+
+const EventRowLimiterSettings& EventRowLimiter::settings() const {
+  return d->settings;
+}
+
+void EventRowLimiter::apply(EventBatch& rows) {
+  apply(rows, std::chrono::steady_clock::now());
+}
+
+void EventRowLimiter::apply(EventBatch& rows,
+                            std::chrono::steady_clock::time_point now) {
+  if (!d->settings.enabled() || rows.empty()) {
+    return;
+  }
+
+  std::uint64_t sampled_out_row_count{0U};
+  std::uint64_t rate_limited_row_count{0U};
+
+  std::string key;
+
+  auto L_dropRow = [&](const osquery::TableRowHolder& row) -> bool {
+    key.clear();
+    if (!d->settings.key_column.empty()) {
+      getColumnValue(key, *row, d->settings.key_column);
+    }
+
+    if (!isSampled(key)) {
+      ++sampled_out_row_count;
+      return true;
+    }
+
+    if (d->settings.rate > 0.0 &&
+        !d->consumeToken(d->getBucket(key, now), now)) {
+      ++rate_limited_row_count;
+      return true;
+    }
+
+    return false;
+  };
+
+  {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    rows.erase(std::remove_if(rows.begin(), rows.end(), L_dropRow),
+               rows.end());
+  }
+
+  if (sampled_out_row_count != 0U) {
+    d->sampled_out_row_count->add(sampled_out_row_count);
+  }
+
+  if (rate_limited_row_count != 0U) {
+    d->rate_limited_row_count->add(rate_limited_row_count);
+  }
+}
+
+std::size_t EventRowLimiter::keyCount() const {
+  std::lock_guard<std::mutex> lock(d->mutex);
+  return d->bucket_map.size();
+}
+
+bool EventRowLimiter::isSampled(const std::string& key) const {
+  if (d->settings.sample_rate >= 1.0) {
+    return true;
+  }
+
+  auto reduced_hash = static_cast<double>(hashKey(key) >> 11U);
+  return reduced_hash < d->sample_threshold;
+}
+} // namespace trailofbits
@@ -0,0 +1,762 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "eventsegmentlog.h"
+
+#include <pubsub/lazytablerow.h>
+
+#include <osquery/logger.h>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace boostfs = boost::filesystem;
+
+namespace trailofbits {
+namespace {
+/// Every segment file starts with this signature
+const char kSegmentSignature[] = {'T', 'O', 'B', 'S', 'E', 'G', '0', '1'};
+
+/// Size of the segment header
+const std::size_t kSegmentHeaderSize = sizeof(kSegmentSignature);
+
+/// Size of the record checksum
+const std::size_t kChecksumSize = sizeof(std::uint32_t);
+
+/// Extension used for the segment files
+const std::string kSegmentExtension = ".seg";
+
+/// A read-only mapping of a segment file
+class MappedSegment final {
+  /// Mapping address
+  void* address{nullptr};
+
+  /// Mapping size
+  std::size_t size{0U};
+
+  /// Private constructor; use ::create() instead
+  MappedSegment(void* address_, std::size_t size_)
+      : address(address_), size(size_) {}
+
+ public:
+  /// Factory method
+  static osquery::Status create(std::shared_ptr<MappedSegment>& obj,
+                                const std::string& path,
+                                std::size_t size) {
+    obj.reset();
+
+    auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+      return osquery::Status(1,
+                             "Failed to open the segment file \"" + path +
+                                 "\": " + std::strerror(errno));
+    }
+
+    auto address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    auto error = errno;
+    close(fd);
+
+    if (address == MAP_FAILED) {
+      return osquery::Status(1,
+                             "Failed to map the segment file \"" + path +
+                                 "\": " + std::strerror(error));
+    }
+
+    // Rows are read in order, exactly once
+    madvise(address, size, MADV_SEQUENTIAL);
+
+    try {
+      obj.reset(new MappedSegment(address, size));
+      return osquery::Status(0);
+
+    } catch (const std::bad_alloc&) {
+      munmap(address, size);
+      return osquery::Status(1, "Memory allocation failure");
+    }
+  }
+
+  /// Destructor
+  ~MappedSegment() {
+    munmap(address, size);
+  }
+
+  /// Returns the start of the mapping
+  const std::uint8_t* begin() const {
+    return static_cast<const std::uint8_t*>(address);
+  }
+
+  /// Returns the end of the mapping
+  const std::uint8_t* end() const {
+    return begin() + size;
+  }
+
+  /// Disable the copy constructor
+  MappedSegment(const MappedSegment& other) = delete;
+
+  /// Disable the assignment operator
+  MappedSegment& operator=(const MappedSegment& other) = delete;
+};
+
+/// A reference to a MappedSegment object
+using MappedSegmentRef = std::shared_ptr<MappedSegment>;
+
+/// Appends an unsigned LEB128 integer to the given buffer
+void writeVarint(std::string& buffer, std::uint64_t value) {
+  while (value >= 0x80U) {
+    buffer.push_back(static_cast<char>((value & 0x7FU) | 0x80U));
+    value >>= 7U;
+  }
+
+  buffer.push_back(static_cast<char>(value));
+}
+
+/// Reads an unsigned LEB128 integer, advancing the given pointer
+bool readVarint(std::uint64_t& value,
+                const std::uint8_t*& ptr,
+                const std::uint8_t* end) {
+  value = 0U;
+
+  for (unsigned int shift = 0U; shift < 64U; shift += 7U) {
+    if (ptr >= end) {
+      return false;
+    }
+
+    auto byte = *ptr;
+    ++ptr;
+
+    value |= static_cast<std::uint64_t>(byte & 0x7FU) << shift;
+    if ((byte & 0x80U) == 0U) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/// Reads a length-prefixed string, advancing the given pointer
+bool readString(std::string& value,
+                const std::uint8_t*& ptr,
+                const std::uint8_t* end) {
+  std::uint64_t length = 0U;
+  if (!readVarint(length, ptr, end) ||
+      length > static_cast<std::uint64_t>(end - ptr)) {
+    return false;
+  }
+
+  auto string_size = static_cast<std::size_t>(length);
+  value.assign(reinterpret_cast<const char*>(ptr), string_size);
+  ptr += string_size;
+
+  return true;
+}
+
+/// FNV-1a hash, used to detect partially written records
+std::uint32_t computeChecksum(const std::uint8_t* data, std::size_t size) {
+  std::uint32_t checksum = 2166136261U;
+
+  for (std::size_t i = 0U; i < size; ++i) {
+    checksum ^= data[i];
+    checksum *= 16777619U;
+  }
+
+  return checksum;
+}
+
+/// Appends a record containing the given row to the buffer. Records are
+/// made of a varint payload size, a checksum and the payload; the payload
+/// is the column count followed by the length-prefixed names and values
+void encodeRecord(std::string& buffer,
+                  std::string& payload,
+                  const osquery::Row& row) {
+  payload.clear();
+  writeVarint(payload, row.size());
+
+  for (const auto& column : row) {
+    writeVarint(payload, column.first.size());
+    payload.append(column.first);
+
+    writeVarint(payload, column.second.size());
+    payload.append(column.second);
+  }
+
+  auto checksum = computeChecksum(
+      reinterpret_cast<const std::uint8_t*>(payload.data()), payload.size());
+
+  char checksum_bytes[kChecksumSize];
+  std::memcpy(checksum_bytes, &checksum, kChecksumSize);
+
+  writeVarint(buffer, payload.size());
+  buffer.append(checksum_bytes, kChecksumSize);
+  buffer.append(payload);
+}
+
+/// Locates the next record, advancing the given pointer; returns false if
+/// the record is incomplete or damaged
+bool nextRecord(const std::uint8_t*& payload,
+                std::size_t& payload_size,
+                const std::uint8_t*& ptr,
+                const std::uint8_t* end) {
+  std::uint64_t size = 0U;
+  if (!readVarint(size, ptr, end) ||
+      static_cast<std::uint64_t>(end - ptr) < kChecksumSize ||
+      size > static_cast<std::uint64_t>(end - ptr) - kChecksumSize) {
+    return false;
+  }
+
+  std::uint32_t checksum = 0U;
+  std::memcpy(&checksum, ptr, kChecksumSize);
+  ptr += kChecksumSize;
+
+  payload = ptr;
+  payload_size = static_cast<std::size_t>(size);
+  ptr += payload_size;
+
+  return computeChecksum(payload, payload_size) == checksum;
+}
+
+/// A row that is decoded from a mapped segment only when osquery reads it
+class MappedSegmentRow final : public LazyTableRow {
+  /// Keeps the mapping alive
+  MappedSegmentRef segment;
+
+  /// Start of the record payload
+  const std::uint8_t* payload{nullptr};
+
+  /// Size of the record payload
+  std::size_t payload_size{0U};
+
+ protected:
+  virtual osquery::Row materialize() const override {
+    osquery::Row row;
+
+    auto ptr = payload;
+    auto end = payload + payload_size;
+
+    std::uint64_t column_count = 0U;
+    if (!readVarint(column_count, ptr, end)) {
+      return row;
+    }
+
+    for (std::uint64_t i = 0U; i < column_count; ++i) {
+      std::string name;
+      std::string value;
+
+      if (!readString(name, ptr, end) || !readString(value, ptr, end)) {
+        break;
+      }
+
+      row.insert({std::move(name), std::move(value)});
+    }
+
+    return row;
+  }
+
+ public:
+  /// Constructor
+  MappedSegmentRow(MappedSegmentRef segment_,
+                   const std::uint8_t* payload_,
+                   std::size_t payload_size_)
+      : segment(std::move(segment_)),
+        payload(payload_),
+        payload_size(payload_size_) {}
+
+  /// Destructor
+  virtual ~MappedSegmentRow() override = default;
+
+  virtual bool columnValue(std::string& value,
+                           const std::string& column_name) const override {
+    auto ptr = payload;
+    auto end = payload + payload_size;
+
+    std::uint64_t column_count = 0U;
+    if (!readVarint(column_count, ptr, end)) {
+      return false;
+    }
+
+    std::string name;
+    for (std::uint64_t i = 0U; i < column_count; ++i) {
+      if (!readString(name, ptr, end) || !readString(value, ptr, end)) {
+        break;
+      }
+
+      if (name == column_name) {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  virtual std::size_t estimatedSize() const override {
+    return sizeof(MappedSegmentRow) + payload_size;
+  }
+};
+
+/// Returns the size of the valid part of the given segment, and how many
+/// rows it contains
+osquery::Status scanSegment(std::size_t& valid_size,
+                            std::size_t& row_count,
+                            const std::string& path,
+                            std::size_t size) {
+  valid_size = 0U;
+  row_count = 0U;
+
+  if (size < kSegmentHeaderSize) {
+    return osquery::Status(0);
+  }
+
+  MappedSegmentRef segment;
+  auto status = MappedSegment::create(segment, path, size);
+  if (!status.ok()) {
+    return status;
+  }
+
+  if (std::memcmp(segment->begin(), kSegmentSignature, kSegmentHeaderSize) !=
+      0) {
+    return osquery::Status(0);
+  }
+
+  auto ptr = segment->begin() + kSegmentHeaderSize;
+  valid_size = kSegmentHeaderSize;
+
+  while (ptr < segment->end()) {
+    const std::uint8_t* payload = nullptr;
+    std::size_t payload_size = 0U;
+
+    if (!nextRecord(payload, payload_size, ptr, segment->end())) {
+      break;
+    }
+
+    valid_size = static_cast<std::size_t>(ptr - segment->begin());
+    ++row_count;
+  }
+
+  return osquery::Status(0);
+}
+
+/// Writes the whole buffer to the given file descriptor
+osquery::Status writeBuffer(int fd, const std::string& buffer) {
+  std::size_t bytes_written = 0U;
+
+  while (bytes_written < buffer.size()) {
+    auto result = write(
+        fd, buffer.data() + bytes_written, buffer.size() - bytes_written);
+
+    if (result == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      return osquery::Status(1,
+                             std::string("Failed to write the segment file: ") +
+                                 std::strerror(errno));
+    }
+
+    bytes_written += static_cast<std::size_t>(result);
+  }
+
+  return osquery::Status(0);
+}
+} // namespace
+
+EventSegmentLog::EventSegmentLog(const std::string& directory_,
+                                 const EventBufferSettings& settings)
+    : directory(directory_),
+      persistent(settings.persistent),
+      segment_size(settings.segment_size),
+      max_disk_usage(settings.max_disk_usage),
+      sync_interval(static_cast<std::chrono::milliseconds::rep>(
+          settings.sync_interval)),
+      last_sync_time(std::chrono::steady_clock::now()) {}
+
+osquery::Status EventSegmentLog::loadSegments() {
+  std::vector<Segment> found_segment_list;
+
+  boost::system::error_code error;
+  for (boostfs::directory_iterator it(directory, error), end;
+       !error && it != end;
+       it.increment(error)) {
+    const auto& path = it->path();
+    if (path.extension().string() != kSegmentExtension) {
+      continue;
+    }
+
+    Segment segment;
+    segment.path = path.string();
+
+    try {
+      segment.id = std::stoull(path.stem().string());
+    } catch (...) {
+      continue;
+    }
+
+    next_segment_id = std::max(next_segment_id, segment.id + 1U);
+
+    if (!persistent) {
+      boostfs::remove(path, error);
+      continue;
+    }
+
+    auto file_size = boostfs::file_size(path, error);
+    if (error) {
+      return osquery::Status(1,
+                             "Failed to access the segment file \"" +
+                                 segment.path + "\": " + error.message());
+    }
+
+    auto status = scanSegment(segment.size,
+                              segment.row_count,
+                              segment.path,
+                              static_cast<std::size_t>(file_size));
+    if (!status.ok()) {
+      return status;
+    }
+
+    if (segment.row_count == 0U) {
+      boostfs::remove(path, error);
+      continue;
+    }
+
+    // Drop whatever was being written when the extension stopped
+    if (segment.size != file_size) {
+      LOG(WARNING) << "Truncating the damaged segment file \"" << segment.path
+                   << "\"";
+
+      if (truncate(segment.path.c_str(), static_cast<off_t>(segment.size)) !=
+          0) {
+        return osquery::Status(1,
+                               "Failed to truncate the segment file \"" +
+                                   segment.path + "\"");
+      }
+    }
+
+    found_segment_list.push_back(segment);
+  }
+
+  if (error) {
+    return osquery::Status(1,
+                           "Failed to enumerate the segment files in \"" +
+                               directory + "\": " + error.message());
+  }
+
+  std::sort(found_segment_list.begin(),
+            found_segment_list.end(),
+            [](const Segment& lhs, const Segment& rhs) -> bool {
+              return lhs.id < rhs.id;
+            });
+
+  for (const auto& segment : found_segment_list) {
+    row_count += segment.row_count;
+    disk_usage += segment.size;
+    segment_list.push_back(segment);
+  }
+
+  return osquery::Status(0);
+}
+
+osquery::Status EventSegmentLog::openActiveSegment() {
+  Segment segment;
+
+  // A log that is being replaced may still be writing in the same folder
+  for (;;) {
+    std::stringstream file_name;
+    file_name << std::setfill('0') << std::setw(20) << next_segment_id
+              << kSegmentExtension;
+
+    segment.id = next_segment_id;
+    segment.path = (boostfs::path(directory) / file_name.str()).string();
+    ++next_segment_id;
+
+    active_fd = open(segment.path.c_str(),
+                     O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                     S_IRUSR | S_IWUSR);
+
+    if (active_fd != -1) {
+      break;
+    }
+
+    if (errno != EEXIST) {
+      return osquery::Status(1,
+                             "Failed to create the segment file \"" +
+                                 segment.path + "\": " + std::strerror(errno));
+    }
+  }
+
+  auto status = writeBuffer(
+      active_fd, std::string(kSegmentSignature, kSegmentHeaderSize));
+
+  if (!status.ok()) {
+    close(active_fd);
+    active_fd = -1;
+
+    unlink(segment.path.c_str());
+    return status;
+  }
+
+  segment.size = kSegmentHeaderSize;
+  disk_usage += segment.size;
+
+  segment_list.push_back(segment);
+  return osquery::Status(0);
+}
+
+void EventSegmentLog::closeActiveSegment() {
+  if (active_fd == -1) {
+    return;
+  }
+
+  auto status = sync();
+  if (!status.ok()) {
+    LOG(ERROR) << status.getMessage();
+  }
+
+  close(active_fd);
+  active_fd = -1;
+}
+
+std::size_t EventSegmentLog::removeOldestSegment() {
+  auto segment = segment_list.front();
+  segment_list.pop_front();
+
+  unlink(segment.path.c_str());
+
+  row_count -= segment.row_count;
+  disk_usage -= segment.size;
+
+  return segment.row_count;
+}
+
+osquery::Status EventSegmentLog::create(EventSegmentLogRef& obj,
+                                        const std::string& directory,
+                                        const std::string& buffer_name,
+                                        const EventBufferSettings& settings) {
+  obj.reset();
+
+  if (directory.empty()) {
+    return osquery::Status(1, "The spill directory has not been set");
+  }
+
+  if (settings.segment_size == 0U) {
+    return osquery::Status(1, "Invalid segment size");
+  }
+
+  auto log_directory = (boostfs::path(directory) / buffer_name).string();
+
+  boost::system::error_code error;
+  boostfs::create_directories(log_directory, error);
+  if (error) {
+    return osquery::Status(1,
+                           "Failed to create the spill directory \"" +
+                               log_directory + "\": " + error.message());
+  }
+
+  try {
+    EventSegmentLogRef log(new EventSegmentLog(log_directory, settings));
+
+    auto status = log->loadSegments();
+    if (!status.ok()) {
+      return status;
+    }
+
+    if (log->row_count != 0U) {
+      LOG(INFO) << "Restored " << log->row_count << " rows from \""
+                << log_directory << "\"";
+    }
+
+    obj = std::move(log);
+    return osquery::Status(0);
+
+  } catch (const std::bad_alloc&) {
+    return osquery::Status(1, "Memory allocation failure");
+  }
+}
+
+EventSegmentLog::~EventSegmentLog() {
+  closeActiveSegment();
+
+  if (persistent) {
+    return;
+  }
+
+  // The folder is left in place, as it is shared with the log that is
+  // replacing this one
+  for (const auto& segment : segment_list) {
+    unlink(segment.path.c_str());
+  }
+}
+
+osquery::Status EventSegmentLog::append(EventBatch& events,
+                                        std::size_t& dropped_row_count) {
+  dropped_row_count = 0U;
+
+  if (events.empty()) {
+    return osquery::Status(0);
+  }
+
+  std::string buffer;
+  std::string payload;
+
+  for (const auto& event : events) {
+    encodeRecord(buffer, payload, static_cast<osquery::Row>(*event));
+  }
+
+  auto event_count = events.size();
+  events.clear();
+
+  if (active_fd != -1 && segment_list.back().size > kSegmentHeaderSize &&
+      segment_list.back().size + buffer.size() > segment_size) {
+    closeActiveSegment();
+  }
+
+  if (active_fd == -1) {
+    auto status = openActiveSegment();
+    if (!status.ok()) {
+      return status;
+    }
+  }
+
+  auto status = writeBuffer(active_fd, buffer);
+  if (!status.ok()) {
+    // Never append after a partial write; the next segment starts clean
+    closeActiveSegment();
+    return status;
+  }
+
+  auto& active_segment = segment_list.back();
+  active_segment.size += buffer.size();
+  active_segment.row_count += event_count;
+
+  disk_usage += buffer.size();
+  row_count += event_count;
+  sync_pending = true;
+
+  if (std::chrono::steady_clock::now() - last_sync_time >= sync_interval) {
+    status = sync();
+    if (!status.ok()) {
+      LOG(ERROR) << status.getMessage();
+    }
+  }
+
+  // The active segment is always the last one, and is never removed
+  while (max_disk_usage != 0U && disk_usage > max_disk_usage &&
+         segment_list.size() > 1U) {
+    dropped_row_count += removeOldestSegment();
+  }
+
+  return osquery::Status(0);
+}
+
+osquery::Status EventSegmentLog::read(EventBatch& events) {
+  closeActiveSegment();
+
+  osquery::Status status(0);
+  std::deque<Segment> failed_segment_list;
+
+  events.reserve(events.size() + row_count);
+
+  for (const auto& segment : segment_list) {
+    if (segment.row_count == 0U) {
+      unlink(segment.path.c_str());
+      continue;
+    }
+
+    MappedSegmentRef mapped_segment;
+    auto map_status =
+        MappedSegment::create(mapped_segment, segment.path, segment.size);
+
+    // Keep reading the other segments, but report the first error
+    if (!map_status.ok()) {
+      if (status.ok()) {
+        status = map_status;
+      }
+
+      failed_segment_list.push_back(segment);
+      continue;
+    }
+
+    // The mapping stays valid until the last row referencing it is gone
+    unlink(segment.path.c_str());
+
+    auto ptr = mapped_segment->begin() + kSegmentHeaderSize;
+
+    while (ptr < mapped_segment->end()) {
+      const std::uint8_t* payload = nullptr;
+      std::size_t payload_size = 0U;
+
+      if (!nextRecord(payload, payload_size, ptr, mapped_segment->end())) {
+        LOG(ERROR) << "The segment file \"" << segment.path
+                   << "\" is damaged";
+        break;
+      }
+
+      events.push_back(osquery::TableRowHolder(
+          new MappedSegmentRow(mapped_segment, payload, payload_size)));
+    }
+  }
+
+  segment_list = std::move(failed_segment_list);
+
+  row_count = 0U;
+  disk_usage = 0U;
+
+  for (const auto& segment : segment_list) {
+    row_count += segment.row_count;
+    disk_usage += segment.size;
+  }
+
+  return status;
+}
+
+osquery::Status EventSegmentLog::sync() {
+  last_sync_time = std::chrono::steady_clock::now();
+
+  if (active_fd == -1 || !sync_pending) {
+    return osquery::Status(0);
+  }
+
+  sync_pending = false;
+
+  if (fdatasync(active_fd) != 0) {
+    return osquery::Status(1,
+                           std::string("Failed to sync the segment file: ") +
+                               std::strerror(errno));
+  }
+
+  return osquery::Status(0);
+}
+
+bool EventSegmentLog::isPersistent() const {
+  return persistent;
+}
+
+std::size_t EventSegmentLog::rowCount() const {
+  return row_count;
+}
+
+std::size_t EventSegmentLog::diskUsage() const {
+  return disk_usage;
+}
+} // namespace trailofbits
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <pubsub/eventbufferlibrary.h>
+
+#include <chrono>
+#include <deque>
+#include <memory>
+
+namespace trailofbits {
+class EventSegmentLog;
+
+/// A reference to an EventSegmentLog object
+using EventSegmentLogRef = std::unique_ptr<EventSegmentLog>;
+
+/// An append-only log of rows, stored on disk as a sequence of segment
+/// files. Segments are memory mapped when they are read, and the returned
+/// rows decode their columns straight from the mapping only when osquery
+/// accesses them.
+///
+/// Persistent logs keep their segments across restarts, and the rows found
+/// at startup are returned the next time the log is read; all other logs
+/// remove their own segments when they are destroyed. The folder itself is
+/// never removed, since a replacement log may already be using it. This
+/// class is not thread safe
+class EventSegmentLog final {
+  /// A single segment file
+  struct Segment final {
+    /// Segment number; used to sort the segments
+    std::uint64_t id{0U};
+
+    /// Path of the segment file
+    std::string path;
+
+    /// File size, in bytes
+    std::size_t size{0U};
+
+    /// How many rows are stored in the segment
+    std::size_t row_count{0U};
+  };
+
+  /// Folder containing the segment files
+  std::string directory;
+
+  /// If true, segments are kept when the log is destroyed
+  bool persistent{false};
+
+  /// Segments are rotated once they reach this size, in bytes
+  std::size_t segment_size{0U};
+
+  /// Oldest segments are removed when the log grows past this size; zero
+  /// means that the log is not bounded
+  std::size_t max_disk_usage{0U};
+
+  /// How often written data is flushed to the disk
+  std::chrono::milliseconds sync_interval;
+
+  /// All the segments, from the oldest to the newest; the last one is the
+  /// active segment when active_fd is valid
+  std::deque<Segment> segment_list;
+
+  /// Descriptor of the segment currently being written, or -1
+  int active_fd{-1};
+
+  /// True if the active segment has data that has not been synced yet
+  bool sync_pending{false};
+
+  /// When the active segment was last synced
+  std::chrono::steady_clock::time_point last_sync_time;
+
+  /// Identifier for the next segment
+  std::uint64_t next_segment_id{1U};
+
+  /// How many rows are currently stored in the log
+  std::size_t row_count{0U};
+
+  /// Sum of all segment sizes, in bytes
+  std::size_t disk_usage{0U};
+
+  /// Private constructor; use ::create() instead
+  EventSegmentLog(const std::string& directory,
+                  const EventBufferSettings& settings);
+
+  /// Loads (or deletes, when the log is not persistent) the segments left
+  /// by a previous run; a partially written record at the end of a segment
+  /// is truncated away
+  osquery::Status loadSegments();
+
+  /// Creates a new active segment
+  osquery::Status openActiveSegment();
+
+  /// Syncs and closes the active segment; the next append will create a new
+  /// one
+  void closeActiveSegment();
+
+  /// Removes the oldest segment, returning how many rows were lost
+  std::size_t removeOldestSegment();
+
+ public:
+  /// Factory method; segments are stored in a folder named after the buffer,
+  /// inside the given directory
+  static osquery::Status create(EventSegmentLogRef& obj,
+                                const std::string& directory,
+                                const std::string& buffer_name,
+                                const EventBufferSettings& settings);
+
+  /// Destructor
+  ~EventSegmentLog();
+
+  /// Appends the given rows to the log; the batch is cleared. When the log
+  /// exceeds its maximum disk usage, the oldest segments are removed and
+  /// the amount of lost rows is returned in dropped_row_count
+  osquery::Status append(EventBatch& events, std::size_t& dropped_row_count);
+
+  /// Appends all the rows in the log to the given batch, then empties it
+  osquery::Status read(EventBatch& events);
+
+  /// Flushes the active segment to the disk
+  osquery::Status sync();
+
+  /// Returns true if the log is kept across restarts
+  bool isPersistent() const;
+
+  /// How many rows are currently stored in the log
+  std::size_t rowCount() const;
+
+  /// How much disk space the log is using, in bytes
+  std::size_t diskUsage() const;
+
+  /// Disable the copy constructor
+  EventSegmentLog(const EventSegmentLog& other) = delete;
+
+  /// Disable the assignment operator
+  EventSegmentLog& operator=(const EventSegmentLog& other) = delete;
+};
+} // namespace trailofbits
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <pubsub/eventbufferlibrary.h>
+
+#include <memory>
+
+namespace trailofbits {
+/// Common base class for the storage engines used by the EventBufferLibrary
+class IEventBuffer {
+ public:
+  /// Appends the given events to the buffer; the batch is cleared
+  virtual void save(EventBatch& events) = 0;
+
+  /// Removes and returns all the events stored in the buffer
+  virtual EventBatch get() = 0;
+
+  /// Returns the events for the given consumer; buffers that do not
+  /// support multiple consumers behave like ::get()
+  virtual EventBatch read(const EventReadRequest& request) = 0;
+
+  /// Returns the buffer counters
+  virtual EventBufferStatistics statistics() = 0;
+
+  /// Moves the rows held in memory to disk if the buffer is persistent
+  virtual void flush() = 0;
+
+  /// Destructor
+  virtual ~IEventBuffer() = default;
+};
+
+/// A reference to an event buffer
+using IEventBufferRef = std::shared_ptr<IEventBuffer>;
+} // namespace trailofbits
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pubsub/latencyhistogram.h>
+
+#include <algorithm>
+
+namespace trailofbits {
+namespace {
+/// Returns the position of the most significant bit
+std::size_t mostSignificantBit(std::uint64_t value) {
+  std::size_t position = 0U;
+  while (value >>= 1U) {
+    ++position;
+  }
+
+  return position;
+}
+
+/// Returns the smallest value that is greater than or equal to the given
+/// fraction of the recorded values
+std::uint64_t percentileValue(
+    const std::array<std::uint64_t, LatencyHistogram::kBucketCount>&
+        bucket_list,
+    std::uint64_t count,
+    double fraction) {
+  auto threshold =
+      static_cast<std::uint64_t>(static_cast<double>(count) * fraction);
+  if (threshold == 0U) {
+    threshold = 1U;
+  }
+
+  std::uint64_t accumulated_count = 0U;
+  for (std::size_t i = 0U; i < bucket_list.size(); ++i) {
+    accumulated_count += bucket_list[i];
+    if (accumulated_count >= threshold) {
+      return LatencyHistogram::bucketLowerBound(i);
+    }
+  }
+
+  return LatencyHistogram::bucketLowerBound(bucket_list.size() - 1U);
+}
+} // namespace
+
+const std::size_t LatencyHistogram::kLinearBucketCount;
+const std::size_t LatencyHistogram::kSubBucketCount;
+const std::size_t LatencyHistogram::kBucketCount;
+
+void LatencyHistogram::record(std::uint64_t value) {
+  bucket_list[bucketIndex(value)].fetch_add(1U, std::memory_order_relaxed);
+  total.fetch_add(value, std::memory_order_relaxed);
+
+  auto current_max = max.load(std::memory_order_relaxed);
+  while (value > current_max &&
+         !max.compare_exchange_weak(
+             current_max, value, std::memory_order_relaxed)) {
+  }
+}
+
+void LatencyHistogram::record(std::chrono::steady_clock::duration value) {
+  auto microseconds =
+      std::chrono::duration_cast<std::chrono::microseconds>(value).count();
+
+  record(static_cast<std::uint64_t>(std::max<decltype(microseconds)>(
+      microseconds, 0)));
+}
+
+LatencyHistogram::Summary LatencyHistogram::summary() const {
+  std::array<std::uint64_t, kBucketCount> bucket_snapshot;
+
+  std::uint64_t bucket_count_sum = 0U;
+  for (std::size_t i = 0U; i < kBucketCount; ++i) {
+    bucket_snapshot[i] = bucket_list[i].load(std::memory_order_relaxed);
+    bucket_count_sum += bucket_snapshot[i];
+  }
+
+  Summary summary;
+  summary.count = bucket_count_sum;
+  summary.total = total.load(std::memory_order_relaxed);
+  summary.max = max.load(std::memory_order_relaxed);
+
+  if (bucket_count_sum == 0U) {
+    return summary;
+  }
+
+  summary.p50 = percentileValue(bucket_snapshot, bucket_count_sum, 0.50);
+  summary.p90 = percentileValue(bucket_snapshot, bucket_count_sum, 0.90);
+  summary.p99 = percentileValue(bucket_snapshot, bucket_count_sum, 0.99);
+
+  return summary;
+}
+
+std::size_t LatencyHistogram::bucketIndex(std::uint64_t value) {
+  if (value < kLinearBucketCount) {
+    return static_cast<std::size_t>(value);
+  }
+
+  // kLinearBucketCount is 2^4, and 8 sub-buckets take 3 bits
+  auto exponent = mostSignificantBit(value);
+  auto sub_bucket = static_cast<std::size_t>(value >> (exponent - 3U)) &
+                    (kSubBucketCount - 1U);
+
+  auto bucket_index =
+      kLinearBucketCount + (exponent - 4U) * kSubBucketCount + sub_bucket;
+
+  return std::min(bucket_index, kBucketCount - 1U);
+}
+
+std::uint64_t LatencyHistogram::bucketLowerBound(std::size_t bucket_index) {
+  if (bucket_index < kLinearBucketCount) {
+    return bucket_index;
+  }
+
+  auto exponent = (bucket_index - kLinearBucketCount) / kSubBucketCount + 4U;
+  auto sub_bucket = (bucket_index - kLinearBucketCount) % kSubBucketCount;
+
+  return (std::uint64_t{1U} << exponent) +
+         (static_cast<std::uint64_t>(sub_bucket) << (exponent - 3U));
+}
+} // namespace trailofbits
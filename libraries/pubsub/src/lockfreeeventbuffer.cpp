@@ -0,0 +1,343 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "lockfreeeventbuffer.h"
+#include "eventbufferutils.h"
+
+#include <osquery/logger.h>
+
+#include <limits>
+
+namespace trailofbits {
+namespace {
+/// Returns the distance between a slot sequence and a ring position
+std::intptr_t sequenceDistance(std::size_t sequence, std::size_t position) {
+  return static_cast<std::intptr_t>(sequence - position);
+}
+} // namespace
+
+LockFreeEventBuffer::LockFreeEventBuffer(
+    const EventBufferSettings& settings_,
+    std::size_t capacity_,
+    EventSegmentLogRef segment_log_,
+    EventBufferPressureStateRef pressure_state_)
+    : settings(settings_),
+      capacity(capacity_),
+      position_mask(capacity_ - 1U),
+      segment_log(std::move(segment_log_)),
+      pressure_state(std::move(pressure_state_)) {
+  slot_list.reset(new Slot[capacity]);
+
+  for (std::size_t i = 0U; i < capacity; ++i) {
+    slot_list[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+bool LockFreeEventBuffer::tryPush(osquery::TableRowHolder& row) {
+  auto position = enqueue_position.load(std::memory_order_relaxed);
+
+  for (;;) {
+    auto& slot = slot_list[position & position_mask];
+    auto sequence = slot.sequence.load(std::memory_order_acquire);
+    auto distance = sequenceDistance(sequence, position);
+
+    if (distance == 0) {
+      if (enqueue_position.compare_exchange_weak(
+              position, position + 1U, std::memory_order_relaxed)) {
+        slot.row = std::move(row);
+        slot.sequence.store(position + 1U, std::memory_order_release);
+        return true;
+      }
+
+    } else if (distance < 0) {
+      return false;
+
+    } else {
+      position = enqueue_position.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+bool LockFreeEventBuffer::tryPop(osquery::TableRowHolder& row) {
+  auto position = dequeue_position.load(std::memory_order_relaxed);
+
+  for (;;) {
+    auto& slot = slot_list[position & position_mask];
+    auto sequence = slot.sequence.load(std::memory_order_acquire);
+    auto distance = sequenceDistance(sequence, position + 1U);
+
+    if (distance == 0) {
+      if (dequeue_position.compare_exchange_weak(
+              position, position + 1U, std::memory_order_relaxed)) {
+        row = std::move(slot.row);
+        slot.sequence.store(position + capacity, std::memory_order_release);
+        return true;
+      }
+
+    } else if (distance < 0) {
+      return false;
+
+    } else {
+      position = dequeue_position.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+std::size_t LockFreeEventBuffer::size() const {
+  auto enqueue_pos = enqueue_position.load(std::memory_order_relaxed);
+  auto dequeue_pos = dequeue_position.load(std::memory_order_relaxed);
+
+  if (enqueue_pos <= dequeue_pos) {
+    return 0U;
+  }
+
+  return std::min(capacity, enqueue_pos - dequeue_pos);
+}
+
+void LockFreeEventBuffer::updatePressure(std::size_t disk_usage) {
+  auto row_limit =
+      getRowLimit(settings,
+                  settings.capacity,
+                  average_row_size.load(std::memory_order_relaxed));
+
+  updatePressureState(*pressure_state, settings, size(), row_limit, disk_usage);
+}
+
+void LockFreeEventBuffer::spillRows(EventBatch& rows) {
+  auto row_count = rows.size();
+
+  osquery::Status status;
+  std::size_t dropped_row_count = 0U;
+
+  std::size_t disk_usage = 0U;
+
+  {
+    std::lock_guard<std::mutex> lock(segment_log_mutex);
+    status = segment_log->append(rows, dropped_row_count);
+    disk_usage = segment_log->diskUsage();
+  }
+
+  updatePressure(disk_usage);
+
+  if (status.ok()) {
+    spilled_row_count.fetch_add(row_count, std::memory_order_relaxed);
+    overwritten_row_count.fetch_add(dropped_row_count,
+                                    std::memory_order_relaxed);
+
+  } else {
+    LOG(ERROR) << status.getMessage();
+    overwritten_row_count.fetch_add(row_count, std::memory_order_relaxed);
+  }
+}
+
+osquery::Status LockFreeEventBuffer::create(
+    IEventBufferRef& obj,
+    const EventBufferSettings& settings,
+    const std::string& buffer_name,
+    EventBufferPressureStateRef pressure_state) {
+  obj.reset();
+
+  if (settings.capacity == 0U ||
+      settings.capacity > (std::numeric_limits<std::size_t>::max() >> 2U)) {
+    return osquery::Status(1, "Invalid buffer capacity");
+  }
+
+  std::size_t ring_capacity = 2U;
+  while (ring_capacity < settings.capacity) {
+    ring_capacity <<= 1U;
+  }
+
+  EventSegmentLogRef segment_log;
+  auto status = createSegmentLog(segment_log, settings, buffer_name);
+  if (!status.ok()) {
+    return status;
+  }
+
+  try {
+    if (!pressure_state) {
+      pressure_state = std::make_shared<EventBufferPressureState>(
+          EventBufferPressure::Low);
+    }
+
+    auto ptr = new LockFreeEventBuffer(settings,
+                                       ring_capacity,
+                                       std::move(segment_log),
+                                       std::move(pressure_state));
+    obj.reset(ptr);
+
+    return osquery::Status(0);
+
+  } catch (const std::bad_alloc&) {
+    return osquery::Status(1, "Memory allocation failure");
+  }
+}
+
+void LockFreeEventBuffer::save(EventBatch& events) {
+  if (!events.empty()) {
+    // Concurrent updates may lose a sample, which is fine for an estimate
+    auto new_average_row_size = updateAverageRowSize(
+        average_row_size.load(std::memory_order_relaxed),
+        estimateRowSize(*events.front()));
+
+    average_row_size.store(new_average_row_size, std::memory_order_relaxed);
+  }
+
+  auto row_limit =
+      getRowLimit(settings,
+                  settings.capacity,
+                  average_row_size.load(std::memory_order_relaxed));
+
+  EventBatch evicted_rows;
+
+  for (auto& row : events) {
+    if (settings.overflow_policy == EventBufferOverflowPolicy::DropNewest) {
+      if (size() >= row_limit || !tryPush(row)) {
+        rejected_row_count.fetch_add(1U, std::memory_order_relaxed);
+      }
+
+      continue;
+    }
+
+    while (size() >= row_limit || !tryPush(row)) {
+      // The ring is full; make room by removing the oldest row
+      osquery::TableRowHolder oldest_row;
+      if (!tryPop(oldest_row)) {
+        continue;
+      }
+
+      if (settings.overflow_policy == EventBufferOverflowPolicy::SpillToDisk) {
+        evicted_rows.push_back(std::move(oldest_row));
+      } else {
+        overwritten_row_count.fetch_add(1U, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  events.clear();
+
+  // Buffers that spill to disk are only measured against their disk usage,
+  // which did not change unless rows have been spilled
+  if (!evicted_rows.empty()) {
+    spillRows(evicted_rows);
+
+  } else if (settings.overflow_policy !=
+             EventBufferOverflowPolicy::SpillToDisk) {
+    updatePressure(0U);
+  }
+}
+
+EventBatch LockFreeEventBuffer::get() {
+  // Spilled rows are always older than the ones we have in memory
+  EventBatch event_batch;
+  std::size_t disk_usage = 0U;
+
+  if (segment_log) {
+    std::lock_guard<std::mutex> lock(segment_log_mutex);
+
+    auto status = segment_log->read(event_batch);
+    if (!status.ok()) {
+      LOG(ERROR) << status.getMessage();
+    }
+
+    disk_usage = segment_log->diskUsage();
+  }
+
+  // Only drain what is already there, so that a busy publisher can't keep
+  // the consumer looping forever
+  auto end_position = enqueue_position.load(std::memory_order_acquire);
+
+  event_batch.reserve(event_batch.size() + std::min(
+      capacity,
+      end_position - dequeue_position.load(std::memory_order_relaxed)));
+
+  osquery::TableRowHolder row;
+  while (dequeue_position.load(std::memory_order_relaxed) < end_position &&
+         tryPop(row)) {
+    event_batch.push_back(std::move(row));
+  }
+
+  updatePressure(disk_usage);
+  return event_batch;
+}
+
+EventBatch LockFreeEventBuffer::read(const EventReadRequest& request) {
+  auto event_batch = get();
+  setRowConsumer(event_batch, request.consumer);
+
+  return event_batch;
+}
+
+EventBufferStatistics LockFreeEventBuffer::statistics() {
+  auto current_average_row_size =
+      average_row_size.load(std::memory_order_relaxed);
+
+  EventBufferStatistics buffer_statistics;
+  buffer_statistics.row_count = size();
+  buffer_statistics.unread_row_count = buffer_statistics.row_count;
+  buffer_statistics.capacity =
+      getRowLimit(settings, settings.capacity, current_average_row_size);
+
+  buffer_statistics.memory_usage =
+      buffer_statistics.row_count * current_average_row_size;
+
+  buffer_statistics.overwritten_row_count =
+      overwritten_row_count.load(std::memory_order_relaxed);
+
+  buffer_statistics.rejected_row_count =
+      rejected_row_count.load(std::memory_order_relaxed);
+
+  buffer_statistics.spilled_row_count =
+      spilled_row_count.load(std::memory_order_relaxed);
+
+  if (segment_log) {
+    std::lock_guard<std::mutex> lock(segment_log_mutex);
+    buffer_statistics.pending_spilled_row_count = segment_log->rowCount();
+    buffer_statistics.disk_usage = segment_log->diskUsage();
+  }
+
+  return buffer_statistics;
+}
+
+void LockFreeEventBuffer::flush() {
+  if (!segment_log || !segment_log->isPersistent()) {
+    return;
+  }
+
+  EventBatch event_batch;
+
+  osquery::TableRowHolder row;
+  while (tryPop(row)) {
+    event_batch.push_back(std::move(row));
+  }
+
+  std::lock_guard<std::mutex> lock(segment_log_mutex);
+
+  std::size_t dropped_row_count = 0U;
+  auto status = segment_log->append(event_batch, dropped_row_count);
+  overwritten_row_count.fetch_add(dropped_row_count,
+                                  std::memory_order_relaxed);
+
+  if (status.ok()) {
+    status = segment_log->sync();
+  }
+
+  if (!status.ok()) {
+    LOG(ERROR) << status.getMessage();
+  }
+
+  updatePressure(segment_log->diskUsage());
+}
+} // namespace trailofbits
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "eventsegmentlog.h"
+#include "ieventbuffer.h"
+
+#include <atomic>
+#include <mutex>
+
+namespace trailofbits {
+/// A bounded, lock-free multi-producer/multi-consumer event buffer, based on
+/// a ring of pre-sized slots that are tagged with a sequence number.
+///
+/// Producers never wait on the consumers: when the ring is full, the
+/// overflow policy decides whether the oldest row is removed or the new one
+/// is discarded. Only the SpillToDisk policy takes a lock, and only when rows
+/// are actually moved to disk
+class LockFreeEventBuffer final : public IEventBuffer {
+  /// A single ring slot
+  struct Slot final {
+    /// Ring position this slot is ready for; producers can write the slot
+    /// when it matches the enqueue position, consumers can read it when it
+    /// matches the dequeue position plus one
+    std::atomic<std::size_t> sequence{0U};
+
+    /// Row data
+    osquery::TableRowHolder row;
+  };
+
+  /// Buffer settings
+  EventBufferSettings settings;
+
+  /// The slot ring
+  std::unique_ptr<Slot[]> slot_list;
+
+  /// Ring capacity; always a power of two, and never less than the capacity
+  /// specified in the settings
+  std::size_t capacity{0U};
+
+  /// Used to wrap ring positions around the slot list
+  std::size_t position_mask{0U};
+
+  /// Next position to be written by a producer
+  alignas(64) std::atomic<std::size_t> enqueue_position{0U};
+
+  /// Next position to be read by a consumer
+  alignas(64) std::atomic<std::size_t> dequeue_position{0U};
+
+  /// Running average of the row size, sampled once per batch
+  alignas(64) std::atomic<std::size_t> average_row_size{0U};
+
+  /// How many rows have been overwritten because the buffer was full
+  std::atomic<std::uint64_t> overwritten_row_count{0U};
+
+  /// How many new rows have been discarded because the buffer was full
+  std::atomic<std::uint64_t> rejected_row_count{0U};
+
+  /// How many rows have been moved to disk because the buffer was full
+  std::atomic<std::uint64_t> spilled_row_count{0U};
+
+  /// Where rows are moved when the overflow policy is set to SpillToDisk,
+  /// or when a persistent buffer is flushed
+  EventSegmentLogRef segment_log;
+
+  /// Mutex protecting the segment log
+  std::mutex segment_log_mutex;
+
+  /// Where the buffer publishes how full it is
+  EventBufferPressureStateRef pressure_state;
+
+  /// Private constructor; use ::create() instead
+  LockFreeEventBuffer(const EventBufferSettings& settings,
+                      std::size_t capacity,
+                      EventSegmentLogRef segment_log,
+                      EventBufferPressureStateRef pressure_state);
+
+  /// Publishes the current fill level; the disk usage is only used by
+  /// buffers that spill to disk
+  void updatePressure(std::size_t disk_usage);
+
+  /// Returns how many rows are currently stored in the ring
+  std::size_t size() const;
+
+  /// Moves the given rows to the segment log
+  void spillRows(EventBatch& rows);
+
+  /// Attempts to append a single row; fails when the ring is full
+  bool tryPush(osquery::TableRowHolder& row);
+
+  /// Attempts to remove the oldest row; fails when the ring is empty
+  bool tryPop(osquery::TableRowHolder& row);
+
+ public:
+  /// Factory method; the ring size is rounded up to the next power of two,
+  /// and a private pressure state is allocated when none is given
+  static osquery::Status create(
+      IEventBufferRef& obj,
+      const EventBufferSettings& settings,
+      const std::string& buffer_name,
+      EventBufferPressureStateRef pressure_state = nullptr);
+
+  /// Destructor
+  virtual ~LockFreeEventBuffer() override = default;
+
+  /// Appends the given events to the buffer; the batch is cleared
+  virtual void save(EventBatch& events) override;
+
+  /// Removes and returns all the events stored in the buffer
+  virtual EventBatch get() override;
+
+  /// Same as ::get(); this engine only supports a single consumer, and all
+  /// of them read from the same rows
+  virtual EventBatch read(const EventReadRequest& request) override;
+
+  /// Returns the buffer counters
+  virtual EventBufferStatistics statistics() override;
+
+  /// Moves the rows held in memory to disk if the buffer is persistent
+  virtual void flush() override;
+
+  /// Disable the copy constructor
+  LockFreeEventBuffer(const LockFreeEventBuffer& other) = delete;
+
+  /// Disable the assignment operator
+  LockFreeEventBuffer& operator=(const LockFreeEventBuffer& other) = delete;
+};
+} // namespace trailofbits
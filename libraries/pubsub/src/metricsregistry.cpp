@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pubsub/eventbufferlibrary.h>
+#include <pubsub/eventrowfilter.h>
+#include <pubsub/metricsregistry.h>
+
+#include <osquery/sql/dynamic_table_row.h>
+
+#include <map>
+#include <mutex>
+#include <tuple>
+
+namespace trailofbits {
+namespace {
+/// Identifies a metric: component, name and metric name
+using MetricKey = std::tuple<std::string, std::string, std::string>;
+
+/// Used to assign a counter slot to each thread
+std::atomic<std::size_t> slot_index_generator{0U};
+
+/// Returns the counter slot assigned to the calling thread
+std::size_t currentSlotIndex() {
+  thread_local std::size_t slot_index =
+      slot_index_generator++ % StripedCounter::kSlotCount;
+
+  return slot_index;
+}
+
+/// Appends a new row to the metrics table
+void appendMetricRow(osquery::TableRows& rows,
+                     const std::string& component,
+                     const std::string& name,
+                     const std::string& metric,
+                     std::uint64_t value) {
+  osquery::Row row = {{"component", component},
+                      {"name", name},
+                      {"metric", metric},
+                      {"value", std::to_string(value)}};
+
+  rows.push_back(
+      osquery::TableRowHolder(new osquery::DynamicTableRow(std::move(row))));
+}
+} // namespace
+
+const std::size_t StripedCounter::kSlotCount;
+
+void StripedCounter::add(std::uint64_t value) {
+  slot_list[currentSlotIndex()].value.fetch_add(value,
+                                                 std::memory_order_relaxed);
+}
+
+std::uint64_t StripedCounter::value() const {
+  std::uint64_t total = 0U;
+  for (const auto& slot : slot_list) {
+    total += slot.value.load(std::memory_order_relaxed);
+  }
+
+  return total;
+}
+
+/// Private class data
+struct MetricsRegistry::PrivateData final {
+  /// Counters
+  std::map<MetricKey, StripedCounterRef> counter_map;
+
+  /// Latency histograms
+  std::map<MetricKey, LatencyHistogramRef> histogram_map;
+
+  /// Mutex protecting the maps; the metrics themselves are lock-free
+  mutable std::mutex mutex;
+};
+
+MetricsRegistry::MetricsRegistry() : d(new PrivateData) {}
+
+MetricsRegistry& MetricsRegistry::instance() {
+  static MetricsRegistry obj;
+  return obj;
+}
+
+MetricsRegistry::~MetricsRegistry() {}
+
+StripedCounterRef MetricsRegistry::counter(const std::string& component,
+                                           const std::string& name,
+                                           const std::string& metric) {
+  std::lock_guard<std::mutex> lock(d->mutex);
+
+  auto& counter_ref = d->counter_map[std::make_tuple(component, name, metric)];
+  if (!counter_ref) {
+    counter_ref = std::make_shared<StripedCounter>();
+  }
+
+  return counter_ref;
+}
+
+LatencyHistogramRef MetricsRegistry::histogram(const std::string& component,
+                                               const std::string& name,
+                                               const std::string& metric) {
+  std::lock_guard<std::mutex> lock(d->mutex);
+
+  auto& histogram_ref =
+      d->histogram_map[std::make_tuple(component, name, metric)];
+  if (!histogram_ref) {
+    histogram_ref = std::make_shared<LatencyHistogram>();
+  }
+
+  return histogram_ref;
+}
+
+MetricValueList MetricsRegistry::values() const {
+  std::lock_guard<std::mutex> lock(d->mutex);
+
+  MetricValueList value_list;
+
+  for (const auto& p : d->counter_map) {
+    MetricValue metric_value;
+    std::tie(metric_value.component, metric_value.name, metric_value.metric) =
+        p.first;
+
+    metric_value.value = p.second->value();
+    value_list.push_back(std::move(metric_value));
+  }
+
+  for (const auto& p : d->histogram_map) {
+    MetricValue metric_value;
+    std::tie(metric_value.component, metric_value.name, metric_value.metric) =
+        p.first;
+
+    metric_value.histogram = true;
+    metric_value.summary = p.second->summary();
+    metric_value.value = metric_value.summary.count;
+    value_list.push_back(std::move(metric_value));
+  }
+
+  return value_list;
+}
+
+osquery::TableRows generateMetricsTableRows(
+    const std::string& table_name,
+    const osquery::QueryContext& context,
+    const osquery::TableColumns& schema) {
+  static_cast<void>(table_name);
+
+  osquery::TableRows rows;
+
+  for (const auto& metric_value : MetricsRegistry::instance().values()) {
+    if (!metric_value.histogram) {
+      appendMetricRow(rows,
+                      metric_value.component,
+                      metric_value.name,
+                      metric_value.metric,
+                      metric_value.value);
+      continue;
+    }
+
+    const auto& summary = metric_value.summary;
+
+    osquery::Row row = {{"component", metric_value.component},
+                        {"name", metric_value.name},
+                        {"metric", metric_value.metric},
+                        {"value", std::to_string(summary.count)},
+                        {"total", std::to_string(summary.total)},
+                        {"p50", std::to_string(summary.p50)},
+                        {"p90", std::to_string(summary.p90)},
+                        {"p99", std::to_string(summary.p99)},
+                        {"max", std::to_string(summary.max)}};
+
+    rows.push_back(
+        osquery::TableRowHolder(new osquery::DynamicTableRow(std::move(row))));
+  }
+
+  for (const auto& p : EventBufferLibrary::instance().statistics()) {
+    const auto& buffer_name = p.first;
+    const auto& buffer_statistics = p.second;
+
+    const std::vector<std::pair<const char*, std::uint64_t>> counter_list = {
+        {"row_count", buffer_statistics.row_count},
+        {"unread_row_count", buffer_statistics.unread_row_count},
+        {"capacity", buffer_statistics.capacity},
+        {"memory_usage", buffer_statistics.memory_usage},
+        {"overwritten_row_count", buffer_statistics.overwritten_row_count},
+        {"rejected_row_count", buffer_statistics.rejected_row_count},
+        {"spilled_row_count", buffer_statistics.spilled_row_count},
+        {"pending_spilled_row_count",
+         buffer_statistics.pending_spilled_row_count},
+        {"disk_usage", buffer_statistics.disk_usage}};
+
+    for (const auto& counter : counter_list) {
+      appendMetricRow(
+          rows, "buffer", buffer_name, counter.first, counter.second);
+    }
+  }
+
+  filterEventRows(rows, context, schema);
+  return rows;
+}
+} // namespace trailofbits
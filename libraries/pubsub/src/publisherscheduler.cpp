@@ -14,84 +14,511 @@
  * limitations under the License.
  */
 
+#include "eventbufferutils.h"
+
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wmacro-redefined"
 #include <pubsub/publisherregistry.h>
 #pragma clang diagnostic pop
 
+#include <pubsub/metricsregistry.h>
 #include <pubsub/publisherscheduler.h>
+#include <pubsub/servicemanager.h>
 #include <pubsub/subscriberregistry.h>
+#include <pubsub/threadsettings.h>
+#include <pubsub/workerpool.h>
 
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <ctime>
+#include <future>
+#include <mutex>
 #include <thread>
 #include <unordered_map>
+#include <unordered_set>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
 
 #include <osquery/logger.h>
 
 namespace trailofbits {
 namespace {
+/// How often the reactor checks for configuration changes, in seconds
+const time_t kReactorConfigurationInterval{1};
+
+/// Epoll tag used by the descriptor that wakes up the reactor
+const std::uint64_t kReactorWakeupTag{~0ULL};
+
+/// Epoll tag used by the configuration timer
+const std::uint64_t kReactorTimerTag{~0ULL - 1ULL};
+
+/// Set in the epoll tag of the publisher flush timers
+const std::uint64_t kReactorFlushTimerTagBit{1ULL << 62U};
+
 /// A reference to a thread
 using ThreadRef = std::unique_ptr<std::thread>;
 
-/// Shared data between the scheduler and the publisher thread
-struct PublisherThreadData final {
-  /// Constructor, used to acquire the reference to the `terminate` flag
-  PublisherThreadData(std::atomic_bool& terminate_thread)
-      : terminate(terminate_thread) {}
+/// Publisher counters, updated by the thread (or worker) running it; the
+/// metrics are also reported by the pubsub_metrics table
+struct PublisherCounters final {
+  /// How many times ::run() has been called
+  StripedCounterRef run_count;
+
+  /// CPU time, in microseconds
+  StripedCounterRef cpu_time;
+
+  /// How long each ::run() call takes
+  LatencyHistogramRef run_latency;
 
+  /// True if the publisher has been halted
+  std::atomic_bool halted{false};
+
+  /// True if the publisher is serviced by the reactor
+  bool reactor{false};
+};
+
+/// A reference to a publisher counters object
+using PublisherCountersRef = std::shared_ptr<PublisherCounters>;
+
+/// Creates the counters for the given publisher
+PublisherCountersRef createPublisherCounters(const std::string& publisher_name,
+                                             bool reactor) {
+  auto& metrics_registry = MetricsRegistry::instance();
+
+  auto counters = std::make_shared<PublisherCounters>();
+  counters->run_count =
+      metrics_registry.counter("publisher", publisher_name, "run_count");
+  counters->cpu_time =
+      metrics_registry.counter("publisher", publisher_name, "cpu_time");
+  counters->run_latency =
+      metrics_registry.histogram("publisher", publisher_name, "run_latency");
+  counters->reactor = reactor;
+
+  return counters;
+}
+
+/// Shared data between the scheduler and the publisher thread; the thread
+/// keeps its own reference, so that it can outlive the scheduler if it
+/// misses the shutdown deadline
+struct PublisherThreadData final {
   /// This thread
   ThreadRef thread;
 
   /// Whether the thread should terminate or keep processing data
-  std::atomic_bool& terminate;
+  std::atomic_bool terminate{false};
+
+  /// Set by the thread once the publisher has been drained
+  std::promise<void> completion;
 
   /// The publisher that this thread should serve
   IEventPublisherRef publisher;
 
   /// The configuration file
   ConfigurationFileRef configuration_file;
+
+  /// Publisher counters
+  PublisherCountersRef counters;
 };
 
 /// A reference to a publisher thread
 using PublisherThreadDataRef = std::shared_ptr<PublisherThreadData>;
 
+/// A publisher serviced by the reactor
+struct ReactorPublisher final {
+  /// The publisher
+  IEventPublisherRef publisher;
+
+  /// The readiness descriptor returned by the publisher
+  int descriptor{-1};
+
+  /// A timerfd descriptor, armed when the publisher is holding back events
+  int flush_timer_fd{-1};
+
+  /// Index inside the reactor publisher list, used as epoll tag
+  std::uint64_t index{0U};
+
+  /// The configuration handle
+  ConfigurationFileHandle configuration_handle{0U};
+
+  /// The last configuration generation seen by the publisher
+  std::uint64_t configuration_generation{0U};
+
+  /// True while a task for this publisher is queued or running; there is
+  /// never more than one
+  std::atomic_bool scheduled{false};
+
+  /// Publisher counters
+  PublisherCountersRef counters;
+};
+
+/// A reference to a reactor publisher
+using ReactorPublisherRef = std::unique_ptr<ReactorPublisher>;
+
+/// Data shared between the reactor thread and the worker tasks
+struct ReactorData final {
+  /// The epoll descriptor
+  int epoll_fd{-1};
+
+  /// An eventfd descriptor used to wake up the reactor
+  int wakeup_fd{-1};
+
+  /// A timerfd descriptor used to check for configuration changes
+  int timer_fd{-1};
+
+  /// The configuration file
+  ConfigurationFileRef configuration_file;
+
+  /// Publishers serviced by the reactor
+  std::vector<ReactorPublisherRef> publisher_list;
+
+  /// The worker pool running the publishers
+  WorkerPoolRef worker_pool;
+
+  /// Mutex protecting the pending task count
+  std::mutex pending_task_mutex;
+
+  /// Signaled when a task completes
+  std::condition_variable pending_task_cv;
+
+  /// How many publisher tasks are queued or running
+  std::size_t pending_task_count{0U};
+
+  /// The reactor thread
+  ThreadRef thread;
+
+  /// Destructor
+  ~ReactorData() {
+    // Tasks can still reference the epoll descriptor
+    worker_pool.reset();
+
+    for (const auto& reactor_publisher : publisher_list) {
+      if (reactor_publisher->flush_timer_fd != -1) {
+        close(reactor_publisher->flush_timer_fd);
+      }
+    }
+
+    for (auto fd : {epoll_fd, wakeup_fd, timer_fd}) {
+      if (fd != -1) {
+        close(fd);
+      }
+    }
+  }
+};
+
+/// A reference to the reactor data
+using ReactorDataRef = std::unique_ptr<ReactorData>;
+
+/// Returns the CPU time used by the calling thread, in microseconds
+std::uint64_t threadCpuTime() {
+  timespec cpu_time{};
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_time) != 0) {
+    return 0U;
+  }
+
+  return static_cast<std::uint64_t>(cpu_time.tv_sec) * 1000000ULL +
+         static_cast<std::uint64_t>(cpu_time.tv_nsec) / 1000ULL;
+}
+
+/// Applies the new configuration (if any) to the given publisher; returns
+/// false if the publisher must be halted. The last generation seen by the
+/// caller is compared first, so that the handle map is only looked up when
+/// a new configuration has been published
+bool updatePublisherConfiguration(
+    const IEventPublisherRef& publisher_ref,
+    const ConfigurationFileRef& configuration_file,
+    ConfigurationFileHandle configuration_handle,
+    std::uint64_t& configuration_generation,
+    PublisherCounters& counters) {
+  auto generation = configuration_file->generation();
+  if (generation == configuration_generation) {
+    return true;
+  }
+
+  configuration_generation = generation;
+
+  if (!configuration_file->configurationChanged(configuration_handle)) {
+    return true;
+  }
+
+  auto start_time = threadCpuTime();
+
+  auto configuration_data =
+      configuration_file->getConfiguration(configuration_handle);
+
+  auto publisher_name =
+      PublisherRegistry::instance().publisherName(publisher_ref);
+
+  auto s = publisher_ref->configure(configuration_data);
+  if (!s.ok()) {
+    LOG(ERROR) << "Publisher \"" << publisher_name
+               << "\" failed the configuration: " << s.getMessage()
+               << ". Halting...\n";
+
+    counters.halted = true;
+    return false;
+  }
+
+  publisher_ref->configureSubscribers(configuration_data);
+
+  EventCoalescingSettings coalescing_settings;
+  s = PublisherScheduler::parseCoalescingSettings(
+      coalescing_settings,
+      configuration_data["pubsub"]["scheduler"]["coalescing"][publisher_name]);
+
+  if (!s.ok()) {
+    LOG(ERROR) << "Invalid coalescing settings for publisher \""
+               << publisher_name << "\": " << s.getMessage();
+  }
+
+  publisher_ref->configureCoalescing(coalescing_settings);
+
+  counters.cpu_time->add(threadCpuTime() - start_time);
+  return true;
+}
+
+/// Calls ::run() on the given publisher; returns false if the publisher
+/// must be halted
+bool runPublisher(IEventPublisherRef publisher_ref,
+                  PublisherCounters& counters) {
+  auto start_time = threadCpuTime();
+  auto start_timestamp = std::chrono::steady_clock::now();
+
+  auto s = publisher_ref->run();
+
+  counters.run_latency->record(std::chrono::steady_clock::now() -
+                               start_timestamp);
+  counters.cpu_time->add(threadCpuTime() - start_time);
+  counters.run_count->add();
+
+  if (!s.ok()) {
+    auto publisher_name =
+        PublisherRegistry::instance().publisherName(publisher_ref);
+
+    LOG(ERROR) << "Publisher \"" << publisher_name
+               << "\" reported an error: " << s.getMessage()
+               << ". Halting...\n";
+
+    counters.halted = true;
+    return false;
+  }
+
+  return true;
+}
+
 /// A thread servicing a publisher
 void publisherThread(PublisherThreadDataRef publisher_thread_data) {
   auto& terminate_thread = publisher_thread_data->terminate;
   auto configuration_file = publisher_thread_data->configuration_file;
   auto publisher_ref = publisher_thread_data->publisher;
+  auto& counters = *publisher_thread_data->counters;
 
   auto configuration_handle = configuration_file->getHandle();
+  std::uint64_t configuration_generation{0U};
 
   while (!terminate_thread) {
-    if (configuration_file->configurationChanged(configuration_handle)) {
-      auto configuration_data =
-          configuration_file->getConfiguration(configuration_handle);
-
-      auto s = publisher_ref->configure(configuration_data);
-      if (!s.ok()) {
-        auto publisher_name =
-            PublisherRegistry::instance().publisherName(publisher_ref);
-
-        LOG(ERROR) << "Publisher \"" << publisher_name
-                   << "\" failed the configuration: " << s.getMessage()
-                   << ". Halting...\n";
-        break;
-      }
+    if (!updatePublisherConfiguration(publisher_ref,
+                                      configuration_file,
+                                      configuration_handle,
+                                      configuration_generation,
+                                      counters)) {
+      break;
+    }
 
-      publisher_ref->configureSubscribers(configuration_data);
+    if (!runPublisher(publisher_ref, counters)) {
+      break;
     }
 
-    auto s = publisher_ref->run();
-    if (!s.ok()) {
-      auto publisher_name =
-          PublisherRegistry::instance().publisherName(publisher_ref);
+    publisher_ref->flushEvents(false);
+  }
+
+  // Run the publisher once more to drain the events it has already
+  // received, then emit everything that is still held back
+  if (!counters.halted) {
+    runPublisher(publisher_ref, counters);
+  }
 
-      LOG(ERROR) << "Publisher \"" << publisher_name
-                 << "\" reported an error: " << s.getMessage()
-                 << ". Halting...\n";
+  publisher_ref->flushEvents(true);
+  publisher_thread_data->completion.set_value();
+}
+
+/// (Re)arms the readiness descriptor of the given publisher
+void armReactorPublisher(ReactorData& reactor_data,
+                         ReactorPublisher& reactor_publisher,
+                         int operation) {
+  epoll_event event{};
+  event.events = EPOLLIN | EPOLLONESHOT;
+  event.data.u64 = reactor_publisher.index;
+
+  if (epoll_ctl(reactor_data.epoll_fd,
+                operation,
+                reactor_publisher.descriptor,
+                &event) != 0) {
+    auto publisher_name = PublisherRegistry::instance().publisherName(
+        reactor_publisher.publisher);
+
+    LOG(ERROR) << "Failed to register the readiness descriptor of publisher \""
+               << publisher_name << "\": " << std::strerror(errno)
+               << ". Halting...\n";
+
+    reactor_publisher.counters->halted = true;
+  }
+}
+
+/// Arms the flush timer of the given publisher with its flush deadline, or
+/// disarms it if there are no pending events
+void armReactorFlushTimer(ReactorPublisher& reactor_publisher) {
+  auto deadline = reactor_publisher.publisher->flushDeadline();
+
+  itimerspec timer_value{};
+  if (deadline != std::chrono::steady_clock::time_point::max()) {
+    auto remaining_time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        deadline - std::chrono::steady_clock::now());
+
+    // A zero value would disarm the timer
+    auto nanoseconds = std::max(remaining_time.count(),
+                                static_cast<std::chrono::nanoseconds::rep>(1));
+
+    timer_value.it_value.tv_sec = static_cast<time_t>(nanoseconds / 1000000000);
+    timer_value.it_value.tv_nsec = static_cast<long>(nanoseconds % 1000000000);
+  }
+
+  if (timerfd_settime(
+          reactor_publisher.flush_timer_fd, 0, &timer_value, nullptr) != 0) {
+    LOG(ERROR) << "Failed to arm the flush timer of a publisher: "
+               << std::strerror(errno);
+  }
+}
+
+/// Worker task; updates the configuration and, if requested, runs the
+/// publisher once. Pending events are emitted when their deadline expires
+void servicePublisher(ReactorData& reactor_data,
+                      ReactorPublisher& reactor_publisher,
+                      bool run_publisher) {
+  auto& counters = *reactor_publisher.counters;
+
+  bool succeeded = updatePublisherConfiguration(
+      reactor_publisher.publisher,
+      reactor_data.configuration_file,
+      reactor_publisher.configuration_handle,
+      reactor_publisher.configuration_generation,
+      counters);
+
+  if (succeeded && run_publisher) {
+    succeeded = runPublisher(reactor_publisher.publisher, counters);
+  }
+
+  reactor_publisher.publisher->flushEvents(!succeeded);
+  armReactorFlushTimer(reactor_publisher);
+
+  reactor_publisher.scheduled = false;
+
+  // The descriptor is level-triggered, so events that have been received
+  // while this task was running are reported again
+  if (succeeded) {
+    armReactorPublisher(reactor_data, reactor_publisher, EPOLL_CTL_MOD);
+  }
+}
+
+/// Queues a task for the given publisher, unless one is already pending
+void dispatchReactorPublisher(ReactorData& reactor_data,
+                              ReactorPublisher& reactor_publisher,
+                              bool run_publisher) {
+  if (reactor_publisher.counters->halted ||
+      reactor_publisher.scheduled.exchange(true)) {
+    return;
+  }
+
+  auto L_task = [&reactor_data, &reactor_publisher, run_publisher]() -> void {
+    servicePublisher(reactor_data, reactor_publisher, run_publisher);
+
+    // Notify while holding the lock, as ::stop() may destroy the condition
+    // variable as soon as the count reaches zero
+    std::lock_guard<std::mutex> lock(reactor_data.pending_task_mutex);
+    --reactor_data.pending_task_count;
+    reactor_data.pending_task_cv.notify_all();
+  };
+
+  {
+    std::lock_guard<std::mutex> lock(reactor_data.pending_task_mutex);
+    ++reactor_data.pending_task_count;
+  }
+
+  auto status = reactor_data.worker_pool->submit(L_task);
+  if (!status.ok()) {
+    LOG(ERROR) << "Failed to schedule a publisher: " << status.getMessage();
+    reactor_publisher.scheduled = false;
+
+    std::lock_guard<std::mutex> lock(reactor_data.pending_task_mutex);
+    --reactor_data.pending_task_count;
+  }
+}
+
+/// Reads (and discards) the counter of an eventfd or timerfd descriptor
+void drainDescriptor(int fd) {
+  std::uint64_t counter;
+  while (read(fd, &counter, sizeof(counter)) == sizeof(counter)) {
+  }
+}
+
+/// The reactor thread; waits for the publishers to become ready and queues
+/// them on the worker pool
+void reactorThread(ReactorData& reactor_data,
+                   std::atomic_bool& terminate_thread) {
+  std::array<epoll_event, 32U> event_list;
+
+  while (!terminate_thread) {
+    auto event_count = epoll_wait(reactor_data.epoll_fd,
+                                  event_list.data(),
+                                  static_cast<int>(event_list.size()),
+                                  -1);
+
+    if (event_count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      LOG(ERROR) << "The publisher reactor has failed: "
+                 << std::strerror(errno);
       break;
     }
+
+    for (auto i = 0U; i < static_cast<unsigned int>(event_count); ++i) {
+      auto tag = event_list.at(i).data.u64;
+
+      if (tag == kReactorWakeupTag) {
+        drainDescriptor(reactor_data.wakeup_fd);
+
+      } else if (tag == kReactorTimerTag) {
+        drainDescriptor(reactor_data.timer_fd);
+
+        for (auto& reactor_publisher : reactor_data.publisher_list) {
+          dispatchReactorPublisher(reactor_data, *reactor_publisher, false);
+        }
+
+      } else if ((tag & kReactorFlushTimerTagBit) != 0U) {
+        auto index = tag & ~kReactorFlushTimerTagBit;
+        if (index >= reactor_data.publisher_list.size()) {
+          continue;
+        }
+
+        auto& reactor_publisher = *reactor_data.publisher_list.at(index);
+        drainDescriptor(reactor_publisher.flush_timer_fd);
+
+        dispatchReactorPublisher(reactor_data, reactor_publisher, false);
+
+      } else if (tag < reactor_data.publisher_list.size()) {
+        auto& reactor_publisher = *reactor_data.publisher_list.at(tag);
+        dispatchReactorPublisher(reactor_data, reactor_publisher, true);
+      }
+    }
   }
 }
 } // namespace
@@ -105,8 +532,21 @@ struct PublisherScheduler::PrivateData final {
   /// The publisher thread list
   std::vector<PublisherThreadDataRef> publisher_thread_descriptors;
 
-  /// This is used to send the shutdown command to the threads
+  /// This is used to send the shutdown command to the reactor
   std::atomic_bool terminate_threads{false};
+
+  /// Publishers whose thread missed the shutdown deadline; they are still
+  /// running, and must not be touched
+  std::unordered_set<IEventPublisher*> detached_publishers;
+
+  /// Reactor data; only allocated in reactor mode
+  ReactorDataRef reactor_data;
+
+  /// Publisher counters, organized by publisher name
+  std::unordered_map<std::string, PublisherCountersRef> counters_map;
+
+  /// Thread settings, organized by thread name
+  ThreadSettingsMap thread_settings_map;
 };
 
 PublisherScheduler::PublisherScheduler(
@@ -115,6 +555,118 @@ PublisherScheduler::PublisherScheduler(
   d->publisher_list = std::move(publisher_list);
 }
 
+osquery::Status PublisherScheduler::startReactor(
+    const PublisherSchedulerSettings& settings,
+    ConfigurationFileRef configuration_file) {
+  auto reactor_data = std::make_unique<ReactorData>();
+  reactor_data->configuration_file = configuration_file;
+
+  for (const auto& publisher : d->publisher_list) {
+    auto descriptor = publisher->readinessDescriptor();
+    if (descriptor == -1) {
+      continue;
+    }
+
+    auto reactor_publisher = std::make_unique<ReactorPublisher>();
+    reactor_publisher->publisher = publisher;
+    reactor_publisher->descriptor = descriptor;
+    reactor_publisher->index = reactor_data->publisher_list.size();
+    reactor_publisher->configuration_handle = configuration_file->getHandle();
+
+    auto publisher_name =
+        PublisherRegistry::instance().publisherName(publisher);
+
+    reactor_publisher->counters = createPublisherCounters(publisher_name, true);
+    d->counters_map.insert({publisher_name, reactor_publisher->counters});
+
+    reactor_data->publisher_list.push_back(std::move(reactor_publisher));
+  }
+
+  if (reactor_data->publisher_list.empty()) {
+    return osquery::Status(0);
+  }
+
+  reactor_data->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  reactor_data->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  reactor_data->timer_fd =
+      timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+  if (reactor_data->epoll_fd == -1 || reactor_data->wakeup_fd == -1 ||
+      reactor_data->timer_fd == -1) {
+    return osquery::Status(1,
+                           std::string("Failed to create the reactor: ") +
+                               std::strerror(errno));
+  }
+
+  itimerspec timer_interval{};
+  timer_interval.it_value.tv_sec = kReactorConfigurationInterval;
+  timer_interval.it_interval.tv_sec = kReactorConfigurationInterval;
+
+  if (timerfd_settime(reactor_data->timer_fd, 0, &timer_interval, nullptr) !=
+      0) {
+    return osquery::Status(1, "Failed to start the reactor timer");
+  }
+
+  for (auto p : {std::make_pair(reactor_data->wakeup_fd, kReactorWakeupTag),
+                 std::make_pair(reactor_data->timer_fd, kReactorTimerTag)}) {
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = p.second;
+
+    if (epoll_ctl(reactor_data->epoll_fd, EPOLL_CTL_ADD, p.first, &event) !=
+        0) {
+      return osquery::Status(1, "Failed to initialize the reactor");
+    }
+  }
+
+  auto status = WorkerPool::create(
+      reactor_data->worker_pool,
+      settings.worker_count,
+      getThreadSettings(d->thread_settings_map, "pubsub_worker"));
+  if (!status.ok()) {
+    return status;
+  }
+
+  for (auto& reactor_publisher : reactor_data->publisher_list) {
+    reactor_publisher->flush_timer_fd =
+        timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    if (reactor_publisher->flush_timer_fd == -1) {
+      return osquery::Status(1, "Failed to create the publisher flush timer");
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = reactor_publisher->index | kReactorFlushTimerTagBit;
+
+    if (epoll_ctl(reactor_data->epoll_fd,
+                  EPOLL_CTL_ADD,
+                  reactor_publisher->flush_timer_fd,
+                  &event) != 0) {
+      return osquery::Status(1, "Failed to initialize the reactor");
+    }
+
+    armReactorPublisher(*reactor_data, *reactor_publisher, EPOLL_CTL_ADD);
+
+    // The initial configuration is applied right away
+    dispatchReactorPublisher(*reactor_data, *reactor_publisher, false);
+  }
+
+  auto reactor_data_ptr = reactor_data.get();
+  auto terminate_ptr = &d->terminate_threads;
+
+  auto L_reactorThread = [reactor_data_ptr, terminate_ptr]() -> void {
+    reactorThread(*reactor_data_ptr, *terminate_ptr);
+  };
+
+  reactor_data->thread = std::make_unique<std::thread>(startThread(
+      getThreadSettings(d->thread_settings_map, "pubsub_reactor"),
+      L_reactorThread));
+
+  d->reactor_data = std::move(reactor_data);
+  return osquery::Status(0);
+}
+
 osquery::Status PublisherScheduler::create(
     PublisherSchedulerRef& publisher_scheduler,
     const std::vector<IEventPublisherRef>& publisher_list) {
@@ -140,37 +692,263 @@ PublisherScheduler::~PublisherScheduler() {
 
 osquery::Status PublisherScheduler::start(
     ConfigurationFileRef configuration_file) {
-  for (const auto& publisher : d->publisher_list) {
-    try {
-      auto publisher_thread_data =
-          std::make_shared<PublisherThreadData>(d->terminate_threads);
+  PublisherSchedulerSettings settings;
+
+  try {
+    auto configuration_handle = configuration_file->getHandle();
+    configuration_file->configurationChanged(configuration_handle);
+
+    auto configuration =
+        configuration_file->getConfiguration(configuration_handle);
+
+    auto status =
+        parseSettings(settings, configuration["pubsub"]["scheduler"]);
+    if (!status.ok()) {
+      return status;
+    }
+
+    status = parseThreadSettingsMap(d->thread_settings_map,
+                                    configuration["pubsub"]["threads"]);
+    if (!status.ok()) {
+      return status;
+    }
+
+    // Services are started before the scheduler, during the publisher
+    // initialization
+    ServiceManager::instance().configureThreads(d->thread_settings_map);
+
+    if (settings.mode == PublisherSchedulerMode::Reactor) {
+      status = startReactor(settings, configuration_file);
+      if (!status.ok()) {
+        return status;
+      }
+    }
+
+    for (const auto& publisher : d->publisher_list) {
+      auto publisher_name =
+          PublisherRegistry::instance().publisherName(publisher);
+      if (d->counters_map.count(publisher_name) != 0U) {
+        continue;
+      }
+
+      auto publisher_thread_data = std::make_shared<PublisherThreadData>();
 
       publisher_thread_data->publisher = publisher;
       publisher_thread_data->configuration_file = configuration_file;
+      publisher_thread_data->counters =
+          createPublisherCounters(publisher_name, false);
 
-      publisher_thread_data->thread =
-          std::make_unique<std::thread>(publisherThread, publisher_thread_data);
+      d->counters_map.insert(
+          {publisher_name, publisher_thread_data->counters});
 
-      d->publisher_thread_descriptors.push_back(publisher_thread_data);
+      auto L_publisherThread = [publisher_thread_data]() -> void {
+        publisherThread(publisher_thread_data);
+      };
 
-    } catch (const std::bad_alloc&) {
-      return osquery::Status(1, "Memory allocation failure");
+      publisher_thread_data->thread = std::make_unique<std::thread>(
+          startThread(getThreadSettings(d->thread_settings_map, publisher_name),
+                      L_publisherThread));
+
+      d->publisher_thread_descriptors.push_back(publisher_thread_data);
     }
+
+  } catch (const std::bad_alloc&) {
+    return osquery::Status(1, "Memory allocation failure");
+
+  } catch (const std::exception& e) {
+    return osquery::Status(1, e.what());
   }
 
-  if (d->publisher_thread_descriptors.empty()) {
+  if (d->publisher_thread_descriptors.empty() && !d->reactor_data) {
     return osquery::Status(1, "No active publisher found");
   }
 
   return osquery::Status(0);
 }
-void PublisherScheduler::stop() {
+
+void PublisherScheduler::stop(std::chrono::milliseconds timeout) {
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+
   d->terminate_threads = true;
+  for (const auto& publisher_descriptor : d->publisher_thread_descriptors) {
+    publisher_descriptor->terminate = true;
+  }
+
+  // Publishers blocking inside ::run() would otherwise hold the shutdown
+  // until their own timeout expires
+  for (const auto& publisher : d->publisher_list) {
+    if (d->detached_publishers.count(publisher.get()) == 0U) {
+      publisher->interrupt();
+    }
+  }
+
+  if (d->reactor_data) {
+    std::uint64_t counter{1U};
+    if (write(d->reactor_data->wakeup_fd, &counter, sizeof(counter)) !=
+        sizeof(counter)) {
+      LOG(ERROR) << "Failed to wake up the publisher reactor";
+    }
+
+    // The reactor thread only waits on epoll; once it has returned, no new
+    // task can be queued
+    auto& reactor_data = *d->reactor_data;
+    reactor_data.thread->join();
+
+    // Since the publishers have been interrupted, the pending tasks should
+    // return quickly
+    bool tasks_completed = false;
+
+    {
+      std::unique_lock<std::mutex> lock(reactor_data.pending_task_mutex);
+      tasks_completed = reactor_data.pending_task_cv.wait_until(
+          lock, deadline, [&reactor_data]() -> bool {
+            return reactor_data.pending_task_count == 0U;
+          });
+    }
+
+    if (tasks_completed) {
+      reactor_data.worker_pool.reset();
+    }
+
+    // Drain the events the publishers have already received; the ones that
+    // are still running are detached
+    for (const auto& reactor_publisher : reactor_data.publisher_list) {
+      if (reactor_publisher->scheduled) {
+        auto publisher_name = PublisherRegistry::instance().publisherName(
+            reactor_publisher->publisher);
+
+        LOG(WARNING) << "Publisher \"" << publisher_name
+                     << "\" did not stop within " << timeout.count()
+                     << " ms and has been detached; its pending events are "
+                        "lost";
+
+        d->detached_publishers.insert(reactor_publisher->publisher.get());
+        continue;
+      }
+
+      auto& counters = *reactor_publisher->counters;
+      if (!counters.halted) {
+        runPublisher(reactor_publisher->publisher, counters);
+      }
+    }
+
+    if (tasks_completed) {
+      d->reactor_data.reset();
+    } else {
+      // The worker tasks still reference the reactor data (and the pool
+      // destructor would wait for them), so it is intentionally leaked
+      static_cast<void>(d->reactor_data.release());
+    }
+  }
 
   for (const auto& publisher_descriptor : d->publisher_thread_descriptors) {
-    publisher_descriptor->thread->join();
+    auto completion = publisher_descriptor->completion.get_future();
+    if (completion.wait_until(deadline) == std::future_status::ready) {
+      publisher_descriptor->thread->join();
+      continue;
+    }
+
+    auto publisher_name = PublisherRegistry::instance().publisherName(
+        publisher_descriptor->publisher);
+
+    LOG(WARNING) << "Publisher \"" << publisher_name
+                 << "\" did not stop within " << timeout.count()
+                 << " ms and has been detached; its pending events are lost";
+
+    publisher_descriptor->thread->detach();
+    d->detached_publishers.insert(publisher_descriptor->publisher.get());
   }
 
   d->publisher_thread_descriptors.clear();
+
+  // Emit the events that are still held back by the coalescing policy
+  for (const auto& publisher : d->publisher_list) {
+    if (d->detached_publishers.count(publisher.get()) == 0U) {
+      publisher->flushEvents(true);
+    }
+  }
+}
+
+osquery::Status PublisherScheduler::parseSettings(
+    PublisherSchedulerSettings& settings, const json11::Json& configuration) {
+  settings = {};
+
+  if (configuration.is_null()) {
+    return osquery::Status(0);
+  }
+
+  if (!configuration.is_object()) {
+    return osquery::Status(1,
+                           "The scheduler configuration must be an object");
+  }
+
+  const auto& mode_obj = configuration["mode"];
+  if (!mode_obj.is_null()) {
+    const auto& mode = mode_obj.string_value();
+
+    if (mode == "threads") {
+      settings.mode = PublisherSchedulerMode::Threads;
+    } else if (mode == "reactor") {
+      settings.mode = PublisherSchedulerMode::Reactor;
+    } else {
+      return osquery::Status(1, "Invalid 'mode' value: " + mode);
+    }
+  }
+
+  return getSizeSetting(settings.worker_count, configuration, "worker_count");
+}
+
+osquery::Status PublisherScheduler::parseCoalescingSettings(
+    EventCoalescingSettings& settings, const json11::Json& configuration) {
+  settings = {};
+
+  if (configuration.is_null()) {
+    return osquery::Status(0);
+  }
+
+  if (!configuration.is_object()) {
+    return osquery::Status(1,
+                           "The coalescing configuration must be an object");
+  }
+
+  auto status = getSizeSetting(
+      settings.max_batch_size, configuration, "max_batch_size");
+  if (!status.ok()) {
+    return status;
+  }
+
+  std::size_t max_linger_time{0U};
+  status = getSizeSetting(max_linger_time, configuration, "max_linger_time");
+  if (!status.ok()) {
+    return status;
+  }
+
+  settings.max_linger_time = std::chrono::milliseconds(max_linger_time);
+
+  if (settings.max_batch_size != 0U && max_linger_time == 0U) {
+    return osquery::Status(
+        1, "The 'max_linger_time' value is required by 'max_batch_size'");
+  }
+
+  return osquery::Status(0);
+}
+
+PublisherStatisticsMap PublisherScheduler::statistics() const {
+  PublisherStatisticsMap statistics_map;
+
+  for (const auto& p : d->counters_map) {
+    const auto& publisher_name = p.first;
+    const auto& counters = *p.second;
+
+    PublisherStatistics statistics;
+    statistics.run_count = counters.run_count->value();
+    statistics.cpu_time = counters.cpu_time->value();
+    statistics.reactor = counters.reactor;
+    statistics.halted = counters.halted;
+
+    statistics_map.insert({publisher_name, statistics});
+  }
+
+  return statistics_map;
 }
 } // namespace trailofbits
@@ -18,8 +18,13 @@
 
 #include <osquery/logger.h>
 
+#include <cerrno>
 #include <vector>
 
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
 namespace trailofbits {
 ServiceManager::ServiceManager() {}
 
@@ -30,14 +35,100 @@ ServiceManager& ServiceManager::instance() {
 
 ServiceManager::~ServiceManager() {}
 
-void ServiceManager::stop() {
+osquery::Status ServiceManager::startService(IServiceRef service_ref) {
+  auto wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (wakeup_fd == -1) {
+    return osquery::Status(1, "Failed to create the service wake-up eventfd");
+  }
+
+  service_ref->wakeup_fd = wakeup_fd;
+
+  try {
+    auto completion = std::make_shared<std::promise<void>>();
+    std::shared_future<void> future = completion->get_future().share();
+
+    // Capture the service reference so that a service detached by ::stop()
+    // remains valid until its thread returns
+    auto L_serviceThread = [service_ref, completion]() -> void {
+      service_ref->run();
+      completion->set_value();
+    };
+
+    auto thread_settings =
+        getThreadSettings(thread_settings_map, service_ref->name());
+
+    pid_t thread_id{0};
+    auto thread_ref = std::make_shared<std::thread>(
+        startThread(thread_settings, L_serviceThread, &thread_id));
+
+    service_list.push_back({service_ref, thread_ref, future, thread_id});
+
+    return osquery::Status(0);
+
+  } catch (const std::system_error&) {
+    close(wakeup_fd);
+    service_ref->wakeup_fd = -1;
+
+    return osquery::Status(1, "Failed to start the service thread");
+  }
+}
+
+void ServiceManager::configureThreads(const ThreadSettingsMap& settings_map) {
+  std::lock_guard<std::mutex> lock(service_list_mutex);
+
+  thread_settings_map = settings_map;
+
+  for (const auto& service_descriptor : service_list) {
+    auto service_name = service_descriptor.service_ref->name();
+    if (thread_settings_map.count(service_name) == 0U) {
+      continue;
+    }
+
+    auto thread_settings =
+        getThreadSettings(thread_settings_map, service_name);
+
+    auto status =
+        applyThreadSettings(thread_settings,
+                            service_descriptor.thread_ref->native_handle(),
+                            service_descriptor.thread_id);
+
+    if (!status.ok()) {
+      LOG(WARNING) << "Failed to apply the thread settings of service \""
+                   << service_name << "\": " << status.getMessage();
+    }
+  }
+}
+
+void ServiceManager::stop(std::chrono::milliseconds timeout) {
   std::lock_guard<std::mutex> lock(service_list_mutex);
 
   terminate = true;
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+
+  for (auto& service_descriptor : service_list) {
+    std::uint64_t value = 1U;
+    auto err = write(
+        service_descriptor.service_ref->wakeup_fd, &value, sizeof(value));
+    static_cast<void>(err);
+  }
 
   for (auto& service_descriptor : service_list) {
+    auto status = service_descriptor.completion.wait_until(deadline);
+    if (status != std::future_status::ready) {
+      // The thread keeps its own service reference; the wake-up descriptor
+      // is intentionally leaked since the service may still be polling it
+      LOG(WARNING) << "A service did not terminate within "
+                   << timeout.count() << " ms and has been detached";
+
+      service_descriptor.thread_ref->detach();
+      continue;
+    }
+
     service_descriptor.thread_ref->join();
     service_descriptor.service_ref->release();
+
+    close(service_descriptor.service_ref->wakeup_fd);
+    service_descriptor.service_ref->wakeup_fd = -1;
   }
 
   service_list.clear();
@@ -48,6 +139,27 @@ bool IService::shouldTerminate() const {
   return terminate->load();
 }
 
+int IService::wakeupDescriptor() const {
+  return wakeup_fd;
+}
+
+bool IService::waitForTermination(std::chrono::milliseconds timeout) const {
+  if (shouldTerminate()) {
+    return true;
+  }
+
+  struct pollfd descriptor = {};
+  descriptor.fd = wakeup_fd;
+  descriptor.events = POLLIN;
+
+  auto timeout_msecs = static_cast<int>(timeout.count());
+  if (poll(&descriptor, 1, timeout_msecs) == -1 && errno != EINTR) {
+    std::this_thread::sleep_for(timeout);
+  }
+
+  return shouldTerminate();
+}
+
 osquery::Status IService::initialize() {
   return osquery::Status(0);
 }
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pubsub/settingsutils.h>
+
+#include <cmath>
+
+namespace trailofbits {
+osquery::Status getSizeSetting(std::size_t& value,
+                               const json11::Json& configuration,
+                               const std::string& name,
+                               std::size_t minimum,
+                               std::size_t maximum) {
+  const auto& value_obj = configuration[name];
+  if (value_obj.is_null()) {
+    return osquery::Status(0);
+  }
+
+  // The std::size_t maximum converts to 2^64, which is already out of range
+  auto number = value_obj.number_value();
+  if (!value_obj.is_number() || std::floor(number) != number ||
+      number < static_cast<double>(minimum) ||
+      number >=
+          static_cast<double>(std::numeric_limits<std::size_t>::max()) ||
+      static_cast<std::size_t>(number) > maximum) {
+    std::string description;
+    if (maximum != std::numeric_limits<std::size_t>::max()) {
+      description = "an integer between " + std::to_string(minimum) +
+                    " and " + std::to_string(maximum);
+    } else if (minimum == 0U) {
+      description = "a non-negative integer";
+    } else if (minimum == 1U) {
+      description = "a positive integer";
+    } else {
+      description = "an integer not lower than " + std::to_string(minimum);
+    }
+
+    return osquery::Status(
+        1, "The '" + name + "' value must be " + description);
+  }
+
+  value = static_cast<std::size_t>(number);
+  return osquery::Status(0);
+}
+
+osquery::Status getNumberSetting(double& value,
+                                 const json11::Json& configuration,
+                                 const std::string& name) {
+  const auto& value_obj = configuration[name];
+  if (value_obj.is_null()) {
+    return osquery::Status(0);
+  }
+
+  if (!value_obj.is_number() || !std::isfinite(value_obj.number_value()) ||
+      value_obj.number_value() < 0.0) {
+    return osquery::Status(
+        1, "The '" + name + "' value must be a non-negative number");
+  }
+
+  value = value_obj.number_value();
+  return osquery::Status(0);
+}
+} // namespace trailofbits
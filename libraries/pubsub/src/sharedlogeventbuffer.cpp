@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sharedlogeventbuffer.h"
+#include "eventbufferutils.h"
+
+#include <osquery/logger.h>
+
+#include <algorithm>
+
+namespace trailofbits {
+namespace {
+/// How many consumer cursors each shared log keeps; the least recently
+/// used one is forgotten when a new consumer arrives
+const std::size_t kMaxConsumerCount = 256U;
+} // namespace
+
+SharedLogEventBuffer::SharedLogEventBuffer(
+    const EventBufferSettings& settings_,
+    EventBufferPressureStateRef pressure_state_)
+    : settings(settings_), pressure_state(std::move(pressure_state_)) {}
+
+void SharedLogEventBuffer::expireCursors() {
+  if (settings.consumer_timeout == 0U) {
+    return;
+  }
+
+  auto expiration_time =
+      std::chrono::steady_clock::now() -
+      std::chrono::seconds(
+          static_cast<std::chrono::seconds::rep>(settings.consumer_timeout));
+
+  for (auto it = cursor_map.begin(); it != cursor_map.end();) {
+    if (it->second.last_read_time < expiration_time) {
+      LOG(WARNING) << "The consumer named \"" << it->first
+                   << "\" has not read the buffer for "
+                   << settings.consumer_timeout
+                   << " seconds, and has been forgotten";
+
+      it = cursor_map.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+std::uint64_t SharedLogEventBuffer::oldestUnreadSequence() const {
+  // Without consumers, nothing has been read yet
+  if (cursor_map.empty()) {
+    return first_sequence;
+  }
+
+  auto oldest_unread_sequence = cursor_map.begin()->second.sequence;
+  for (const auto& p : cursor_map) {
+    oldest_unread_sequence =
+        std::min(oldest_unread_sequence, p.second.sequence);
+  }
+
+  return oldest_unread_sequence;
+}
+
+std::size_t SharedLogEventBuffer::unreadRowCount() const {
+  return static_cast<std::size_t>(
+      first_sequence + row_list.size() -
+      std::max(oldestUnreadSequence(), first_sequence));
+}
+
+void SharedLogEventBuffer::updatePressure() {
+  updatePressureState(
+      *pressure_state,
+      settings,
+      unreadRowCount(),
+      getRowLimit(settings, settings.capacity, average_row_size),
+      0U);
+}
+
+osquery::Status SharedLogEventBuffer::create(
+    IEventBufferRef& obj,
+    const EventBufferSettings& settings,
+    const std::string& buffer_name,
+    EventBufferPressureStateRef pressure_state) {
+  static_cast<void>(buffer_name);
+
+  obj.reset();
+
+  if (settings.capacity == 0U) {
+    return osquery::Status(1, "Invalid buffer capacity");
+  }
+
+  if (settings.overflow_policy == EventBufferOverflowPolicy::SpillToDisk ||
+      settings.persistent) {
+    return osquery::Status(
+        1, "Shared logs can't be spilled to disk or made persistent");
+  }
+
+  try {
+    if (!pressure_state) {
+      pressure_state = std::make_shared<EventBufferPressureState>(
+          EventBufferPressure::Low);
+    }
+
+    auto ptr = new SharedLogEventBuffer(settings, std::move(pressure_state));
+    obj.reset(ptr);
+
+    return osquery::Status(0);
+
+  } catch (const std::bad_alloc&) {
+    return osquery::Status(1, "Memory allocation failure");
+  }
+}
+
+void SharedLogEventBuffer::save(EventBatch& events) {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  if (!events.empty()) {
+    average_row_size = updateAverageRowSize(average_row_size,
+                                            estimateRowSize(*events.front()));
+  }
+
+  expireCursors();
+
+  auto row_limit = getRowLimit(settings, settings.capacity, average_row_size);
+  auto oldest_unread_sequence = oldestUnreadSequence();
+
+  for (auto& row : events) {
+    if (row_list.size() >= row_limit &&
+        settings.overflow_policy == EventBufferOverflowPolicy::DropNewest) {
+      ++rejected_row_count;
+      continue;
+    }
+
+    while (row_list.size() >= row_limit) {
+      if (first_sequence >= oldest_unread_sequence) {
+        ++overwritten_row_count;
+      }
+
+      row_list.pop_front();
+      ++first_sequence;
+    }
+
+    // Rows moved from another shared log are not wrapped twice
+    auto shared_row = dynamic_cast<const SharedTableRow*>(row.get());
+    if (shared_row != nullptr) {
+      row_list.push_back(shared_row->data());
+    } else {
+      row_list.push_back(SharedTableRowData(row.release()));
+    }
+  }
+
+  events.clear();
+  updatePressure();
+}
+
+EventBatch SharedLogEventBuffer::get() {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  EventBatch event_batch;
+  event_batch.reserve(row_list.size());
+
+  for (auto& row : row_list) {
+    event_batch.push_back(osquery::TableRowHolder(
+        new SharedTableRow(std::move(row), first_sequence, true, nullptr)));
+
+    ++first_sequence;
+  }
+
+  row_list.clear();
+  updatePressure();
+
+  return event_batch;
+}
+
+EventBatch SharedLogEventBuffer::read(const EventReadRequest& request) {
+  std::shared_ptr<const std::string> consumer;
+  if (!request.consumer.empty()) {
+    consumer = std::make_shared<const std::string>(request.consumer);
+  }
+
+  EventBatch event_batch;
+  std::uint64_t missed_row_count = 0U;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    expireCursors();
+
+    // New consumers start from the oldest row that is still available
+    auto cursor_it = cursor_map.find(request.consumer);
+    if (cursor_it == cursor_map.end()) {
+      if (cursor_map.size() >= kMaxConsumerCount) {
+        auto L_compareReadTime = [](const CursorMap::value_type& lhs,
+                                    const CursorMap::value_type& rhs) -> bool {
+          return lhs.second.last_read_time < rhs.second.last_read_time;
+        };
+
+        auto oldest_it = std::min_element(
+            cursor_map.begin(), cursor_map.end(), L_compareReadTime);
+
+        LOG(WARNING) << "Too many consumers are reading the buffer; the "
+                        "consumer named \""
+                     << oldest_it->first << "\" has been forgotten";
+
+        cursor_map.erase(oldest_it);
+      }
+
+      ConsumerCursor new_cursor;
+      new_cursor.sequence = first_sequence;
+
+      cursor_it = cursor_map.insert({request.consumer, new_cursor}).first;
+    }
+
+    cursor_it->second.last_read_time = std::chrono::steady_clock::now();
+
+    auto& cursor = cursor_it->second.sequence;
+    if (request.has_start_sequence) {
+      cursor = request.start_sequence;
+
+    } else if (cursor < first_sequence) {
+      missed_row_count = first_sequence - cursor;
+    }
+
+    cursor = std::max(cursor, first_sequence);
+
+    auto end_sequence = first_sequence + row_list.size();
+    if (cursor < end_sequence) {
+      event_batch.reserve(static_cast<std::size_t>(end_sequence - cursor));
+    }
+
+    for (; cursor < end_sequence; ++cursor) {
+      auto index = static_cast<std::size_t>(cursor - first_sequence);
+
+      event_batch.push_back(osquery::TableRowHolder(
+          new SharedTableRow(row_list.at(index), cursor, true, consumer)));
+    }
+
+    updatePressure();
+  }
+
+  if (missed_row_count != 0U) {
+    LOG(WARNING) << "The consumer named \"" << request.consumer
+                 << "\" has missed " << missed_row_count
+                 << " rows that were discarded before it could read them";
+  }
+
+  return event_batch;
+}
+
+EventBufferStatistics SharedLogEventBuffer::statistics() {
+  std::lock_guard<std::mutex> lock(mutex);
+  expireCursors();
+
+  EventBufferStatistics buffer_statistics;
+  buffer_statistics.row_count = row_list.size();
+  buffer_statistics.unread_row_count = unreadRowCount();
+  buffer_statistics.capacity =
+      getRowLimit(settings, settings.capacity, average_row_size);
+
+  buffer_statistics.memory_usage = row_list.size() * average_row_size;
+  buffer_statistics.overwritten_row_count = overwritten_row_count;
+  buffer_statistics.rejected_row_count = rejected_row_count;
+
+  return buffer_statistics;
+}
+
+void SharedLogEventBuffer::flush() {}
+} // namespace trailofbits
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "ieventbuffer.h"
+#include "sharedtablerow.h"
+
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+namespace trailofbits {
+/// An append-only event buffer that can be read by multiple consumers.
+///
+/// Every row gets a sequence number, and each consumer keeps its own read
+/// cursor; reading a row does not remove it. Consumers share the same row
+/// objects, so memory usage only depends on the amount of buffered rows.
+/// When the buffer is full, the oldest rows are discarded even if some
+/// consumers have not read them yet.
+///
+/// Cursors of consumers that stop reading are forgotten once the consumer
+/// timeout expires, or when too many consumers are tracked; a forgotten
+/// consumer starts again from the oldest row that is still available
+class SharedLogEventBuffer final : public IEventBuffer {
+  /// The read position of a consumer
+  struct ConsumerCursor final {
+    /// The next sequence number the consumer will read
+    std::uint64_t sequence{0U};
+
+    /// When the consumer has last read the buffer
+    std::chrono::steady_clock::time_point last_read_time;
+  };
+
+  /// A map of read cursors, organized by consumer name
+  using CursorMap = std::unordered_map<std::string, ConsumerCursor>;
+
+  /// Buffer settings
+  EventBufferSettings settings;
+
+  /// The buffered rows, from the oldest to the newest
+  std::deque<SharedTableRowData> row_list;
+
+  /// Sequence number of the first row in row_list
+  std::uint64_t first_sequence{0U};
+
+  /// Read cursors
+  CursorMap cursor_map;
+
+  /// Mutex protecting the rows, the cursors and the counters
+  std::mutex mutex;
+
+  /// Running average of the row size, sampled once per batch
+  std::size_t average_row_size{0U};
+
+  /// How many rows have been discarded before all consumers could read them
+  std::uint64_t overwritten_row_count{0U};
+
+  /// How many new rows have been discarded because the buffer was full
+  std::uint64_t rejected_row_count{0U};
+
+  /// Where the buffer publishes how full it is
+  EventBufferPressureStateRef pressure_state;
+
+  /// Private constructor; use ::create() instead
+  SharedLogEventBuffer(const EventBufferSettings& settings,
+                       EventBufferPressureStateRef pressure_state);
+
+  /// Forgets the consumers that have not read the buffer within the
+  /// consumer timeout; the mutex must be held
+  void expireCursors();
+
+  /// Returns the sequence number of the oldest row that has not been read
+  /// by all the consumers
+  std::uint64_t oldestUnreadSequence() const;
+
+  /// Returns how many rows have not been read by all the consumers
+  std::size_t unreadRowCount() const;
+
+  /// Publishes the current fill level; the mutex must be held
+  void updatePressure();
+
+ public:
+  /// Factory method; a private pressure state is allocated when none is
+  /// given
+  static osquery::Status create(
+      IEventBufferRef& obj,
+      const EventBufferSettings& settings,
+      const std::string& buffer_name,
+      EventBufferPressureStateRef pressure_state = nullptr);
+
+  /// Destructor
+  virtual ~SharedLogEventBuffer() override = default;
+
+  /// Appends the given events to the buffer; the batch is cleared
+  virtual void save(EventBatch& events) override;
+
+  /// Removes and returns all the events stored in the buffer, regardless
+  /// of the consumer cursors
+  virtual EventBatch get() override;
+
+  /// Returns the rows the consumer has not read yet, and advances its
+  /// cursor past them
+  virtual EventBatch read(const EventReadRequest& request) override;
+
+  /// Returns the buffer counters
+  virtual EventBufferStatistics statistics() override;
+
+  /// Shared logs are never persisted
+  virtual void flush() override;
+
+  /// Disable the copy constructor
+  SharedLogEventBuffer(const SharedLogEventBuffer& other) = delete;
+
+  /// Disable the assignment operator
+  SharedLogEventBuffer& operator=(const SharedLogEventBuffer& other) = delete;
+};
+} // namespace trailofbits
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sharedtablerow.h"
+#include "eventbufferutils.h"
+
+namespace trailofbits {
+SharedTableRow::SharedTableRow(SharedTableRowData row_,
+                               std::uint64_t sequence_,
+                               bool has_sequence_,
+                               std::shared_ptr<const std::string> consumer_)
+    : row(std::move(row_)),
+      sequence(sequence_),
+      has_sequence(has_sequence_),
+      consumer(std::move(consumer_)) {}
+
+osquery::Row SharedTableRow::materialize() const {
+  auto row_data = static_cast<osquery::Row>(*row);
+
+  if (has_sequence) {
+    row_data[kSequenceColumnName] = std::to_string(sequence);
+  }
+
+  if (consumer) {
+    row_data[kConsumerColumnName] = *consumer;
+  }
+
+  return row_data;
+}
+
+bool SharedTableRow::columnValue(std::string& value,
+                                 const std::string& column_name) const {
+  if (column_name == kSequenceColumnName) {
+    if (!has_sequence) {
+      return false;
+    }
+
+    value = std::to_string(sequence);
+    return true;
+  }
+
+  if (column_name == kConsumerColumnName) {
+    if (!consumer) {
+      return false;
+    }
+
+    value = *consumer;
+    return true;
+  }
+
+  auto lazy_row = dynamic_cast<const LazyTableRow*>(row.get());
+  if (lazy_row != nullptr) {
+    return lazy_row->columnValue(value, column_name);
+  }
+
+  auto row_data = static_cast<osquery::Row>(*row);
+
+  auto it = row_data.find(column_name);
+  if (it == row_data.end()) {
+    return false;
+  }
+
+  value = std::move(it->second);
+  return true;
+}
+
+std::size_t SharedTableRow::estimatedSize() const {
+  return sizeof(SharedTableRow) + estimateRowSize(*row);
+}
+
+const SharedTableRowData& SharedTableRow::data() const {
+  return row;
+}
+} // namespace trailofbits
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <pubsub/lazytablerow.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace trailofbits {
+/// A shared, read-only reference to a row
+using SharedTableRowData = std::shared_ptr<const osquery::TableRow>;
+
+/// A table row that references data shared by all the consumers of an
+/// event buffer, adding the hidden "sequence" and "consumer" columns
+class SharedTableRow final : public LazyTableRow {
+  /// The shared row data
+  SharedTableRowData row;
+
+  /// Sequence number of the row inside its buffer
+  std::uint64_t sequence{0U};
+
+  /// True if the sequence number is valid
+  bool has_sequence{false};
+
+  /// The consumer that has read the row; shared by all the rows returned
+  /// by the same read
+  std::shared_ptr<const std::string> consumer;
+
+ protected:
+  virtual osquery::Row materialize() const override;
+
+ public:
+  /// Constructor
+  SharedTableRow(SharedTableRowData row,
+                 std::uint64_t sequence,
+                 bool has_sequence,
+                 std::shared_ptr<const std::string> consumer);
+
+  /// Destructor
+  virtual ~SharedTableRow() override = default;
+
+  virtual bool columnValue(std::string& value,
+                           const std::string& column_name) const override;
+
+  virtual std::size_t estimatedSize() const override;
+
+  /// Returns the shared row data
+  const SharedTableRowData& data() const;
+};
+} // namespace trailofbits
@@ -24,12 +24,15 @@
 #include <boost/thread/shared_mutex.hpp>
 
 #include <iostream>
+#include <unordered_map>
 #include <unordered_set>
 
 namespace trailofbits {
 namespace {
-/// This structure holds the name of the publisher and the subscriber
+/// This structure holds the subscriber along with the name of the publisher
+/// and the subscriber
 struct EventSubscriberInformation final {
+  IEventSubscriberRef subscriber;
   std::string publisher_name;
   std::string subscriber_name;
 };
@@ -53,27 +56,24 @@ SubscriberFactoryMap& subscriberFactoryMap() {
 
 /// Private class data
 struct SubscriberRegistry::PrivateData final {
-  /// The subscriber map
-  std::unordered_map<IEventSubscriberRef, EventSubscriberInformation>
-      subscriber_map;
+  /// The subscriber list, indexed by subscriber id
+  std::vector<EventSubscriberInformation> subscriber_list;
 
-  /// The mutex protecting the subscriber map
-  boost::shared_timed_mutex subscriber_map_mutex;
+  /// The mutex protecting the subscriber list
+  boost::shared_timed_mutex subscriber_list_mutex;
 };
 
 SubscriberRegistry::SubscriberRegistry() : d(new PrivateData) {}
 
-std::string SubscriberRegistry::subscriberName(IEventSubscriberRef subscriber) {
-  boost::upgrade_lock<decltype(d->subscriber_map_mutex)> lock(
-      d->subscriber_map_mutex);
+std::string SubscriberRegistry::subscriberName(SubscriberId subscriber_id) {
+  boost::shared_lock<decltype(d->subscriber_list_mutex)> lock(
+      d->subscriber_list_mutex);
 
-  auto it = d->subscriber_map.find(subscriber);
-  if (it == d->subscriber_map.end()) {
+  if (subscriber_id >= d->subscriber_list.size()) {
     return std::string();
   }
 
-  const auto& subscriber_info = it->second;
-  return subscriber_info.subscriber_name;
+  return d->subscriber_list[subscriber_id].subscriber_name;
 }
 
 SubscriberRegistry::~SubscriberRegistry() {}
@@ -97,8 +97,8 @@ SubscriberRegistry& SubscriberRegistry::instance() {
 }
 
 osquery::Status SubscriberRegistry::initialize() {
-  boost::unique_lock<decltype(d->subscriber_map_mutex)> lock(
-      d->subscriber_map_mutex);
+  boost::unique_lock<decltype(d->subscriber_list_mutex)> lock(
+      d->subscriber_list_mutex);
 
   std::unordered_set<std::string> failed_publishers;
 
@@ -134,19 +134,22 @@ osquery::Status SubscriberRegistry::initialize() {
       continue;
     }
 
-    status = publisher->subscribe(subscriber);
+    auto subscriber_id = static_cast<SubscriberId>(d->subscriber_list.size());
+
+    status = publisher->subscribe(subscriber_id, subscriber, subscriber_name);
     if (!status.ok()) {
       std::cerr << "Subscriber \"" << subscriber_name
                 << "\" could not subscribe to publisher \""
                 << subscriber_descriptor.publisher_name
                 << "\": " << status.getMessage() << "\n";
+      continue;
     }
 
-    d->subscriber_map.insert(
-        {subscriber, {subscriber_descriptor.publisher_name, subscriber_name}});
+    d->subscriber_list.push_back(
+        {subscriber, subscriber_descriptor.publisher_name, subscriber_name});
   }
 
-  if (d->subscriber_map.empty()) {
+  if (d->subscriber_list.empty()) {
     return osquery::Status(1, "No active subscriber found");
   }
 
@@ -154,15 +157,15 @@ osquery::Status SubscriberRegistry::initialize() {
 }
 
 osquery::Status SubscriberRegistry::release() {
-  boost::unique_lock<decltype(d->subscriber_map_mutex)> lock(
-      d->subscriber_map_mutex);
+  boost::unique_lock<decltype(d->subscriber_list_mutex)> lock(
+      d->subscriber_list_mutex);
 
   std::unordered_set<std::string> publisher_name_list;
   bool release_error = false;
 
-  for (auto& p : d->subscriber_map) {
-    auto subscriber_ref = p.first;
-    const auto& subscriber_info = p.second;
+  for (auto i = 0U; i < d->subscriber_list.size(); ++i) {
+    auto subscriber_id = static_cast<SubscriberId>(i);
+    const auto& subscriber_info = d->subscriber_list[i];
 
     IEventPublisherRef publisher;
     auto status = PublisherRegistry::instance().get(
@@ -175,11 +178,11 @@ osquery::Status SubscriberRegistry::release() {
       continue;
     }
 
-    publisher->unsubscribe(subscriber_ref);
+    publisher->unsubscribe(subscriber_id);
     publisher_name_list.insert(subscriber_info.publisher_name);
   }
 
-  d->subscriber_map.clear();
+  d->subscriber_list.clear();
 
   for (auto& publisher_name : publisher_name_list) {
     auto status = PublisherRegistry::instance().release(publisher_name);
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pubsub/metricsregistry.h>
+#include <pubsub/table_generator.h>
+
+#include <algorithm>
+#include <chrono>
+
+namespace trailofbits {
+namespace {
+/// Converts a sequence number constraint
+bool parseSequence(std::uint64_t& sequence, const std::string& value) {
+  try {
+    std::size_t processed_chars = 0U;
+    sequence = std::stoull(value, &processed_chars);
+
+    return processed_chars == value.size() && value.front() != '-';
+
+  } catch (...) {
+    return false;
+  }
+}
+
+/// Returns the first sequence number that can satisfy the constraints, if
+/// any
+void getStartSequence(EventReadRequest& request,
+                      const osquery::ConstraintList& constraint_list) {
+  std::uint64_t sequence = 0U;
+
+  for (const auto& value : constraint_list.getAll(osquery::GREATER_THAN)) {
+    if (parseSequence(sequence, value)) {
+      sequence += 1U;
+
+      request.start_sequence = std::max(request.start_sequence, sequence);
+      request.has_start_sequence = true;
+    }
+  }
+
+  for (const auto& value :
+       constraint_list.getAll(osquery::GREATER_THAN_OR_EQUALS)) {
+    if (parseSequence(sequence, value)) {
+      request.start_sequence = std::max(request.start_sequence, sequence);
+      request.has_start_sequence = true;
+    }
+  }
+
+  // With more than one value (i.e.: IN), start from the smallest one
+  auto equals_value_list = constraint_list.getAll(osquery::EQUALS);
+
+  bool equals_found = false;
+  std::uint64_t equals_sequence = 0U;
+
+  for (const auto& value : equals_value_list) {
+    if (!parseSequence(sequence, value)) {
+      continue;
+    }
+
+    equals_sequence = equals_found ? std::min(equals_sequence, sequence)
+                                   : sequence;
+    equals_found = true;
+  }
+
+  if (equals_found) {
+    request.start_sequence = std::max(request.start_sequence, equals_sequence);
+    request.has_start_sequence = true;
+  }
+}
+} // namespace
+
+osquery::TableRows generateTableRows(const std::string& table_name,
+                                     const osquery::QueryContext& context,
+                                     const osquery::TableColumns& schema) {
+  auto start_time = std::chrono::steady_clock::now();
+
+  EventReadRequest base_request;
+
+  auto sequence_it = context.constraints.find(kSequenceColumnName);
+  if (sequence_it != context.constraints.end()) {
+    getStartSequence(base_request, sequence_it->second);
+  }
+
+  std::vector<EventReadRequest> request_list;
+
+  auto consumer_it = context.constraints.find(kConsumerColumnName);
+  if (consumer_it != context.constraints.end()) {
+    for (const auto& consumer : consumer_it->second.getAll(osquery::EQUALS)) {
+      auto request = base_request;
+      request.consumer = consumer;
+
+      request_list.push_back(std::move(request));
+    }
+  }
+
+  if (request_list.empty()) {
+    request_list.push_back(base_request);
+  }
+
+  auto& event_buffer_library = EventBufferLibrary::instance();
+
+  osquery::TableRows rows;
+  for (const auto& request : request_list) {
+    auto request_rows = event_buffer_library.getEvents(table_name, request);
+
+    if (rows.empty()) {
+      rows = std::move(request_rows);
+    } else {
+      std::move(request_rows.begin(),
+                request_rows.end(),
+                std::back_inserter(rows));
+    }
+  }
+
+  filterEventRows(rows, context, schema);
+
+  auto& metrics_registry = MetricsRegistry::instance();
+  metrics_registry.counter("table", table_name, "returned_rows")
+      ->add(rows.size());
+  metrics_registry.histogram("table", table_name, "generate_latency")
+      ->record(std::chrono::steady_clock::now() - start_time);
+
+  return rows;
+}
+} // namespace trailofbits
@@ -0,0 +1,447 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <pubsub/threadsettings.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <future>
+
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <osquery/logger.h>
+
+namespace trailofbits {
+namespace {
+/// Maximum length of a thread name, excluding the null terminator
+const std::size_t kMaxThreadNameLength = 15U;
+
+/// Scheduling policy names, as used in the configuration file
+const std::map<std::string, ThreadSchedulingPolicy> kSchedulingPolicyMap = {
+    {"other", ThreadSchedulingPolicy::Other},
+    {"batch", ThreadSchedulingPolicy::Batch},
+    {"idle", ThreadSchedulingPolicy::Idle},
+    {"fifo", ThreadSchedulingPolicy::Fifo},
+    {"rr", ThreadSchedulingPolicy::RoundRobin}};
+
+/// Returns true if the given policy is a realtime one
+bool isRealtimePolicy(ThreadSchedulingPolicy policy) {
+  return policy == ThreadSchedulingPolicy::Fifo ||
+         policy == ThreadSchedulingPolicy::RoundRobin;
+}
+
+/// Converts the given policy to the SCHED_* value
+int getSchedulingPolicyValue(ThreadSchedulingPolicy policy) {
+  switch (policy) {
+  case ThreadSchedulingPolicy::Batch:
+    return SCHED_BATCH;
+
+  case ThreadSchedulingPolicy::Idle:
+    return SCHED_IDLE;
+
+  case ThreadSchedulingPolicy::Fifo:
+    return SCHED_FIFO;
+
+  case ThreadSchedulingPolicy::RoundRobin:
+    return SCHED_RR;
+
+  case ThreadSchedulingPolicy::Inherit:
+  case ThreadSchedulingPolicy::Other:
+  default:
+    return SCHED_OTHER;
+  }
+}
+
+/// Reads an integer setting, checking that it is within the given range
+osquery::Status getIntegerSetting(int& value,
+                                  bool& found,
+                                  const json11::Json& configuration,
+                                  const std::string& name,
+                                  int minimum,
+                                  int maximum) {
+  found = false;
+
+  const auto& value_obj = configuration[name];
+  if (value_obj.is_null()) {
+    return osquery::Status(0);
+  }
+
+  if (!value_obj.is_number() || value_obj.number_value() < minimum ||
+      value_obj.number_value() > maximum) {
+    return osquery::Status(1,
+                           "The '" + name + "' value must be between " +
+                               std::to_string(minimum) + " and " +
+                               std::to_string(maximum));
+  }
+
+  value = value_obj.int_value();
+  found = true;
+
+  return osquery::Status(0);
+}
+
+/// Returns the CPUs of the given NUMA node
+osquery::Status getNumaNodeCpuList(std::vector<unsigned int>& cpu_list,
+                                   int numa_node) {
+  cpu_list.clear();
+
+  auto path = "/sys/devices/system/node/node" + std::to_string(numa_node) +
+              "/cpulist";
+
+  std::ifstream cpu_list_file(path);
+  std::string value;
+  if (!std::getline(cpu_list_file, value)) {
+    return osquery::Status(
+        1, "NUMA node " + std::to_string(numa_node) + " was not found");
+  }
+
+  return ThreadSettings::parseCpuList(cpu_list, value);
+}
+} // namespace
+
+osquery::Status ThreadSettings::parse(ThreadSettings& settings,
+                                      const json11::Json& configuration) {
+  settings = {};
+
+  if (configuration.is_null()) {
+    return osquery::Status(0);
+  }
+
+  if (!configuration.is_object()) {
+    return osquery::Status(1, "The thread configuration must be an object");
+  }
+
+  const auto& name_obj = configuration["name"];
+  if (!name_obj.is_null()) {
+    if (!name_obj.is_string() || name_obj.string_value().empty()) {
+      return osquery::Status(1, "The 'name' value must be a non-empty string");
+    }
+
+    settings.name = name_obj.string_value();
+  }
+
+  const auto& cpus_obj = configuration["cpus"];
+  if (cpus_obj.is_string()) {
+    auto status = parseCpuList(settings.cpu_list, cpus_obj.string_value());
+    if (!status.ok()) {
+      return status;
+    }
+
+  } else if (cpus_obj.is_array()) {
+    for (const auto& cpu_obj : cpus_obj.array_items()) {
+      auto cpu = cpu_obj.number_value();
+      if (!cpu_obj.is_number() || std::floor(cpu) != cpu || cpu < 0.0 ||
+          cpu >= static_cast<double>(CPU_SETSIZE)) {
+        return osquery::Status(1, "The 'cpus' array must contain CPU numbers");
+      }
+
+      settings.cpu_list.push_back(static_cast<unsigned int>(cpu));
+    }
+
+  } else if (!cpus_obj.is_null()) {
+    return osquery::Status(1, "The 'cpus' value must be a string or an array");
+  }
+
+  bool found{false};
+  auto status = getIntegerSetting(
+      settings.numa_node, found, configuration, "numa_node", 0, 1023);
+  if (!status.ok()) {
+    return status;
+  }
+
+  const auto& policy_obj = configuration["policy"];
+  if (!policy_obj.is_null()) {
+    auto it = kSchedulingPolicyMap.find(policy_obj.string_value());
+    if (it == kSchedulingPolicyMap.end()) {
+      return osquery::Status(
+          1, "Invalid 'policy' value: " + policy_obj.string_value());
+    }
+
+    settings.policy = it->second;
+  }
+
+  status = getIntegerSetting(
+      settings.priority, found, configuration, "priority", 1, 99);
+  if (!status.ok()) {
+    return status;
+  }
+
+  if (found != isRealtimePolicy(settings.policy)) {
+    return osquery::Status(
+        1, "The 'priority' value is required by (and only valid for) the "
+           "'fifo' and 'rr' policies");
+  }
+
+  status = getIntegerSetting(
+      settings.nice, settings.set_nice, configuration, "nice", -20, 19);
+  if (!status.ok()) {
+    return status;
+  }
+
+  if (settings.set_nice && isRealtimePolicy(settings.policy)) {
+    return osquery::Status(
+        1, "The 'nice' value can't be used with the 'fifo' and 'rr' policies");
+  }
+
+  return osquery::Status(0);
+}
+
+osquery::Status ThreadSettings::parseCpuList(
+    std::vector<unsigned int>& cpu_list, const std::string& value) {
+  cpu_list.clear();
+
+  auto L_parseCpu = [](unsigned int& cpu, const std::string& str) -> bool {
+    if (str.empty() ||
+        !std::all_of(str.begin(), str.end(), [](char c) -> bool {
+          return c >= '0' && c <= '9';
+        })) {
+      return false;
+    }
+
+    // Longer strings could overflow std::stoul
+    if (str.size() > std::to_string(CPU_SETSIZE).size()) {
+      return false;
+    }
+
+    auto number = std::stoul(str);
+    if (number >= CPU_SETSIZE) {
+      return false;
+    }
+
+    cpu = static_cast<unsigned int>(number);
+    return true;
+  };
+
+  std::size_t start = 0U;
+  while (start <= value.size()) {
+    auto end = value.find(',', start);
+    if (end == std::string::npos) {
+      end = value.size();
+    }
+
+    auto range = value.substr(start, end - start);
+    start = end + 1U;
+
+    auto separator = range.find('-');
+    unsigned int first_cpu{0U};
+    unsigned int last_cpu{0U};
+
+    bool valid = L_parseCpu(first_cpu, range.substr(0U, separator));
+    if (valid) {
+      if (separator == std::string::npos) {
+        last_cpu = first_cpu;
+      } else {
+        valid = L_parseCpu(last_cpu, range.substr(separator + 1U)) &&
+                last_cpu >= first_cpu;
+      }
+    }
+
+    if (!valid) {
+      cpu_list.clear();
+      return osquery::Status(1, "Invalid CPU list: " + value);
+    }
+
+    for (auto cpu = first_cpu; cpu <= last_cpu; ++cpu) {
+      cpu_list.push_back(cpu);
+    }
+  }
+
+  return osquery::Status(0);
+}
+
+osquery::Status parseThreadSettingsMap(ThreadSettingsMap& settings_map,
+                                       const json11::Json& configuration) {
+  settings_map.clear();
+
+  if (configuration.is_null()) {
+    return osquery::Status(0);
+  }
+
+  if (!configuration.is_object()) {
+    return osquery::Status(1, "The threads configuration must be an object");
+  }
+
+  for (const auto& p : configuration.object_items()) {
+    const auto& thread_name = p.first;
+
+    ThreadSettings settings;
+    auto status = ThreadSettings::parse(settings, p.second);
+    if (!status.ok()) {
+      settings_map.clear();
+
+      return osquery::Status(
+          1,
+          "Invalid settings for thread \"" + thread_name +
+              "\": " + status.getMessage());
+    }
+
+    settings_map.insert({thread_name, settings});
+  }
+
+  return osquery::Status(0);
+}
+
+ThreadSettings getThreadSettings(const ThreadSettingsMap& settings_map,
+                                 const std::string& thread_name) {
+  ThreadSettings settings;
+
+  auto it = settings_map.find(thread_name);
+  if (it != settings_map.end()) {
+    settings = it->second;
+  }
+
+  if (settings.name.empty()) {
+    settings.name = thread_name;
+  }
+
+  return settings;
+}
+
+pid_t currentThreadId() {
+  return static_cast<pid_t>(syscall(SYS_gettid));
+}
+
+osquery::Status applyThreadSettings(const ThreadSettings& settings,
+                                    pthread_t thread,
+                                    pid_t thread_id) {
+  osquery::Status status(0);
+
+  auto L_recordError = [&status](const std::string& message,
+                                 int error) -> void {
+    if (status.ok()) {
+      status = osquery::Status(1, message + ": " + std::strerror(error));
+    }
+  };
+
+  if (!settings.name.empty()) {
+    auto name = settings.name.substr(0U, kMaxThreadNameLength);
+
+    auto error = pthread_setname_np(thread, name.c_str());
+    if (error != 0) {
+      L_recordError("Failed to set the thread name", error);
+    }
+  }
+
+  auto cpu_list = settings.cpu_list;
+
+  if (settings.numa_node >= 0) {
+    std::vector<unsigned int> node_cpu_list;
+    auto numa_status = getNumaNodeCpuList(node_cpu_list, settings.numa_node);
+
+    if (!numa_status.ok()) {
+      if (status.ok()) {
+        status = numa_status;
+      }
+
+      cpu_list.clear();
+
+    } else if (cpu_list.empty()) {
+      cpu_list = std::move(node_cpu_list);
+
+    } else {
+      auto L_notInNode = [&node_cpu_list](unsigned int cpu) -> bool {
+        return std::find(node_cpu_list.begin(), node_cpu_list.end(), cpu) ==
+               node_cpu_list.end();
+      };
+
+      cpu_list.erase(
+          std::remove_if(cpu_list.begin(), cpu_list.end(), L_notInNode),
+          cpu_list.end());
+
+      if (cpu_list.empty() && status.ok()) {
+        status = osquery::Status(
+            1, "None of the selected CPUs belongs to the selected NUMA node");
+      }
+    }
+  }
+
+  if (!cpu_list.empty()) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+
+    for (auto cpu : cpu_list) {
+      CPU_SET(cpu, &cpu_set);
+    }
+
+    auto error = pthread_setaffinity_np(thread, sizeof(cpu_set), &cpu_set);
+    if (error != 0) {
+      L_recordError("Failed to set the CPU affinity", error);
+    }
+  }
+
+  if (settings.policy != ThreadSchedulingPolicy::Inherit) {
+    sched_param parameters{};
+    parameters.sched_priority = settings.priority;
+
+    auto error = pthread_setschedparam(
+        thread, getSchedulingPolicyValue(settings.policy), &parameters);
+
+    if (error != 0) {
+      L_recordError("Failed to set the scheduling policy", error);
+    }
+  }
+
+  // The nice value is a per-thread attribute on Linux
+  if (settings.set_nice &&
+      setpriority(
+          PRIO_PROCESS, static_cast<id_t>(thread_id), settings.nice) != 0) {
+    L_recordError("Failed to set the nice value", errno);
+  }
+
+  return status;
+}
+
+osquery::Status applyThreadSettings(const ThreadSettings& settings) {
+  return applyThreadSettings(settings, pthread_self(), currentThreadId());
+}
+
+std::thread startThread(const ThreadSettings& settings,
+                        std::function<void()> function,
+                        pid_t* thread_id) {
+  std::promise<pid_t> started;
+  auto started_future = started.get_future();
+
+  // The promise is moved into the new thread, so that it never outlives the
+  // caller's stack frame
+  auto L_threadRoutine = [settings, function](
+                             std::promise<pid_t> started) -> void {
+    auto status = applyThreadSettings(settings);
+    if (!status.ok()) {
+      LOG(WARNING) << "Failed to apply the settings of thread \""
+                   << settings.name << "\": " << status.getMessage();
+    }
+
+    started.set_value(currentThreadId());
+    function();
+  };
+
+  std::thread thread(L_threadRoutine, std::move(started));
+
+  auto new_thread_id = started_future.get();
+  if (thread_id != nullptr) {
+    *thread_id = new_thread_id;
+  }
+
+  return thread;
+}
+} // namespace trailofbits
@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pubsub/threadsettings.h>
+#include <pubsub/workerpool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <osquery/logger.h>
+
+namespace trailofbits {
+namespace {
+/// A task queue, owned by a single worker
+struct WorkerQueue final {
+  /// Mutex protecting the task list
+  std::mutex mutex;
+
+  /// Pending tasks; the owner pops from the back, thieves from the front
+  std::deque<WorkerPool::Task> task_list;
+};
+
+/// A reference to a worker queue
+using WorkerQueueRef = std::unique_ptr<WorkerQueue>;
+
+/// The pool owning the current thread, if any
+thread_local const WorkerPool* current_pool{nullptr};
+
+/// The queue index of the current worker thread
+thread_local std::size_t current_worker_index{0U};
+} // namespace
+
+/// Private class data
+struct WorkerPool::PrivateData final {
+  /// One queue per worker
+  std::vector<WorkerQueueRef> queue_list;
+
+  /// Worker threads
+  std::vector<std::thread> thread_list;
+
+  /// Used to distribute tasks submitted from outside the pool
+  std::atomic<std::size_t> next_queue_index{0U};
+
+  /// Mutex used to put idle workers to sleep
+  std::mutex wait_mutex;
+
+  /// Condition variable used to wake up idle workers
+  std::condition_variable wait_cv;
+
+  /// How many tasks are queued; protected by wait_mutex
+  std::size_t pending_task_count{0U};
+
+  /// Set when the pool is being destroyed; protected by wait_mutex
+  bool terminate{false};
+};
+
+WorkerPool::WorkerPool(std::size_t worker_count,
+                       const ThreadSettings& thread_settings)
+    : d(new PrivateData) {
+  if (worker_count == 0U) {
+    worker_count = std::max(1U, std::thread::hardware_concurrency());
+  }
+
+  for (std::size_t i = 0U; i < worker_count; ++i) {
+    d->queue_list.push_back(std::make_unique<WorkerQueue>());
+  }
+
+  try {
+    for (std::size_t i = 0U; i < worker_count; ++i) {
+      auto L_workerThread = [this, i]() -> void { workerThread(i); };
+      d->thread_list.push_back(startThread(thread_settings, L_workerThread));
+    }
+
+  } catch (const std::system_error&) {
+    {
+      std::lock_guard<std::mutex> lock(d->wait_mutex);
+      d->terminate = true;
+    }
+
+    d->wait_cv.notify_all();
+
+    for (auto& thread : d->thread_list) {
+      thread.join();
+    }
+
+    throw osquery::Status(1, "Failed to start the worker threads");
+  }
+}
+
+void WorkerPool::workerThread(std::size_t worker_index) {
+  current_pool = this;
+  current_worker_index = worker_index;
+
+  for (;;) {
+    Task task;
+    if (acquireTask(task, worker_index)) {
+      {
+        std::lock_guard<std::mutex> lock(d->wait_mutex);
+        --d->pending_task_count;
+      }
+
+      try {
+        task();
+
+      } catch (const std::exception& e) {
+        LOG(ERROR) << "A worker task has thrown an exception: " << e.what();
+      }
+
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(d->wait_mutex);
+    d->wait_cv.wait(lock, [this]() -> bool {
+      return d->terminate || d->pending_task_count != 0U;
+    });
+
+    if (d->terminate && d->pending_task_count == 0U) {
+      break;
+    }
+  }
+
+  current_pool = nullptr;
+}
+
+bool WorkerPool::acquireTask(Task& task, std::size_t worker_index) {
+  {
+    auto& queue = *d->queue_list.at(worker_index);
+
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.task_list.empty()) {
+      task = std::move(queue.task_list.back());
+      queue.task_list.pop_back();
+      return true;
+    }
+  }
+
+  auto queue_count = d->queue_list.size();
+  for (std::size_t i = 1U; i < queue_count; ++i) {
+    auto& victim = *d->queue_list.at((worker_index + i) % queue_count);
+
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.task_list.empty()) {
+      task = std::move(victim.task_list.front());
+      victim.task_list.pop_front();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+osquery::Status WorkerPool::create(WorkerPoolRef& obj,
+                                   std::size_t worker_count,
+                                   const ThreadSettings& thread_settings) {
+  obj.reset();
+
+  try {
+    auto ptr = new WorkerPool(worker_count, thread_settings);
+    obj.reset(ptr);
+
+    return osquery::Status(0);
+
+  } catch (const std::bad_alloc&) {
+    return osquery::Status(1, "Memory allocation failure");
+
+  } catch (const osquery::Status& status) {
+    return status;
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(d->wait_mutex);
+    d->terminate = true;
+  }
+
+  d->wait_cv.notify_all();
+
+  for (auto& thread : d->thread_list) {
+    thread.join();
+  }
+}
+
+osquery::Status WorkerPool::submit(Task task) {
+  auto queue_index = isWorkerThread()
+                         ? current_worker_index
+                         : d->next_queue_index++ % d->queue_list.size();
+
+  // The counter is incremented first so that it never goes below zero when
+  // a worker acquires the task before this function returns
+  {
+    std::lock_guard<std::mutex> lock(d->wait_mutex);
+    ++d->pending_task_count;
+  }
+
+  try {
+    auto& queue = *d->queue_list.at(queue_index);
+
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.task_list.push_back(std::move(task));
+
+  } catch (const std::bad_alloc&) {
+    std::lock_guard<std::mutex> lock(d->wait_mutex);
+    --d->pending_task_count;
+
+    return osquery::Status(1, "Memory allocation failure");
+  }
+
+  d->wait_cv.notify_one();
+  return osquery::Status(0);
+}
+
+void WorkerPool::parallelFor(
+    std::size_t count, const std::function<void(std::size_t)>& function) {
+  if (count == 0U) {
+    return;
+  }
+
+  std::mutex completion_mutex;
+  std::condition_variable completion_cv;
+  std::size_t pending_call_count = count - 1U;
+
+  for (std::size_t i = 1U; i < count; ++i) {
+    auto L_task = [&, i]() -> void {
+      function(i);
+
+      // Notify while holding the lock, as the waiting thread owns the
+      // condition variable
+      std::lock_guard<std::mutex> completion_lock(completion_mutex);
+      --pending_call_count;
+      completion_cv.notify_one();
+    };
+
+    auto status = submit(L_task);
+    if (!status.ok()) {
+      L_task();
+    }
+  }
+
+  function(0U);
+
+  std::unique_lock<std::mutex> completion_lock(completion_mutex);
+  completion_cv.wait(completion_lock, [&pending_call_count]() -> bool {
+    return pending_call_count == 0U;
+  });
+}
+
+std::size_t WorkerPool::workerCount() const {
+  return d->queue_list.size();
+}
+
+bool WorkerPool::isWorkerThread() const {
+  return current_pool == this;
+}
+} // namespace trailofbits
@@ -0,0 +1,428 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pubsub/baseaggregatingsubscriber.h>
+#include <pubsub/baseeventpublisher.h>
+#include <pubsub/publisherscheduler.h>
+
+#include <osquery/sql/dynamic_table_row.h>
+
+#include <atomic>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+namespace trailofbits {
+namespace {
+struct TestSubscriptionContext final {};
+
+struct TestEventContext final {
+  std::vector<std::size_t> value_list;
+
+  std::size_t eventCount() const {
+    return value_list.size();
+  }
+};
+
+using TestPublisherBase =
+    BaseEventPublisher<TestSubscriptionContext, TestEventContext>;
+
+class TestPublisher final : public TestPublisherBase {
+ public:
+  std::size_t backpressure_change_count{0U};
+
+  osquery::Status initialize() noexcept override {
+    return osquery::Status(0);
+  }
+
+  osquery::Status configure(const json11::Json&) noexcept override {
+    return osquery::Status(0);
+  }
+
+  osquery::Status release() noexcept override {
+    return osquery::Status(0);
+  }
+
+  osquery::Status run() noexcept override {
+    return osquery::Status(0);
+  }
+
+  void emit(std::size_t value) {
+    EventContextRef event_context;
+    ASSERT_TRUE(createEventContext(event_context).ok());
+
+    event_context->value_list.push_back(value);
+    emitEvents(event_context);
+  }
+
+ protected:
+  void backpressureChanged(bool) noexcept override {
+    ++backpressure_change_count;
+  }
+};
+
+class TestSubscriber final : public BaseEventSubscriber<TestPublisherBase> {
+ public:
+  std::atomic<std::size_t>& active_callback_count;
+  std::atomic<std::size_t>& max_active_callback_count;
+
+  TestSubscriber(std::atomic<std::size_t>& active_callback_count_,
+                 std::atomic<std::size_t>& max_active_callback_count_)
+      : active_callback_count(active_callback_count_),
+        max_active_callback_count(max_active_callback_count_) {}
+
+  osquery::Status initialize() noexcept override {
+    return osquery::Status(0);
+  }
+
+  void release() noexcept override {}
+
+  osquery::Status configure(TestPublisherBase::SubscriptionContextRef,
+                            const json11::Json&) noexcept override {
+    return osquery::Status(0);
+  }
+
+  osquery::Status callback(
+      osquery::TableRows& new_events,
+      TestPublisherBase::SubscriptionContextRef,
+      TestPublisherBase::EventContextRef event_context) override {
+    auto active_count = ++active_callback_count;
+
+    auto max_active_count = max_active_callback_count.load();
+    while (active_count > max_active_count &&
+           !max_active_callback_count.compare_exchange_weak(max_active_count,
+                                                            active_count)) {
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    for (auto value : event_context->value_list) {
+      osquery::Row row = {{"value", std::to_string(value)}};
+      new_events.push_back(osquery::TableRowHolder(
+          new osquery::DynamicTableRow(std::move(row))));
+    }
+
+    --active_callback_count;
+    return osquery::Status(0);
+  }
+};
+
+const osquery::TableColumns kAggregationSchema = {
+    std::make_tuple(
+        "window_start", osquery::BIGINT_TYPE, osquery::ColumnOptions::DEFAULT),
+    std::make_tuple(
+        "window_end", osquery::BIGINT_TYPE, osquery::ColumnOptions::DEFAULT),
+    std::make_tuple(
+        "value", osquery::TEXT_TYPE, osquery::ColumnOptions::DEFAULT),
+    std::make_tuple(
+        "count", osquery::BIGINT_TYPE, osquery::ColumnOptions::DEFAULT),
+    std::make_tuple(
+        "count_error", osquery::BIGINT_TYPE, osquery::ColumnOptions::DEFAULT)};
+
+class TestAggregatingSubscriber final
+    : public BaseAggregatingSubscriber<TestPublisherBase> {
+ public:
+  TestAggregatingSubscriber(const std::string& name)
+      : BaseAggregatingSubscriber<TestPublisherBase>(name,
+                                                     kAggregationSchema) {}
+
+  osquery::Status initialize() noexcept override {
+    return osquery::Status(0);
+  }
+
+ protected:
+  osquery::Status aggregate(
+      EventAggregator& event_aggregator,
+      TestPublisherBase::SubscriptionContextRef,
+      TestPublisherBase::EventContextRef event_context) override {
+    for (auto value : event_context->value_list) {
+      event_aggregator.add({std::to_string(value)}, std::time(nullptr));
+    }
+
+    return osquery::Status(0);
+  }
+};
+} // namespace
+
+TEST(BaseEventPublisherTests, ParallelDispatch) {
+  std::atomic<std::size_t> active_callback_count{0U};
+  std::atomic<std::size_t> max_active_callback_count{0U};
+
+  TestPublisher publisher;
+
+  std::vector<std::string> subscriber_name_list;
+  for (auto i = 0U; i < 4U; ++i) {
+    auto subscriber_name = "parallel_dispatch_test_" + std::to_string(i);
+    subscriber_name_list.push_back(subscriber_name);
+
+    auto subscriber = std::make_shared<TestSubscriber>(
+        active_callback_count, max_active_callback_count);
+
+    auto status = publisher.subscribe(i, subscriber, subscriber_name);
+    ASSERT_TRUE(status.ok());
+  }
+
+  auto configuration = json11::Json::object{
+      {"pubsub",
+       json11::Json::object{
+           {"dispatch",
+            json11::Json::object{{"mode", "parallel"},
+                                 {"worker_count", 4}}}}}};
+
+  publisher.configureSubscribers(configuration);
+  publisher.emit(1U);
+
+  // Every subscriber has processed the event when emitEvents() returns
+  EXPECT_EQ(active_callback_count, 0U);
+  EXPECT_GT(max_active_callback_count, 1U);
+
+  auto latency_map = publisher.subscriberLatency();
+  EXPECT_EQ(latency_map.size(), 4U);
+
+  for (const auto& subscriber_name : subscriber_name_list) {
+    auto event_batch =
+        EventBufferLibrary::instance().getEvents(subscriber_name);
+    ASSERT_EQ(event_batch.size(), 1U);
+
+    auto row = static_cast<osquery::Row>(*event_batch.front());
+    EXPECT_EQ(row.at("value"), "1");
+
+    EXPECT_EQ(latency_map.at(subscriber_name).count, 1U);
+    EXPECT_GE(latency_map.at(subscriber_name).max, 50000U);
+  }
+}
+
+TEST(BaseEventPublisherTests, DispatchSettings) {
+  EventDispatchSettings settings;
+  auto status = EventDispatchSettings::parse(
+      settings,
+      json11::Json::object{{"mode", "parallel"}, {"worker_count", 0}});
+
+  ASSERT_TRUE(status.ok());
+  EXPECT_EQ(settings.mode, EventDispatchMode::Parallel);
+  EXPECT_EQ(settings.worker_count, 0U);
+
+  for (const auto& worker_count : {json11::Json(-1),
+                                   json11::Json(2.5),
+                                   json11::Json(1e30),
+                                   json11::Json("4")}) {
+    status = EventDispatchSettings::parse(
+        settings, json11::Json::object{{"worker_count", worker_count}});
+    EXPECT_FALSE(status.ok());
+  }
+}
+
+TEST(BaseEventPublisherTests, Backpressure) {
+  std::atomic<std::size_t> active_callback_count{0U};
+  std::atomic<std::size_t> max_active_callback_count{0U};
+
+  TestPublisher publisher;
+
+  auto subscriber = std::make_shared<TestSubscriber>(
+      active_callback_count, max_active_callback_count);
+
+  auto status = publisher.subscribe(0U, subscriber, "backpressure_test");
+  ASSERT_TRUE(status.ok());
+
+  auto configuration = json11::Json::object{
+      {"pubsub",
+       json11::Json::object{
+           {"buffers",
+            json11::Json::object{
+                {"backpressure_test",
+                 json11::Json::object{{"capacity", 4},
+                                      {"high_watermark", 75},
+                                      {"low_watermark", 25}}}}}}}};
+
+  publisher.configureSubscribers(configuration);
+
+  // The backpressure is set when the high watermark is reached...
+  for (auto i = 0U; i < 3U; ++i) {
+    EXPECT_FALSE(publisher.backpressure());
+    publisher.emit(i);
+  }
+
+  EXPECT_TRUE(publisher.backpressure());
+  EXPECT_EQ(publisher.backpressure_change_count, 1U);
+
+  // ...and released once the buffer goes back below the low watermark
+  auto event_batch =
+      EventBufferLibrary::instance().getEvents("backpressure_test");
+  EXPECT_EQ(event_batch.size(), 3U);
+
+  publisher.emit(3U);
+  EXPECT_FALSE(publisher.backpressure());
+  EXPECT_EQ(publisher.backpressure_change_count, 2U);
+}
+
+TEST(BaseEventPublisherTests, SubscriptionTable) {
+  std::atomic<std::size_t> active_callback_count{0U};
+  std::atomic<std::size_t> max_active_callback_count{0U};
+
+  TestPublisher publisher;
+
+  for (auto i = 0U; i < 2U; ++i) {
+    auto subscriber = std::make_shared<TestSubscriber>(
+        active_callback_count, max_active_callback_count);
+
+    auto status = publisher.subscribe(
+        i, subscriber, "subscription_table_test_" + std::to_string(i));
+    ASSERT_TRUE(status.ok());
+  }
+
+  EXPECT_EQ(publisher.subscriptionCount(), 2U);
+  publisher.emit(1U);
+
+  // Removed subscribers no longer receive events
+  publisher.unsubscribe(0U);
+  EXPECT_EQ(publisher.subscriptionCount(), 1U);
+  EXPECT_THROW(publisher.unsubscribe(0U), std::logic_error);
+
+  publisher.emit(2U);
+
+  auto event_batch =
+      EventBufferLibrary::instance().getEvents("subscription_table_test_0");
+  EXPECT_EQ(event_batch.size(), 1U);
+
+  event_batch =
+      EventBufferLibrary::instance().getEvents("subscription_table_test_1");
+  EXPECT_EQ(event_batch.size(), 2U);
+}
+
+TEST(BaseEventPublisherTests, Coalescing) {
+  std::atomic<std::size_t> active_callback_count{0U};
+  std::atomic<std::size_t> max_active_callback_count{0U};
+
+  TestPublisher publisher;
+
+  auto subscriber = std::make_shared<TestSubscriber>(
+      active_callback_count, max_active_callback_count);
+
+  auto status = publisher.subscribe(0U, subscriber, "coalescing_test");
+  ASSERT_TRUE(status.ok());
+
+  EventCoalescingSettings coalescing_settings;
+  status = PublisherScheduler::parseCoalescingSettings(
+      coalescing_settings,
+      json11::Json::object{{"max_batch_size", 3}, {"max_linger_time", 200}});
+
+  ASSERT_TRUE(status.ok());
+  publisher.configureCoalescing(coalescing_settings);
+
+  // Events are held back until the batch is large enough...
+  publisher.emit(0U);
+  publisher.emit(1U);
+
+  auto& event_buffer_library = EventBufferLibrary::instance();
+  EXPECT_TRUE(event_buffer_library.getEvents("coalescing_test").empty());
+  EXPECT_NE(publisher.flushDeadline(),
+            std::chrono::steady_clock::time_point::max());
+
+  publisher.emit(2U);
+
+  auto event_batch = event_buffer_library.getEvents("coalescing_test");
+  EXPECT_EQ(event_batch.size(), 3U);
+  EXPECT_EQ(publisher.flushDeadline(),
+            std::chrono::steady_clock::time_point::max());
+
+  // ...or until the linger time expires
+  publisher.emit(3U);
+  publisher.flushEvents(false);
+  EXPECT_TRUE(event_buffer_library.getEvents("coalescing_test").empty());
+
+  std::this_thread::sleep_until(publisher.flushDeadline());
+  publisher.flushEvents(false);
+
+  event_batch = event_buffer_library.getEvents("coalescing_test");
+  ASSERT_EQ(event_batch.size(), 1U);
+
+  auto row = static_cast<osquery::Row>(*event_batch.front());
+  EXPECT_EQ(row.at("value"), "3");
+
+  // A batch size without a linger time is rejected
+  status = PublisherScheduler::parseCoalescingSettings(
+      coalescing_settings, json11::Json::object{{"max_batch_size", 3}});
+  EXPECT_FALSE(status.ok());
+}
+
+TEST(BaseEventPublisherTests, AggregationWindows) {
+  TestPublisher publisher;
+
+  auto subscriber =
+      std::make_shared<TestAggregatingSubscriber>("aggregation_test");
+
+  auto status = publisher.subscribe(0U, subscriber, "aggregation_test");
+  ASSERT_TRUE(status.ok());
+
+  status = subscriber->configure(
+      nullptr,
+      json11::Json::object{
+          {"pubsub",
+           json11::Json::object{
+               {"aggregation",
+                json11::Json::object{
+                    {"aggregation_test",
+                     json11::Json::object{{"window_size", 1}}}}}}}});
+  ASSERT_TRUE(status.ok());
+
+  // Invalid settings are reported, and the current ones are kept
+  status = subscriber->configure(
+      nullptr,
+      json11::Json::object{
+          {"pubsub",
+           json11::Json::object{
+               {"aggregation",
+                json11::Json::object{
+                    {"aggregation_test",
+                     json11::Json::object{{"window_size", 0}}}}}}}});
+  EXPECT_FALSE(status.ok());
+
+  EXPECT_EQ(publisher.flushDeadline(),
+            std::chrono::steady_clock::time_point::max());
+
+  // The window is collected once it has ended, even without new events
+  publisher.emit(1U);
+
+  auto deadline = publisher.flushDeadline();
+  ASSERT_NE(deadline, std::chrono::steady_clock::time_point::max());
+  EXPECT_LE(deadline,
+            std::chrono::steady_clock::now() + std::chrono::seconds(1));
+
+  std::this_thread::sleep_until(deadline);
+  publisher.flushEvents(false);
+
+  auto& event_buffer_library = EventBufferLibrary::instance();
+  auto event_batch = event_buffer_library.getEvents("aggregation_test");
+  ASSERT_EQ(event_batch.size(), 1U);
+
+  auto row = static_cast<osquery::Row>(*event_batch.front());
+  EXPECT_EQ(row.at("value"), "1");
+  EXPECT_EQ(row.at("count"), "1");
+
+  EXPECT_EQ(publisher.flushDeadline(),
+            std::chrono::steady_clock::time_point::max());
+
+  // The current window is saved when the subscriber is released
+  publisher.emit(2U);
+  publisher.unsubscribe(0U);
+
+  event_batch = event_buffer_library.getEvents("aggregation_test");
+  ASSERT_EQ(event_batch.size(), 1U);
+
+  row = static_cast<osquery::Row>(*event_batch.front());
+  EXPECT_EQ(row.at("value"), "2");
+}
+} // namespace trailofbits
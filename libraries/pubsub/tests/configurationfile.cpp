@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pubsub/configurationfile.h>
+
+#include <chrono>
+#include <fstream>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+
+#include <gtest/gtest.h>
+
+namespace boostfs = boost::filesystem;
+
+namespace trailofbits {
+namespace {
+void writeConfigurationFile(const boostfs::path& path,
+                            const std::string& contents) {
+  // Replace the file like most editors do
+  auto temporary_path = path.string() + ".tmp";
+
+  {
+    std::ofstream configuration_file(temporary_path);
+    configuration_file << contents;
+  }
+
+  boostfs::rename(temporary_path, path);
+}
+
+bool waitForConfigurationChange(ConfigurationFileRef configuration_file,
+                                ConfigurationFileHandle handle) {
+  for (auto i = 0U; i < 200U; ++i) {
+    if (configuration_file->configurationChanged(handle)) {
+      return true;
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  return false;
+}
+} // namespace
+
+TEST(ConfigurationFileTests, ConfigurationReload) {
+  auto configuration_directory =
+      boostfs::temp_directory_path() /
+      boostfs::unique_path("pubsub_tests_%%%%%%%%");
+
+  ASSERT_TRUE(boostfs::create_directory(configuration_directory));
+
+  auto configuration_path = configuration_directory / "configuration.json";
+  writeConfigurationFile(configuration_path, R"({"value": 1})");
+
+  {
+    ConfigurationFileRef configuration_file;
+    auto status = ConfigurationFile::create(configuration_file,
+                                            configuration_path.string());
+    ASSERT_TRUE(status.ok());
+
+    auto initial_generation = configuration_file->generation();
+
+    // The initial configuration is reported once to each handle
+    auto first_handle = configuration_file->getHandle();
+    auto second_handle = configuration_file->getHandle();
+
+    EXPECT_TRUE(configuration_file->configurationChanged(first_handle));
+    EXPECT_FALSE(configuration_file->configurationChanged(first_handle));
+    EXPECT_EQ(
+        configuration_file->getConfiguration(first_handle)["value"].int_value(),
+        1);
+
+    writeConfigurationFile(configuration_path, R"({"value": 2})");
+    EXPECT_TRUE(waitForConfigurationChange(configuration_file, first_handle));
+    EXPECT_EQ(
+        configuration_file->getConfiguration(first_handle)["value"].int_value(),
+        2);
+
+    auto generation = configuration_file->generation();
+    EXPECT_NE(generation, initial_generation);
+
+    EXPECT_TRUE(configuration_file->configurationChanged(second_handle));
+    EXPECT_EQ(configuration_file->getConfiguration(second_handle)["value"]
+                  .int_value(),
+              2);
+
+    // Invalid files and identical configurations are ignored
+    writeConfigurationFile(configuration_path, "{");
+    writeConfigurationFile(configuration_path, R"({ "value" : 2 })");
+    EXPECT_FALSE(waitForConfigurationChange(configuration_file, first_handle));
+    EXPECT_EQ(
+        configuration_file->getConfiguration(first_handle)["value"].int_value(),
+        2);
+
+    EXPECT_EQ(configuration_file->generation(), generation);
+  }
+
+  boostfs::remove_all(configuration_directory);
+}
+} // namespace trailofbits
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pubsub/eventaggregator.h>
+
+#include <limits>
+
+#include <gtest/gtest.h>
+
+namespace trailofbits {
+namespace {
+const osquery::TableColumns kTestSchema = {
+    std::make_tuple(
+        "window_start", osquery::BIGINT_TYPE, osquery::ColumnOptions::DEFAULT),
+    std::make_tuple(
+        "window_end", osquery::BIGINT_TYPE, osquery::ColumnOptions::DEFAULT),
+    std::make_tuple(
+        "source_address", osquery::TEXT_TYPE, osquery::ColumnOptions::DEFAULT),
+    std::make_tuple(
+        "record_name", osquery::TEXT_TYPE, osquery::ColumnOptions::DEFAULT),
+    std::make_tuple(
+        "count", osquery::BIGINT_TYPE, osquery::ColumnOptions::DEFAULT),
+    std::make_tuple(
+        "count_error", osquery::BIGINT_TYPE, osquery::ColumnOptions::DEFAULT),
+    std::make_tuple(
+        "consumer", osquery::TEXT_TYPE, osquery::ColumnOptions::HIDDEN)};
+
+/// Returns the materialized row for the given key
+osquery::Row findRow(const EventBatch& rows,
+                     const std::string& source_address,
+                     const std::string& record_name) {
+  for (const auto& row : rows) {
+    auto row_data = static_cast<osquery::Row>(*row);
+
+    if (row_data["source_address"] == source_address &&
+        row_data["record_name"] == record_name) {
+      return row_data;
+    }
+  }
+
+  return {};
+}
+} // namespace
+
+TEST(EventAggregatorTests, Settings) {
+  EventAggregatorSettings settings;
+  auto status = EventAggregatorSettings::parse(
+      settings,
+      json11::Json::object{{"window_size", 300}, {"max_group_count", 10}});
+
+  ASSERT_TRUE(status.ok());
+  EXPECT_EQ(settings.window_size, 300U);
+  EXPECT_EQ(settings.max_group_count, 10U);
+
+  status = EventAggregatorSettings::parse(
+      settings, json11::Json::object{{"window_size", 0}});
+  EXPECT_FALSE(status.ok());
+
+  status = EventAggregatorSettings::parse(
+      settings, json11::Json::object{{"max_group_count", 1e30}});
+  EXPECT_FALSE(status.ok());
+
+  // The aggregation columns are required
+  const osquery::TableColumns invalid_schema = {std::make_tuple(
+      "record_name", osquery::TEXT_TYPE, osquery::ColumnOptions::DEFAULT)};
+
+  EventAggregatorRef aggregator;
+  status = EventAggregator::create(aggregator, "invalid", invalid_schema);
+  EXPECT_FALSE(status.ok());
+}
+
+TEST(EventAggregatorTests, Windows) {
+  EventAggregatorRef aggregator;
+  auto status = EventAggregator::create(aggregator, "windows", kTestSchema);
+  ASSERT_TRUE(status.ok());
+
+  EventAggregatorSettings settings;
+  settings.window_size = 60U;
+  aggregator->configure(settings);
+
+  const auto& key_columns = aggregator->keyColumns();
+  ASSERT_EQ(key_columns.size(), 2U);
+  EXPECT_EQ(key_columns.at(0), "source_address");
+  EXPECT_EQ(key_columns.at(1), "record_name");
+
+  aggregator->add({"10.0.0.1", "www.example.com"}, 120);
+  aggregator->add({"10.0.0.1", "www.example.com"}, 150);
+  aggregator->add({"10.0.0.2", "www.example.com"}, 179);
+  aggregator->add({"10.0.0.1", "mail.example.com"}, 130, 5U);
+  EXPECT_EQ(aggregator->groupCount(), 3U);
+
+  // The window has not ended yet
+  EventBatch rows;
+  aggregator->collect(rows, 179);
+  EXPECT_TRUE(rows.empty());
+
+  // Events from the next window close the current one
+  aggregator->add({"10.0.0.1", "www.example.com"}, 180);
+  EXPECT_EQ(aggregator->groupCount(), 1U);
+
+  aggregator->collect(rows, 180);
+  ASSERT_EQ(rows.size(), 3U);
+
+  auto row = findRow(rows, "10.0.0.1", "www.example.com");
+  EXPECT_EQ(row["window_start"], "120");
+  EXPECT_EQ(row["window_end"], "180");
+  EXPECT_EQ(row["count"], "2");
+  EXPECT_EQ(row["count_error"], "0");
+
+  EXPECT_EQ(findRow(rows, "10.0.0.1", "mail.example.com")["count"], "5");
+  EXPECT_EQ(findRow(rows, "10.0.0.2", "www.example.com")["count"], "1");
+
+  // Windows also end when no events are received
+  rows.clear();
+  aggregator->collect(rows, 240);
+  ASSERT_EQ(rows.size(), 1U);
+  EXPECT_EQ(findRow(rows, "10.0.0.1", "www.example.com")["window_start"],
+            "180");
+
+  rows.clear();
+  aggregator->collect(rows, 300);
+  EXPECT_TRUE(rows.empty());
+
+  // The collection time follows the current window
+  EXPECT_EQ(aggregator->collectionTime(),
+            std::numeric_limits<std::time_t>::max());
+
+  aggregator->add({"10.0.0.1", "www.example.com"}, 310);
+  EXPECT_EQ(aggregator->collectionTime(), 360);
+
+  aggregator->add({"10.0.0.1", "www.example.com"}, 360);
+  EXPECT_EQ(aggregator->collectionTime(), 0);
+}
+
+TEST(EventAggregatorTests, MaxGroupCount) {
+  EventAggregatorRef aggregator;
+  auto status =
+      EventAggregator::create(aggregator, "max_group_count", kTestSchema);
+  ASSERT_TRUE(status.ok());
+
+  EventAggregatorSettings settings;
+  settings.window_size = 60U;
+  settings.max_group_count = 3U;
+  aggregator->configure(settings);
+
+  // Two heavy hitters, followed by many rare domains
+  aggregator->add({"10.0.0.1", "a.example.com"}, 0, 100U);
+  aggregator->add({"10.0.0.1", "b.example.com"}, 0, 50U);
+
+  for (std::size_t i = 0U; i < 40U; ++i) {
+    aggregator->add({"10.0.0.1", std::to_string(i) + ".example.com"}, 0);
+  }
+
+  EXPECT_EQ(aggregator->groupCount(), 3U);
+
+  EventBatch rows;
+  aggregator->flush(rows);
+  ASSERT_EQ(rows.size(), 3U);
+
+  // The heavy hitters are counted exactly
+  auto row = findRow(rows, "10.0.0.1", "a.example.com");
+  EXPECT_EQ(row["count"], "100");
+  EXPECT_EQ(row["count_error"], "0");
+
+  row = findRow(rows, "10.0.0.1", "b.example.com");
+  EXPECT_EQ(row["count"], "50");
+  EXPECT_EQ(row["count_error"], "0");
+
+  // The last group has inherited the count of all the rare ones
+  row = findRow(rows, "10.0.0.1", "39.example.com");
+  EXPECT_EQ(row["count"], "40");
+  EXPECT_EQ(row["count_error"], "39");
+}
+} // namespace trailofbits
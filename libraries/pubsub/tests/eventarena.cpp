@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <pubsub/eventarena.h>
+#include <pubsub/eventcontextpool.h>
+
+#include <cstdint>
+
+#include <gtest/gtest.h>
+
+namespace trailofbits {
+namespace {
+struct TestEventContext final {
+  EventArena arena{1024U};
+  ArenaVector<ArenaString> string_list{ArenaAllocator<ArenaString>(arena)};
+
+  std::size_t reset_count{0U};
+
+  void reset() {
+    {
+      ArenaVector<ArenaString> empty_list{ArenaAllocator<ArenaString>(arena)};
+      string_list.swap(empty_list);
+    }
+
+    arena.reset();
+    ++reset_count;
+  }
+};
+} // namespace
+
+TEST(EventArenaTests, Allocation) {
+  EventArena arena(1024U, 4096U);
+
+  for (std::size_t alignment : {1U, 2U, 4U, 8U, 16U}) {
+    auto ptr = arena.allocate(3U, alignment);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(ptr) % alignment, 0U);
+  }
+
+  // Large allocations get their own chunk
+  arena.allocate(2048U, 8U);
+  EXPECT_GE(arena.usedSize(), 2048U + 15U);
+
+  auto reserved_size = arena.reservedSize();
+  EXPECT_GE(reserved_size, 1024U + 2048U);
+
+  // Resetting keeps the chunks...
+  arena.reset();
+  EXPECT_EQ(arena.usedSize(), 0U);
+  EXPECT_EQ(arena.reservedSize(), reserved_size);
+
+  // ...unless they go over the retention limit
+  for (auto i = 0U; i < 8U; ++i) {
+    arena.allocate(1000U, 8U);
+  }
+
+  EXPECT_GT(arena.reservedSize(), 4096U);
+
+  arena.reset();
+  EXPECT_LE(arena.reservedSize(), 4096U);
+}
+
+TEST(EventArenaTests, Containers) {
+  EventArena arena(1024U);
+
+  {
+    ArenaVector<ArenaString> string_list{ArenaAllocator<ArenaString>(arena)};
+    for (auto i = 0U; i < 100U; ++i) {
+      string_list.emplace_back(std::string(64U, 'A').c_str(),
+                               ArenaAllocator<char>(arena));
+    }
+
+    EXPECT_EQ(string_list.back().size(), 64U);
+    EXPECT_GT(arena.usedSize(), 100U * 64U);
+  }
+
+  arena.reset();
+
+  // The memory is reused after a reset
+  auto reserved_size = arena.reservedSize();
+
+  ArenaString value(std::string(512U, 'B').c_str(),
+                    ArenaAllocator<char>(arena));
+  EXPECT_EQ(arena.reservedSize(), reserved_size);
+}
+
+TEST(EventContextPoolTests, Recycling) {
+  EventContextPool<TestEventContext> pool(1U);
+
+  std::shared_ptr<TestEventContext> first_context;
+  ASSERT_TRUE(pool.acquire(first_context).ok());
+
+  first_context->string_list.emplace_back(
+      "test", ArenaAllocator<char>(first_context->arena));
+
+  auto first_context_ptr = first_context.get();
+  auto second_context = first_context;
+
+  // Contexts are only recycled when the last reference is dropped
+  first_context.reset();
+  EXPECT_EQ(pool.idleContextCount(), 0U);
+
+  second_context.reset();
+  EXPECT_EQ(pool.idleContextCount(), 1U);
+
+  ASSERT_TRUE(pool.acquire(first_context).ok());
+  EXPECT_EQ(first_context.get(), first_context_ptr);
+  EXPECT_EQ(first_context->reset_count, 1U);
+  EXPECT_TRUE(first_context->string_list.empty());
+  EXPECT_EQ(first_context->arena.usedSize(), 0U);
+
+  // The pool does not keep more than the configured amount of contexts
+  ASSERT_TRUE(pool.acquire(second_context).ok());
+  EXPECT_NE(first_context, second_context);
+
+  first_context.reset();
+  second_context.reset();
+  EXPECT_EQ(pool.idleContextCount(), 1U);
+}
+
+TEST(EventContextPoolTests, ContextOutlivesPool) {
+  std::shared_ptr<TestEventContext> event_context;
+
+  {
+    EventContextPool<TestEventContext> pool;
+    ASSERT_TRUE(pool.acquire(event_context).ok());
+  }
+
+  // Destroying the context after the pool must not access it
+  event_context.reset();
+}
+} // namespace trailofbits
@@ -0,0 +1,301 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "eventbuffertestutils.h"
+#include "eventbufferutils.h"
+
+#include <thread>
+
+#include <boost/filesystem.hpp>
+
+#include <gtest/gtest.h>
+
+namespace trailofbits {
+namespace {
+EventBufferSettings generateSettings(EventBufferEngine engine,
+                                     std::size_t capacity) {
+  EventBufferSettings settings;
+  settings.engine = engine;
+  settings.capacity = capacity;
+
+  return settings;
+}
+
+void testDropNewest(EventBufferEngine engine) {
+  auto settings = generateSettings(engine, 4U);
+  settings.overflow_policy = EventBufferOverflowPolicy::DropNewest;
+
+  IEventBufferRef event_buffer;
+  auto status = createEventBuffer(event_buffer, settings);
+  ASSERT_TRUE(status.ok());
+
+  auto event_batch = generateEventBatch(0U, 6U);
+  event_buffer->save(event_batch);
+
+  auto statistics = event_buffer->statistics();
+  EXPECT_EQ(statistics.row_count, 4U);
+  EXPECT_EQ(statistics.overwritten_row_count, 0U);
+  EXPECT_EQ(statistics.rejected_row_count, 2U);
+
+  auto saved_events = event_buffer->get();
+  ASSERT_EQ(saved_events.size(), 4U);
+
+  for (std::size_t i = 0U; i < saved_events.size(); ++i) {
+    EXPECT_EQ(getRowValue(saved_events.at(i)), i);
+  }
+}
+
+void testMemoryLimit(EventBufferEngine engine) {
+  auto settings = generateSettings(engine, 1000U);
+
+  auto event_batch = generateEventBatch(0U, 1U);
+  settings.max_memory = estimateRowSize(*event_batch.front()) * 10U;
+
+  IEventBufferRef event_buffer;
+  auto status = createEventBuffer(event_buffer, settings);
+  ASSERT_TRUE(status.ok());
+
+  event_batch = generateEventBatch(0U, 50U);
+  event_buffer->save(event_batch);
+
+  auto statistics = event_buffer->statistics();
+  EXPECT_EQ(statistics.capacity, 10U);
+  EXPECT_EQ(statistics.row_count, 10U);
+  EXPECT_EQ(statistics.overwritten_row_count, 40U);
+  EXPECT_LE(statistics.memory_usage, settings.max_memory);
+}
+
+void testSpillToDisk(EventBufferEngine engine) {
+  auto settings = generateSettings(engine, 4U);
+  settings.overflow_policy = EventBufferOverflowPolicy::SpillToDisk;
+  settings.spill_directory =
+      (boost::filesystem::temp_directory_path() /
+       boost::filesystem::unique_path("pubsub_tests_%%%%%%%%"))
+          .string();
+
+  IEventBufferRef event_buffer;
+  auto status = createEventBuffer(event_buffer, settings);
+  ASSERT_TRUE(status.ok());
+
+  for (std::size_t i = 0U; i < 3U; ++i) {
+    auto event_batch = generateEventBatch(i * 4U, 4U);
+    event_buffer->save(event_batch);
+  }
+
+  auto statistics = event_buffer->statistics();
+  EXPECT_EQ(statistics.row_count, 4U);
+  EXPECT_EQ(statistics.overwritten_row_count, 0U);
+  EXPECT_EQ(statistics.spilled_row_count, 8U);
+  EXPECT_EQ(statistics.pending_spilled_row_count, 8U);
+
+  auto saved_events = event_buffer->get();
+  ASSERT_EQ(saved_events.size(), 12U);
+
+  for (std::size_t i = 0U; i < saved_events.size(); ++i) {
+    EXPECT_EQ(getRowValue(saved_events.at(i)), i);
+  }
+
+  EXPECT_EQ(event_buffer->statistics().pending_spilled_row_count, 0U);
+
+  event_buffer.reset();
+  boost::filesystem::remove_all(settings.spill_directory);
+}
+
+void testPressureState(EventBufferEngine engine) {
+  auto pressure_state =
+      std::make_shared<EventBufferPressureState>(EventBufferPressure::Low);
+
+  IEventBufferRef event_buffer;
+  auto status = createEventBuffer(
+      event_buffer, generateSettings(engine, 10U), pressure_state);
+  ASSERT_TRUE(status.ok());
+
+  auto event_batch = generateEventBatch(0U, 6U);
+  event_buffer->save(event_batch);
+  EXPECT_EQ(pressure_state->load(), EventBufferPressure::Normal);
+
+  event_batch = generateEventBatch(6U, 3U);
+  event_buffer->save(event_batch);
+  EXPECT_EQ(pressure_state->load(), EventBufferPressure::High);
+
+  EXPECT_EQ(event_buffer->get().size(), 9U);
+  EXPECT_EQ(pressure_state->load(), EventBufferPressure::Low);
+}
+
+void testOverwriteOldest(IEventBufferRef event_buffer) {
+  auto event_batch = generateEventBatch(0U, 6U);
+  event_buffer->save(event_batch);
+  EXPECT_TRUE(event_batch.empty());
+
+  auto statistics = event_buffer->statistics();
+  EXPECT_EQ(statistics.row_count, 4U);
+  EXPECT_EQ(statistics.capacity, 4U);
+  EXPECT_EQ(statistics.overwritten_row_count, 2U);
+
+  auto saved_events = event_buffer->get();
+  ASSERT_EQ(saved_events.size(), 4U);
+
+  for (std::size_t i = 0U; i < saved_events.size(); ++i) {
+    EXPECT_EQ(getRowValue(saved_events.at(i)), i + 2U);
+  }
+
+  EXPECT_TRUE(event_buffer->get().empty());
+  EXPECT_EQ(event_buffer->statistics().row_count, 0U);
+}
+} // namespace
+
+TEST(EventBufferTests, CircularBufferOverwrite) {
+  IEventBufferRef event_buffer;
+  auto status = createEventBuffer(
+      event_buffer, generateSettings(EventBufferEngine::CircularBuffer, 4U));
+  ASSERT_TRUE(status.ok());
+
+  testOverwriteOldest(event_buffer);
+}
+
+TEST(EventBufferTests, LockFreeRingOverwrite) {
+  IEventBufferRef event_buffer;
+  auto status = createEventBuffer(
+      event_buffer, generateSettings(EventBufferEngine::LockFreeRing, 4U));
+  ASSERT_TRUE(status.ok());
+
+  testOverwriteOldest(event_buffer);
+}
+
+TEST(EventBufferTests, LockFreeRingCapacity) {
+  IEventBufferRef event_buffer;
+  auto status = createEventBuffer(
+      event_buffer, generateSettings(EventBufferEngine::LockFreeRing, 0U));
+  EXPECT_FALSE(status.ok());
+
+  status = createEventBuffer(
+      event_buffer, generateSettings(EventBufferEngine::LockFreeRing, 1000U));
+  ASSERT_TRUE(status.ok());
+  EXPECT_EQ(event_buffer->statistics().capacity, 1000U);
+}
+
+TEST(EventBufferTests, DropNewest) {
+  testDropNewest(EventBufferEngine::CircularBuffer);
+  testDropNewest(EventBufferEngine::LockFreeRing);
+}
+
+TEST(EventBufferTests, MemoryLimit) {
+  testMemoryLimit(EventBufferEngine::CircularBuffer);
+  testMemoryLimit(EventBufferEngine::LockFreeRing);
+}
+
+TEST(EventBufferTests, PressureState) {
+  testPressureState(EventBufferEngine::CircularBuffer);
+  testPressureState(EventBufferEngine::LockFreeRing);
+}
+
+TEST(EventBufferTests, SpillToDisk) {
+  testSpillToDisk(EventBufferEngine::CircularBuffer);
+  testSpillToDisk(EventBufferEngine::LockFreeRing);
+}
+
+TEST(EventBufferTests, ParseSettings) {
+  EventBufferSettings settings;
+  auto status = EventBufferLibrary::parseSettings(settings, json11::Json());
+  ASSERT_TRUE(status.ok());
+  EXPECT_TRUE(settings == EventBufferSettings());
+
+  std::string parsing_errors;
+  auto configuration = json11::Json::parse(
+      "{\"engine\": \"lock_free_ring\", \"capacity\": 128, "
+      "\"max_memory\": 65536, \"overflow_policy\": \"drop_newest\"}",
+      parsing_errors);
+
+  status = EventBufferLibrary::parseSettings(settings, configuration);
+  ASSERT_TRUE(status.ok());
+
+  EXPECT_EQ(settings.engine, EventBufferEngine::LockFreeRing);
+  EXPECT_EQ(settings.capacity, 128U);
+  EXPECT_EQ(settings.max_memory, 65536U);
+  EXPECT_EQ(settings.overflow_policy, EventBufferOverflowPolicy::DropNewest);
+
+  configuration = json11::Json::parse(
+      "{\"overflow_policy\": \"spill_to_disk\"}", parsing_errors);
+
+  status = EventBufferLibrary::parseSettings(settings, configuration);
+  EXPECT_FALSE(status.ok());
+
+  configuration =
+      json11::Json::parse("{\"engine\": \"invalid\"}", parsing_errors);
+
+  status = EventBufferLibrary::parseSettings(settings, configuration);
+  EXPECT_FALSE(status.ok());
+
+  configuration = json11::Json::parse(
+      "{\"high_watermark\": 50, \"low_watermark\": 60}", parsing_errors);
+
+  status = EventBufferLibrary::parseSettings(settings, configuration);
+  EXPECT_FALSE(status.ok());
+
+  // Sizes must be integers that fit a std::size_t
+  for (const auto& invalid_size : {"0", "-1", "2.5", "1e30"}) {
+    configuration = json11::Json::parse(
+        std::string("{\"capacity\": ") + invalid_size + "}", parsing_errors);
+
+    status = EventBufferLibrary::parseSettings(settings, configuration);
+    EXPECT_FALSE(status.ok()) << invalid_size;
+  }
+
+  configuration =
+      json11::Json::parse("{\"max_memory\": 0}", parsing_errors);
+
+  status = EventBufferLibrary::parseSettings(settings, configuration);
+  EXPECT_TRUE(status.ok());
+}
+
+TEST(EventBufferTests, LockFreeRingConcurrentProducers) {
+  const std::size_t kProducerCount = 4U;
+  const std::size_t kRowsPerProducer = 10000U;
+
+  IEventBufferRef event_buffer;
+  auto status = createEventBuffer(
+      event_buffer, generateSettings(EventBufferEngine::LockFreeRing, 1024U));
+  ASSERT_TRUE(status.ok());
+
+  std::vector<std::thread> producer_list;
+  for (std::size_t i = 0U; i < kProducerCount; ++i) {
+    producer_list.emplace_back([event_buffer, i, kRowsPerProducer]() {
+      for (std::size_t j = 0U; j < kRowsPerProducer; j += 100U) {
+        auto event_batch =
+            generateEventBatch((i * kRowsPerProducer) + j, 100U);
+
+        event_buffer->save(event_batch);
+      }
+    });
+  }
+
+  std::size_t received_row_count = 0U;
+  for (std::size_t i = 0U; i < 100U; ++i) {
+    received_row_count += event_buffer->get().size();
+  }
+
+  for (auto& producer : producer_list) {
+    producer.join();
+  }
+
+  received_row_count += event_buffer->get().size();
+
+  auto statistics = event_buffer->statistics();
+  EXPECT_EQ(statistics.row_count, 0U);
+  EXPECT_EQ(received_row_count + statistics.overwritten_row_count,
+            kProducerCount * kRowsPerProducer);
+}
+} // namespace trailofbits
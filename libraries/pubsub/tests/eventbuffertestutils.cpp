@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "eventbuffertestutils.h"
+#include "circulareventbuffer.h"
+#include "lockfreeeventbuffer.h"
+
+#include <osquery/sql/dynamic_table_row.h>
+
+namespace trailofbits {
+EventBatch generateEventBatch(std::size_t first_value, std::size_t count) {
+  EventBatch event_batch;
+
+  for (auto i = first_value; i < first_value + count; ++i) {
+    osquery::Row row = {{"value", std::to_string(i)},
+                        {"name", "row_" + std::to_string(i)}};
+
+    event_batch.push_back(osquery::TableRowHolder(
+        new osquery::DynamicTableRow(std::move(row))));
+  }
+
+  return event_batch;
+}
+
+std::size_t getColumnValue(const osquery::TableRowHolder& row,
+                           const std::string& column_name) {
+  auto row_data = static_cast<osquery::Row>(*row);
+  return static_cast<std::size_t>(std::stoull(row_data.at(column_name)));
+}
+
+std::size_t getRowValue(const osquery::TableRowHolder& row) {
+  return getColumnValue(row, "value");
+}
+
+osquery::Status createEventBuffer(IEventBufferRef& event_buffer,
+                                  const EventBufferSettings& settings,
+                                  EventBufferPressureStateRef pressure_state) {
+  if (settings.engine == EventBufferEngine::CircularBuffer) {
+    return CircularEventBuffer::create(
+        event_buffer, settings, "test", std::move(pressure_state));
+  } else {
+    return LockFreeEventBuffer::create(
+        event_buffer, settings, "test", std::move(pressure_state));
+  }
+}
+} // namespace trailofbits
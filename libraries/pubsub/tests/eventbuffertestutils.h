@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "ieventbuffer.h"
+
+#include <pubsub/eventbufferlibrary.h>
+
+namespace trailofbits {
+/// Generates `count` rows; the "value" column is set to `first_value` for
+/// the first row and incremented for each of the following ones
+EventBatch generateEventBatch(std::size_t first_value, std::size_t count);
+
+/// Returns the numeric value of the given column
+std::size_t getColumnValue(const osquery::TableRowHolder& row,
+                           const std::string& column_name);
+
+/// Returns the "value" column of a row created by generateEventBatch()
+std::size_t getRowValue(const osquery::TableRowHolder& row);
+
+/// Creates a circular or lock-free buffer named "test", depending on the
+/// engine selected in the settings
+osquery::Status createEventBuffer(
+    IEventBufferRef& event_buffer,
+    const EventBufferSettings& settings,
+    EventBufferPressureStateRef pressure_state = nullptr);
+} // namespace trailofbits
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "eventbufferutils.h"
+
+#include <pubsub/eventcolumnbatch.h>
+
+#include <gtest/gtest.h>
+
+namespace trailofbits {
+namespace {
+const osquery::TableColumns kTestSchema = {
+    std::make_tuple(
+        "name", osquery::TEXT_TYPE, osquery::ColumnOptions::DEFAULT),
+    std::make_tuple(
+        "size", osquery::TEXT_TYPE, osquery::ColumnOptions::DEFAULT),
+    std::make_tuple(
+        "data", osquery::TEXT_TYPE, osquery::ColumnOptions::DEFAULT)};
+} // namespace
+
+TEST(EventColumnBatchTests, MaterializeRows) {
+  auto name_column = EventColumnBatch::columnIndex(kTestSchema, "name");
+  auto size_column = EventColumnBatch::columnIndex(kTestSchema, "size");
+  auto data_column = EventColumnBatch::columnIndex(kTestSchema, "data");
+
+  ASSERT_EQ(name_column, 0U);
+  ASSERT_EQ(size_column, 1U);
+  ASSERT_EQ(data_column, 2U);
+
+  EXPECT_EQ(EventColumnBatch::columnIndex(kTestSchema, "missing"),
+            EventColumnBatch::kInvalidColumn);
+
+  EventColumnBatchRef batch;
+  auto status = EventColumnBatch::create(batch, kTestSchema);
+  ASSERT_TRUE(status.ok());
+
+  auto first_row = batch->addRow();
+  batch->setText(first_row, name_column, "first");
+  batch->setInteger(first_row, size_column, -10);
+
+  auto second_row = batch->addRow();
+  batch->copyRow(second_row, first_row);
+  batch->setText(second_row, data_column, std::string("payload"));
+
+  ASSERT_EQ(batch->rowCount(), 2U);
+  EXPECT_EQ(batch->cellType(first_row, data_column),
+            EventColumnBatch::CellType::Null);
+
+  EXPECT_EQ(batch->integerValue(second_row, size_column), -10);
+  EXPECT_EQ(batch->textValue(second_row, name_column), "first");
+
+  osquery::TableRows table_rows;
+  EventColumnBatch::appendTableRows(table_rows, batch);
+  batch.reset();
+
+  ASSERT_EQ(table_rows.size(), 2U);
+
+  // Null cells are not part of the row
+  auto row_data = static_cast<osquery::Row>(*table_rows.at(0));
+  EXPECT_EQ(row_data.size(), 2U);
+  EXPECT_EQ(row_data.at("name"), "first");
+  EXPECT_EQ(row_data.at("size"), "-10");
+
+  row_data = static_cast<osquery::Row>(*table_rows.at(1));
+  EXPECT_EQ(row_data.size(), 3U);
+  EXPECT_EQ(row_data.at("data"), "payload");
+
+  // Lazy rows report their size without being converted
+  EXPECT_GT(estimateRowSize(*table_rows.at(0)), 0U);
+
+  auto cloned_row = table_rows.at(1)->clone();
+  EXPECT_EQ(static_cast<osquery::Row>(*cloned_row), row_data);
+}
+} // namespace trailofbits
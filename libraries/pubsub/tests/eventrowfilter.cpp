@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pubsub/eventcolumnbatch.h>
+#include <pubsub/eventrowfilter.h>
+
+#include <osquery/sql/dynamic_table_row.h>
+
+#include <gtest/gtest.h>
+
+namespace trailofbits {
+namespace {
+const osquery::TableColumns kTestSchema = {
+    std::make_tuple(
+        "name", osquery::TEXT_TYPE, osquery::ColumnOptions::DEFAULT),
+    std::make_tuple(
+        "size", osquery::BIGINT_TYPE, osquery::ColumnOptions::DEFAULT),
+    std::make_tuple(
+        "data", osquery::TEXT_TYPE, osquery::ColumnOptions::DEFAULT)};
+
+EventBatch generateEventBatch() {
+  EventColumnBatchRef batch;
+  auto status = EventColumnBatch::create(batch, kTestSchema);
+  EXPECT_TRUE(status.ok());
+
+  const char* name_list[] = {"www.example.com", "mail.example.org", "host"};
+
+  for (std::size_t i = 0U; i < 3U; ++i) {
+    auto row = batch->addRow();
+    batch->setText(row, 0U, name_list[i]);
+    batch->setInteger(row, 1U, static_cast<std::int64_t>(i * 100U));
+  }
+
+  EventBatch event_batch;
+  EventColumnBatch::appendTableRows(event_batch, batch);
+
+  // Rows that are not lazy are supported too
+  osquery::Row row = {{"name", "static"}, {"size", "1000"}, {"data", "x"}};
+  event_batch.push_back(osquery::TableRowHolder(
+      new osquery::DynamicTableRow(std::move(row))));
+
+  return event_batch;
+}
+
+std::size_t countMatchingRows(
+    const std::vector<std::pair<unsigned char, std::string>>& constraints,
+    const std::string& column_name) {
+  osquery::QueryContext context;
+
+  for (const auto& constraint : constraints) {
+    context.constraints[column_name].add(
+        osquery::Constraint(constraint.first, constraint.second));
+  }
+
+  auto event_batch = generateEventBatch();
+  filterEventRows(event_batch, context, kTestSchema);
+
+  return event_batch.size();
+}
+} // namespace
+
+TEST(EventRowFilterTests, LikePattern) {
+  EXPECT_TRUE(EventRowFilter::matchLikePattern("www.example.com", "%"));
+  EXPECT_TRUE(EventRowFilter::matchLikePattern("", "%"));
+  EXPECT_FALSE(EventRowFilter::matchLikePattern("", "_"));
+
+  EXPECT_TRUE(
+      EventRowFilter::matchLikePattern("www.example.com", "%.EXAMPLE.com"));
+
+  EXPECT_TRUE(EventRowFilter::matchLikePattern("www.example.com", "w_w%"));
+  EXPECT_TRUE(EventRowFilter::matchLikePattern("abcabc", "%abc"));
+  EXPECT_TRUE(EventRowFilter::matchLikePattern("abcabd", "%ab_%d"));
+
+  EXPECT_FALSE(EventRowFilter::matchLikePattern("www.example.com", "%.org"));
+  EXPECT_FALSE(EventRowFilter::matchLikePattern("abc", "ab"));
+  EXPECT_FALSE(EventRowFilter::matchLikePattern("ab", "abc"));
+
+  // '_' matches whole UTF-8 characters, as in SQLite
+  const std::string kUtf8Value = "m\xC3\xBCnchen.\xE4\xBE\x8B";
+  EXPECT_TRUE(EventRowFilter::matchLikePattern(kUtf8Value, "m_nchen._"));
+  EXPECT_TRUE(EventRowFilter::matchLikePattern(kUtf8Value, "%_nchen%"));
+  EXPECT_TRUE(EventRowFilter::matchLikePattern(kUtf8Value, "%._"));
+  EXPECT_FALSE(EventRowFilter::matchLikePattern(kUtf8Value, "m__nchen%"));
+  EXPECT_FALSE(EventRowFilter::matchLikePattern(kUtf8Value, "%.__"));
+}
+
+TEST(EventRowFilterTests, Constraints) {
+  EXPECT_EQ(countMatchingRows({}, "name"), 4U);
+
+  EXPECT_EQ(countMatchingRows({{osquery::EQUALS, "host"}}, "name"), 1U);
+  EXPECT_EQ(countMatchingRows({{osquery::LIKE, "%.example.%"}}, "name"), 2U);
+  EXPECT_EQ(countMatchingRows({{osquery::LIKE, "%.EXAMPLE.com"},
+                               {osquery::EQUALS, "host"}},
+                              "name"),
+            0U);
+
+  // Numeric columns are not compared as strings
+  EXPECT_EQ(countMatchingRows({{osquery::GREATER_THAN, "99"}}, "size"), 3U);
+  EXPECT_EQ(
+      countMatchingRows({{osquery::GREATER_THAN_OR_EQUALS, "100"},
+                         {osquery::LESS_THAN, "1000"}},
+                        "size"),
+      2U);
+
+  EXPECT_EQ(countMatchingRows({{osquery::LESS_THAN_OR_EQUALS, "0"}}, "size"),
+            1U);
+
+  // NULL values never match
+  EXPECT_EQ(countMatchingRows({{osquery::EQUALS, "x"}}, "data"), 1U);
+
+  // Constraints that can't be evaluated are left to osquery
+  EXPECT_EQ(countMatchingRows({{osquery::GLOB, "*"}}, "name"), 4U);
+  EXPECT_EQ(countMatchingRows({{osquery::EQUALS, "x"}}, "missing"), 4U);
+}
+} // namespace trailofbits
@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pubsub/eventrowlimiter.h>
+#include <pubsub/metricsregistry.h>
+
+#include <osquery/sql/dynamic_table_row.h>
+
+#include <algorithm>
+
+#include <gtest/gtest.h>
+
+namespace trailofbits {
+namespace {
+/// Appends the given amount of rows with the specified source address
+void appendRows(EventBatch& rows,
+                const std::string& source_address,
+                std::size_t count) {
+  for (std::size_t i = 0U; i < count; ++i) {
+    osquery::Row row = {{"source_address", source_address},
+                        {"record_name", "www.example.com"}};
+
+    rows.push_back(osquery::TableRowHolder(
+        new osquery::DynamicTableRow(std::move(row))));
+  }
+}
+
+/// Counts the rows with the specified source address
+std::size_t countRows(const EventBatch& rows,
+                      const std::string& source_address) {
+  return static_cast<std::size_t>(
+      std::count_if(rows.begin(),
+                     rows.end(),
+                     [&](const osquery::TableRowHolder& row) -> bool {
+                       auto row_data = static_cast<osquery::Row>(*row);
+                       return row_data["source_address"] == source_address;
+                     }));
+}
+} // namespace
+
+TEST(EventRowLimiterTests, Settings) {
+  EventRowLimiterSettings settings;
+  auto status = EventRowLimiterSettings::parse(settings, json11::Json());
+  ASSERT_TRUE(status.ok());
+  EXPECT_FALSE(settings.enabled());
+
+  status = EventRowLimiterSettings::parse(
+      settings,
+      json11::Json::object{{"key_column", "source_address"}, {"rate", 10}});
+  ASSERT_TRUE(status.ok());
+  EXPECT_TRUE(settings.enabled());
+  EXPECT_EQ(settings.key_column, "source_address");
+  EXPECT_EQ(settings.burst, 10U);
+
+  status = EventRowLimiterSettings::parse(
+      settings, json11::Json::object{{"sample_rate", 1.5}});
+  EXPECT_FALSE(status.ok());
+
+  status = EventRowLimiterSettings::parse(
+      settings, json11::Json::object{{"rate", -1}});
+  EXPECT_FALSE(status.ok());
+
+  status = EventRowLimiterSettings::parse(
+      settings, json11::Json::object{{"rate", 1}, {"max_key_count", 0}});
+  EXPECT_FALSE(status.ok());
+  status = EventRowLimiterSettings::parse(
+      settings, json11::Json::object{{"rate", 1}, {"burst", 2.5}});
+  EXPECT_FALSE(status.ok());
+
+  status = EventRowLimiterSettings::parse(
+      settings, json11::Json::object{{"rate", 1e30}});
+  ASSERT_TRUE(status.ok());
+  EXPECT_EQ(settings.burst, 4294967295U);
+}
+
+TEST(EventRowLimiterTests, RateLimiting) {
+  EventRowLimiterSettings settings;
+  settings.key_column = "source_address";
+  settings.rate = 10.0;
+  settings.burst = 5U;
+
+  EventRowLimiterRef row_limiter;
+  auto status =
+      EventRowLimiter::create(row_limiter, "row_limiter_test", settings);
+  ASSERT_TRUE(status.ok());
+
+  auto start_time = std::chrono::steady_clock::now();
+
+  // The noisy key can only use its own bucket
+  EventBatch rows;
+  appendRows(rows, "10.0.0.1", 20U);
+  appendRows(rows, "10.0.0.2", 3U);
+
+  row_limiter->apply(rows, start_time);
+  EXPECT_EQ(countRows(rows, "10.0.0.1"), 5U);
+  EXPECT_EQ(countRows(rows, "10.0.0.2"), 3U);
+  EXPECT_EQ(row_limiter->keyCount(), 2U);
+
+  // Half a second later, 5 more tokens are available
+  rows.clear();
+  appendRows(rows, "10.0.0.1", 20U);
+
+  row_limiter->apply(rows, start_time + std::chrono::milliseconds(500));
+  EXPECT_EQ(rows.size(), 5U);
+
+  auto rate_limited_row_count = MetricsRegistry::instance().counter(
+      "subscriber", "row_limiter_test", "rate_limited_rows");
+  EXPECT_EQ(rate_limited_row_count->value(), 30U);
+}
+
+TEST(EventRowLimiterTests, MaxKeyCount) {
+  EventRowLimiterSettings settings;
+  settings.key_column = "source_address";
+  settings.rate = 1.0;
+  settings.burst = 1U;
+  settings.max_key_count = 2U;
+
+  EventRowLimiterRef row_limiter;
+  auto status =
+      EventRowLimiter::create(row_limiter, "max_key_count_test", settings);
+  ASSERT_TRUE(status.ok());
+
+  auto start_time = std::chrono::steady_clock::now();
+
+  // Keys that can't be tracked share the same bucket
+  EventBatch rows;
+  for (const auto& source_address :
+       {"10.0.0.1", "10.0.0.2", "10.0.0.3", "10.0.0.4"}) {
+    appendRows(rows, source_address, 2U);
+  }
+
+  row_limiter->apply(rows, start_time);
+  EXPECT_EQ(rows.size(), 3U);
+  EXPECT_EQ(row_limiter->keyCount(), 2U);
+
+  // Once the buckets are full again, they make room for new keys
+  rows.clear();
+  appendRows(rows, "10.0.0.3", 1U);
+
+  row_limiter->apply(rows, start_time + std::chrono::seconds(2));
+  EXPECT_EQ(rows.size(), 1U);
+  EXPECT_EQ(row_limiter->keyCount(), 1U);
+}
+
+TEST(EventRowLimiterTests, PruneInterval) {
+  EventRowLimiterSettings settings;
+  settings.key_column = "source_address";
+  settings.rate = 2.0;
+  settings.burst = 2U;
+  settings.max_key_count = 2U;
+
+  EventRowLimiterRef row_limiter;
+  auto status =
+      EventRowLimiter::create(row_limiter, "prune_interval_test", settings);
+  ASSERT_TRUE(status.ok());
+
+  auto start_time = std::chrono::steady_clock::now();
+
+  EventBatch rows;
+  appendRows(rows, "10.0.0.1", 1U);
+  appendRows(rows, "10.0.0.2", 2U);
+  appendRows(rows, "10.0.0.3", 1U);
+
+  row_limiter->apply(rows, start_time);
+  EXPECT_EQ(row_limiter->keyCount(), 2U);
+
+  // The first bucket is full again, but the buckets have just been pruned
+  rows.clear();
+  appendRows(rows, "10.0.0.4", 1U);
+
+  row_limiter->apply(rows, start_time + std::chrono::milliseconds(750));
+  EXPECT_EQ(row_limiter->keyCount(), 2U);
+
+  // Pruning resumes once the refill interval has elapsed
+  rows.clear();
+  appendRows(rows, "10.0.0.4", 1U);
+
+  row_limiter->apply(rows, start_time + std::chrono::seconds(1));
+  EXPECT_EQ(row_limiter->keyCount(), 1U);
+}
+
+TEST(EventRowLimiterTests, Sampling) {
+  EventRowLimiterSettings settings;
+  settings.key_column = "source_address";
+  settings.sample_rate = 0.25;
+
+  EventRowLimiterRef row_limiter;
+  auto status =
+      EventRowLimiter::create(row_limiter, "sampling_test", settings);
+  ASSERT_TRUE(status.ok());
+
+  EventBatch rows;
+  for (std::size_t i = 0U; i < 1000U; ++i) {
+    appendRows(rows, "10.0.0." + std::to_string(i), 2U);
+  }
+
+  row_limiter->apply(rows);
+
+  // Keys are either kept or dropped as a whole
+  std::size_t sampled_key_count = 0U;
+  for (std::size_t i = 0U; i < 1000U; ++i) {
+    auto source_address = "10.0.0." + std::to_string(i);
+
+    auto row_count = countRows(rows, source_address);
+    EXPECT_EQ(row_count, row_limiter->isSampled(source_address) ? 2U : 0U);
+
+    if (row_count != 0U) {
+      ++sampled_key_count;
+    }
+  }
+
+  EXPECT_GT(sampled_key_count, 150U);
+  EXPECT_LT(sampled_key_count, 350U);
+
+  // The hash does not depend on the limiter instance
+  EventRowLimiterRef other_row_limiter;
+  status =
+      EventRowLimiter::create(other_row_limiter, "sampling_test", settings);
+  ASSERT_TRUE(status.ok());
+
+  for (std::size_t i = 0U; i < 1000U; ++i) {
+    auto source_address = "10.0.0." + std::to_string(i);
+    EXPECT_EQ(row_limiter->isSampled(source_address),
+              other_row_limiter->isSampled(source_address));
+  }
+
+  auto sampled_out_row_count = MetricsRegistry::instance().counter(
+      "subscriber", "sampling_test", "sampled_out_rows");
+  EXPECT_EQ(sampled_out_row_count->value(), 2000U - rows.size());
+}
+} // namespace trailofbits
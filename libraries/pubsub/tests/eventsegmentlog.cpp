@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "eventbuffertestutils.h"
+#include "eventsegmentlog.h"
+
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+
+#include <gtest/gtest.h>
+
+namespace boostfs = boost::filesystem;
+
+namespace trailofbits {
+namespace {
+EventBufferSettings generateSettings() {
+  EventBufferSettings settings;
+  settings.spill_directory =
+      (boostfs::temp_directory_path() /
+       boostfs::unique_path("pubsub_tests_%%%%%%%%"))
+          .string();
+
+  return settings;
+}
+
+std::size_t countSegmentFiles(const std::string& directory) {
+  std::size_t count = 0U;
+
+  for (boostfs::directory_iterator it(directory), end; it != end; ++it) {
+    if (it->path().extension() == ".seg") {
+      ++count;
+    }
+  }
+
+  return count;
+}
+} // namespace
+
+TEST(EventSegmentLogTests, AppendAndRead) {
+  auto settings = generateSettings();
+
+  EventSegmentLogRef segment_log;
+  auto status = EventSegmentLog::create(
+      segment_log, settings.spill_directory, "test", settings);
+  ASSERT_TRUE(status.ok());
+
+  std::size_t dropped_row_count = 0U;
+  auto event_batch = generateEventBatch(0U, 100U);
+  status = segment_log->append(event_batch, dropped_row_count);
+  ASSERT_TRUE(status.ok());
+
+  EXPECT_TRUE(event_batch.empty());
+  EXPECT_EQ(dropped_row_count, 0U);
+  EXPECT_EQ(segment_log->rowCount(), 100U);
+  EXPECT_GT(segment_log->diskUsage(), 0U);
+
+  EventBatch saved_events;
+  status = segment_log->read(saved_events);
+  ASSERT_TRUE(status.ok());
+  ASSERT_EQ(saved_events.size(), 100U);
+
+  for (std::size_t i = 0U; i < saved_events.size(); ++i) {
+    auto row_data = static_cast<osquery::Row>(*saved_events.at(i));
+    EXPECT_EQ(row_data.at("value"), std::to_string(i));
+    EXPECT_EQ(row_data.at("name"), "row_" + std::to_string(i));
+  }
+
+  EXPECT_EQ(segment_log->rowCount(), 0U);
+  EXPECT_EQ(segment_log->diskUsage(), 0U);
+
+  // Non-persistent logs clean up after themselves
+  segment_log.reset();
+  EXPECT_EQ(countSegmentFiles(
+                (boostfs::path(settings.spill_directory) / "test").string()),
+            0U);
+
+  boostfs::remove_all(settings.spill_directory);
+}
+
+TEST(EventSegmentLogTests, ReplacedLog) {
+  auto settings = generateSettings();
+
+  // The library creates the new log before it releases the old one, and
+  // both share the same folder
+  EventSegmentLogRef old_segment_log;
+  auto status = EventSegmentLog::create(
+      old_segment_log, settings.spill_directory, "test", settings);
+  ASSERT_TRUE(status.ok());
+
+  std::size_t dropped_row_count = 0U;
+  auto event_batch = generateEventBatch(0U, 10U);
+  status = old_segment_log->append(event_batch, dropped_row_count);
+  ASSERT_TRUE(status.ok());
+
+  EventBatch saved_events;
+  status = old_segment_log->read(saved_events);
+  ASSERT_TRUE(status.ok());
+  ASSERT_EQ(saved_events.size(), 10U);
+
+  EventSegmentLogRef new_segment_log;
+  status = EventSegmentLog::create(
+      new_segment_log, settings.spill_directory, "test", settings);
+  ASSERT_TRUE(status.ok());
+
+  event_batch = generateEventBatch(10U, 10U);
+  status = old_segment_log->append(event_batch, dropped_row_count);
+  ASSERT_TRUE(status.ok());
+
+  old_segment_log.reset();
+
+  event_batch = generateEventBatch(20U, 10U);
+  status = new_segment_log->append(event_batch, dropped_row_count);
+  ASSERT_TRUE(status.ok());
+
+  saved_events.clear();
+  status = new_segment_log->read(saved_events);
+  ASSERT_TRUE(status.ok());
+  ASSERT_EQ(saved_events.size(), 10U);
+
+  for (std::size_t i = 0U; i < saved_events.size(); ++i) {
+    EXPECT_EQ(getRowValue(saved_events.at(i)), 20U + i);
+  }
+
+  new_segment_log.reset();
+  boostfs::remove_all(settings.spill_directory);
+}
+
+TEST(EventSegmentLogTests, RotationAndDiskLimit) {
+  auto settings = generateSettings();
+  settings.segment_size = 1024U;
+  settings.max_disk_usage = 4096U;
+
+  EventSegmentLogRef segment_log;
+  auto status = EventSegmentLog::create(
+      segment_log, settings.spill_directory, "test", settings);
+  ASSERT_TRUE(status.ok());
+
+  std::size_t total_dropped_row_count = 0U;
+
+  for (std::size_t i = 0U; i < 100U; ++i) {
+    std::size_t dropped_row_count = 0U;
+    auto event_batch = generateEventBatch(i * 10U, 10U);
+
+    status = segment_log->append(event_batch, dropped_row_count);
+    ASSERT_TRUE(status.ok());
+
+    total_dropped_row_count += dropped_row_count;
+  }
+
+  auto log_directory = boostfs::path(settings.spill_directory) / "test";
+
+  EXPECT_GT(countSegmentFiles(log_directory.string()), 1U);
+  EXPECT_LE(segment_log->diskUsage(), settings.max_disk_usage);
+  EXPECT_GT(total_dropped_row_count, 0U);
+  EXPECT_EQ(segment_log->rowCount() + total_dropped_row_count, 1000U);
+
+  // Only the oldest rows have been dropped
+  EventBatch saved_events;
+  status = segment_log->read(saved_events);
+  ASSERT_TRUE(status.ok());
+  ASSERT_EQ(saved_events.size(), 1000U - total_dropped_row_count);
+
+  for (std::size_t i = 0U; i < saved_events.size(); ++i) {
+    EXPECT_EQ(getRowValue(saved_events.at(i)), total_dropped_row_count + i);
+  }
+
+  EXPECT_EQ(countSegmentFiles(log_directory.string()), 0U);
+
+  segment_log.reset();
+  boostfs::remove_all(settings.spill_directory);
+}
+
+TEST(EventSegmentLogTests, RecoverDamagedSegment) {
+  auto settings = generateSettings();
+  settings.persistent = true;
+
+  EventSegmentLogRef segment_log;
+  auto status = EventSegmentLog::create(
+      segment_log, settings.spill_directory, "test", settings);
+  ASSERT_TRUE(status.ok());
+
+  std::size_t dropped_row_count = 0U;
+  auto event_batch = generateEventBatch(0U, 10U);
+  status = segment_log->append(event_batch, dropped_row_count);
+  ASSERT_TRUE(status.ok());
+
+  segment_log.reset();
+
+  // Simulate a record that was only partially written before a crash
+  auto log_directory = boostfs::path(settings.spill_directory) / "test";
+  ASSERT_EQ(countSegmentFiles(log_directory.string()), 1U);
+
+  boostfs::directory_iterator it(log_directory);
+  {
+    std::ofstream segment_file(it->path().string(),
+                               std::ios::binary | std::ios::app);
+    segment_file.write("\x40\x01\x02", 3);
+  }
+
+  status = EventSegmentLog::create(
+      segment_log, settings.spill_directory, "test", settings);
+  ASSERT_TRUE(status.ok());
+  EXPECT_EQ(segment_log->rowCount(), 10U);
+
+  event_batch = generateEventBatch(10U, 5U);
+  status = segment_log->append(event_batch, dropped_row_count);
+  ASSERT_TRUE(status.ok());
+
+  EventBatch saved_events;
+  status = segment_log->read(saved_events);
+  ASSERT_TRUE(status.ok());
+  ASSERT_EQ(saved_events.size(), 15U);
+
+  for (std::size_t i = 0U; i < saved_events.size(); ++i) {
+    EXPECT_EQ(getRowValue(saved_events.at(i)), i);
+  }
+
+  segment_log.reset();
+  boostfs::remove_all(settings.spill_directory);
+}
+
+TEST(EventSegmentLogTests, PersistentBuffer) {
+  for (auto engine :
+       {EventBufferEngine::CircularBuffer, EventBufferEngine::LockFreeRing}) {
+    auto settings = generateSettings();
+    settings.engine = engine;
+    settings.capacity = 8U;
+    settings.persistent = true;
+
+    IEventBufferRef event_buffer;
+    auto status = createEventBuffer(event_buffer, settings);
+    ASSERT_TRUE(status.ok());
+
+    auto event_batch = generateEventBatch(0U, 8U);
+    event_buffer->save(event_batch);
+
+    // Simulate a restart
+    event_buffer->flush();
+    event_buffer.reset();
+
+    status = createEventBuffer(event_buffer, settings);
+    ASSERT_TRUE(status.ok());
+
+    EXPECT_EQ(event_buffer->statistics().pending_spilled_row_count, 8U);
+
+    event_batch = generateEventBatch(8U, 2U);
+    event_buffer->save(event_batch);
+
+    auto saved_events = event_buffer->get();
+    ASSERT_EQ(saved_events.size(), 10U);
+
+    for (std::size_t i = 0U; i < saved_events.size(); ++i) {
+      EXPECT_EQ(getRowValue(saved_events.at(i)), i);
+    }
+
+    event_buffer.reset();
+    boostfs::remove_all(settings.spill_directory);
+  }
+}
+} // namespace trailofbits
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pubsub/latencyhistogram.h>
+
+#include <gtest/gtest.h>
+
+namespace trailofbits {
+TEST(LatencyHistogramTests, BucketBoundaries) {
+  for (std::uint64_t value = 0U; value < 1000000U; value = value * 3U + 1U) {
+    auto bucket_index = LatencyHistogram::bucketIndex(value);
+    ASSERT_LT(bucket_index, LatencyHistogram::kBucketCount);
+
+    auto lower_bound = LatencyHistogram::bucketLowerBound(bucket_index);
+    EXPECT_LE(lower_bound, value);
+
+    // Each bucket is at most 12.5% wider than its lower bound
+    EXPECT_LE(value - lower_bound, lower_bound / 8U);
+  }
+}
+
+TEST(LatencyHistogramTests, Summary) {
+  LatencyHistogram histogram;
+  EXPECT_EQ(histogram.summary().count, 0U);
+
+  for (std::uint64_t value = 1U; value <= 100U; ++value) {
+    histogram.record(value);
+  }
+
+  auto summary = histogram.summary();
+  EXPECT_EQ(summary.count, 100U);
+  EXPECT_EQ(summary.total, 5050U);
+  EXPECT_EQ(summary.max, 100U);
+
+  EXPECT_GE(summary.p50, 50U - 50U / 8U);
+  EXPECT_LE(summary.p50, 50U);
+
+  EXPECT_GE(summary.p99, 99U - 99U / 8U);
+  EXPECT_LE(summary.p99, 99U);
+}
+} // namespace trailofbits
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pubsub/metricsregistry.h>
+
+#include <osquery/sql/dynamic_table_row.h>
+
+#include <thread>
+
+#include <gtest/gtest.h>
+
+namespace trailofbits {
+// clang-format off
+BEGIN_TABLE(metrics_test)
+  TABLE_COLUMN(component, osquery::TEXT_TYPE)
+  TABLE_COLUMN(name, osquery::TEXT_TYPE)
+  TABLE_COLUMN(metric, osquery::TEXT_TYPE)
+  TABLE_COLUMN(value, osquery::BIGINT_TYPE)
+END_CUSTOM_TABLE(metrics_test, generateMetricsTableRows)
+// clang-format on
+
+TEST(MetricsRegistryTests, StripedCounter) {
+  auto counter =
+      MetricsRegistry::instance().counter("test", "striped_counter", "value");
+
+  std::vector<std::thread> thread_list;
+  for (auto i = 0U; i < 8U; ++i) {
+    thread_list.emplace_back([counter]() {
+      for (auto j = 0U; j < 10000U; ++j) {
+        counter->add();
+      }
+    });
+  }
+
+  for (auto& thread : thread_list) {
+    thread.join();
+  }
+
+  EXPECT_EQ(counter->value(), 80000U);
+
+  // The same metric is returned each time
+  auto same_counter =
+      MetricsRegistry::instance().counter("test", "striped_counter", "value");
+  EXPECT_EQ(counter, same_counter);
+}
+
+TEST(MetricsRegistryTests, MetricsTable) {
+  auto histogram =
+      MetricsRegistry::instance().histogram("test", "metrics_table", "latency");
+  histogram->record(100U);
+  histogram->record(200U);
+
+  EventBatch event_batch;
+  event_batch.push_back(osquery::TableRowHolder(
+      new osquery::DynamicTableRow(osquery::Row{{"value", "1"}})));
+  EventBufferLibrary::instance().saveEvents(event_batch, "metrics_test");
+
+  osquery::QueryContext context;
+  context.constraints["name"].add(
+      osquery::Constraint(osquery::EQUALS, "metrics_test"));
+
+  auto rows = generateMetricsTableRows(
+      "pubsub_metrics", context, metrics_testTableSchema());
+
+  std::map<std::string, std::string> buffer_metric_map;
+  for (const auto& row : rows) {
+    auto row_data = static_cast<osquery::Row>(*row);
+    EXPECT_EQ(row_data.at("name"), "metrics_test");
+
+    buffer_metric_map.insert({row_data.at("metric"), row_data.at("value")});
+  }
+
+  EXPECT_EQ(buffer_metric_map.at("row_count"), "1");
+  EXPECT_EQ(buffer_metric_map.at("overwritten_row_count"), "0");
+
+  context.constraints.clear();
+  context.constraints["name"].add(
+      osquery::Constraint(osquery::EQUALS, "metrics_table"));
+
+  rows = generateMetricsTableRows(
+      "pubsub_metrics", context, metrics_testTableSchema());
+  ASSERT_EQ(rows.size(), 1U);
+
+  auto row_data = static_cast<osquery::Row>(*rows.front());
+  EXPECT_EQ(row_data.at("value"), "2");
+  EXPECT_EQ(row_data.at("total"), "300");
+  EXPECT_EQ(row_data.at("max"), "200");
+}
+} // namespace trailofbits
@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <pubsub/publisherscheduler.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+namespace boostfs = boost::filesystem;
+
+namespace trailofbits {
+namespace {
+/// A publisher that blocks inside ::run() until new events are queued or
+/// it is interrupted; events are held back until they are flushed
+class TestPublisher final : public IEventPublisher {
+  std::mutex mutex;
+  std::condition_variable cv;
+
+  std::size_t queued_event_count{0U};
+  std::size_t pending_event_count{0U};
+  bool interrupted{false};
+
+ public:
+  /// If set, ::interrupt() is ignored and ::run() blocks until ::unblock()
+  bool ignore_interrupt{false};
+
+  /// If set, the publisher is serviced by the reactor
+  int readiness_fd{-1};
+
+  std::atomic<std::size_t> run_count{0U};
+  std::atomic<std::size_t> completed_run_count{0U};
+  std::atomic<std::size_t> flushed_event_count{0U};
+  std::atomic_bool stopped{false};
+
+  ~TestPublisher() override {
+    if (readiness_fd != -1) {
+      close(readiness_fd);
+    }
+  }
+
+  /// Queues new events, without waking up ::run()
+  void queueEvents(std::size_t event_count) {
+    std::lock_guard<std::mutex> lock(mutex);
+    queued_event_count += event_count;
+  }
+
+  /// Releases a publisher that ignores ::interrupt()
+  void unblock() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      ignore_interrupt = false;
+    }
+
+    cv.notify_all();
+  }
+
+  osquery::Status subscribe(SubscriberId,
+                            IEventSubscriberRef,
+                            const std::string&) override {
+    return osquery::Status(0);
+  }
+
+  void unsubscribe(SubscriberId) override {}
+
+  osquery::Status initialize() noexcept override {
+    return osquery::Status(0);
+  }
+
+  osquery::Status configure(const json11::Json&) noexcept override {
+    return osquery::Status(0);
+  }
+
+  void configureSubscribers(const json11::Json&) noexcept override {}
+
+  osquery::Status release() noexcept override {
+    return osquery::Status(0);
+  }
+
+  osquery::Status run() noexcept override {
+    ++run_count;
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    // Reactor publishers are only run when their descriptor is readable,
+    // and only block when they ignore ::interrupt()
+    if (readiness_fd == -1 || ignore_interrupt) {
+      auto L_wakeUp = [this]() -> bool {
+        return !ignore_interrupt &&
+               (interrupted || queued_event_count != 0U);
+      };
+
+      cv.wait(lock, L_wakeUp);
+    }
+
+    pending_event_count += queued_event_count;
+    queued_event_count = 0U;
+
+    ++completed_run_count;
+    return osquery::Status(0);
+  }
+
+  std::size_t subscriptionCount() noexcept override {
+    return 0U;
+  }
+
+  LatencySummaryMap subscriberLatency() noexcept override {
+    return {};
+  }
+
+  bool backpressure() noexcept override {
+    return false;
+  }
+
+  int readinessDescriptor() noexcept override {
+    return readiness_fd;
+  }
+
+  void flushEvents(bool force) noexcept override {
+    if (!force) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    flushed_event_count += pending_event_count;
+    pending_event_count = 0U;
+
+    stopped = true;
+  }
+
+  void interrupt() noexcept override {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      interrupted = true;
+    }
+
+    cv.notify_all();
+  }
+};
+
+/// Starts a scheduler for the given publisher, using the given settings
+void startScheduler(PublisherSchedulerRef& scheduler,
+                    std::shared_ptr<TestPublisher> publisher,
+                    const std::string& scheduler_settings) {
+  auto configuration_directory =
+      boostfs::temp_directory_path() /
+      boostfs::unique_path("pubsub_tests_%%%%%%%%");
+
+  ASSERT_TRUE(boostfs::create_directory(configuration_directory));
+
+  auto configuration_path = configuration_directory / "configuration.json";
+
+  {
+    std::ofstream configuration_file(configuration_path.string());
+    configuration_file << R"({"pubsub": {"scheduler": )" << scheduler_settings
+                       << "}}";
+  }
+
+  ConfigurationFileRef configuration_file;
+  auto status = ConfigurationFile::create(configuration_file,
+                                          configuration_path.string());
+  ASSERT_TRUE(status.ok());
+
+  status = PublisherScheduler::create(scheduler, {publisher});
+  ASSERT_TRUE(status.ok());
+
+  status = scheduler->start(configuration_file);
+  ASSERT_TRUE(status.ok());
+
+  boostfs::remove_all(configuration_directory);
+}
+
+/// Returns how long it takes to stop the given scheduler
+std::chrono::milliseconds stopScheduler(PublisherSchedulerRef& scheduler,
+                                        std::chrono::milliseconds timeout) {
+  auto start_time = std::chrono::steady_clock::now();
+  scheduler->stop(timeout);
+
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start_time);
+}
+} // namespace
+
+TEST(PublisherSchedulerTests, ThreadShutdown) {
+  auto publisher = std::make_shared<TestPublisher>();
+
+  PublisherSchedulerRef scheduler;
+  startScheduler(scheduler, publisher, R"({"mode": "threads"})");
+  ASSERT_TRUE(scheduler);
+
+  // Wait for the publisher to block inside ::run()
+  while (publisher->run_count == 0U) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  // Events received right before the shutdown must not be lost
+  publisher->queueEvents(5U);
+
+  auto elapsed_time = stopScheduler(scheduler, std::chrono::seconds(5));
+  EXPECT_LT(elapsed_time.count(), 1000);
+
+  EXPECT_TRUE(publisher->stopped);
+  EXPECT_GE(publisher->run_count, 2U);
+  EXPECT_EQ(publisher->flushed_event_count, 5U);
+
+  // Stopping the scheduler again is harmless
+  scheduler.reset();
+  EXPECT_EQ(publisher->flushed_event_count, 5U);
+}
+
+TEST(PublisherSchedulerTests, ReactorShutdown) {
+  auto publisher = std::make_shared<TestPublisher>();
+  publisher->readiness_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  ASSERT_NE(publisher->readiness_fd, -1);
+
+  PublisherSchedulerRef scheduler;
+  startScheduler(
+      scheduler, publisher, R"({"mode": "reactor", "worker_count": 1})");
+  ASSERT_TRUE(scheduler);
+
+  // The readiness descriptor is never signaled; the events are picked up
+  // by the final run
+  publisher->queueEvents(3U);
+
+  auto elapsed_time = stopScheduler(scheduler, std::chrono::seconds(5));
+  EXPECT_LT(elapsed_time.count(), 1000);
+
+  EXPECT_GE(publisher->run_count, 1U);
+  EXPECT_EQ(publisher->flushed_event_count, 3U);
+}
+
+TEST(PublisherSchedulerTests, ShutdownDeadline) {
+  auto publisher = std::make_shared<TestPublisher>();
+  publisher->ignore_interrupt = true;
+
+  PublisherSchedulerRef scheduler;
+  startScheduler(scheduler, publisher, R"({"mode": "threads"})");
+  ASSERT_TRUE(scheduler);
+
+  while (publisher->run_count == 0U) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  // The publisher does not honor ::interrupt(), so its thread is detached
+  auto elapsed_time =
+      stopScheduler(scheduler, std::chrono::milliseconds(100));
+
+  EXPECT_LT(elapsed_time.count(), 1000);
+  EXPECT_FALSE(publisher->stopped);
+
+  scheduler.reset();
+  EXPECT_FALSE(publisher->stopped);
+
+  // The detached thread still owns the publisher, and completes normally
+  publisher->unblock();
+
+  for (auto i = 0U; i < 200U && !publisher->stopped; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  EXPECT_TRUE(publisher->stopped);
+}
+
+TEST(PublisherSchedulerTests, ReactorShutdownDeadline) {
+  auto publisher = std::make_shared<TestPublisher>();
+  publisher->ignore_interrupt = true;
+  publisher->readiness_fd = eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+  ASSERT_NE(publisher->readiness_fd, -1);
+
+  PublisherSchedulerRef scheduler;
+  startScheduler(
+      scheduler, publisher, R"({"mode": "reactor", "worker_count": 1})");
+  ASSERT_TRUE(scheduler);
+
+  while (publisher->run_count == 0U) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  // The worker running the publisher can't be joined, so the reactor is
+  // detached instead of waiting for it
+  auto elapsed_time =
+      stopScheduler(scheduler, std::chrono::milliseconds(100));
+
+  EXPECT_LT(elapsed_time.count(), 1000);
+  EXPECT_EQ(publisher->completed_run_count, 0U);
+
+  scheduler.reset();
+  EXPECT_FALSE(publisher->stopped);
+
+  // The detached worker completes normally
+  publisher->unblock();
+
+  for (auto i = 0U; i < 200U && publisher->completed_run_count == 0U; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  EXPECT_EQ(publisher->completed_run_count, 1U);
+}
+} // namespace trailofbits
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <pubsub/servicemanager.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+namespace trailofbits {
+namespace {
+/// A service that sleeps for a long time between each iteration
+class SleepingService final : public IService {
+ public:
+  std::atomic_bool running{false};
+  std::atomic_bool released{false};
+
+  void run() override {
+    running = true;
+
+    while (!waitForTermination(std::chrono::seconds(60))) {
+    }
+  }
+
+  void release() override {
+    released = true;
+  }
+
+  std::string name() const override {
+    return "sleeping_service";
+  }
+};
+} // namespace
+
+TEST(ServiceManagerTests, Shutdown) {
+  auto& service_manager = ServiceManager::instance();
+
+  std::shared_ptr<SleepingService> service;
+  auto status = service_manager.createService(service);
+  ASSERT_TRUE(status.ok());
+
+  while (!service->running) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  // The service is woken up instead of waiting for its timeout
+  auto start_time = std::chrono::steady_clock::now();
+  service_manager.stop(std::chrono::seconds(5));
+
+  auto elapsed_time = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start_time);
+
+  EXPECT_LT(elapsed_time.count(), 1000);
+  EXPECT_TRUE(service->released);
+
+  // No new service can be created once the manager has been stopped
+  std::shared_ptr<SleepingService> late_service;
+  status = service_manager.createService(late_service);
+  EXPECT_FALSE(status.ok());
+}
+} // namespace trailofbits
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pubsub/settingsutils.h>
+
+#include <gtest/gtest.h>
+
+namespace trailofbits {
+TEST(SettingsUtilsTests, SizeSetting) {
+  std::size_t value{5U};
+
+  // Missing settings keep the current value
+  auto status = getSizeSetting(value, json11::Json::object{}, "value");
+  ASSERT_TRUE(status.ok());
+  EXPECT_EQ(value, 5U);
+
+  status = getSizeSetting(
+      value, json11::Json::object{{"value", 64}}, "value", 1U, 64U);
+  ASSERT_TRUE(status.ok());
+  EXPECT_EQ(value, 64U);
+
+  for (const auto& invalid_value : {json11::Json(0),
+                                    json11::Json(65),
+                                    json11::Json(2.5),
+                                    json11::Json(-1),
+                                    json11::Json(1e30),
+                                    json11::Json("4")}) {
+    status = getSizeSetting(value,
+                            json11::Json::object{{"value", invalid_value}},
+                            "value",
+                            1U,
+                            64U);
+
+    EXPECT_FALSE(status.ok());
+    EXPECT_EQ(value, 64U);
+  }
+}
+
+TEST(SettingsUtilsTests, NumberSetting) {
+  double value{1.0};
+
+  auto status =
+      getNumberSetting(value, json11::Json::object{{"value", 0.5}}, "value");
+  ASSERT_TRUE(status.ok());
+  EXPECT_EQ(value, 0.5);
+
+  status =
+      getNumberSetting(value, json11::Json::object{{"value", -1}}, "value");
+  EXPECT_FALSE(status.ok());
+  EXPECT_EQ(value, 0.5);
+}
+} // namespace trailofbits
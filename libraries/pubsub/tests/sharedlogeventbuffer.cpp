@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "eventbuffertestutils.h"
+#include "sharedlogeventbuffer.h"
+
+#include <pubsub/table_generator.h>
+
+#include <thread>
+
+#include <gtest/gtest.h>
+
+namespace trailofbits {
+namespace {
+const osquery::TableColumns kTestSchema = {
+    std::make_tuple(
+        "value", osquery::BIGINT_TYPE, osquery::ColumnOptions::DEFAULT),
+    std::make_tuple(kConsumerColumnName,
+                    osquery::TEXT_TYPE,
+                    osquery::ColumnOptions::HIDDEN),
+    std::make_tuple(kSequenceColumnName,
+                    osquery::BIGINT_TYPE,
+                    osquery::ColumnOptions::HIDDEN)};
+
+EventReadRequest generateReadRequest(const std::string& consumer) {
+  EventReadRequest request;
+  request.consumer = consumer;
+
+  return request;
+}
+} // namespace
+
+TEST(SharedLogEventBufferTests, MultipleConsumers) {
+  EventBufferSettings settings;
+  settings.engine = EventBufferEngine::SharedLog;
+  settings.capacity = 8U;
+
+  IEventBufferRef event_buffer;
+  auto status = SharedLogEventBuffer::create(event_buffer, settings, "test");
+  ASSERT_TRUE(status.ok());
+
+  auto event_batch = generateEventBatch(0U, 4U);
+  event_buffer->save(event_batch);
+
+  auto first_consumer_rows = event_buffer->read(generateReadRequest("first"));
+  ASSERT_EQ(first_consumer_rows.size(), 4U);
+
+  // Reading does not remove the rows for the other consumers
+  auto second_consumer_rows =
+      event_buffer->read(generateReadRequest("second"));
+  ASSERT_EQ(second_consumer_rows.size(), 4U);
+
+  for (std::size_t i = 0U; i < 4U; ++i) {
+    EXPECT_EQ(getColumnValue(first_consumer_rows.at(i), "value"), i);
+    EXPECT_EQ(getColumnValue(first_consumer_rows.at(i), "sequence"), i);
+
+    auto row_data = static_cast<osquery::Row>(*second_consumer_rows.at(i));
+    EXPECT_EQ(row_data.at("consumer"), "second");
+
+    // Both consumers share the same row objects
+    auto first_row =
+        dynamic_cast<const SharedTableRow*>(first_consumer_rows.at(i).get());
+    auto second_row =
+        dynamic_cast<const SharedTableRow*>(second_consumer_rows.at(i).get());
+
+    ASSERT_NE(first_row, nullptr);
+    ASSERT_NE(second_row, nullptr);
+    EXPECT_EQ(first_row->data(), second_row->data());
+  }
+
+  EXPECT_TRUE(event_buffer->read(generateReadRequest("first")).empty());
+  EXPECT_EQ(event_buffer->statistics().row_count, 4U);
+
+  // Replay from a specific sequence number
+  auto request = generateReadRequest("first");
+  request.has_start_sequence = true;
+  request.start_sequence = 2U;
+
+  auto replayed_rows = event_buffer->read(request);
+  ASSERT_EQ(replayed_rows.size(), 2U);
+  EXPECT_EQ(getColumnValue(replayed_rows.at(0), "sequence"), 2U);
+
+  // The second consumer falls behind and misses the oldest rows
+  event_batch = generateEventBatch(4U, 10U);
+  event_buffer->save(event_batch);
+
+  auto statistics = event_buffer->statistics();
+  EXPECT_EQ(statistics.row_count, 8U);
+  // Rows 0-3 had already been read by everyone
+  EXPECT_EQ(statistics.overwritten_row_count, 2U);
+
+  second_consumer_rows = event_buffer->read(generateReadRequest("second"));
+  ASSERT_EQ(second_consumer_rows.size(), 8U);
+  EXPECT_EQ(getColumnValue(second_consumer_rows.front(), "sequence"), 6U);
+  EXPECT_EQ(getColumnValue(second_consumer_rows.back(), "value"), 13U);
+}
+
+TEST(SharedLogEventBufferTests, IdleConsumers) {
+  auto pressure_state =
+      std::make_shared<EventBufferPressureState>(EventBufferPressure::Low);
+
+  EventBufferSettings settings;
+  settings.engine = EventBufferEngine::SharedLog;
+  settings.capacity = 10U;
+  settings.consumer_timeout = 1U;
+
+  IEventBufferRef event_buffer;
+  auto status = SharedLogEventBuffer::create(
+      event_buffer, settings, "test", pressure_state);
+  ASSERT_TRUE(status.ok());
+
+  EXPECT_TRUE(event_buffer->read(generateReadRequest("active")).empty());
+  EXPECT_TRUE(event_buffer->read(generateReadRequest("idle")).empty());
+
+  auto event_batch = generateEventBatch(0U, 10U);
+  event_buffer->save(event_batch);
+  EXPECT_EQ(pressure_state->load(), EventBufferPressure::High);
+
+  // The active consumer keeps reading, while the idle one never comes back
+  std::this_thread::sleep_for(std::chrono::milliseconds(600));
+  EXPECT_EQ(event_buffer->read(generateReadRequest("active")).size(), 10U);
+
+  // The idle consumer still holds back the rows it has not read
+  EXPECT_EQ(event_buffer->statistics().unread_row_count, 10U);
+  EXPECT_EQ(pressure_state->load(), EventBufferPressure::High);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(600));
+  EXPECT_TRUE(event_buffer->read(generateReadRequest("active")).empty());
+
+  // Once forgotten, it no longer counts towards the pressure
+  EXPECT_EQ(event_buffer->statistics().unread_row_count, 0U);
+  EXPECT_EQ(pressure_state->load(), EventBufferPressure::Low);
+
+  // If it comes back, it starts again from the oldest row
+  EXPECT_EQ(event_buffer->read(generateReadRequest("idle")).size(), 10U);
+}
+
+TEST(SharedLogEventBufferTests, GenerateTableRows) {
+  const std::string kBufferName = "shared_log_table_test";
+
+  EventBufferSettings settings;
+  settings.engine = EventBufferEngine::SharedLog;
+
+  auto& event_buffer_library = EventBufferLibrary::instance();
+
+  auto status = event_buffer_library.configureBuffer(kBufferName, settings);
+  ASSERT_TRUE(status.ok());
+
+  auto event_batch = generateEventBatch(0U, 10U);
+  event_buffer_library.saveEvents(event_batch, kBufferName);
+
+  osquery::QueryContext context;
+  context.constraints[kConsumerColumnName].add(
+      osquery::Constraint(osquery::EQUALS, "pack"));
+
+  auto rows = generateTableRows(kBufferName, context, kTestSchema);
+  EXPECT_EQ(rows.size(), 10U);
+
+  rows = generateTableRows(kBufferName, context, kTestSchema);
+  EXPECT_TRUE(rows.empty());
+
+  context.constraints[kSequenceColumnName].add(
+      osquery::Constraint(osquery::GREATER_THAN, "6"));
+
+  rows = generateTableRows(kBufferName, context, kTestSchema);
+  ASSERT_EQ(rows.size(), 3U);
+  EXPECT_EQ(getColumnValue(rows.front(), "value"), 7U);
+
+  // Other consumers are not affected
+  context = osquery::QueryContext();
+  context.constraints[kConsumerColumnName].add(
+      osquery::Constraint(osquery::EQUALS, "distributed"));
+
+  context.constraints["value"].add(
+      osquery::Constraint(osquery::LESS_THAN, "5"));
+
+  rows = generateTableRows(kBufferName, context, kTestSchema);
+  EXPECT_EQ(rows.size(), 5U);
+}
+} // namespace trailofbits
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <pubsub/threadsettings.h>
+
+#include <array>
+
+#include <sched.h>
+
+#include <gtest/gtest.h>
+
+namespace trailofbits {
+TEST(ThreadSettingsTests, CpuList) {
+  std::vector<unsigned int> cpu_list;
+
+  auto status = ThreadSettings::parseCpuList(cpu_list, "0,2-4,7");
+  ASSERT_TRUE(status.ok());
+  EXPECT_EQ(cpu_list, std::vector<unsigned int>({0U, 2U, 3U, 4U, 7U}));
+
+  for (const auto& invalid_value : {"", "1,", "4-2", "a", "1-", "-1"}) {
+    status = ThreadSettings::parseCpuList(cpu_list, invalid_value);
+    EXPECT_FALSE(status.ok()) << invalid_value;
+    EXPECT_TRUE(cpu_list.empty());
+  }
+}
+
+TEST(ThreadSettingsTests, Parse) {
+  std::string error;
+  auto configuration = json11::Json::parse(R"({
+    "pcap_reader": {
+      "name": "dns_capture",
+      "cpus": "2-3",
+      "numa_node": 0,
+      "policy": "fifo",
+      "priority": 10
+    },
+
+    "dns_events_publisher": {
+      "cpus": [1, 5],
+      "nice": -5
+    }
+  })",
+                                           error);
+
+  ASSERT_TRUE(error.empty());
+
+  ThreadSettingsMap settings_map;
+  auto status = parseThreadSettingsMap(settings_map, configuration);
+  ASSERT_TRUE(status.ok()) << status.getMessage();
+  ASSERT_EQ(settings_map.size(), 2U);
+
+  auto settings = getThreadSettings(settings_map, "pcap_reader");
+  EXPECT_EQ(settings.name, "dns_capture");
+  EXPECT_EQ(settings.cpu_list, std::vector<unsigned int>({2U, 3U}));
+  EXPECT_EQ(settings.numa_node, 0);
+  EXPECT_EQ(settings.policy, ThreadSchedulingPolicy::Fifo);
+  EXPECT_EQ(settings.priority, 10);
+  EXPECT_FALSE(settings.set_nice);
+
+  settings = getThreadSettings(settings_map, "dns_events_publisher");
+  EXPECT_EQ(settings.name, "dns_events_publisher");
+  EXPECT_EQ(settings.cpu_list, std::vector<unsigned int>({1U, 5U}));
+  EXPECT_EQ(settings.numa_node, -1);
+  EXPECT_EQ(settings.policy, ThreadSchedulingPolicy::Inherit);
+  EXPECT_TRUE(settings.set_nice);
+  EXPECT_EQ(settings.nice, -5);
+
+  // Threads without settings are only renamed
+  settings = getThreadSettings(settings_map, "pubsub_worker");
+  EXPECT_EQ(settings.name, "pubsub_worker");
+  EXPECT_TRUE(settings.cpu_list.empty());
+  EXPECT_EQ(settings.policy, ThreadSchedulingPolicy::Inherit);
+
+  const std::array<const char*, 10U> invalid_configurations = {
+      R"({"policy": "fast"})",
+      R"({"policy": "fifo"})",
+      R"({"policy": "other", "priority": 10})",
+      R"({"policy": "rr", "priority": 10, "nice": 0})",
+      R"({"nice": 20})",
+      R"({"cpus": 3})",
+      R"({"cpus": [1.5]})",
+      R"({"cpus": [1024]})",
+      R"({"cpus": [1e30]})",
+      R"({"cpus": "99999999999999999999"})"};
+
+  for (const auto& invalid_configuration : invalid_configurations) {
+    ThreadSettings invalid_settings;
+    status = ThreadSettings::parse(
+        invalid_settings, json11::Json::parse(invalid_configuration, error));
+
+    EXPECT_FALSE(status.ok()) << invalid_configuration;
+  }
+}
+
+TEST(ThreadSettingsTests, StartThread) {
+  cpu_set_t initial_cpu_set;
+  ASSERT_EQ(sched_getaffinity(0, sizeof(initial_cpu_set), &initial_cpu_set),
+            0);
+
+  // Pin the new thread to the first CPU we are allowed to use
+  ThreadSettings settings;
+  settings.name = "a_long_thread_name";
+
+  for (unsigned int cpu = 0U; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &initial_cpu_set)) {
+      settings.cpu_list.push_back(cpu);
+      break;
+    }
+  }
+
+  ASSERT_EQ(settings.cpu_list.size(), 1U);
+
+  std::array<char, 16U> thread_name{};
+  cpu_set_t thread_cpu_set;
+  CPU_ZERO(&thread_cpu_set);
+
+  auto L_threadRoutine = [&thread_name, &thread_cpu_set]() -> void {
+    pthread_getname_np(pthread_self(), thread_name.data(), thread_name.size());
+    sched_getaffinity(0, sizeof(thread_cpu_set), &thread_cpu_set);
+  };
+
+  pid_t thread_id{0};
+  auto thread = startThread(settings, L_threadRoutine, &thread_id);
+  thread.join();
+
+  EXPECT_NE(thread_id, 0);
+  EXPECT_NE(thread_id, currentThreadId());
+
+  // Names are truncated to 15 characters
+  EXPECT_EQ(std::string(thread_name.data()), "a_long_thread_n");
+
+  EXPECT_EQ(CPU_COUNT(&thread_cpu_set), 1);
+  EXPECT_TRUE(CPU_ISSET(settings.cpu_list.front(), &thread_cpu_set));
+
+  // The calling thread is not affected
+  cpu_set_t current_cpu_set;
+  ASSERT_EQ(sched_getaffinity(0, sizeof(current_cpu_set), &current_cpu_set),
+            0);
+
+  EXPECT_TRUE(CPU_EQUAL(&current_cpu_set, &initial_cpu_set));
+}
+} // namespace trailofbits
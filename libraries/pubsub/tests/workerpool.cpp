@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pubsub/workerpool.h>
+
+#include <atomic>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace trailofbits {
+TEST(WorkerPoolTests, TaskExecution) {
+  std::atomic<std::size_t> executed_task_count{0U};
+
+  {
+    WorkerPoolRef worker_pool;
+    auto status = WorkerPool::create(worker_pool, 4U);
+    ASSERT_TRUE(status.ok());
+    EXPECT_EQ(worker_pool->workerCount(), 4U);
+    EXPECT_FALSE(worker_pool->isWorkerThread());
+
+    auto L_childTask = [&executed_task_count]() -> void {
+      ++executed_task_count;
+    };
+
+    // Tasks submitted from a worker are pushed to its own queue, and can be
+    // stolen by the idle workers
+    auto worker_pool_ptr = worker_pool.get();
+
+    auto L_parentTask = [&executed_task_count, worker_pool_ptr, L_childTask]()
+        -> void {
+      EXPECT_TRUE(worker_pool_ptr->isWorkerThread());
+
+      for (auto i = 0U; i < 16U; ++i) {
+        EXPECT_TRUE(worker_pool_ptr->submit(L_childTask).ok());
+      }
+
+      ++executed_task_count;
+    };
+
+    for (auto i = 0U; i < 64U; ++i) {
+      status = worker_pool->submit(L_parentTask);
+      ASSERT_TRUE(status.ok());
+    }
+
+    // The destructor waits for all the pending tasks
+  }
+
+  EXPECT_EQ(executed_task_count, 64U * 17U);
+}
+
+TEST(WorkerPoolTests, ParallelFor) {
+  WorkerPoolRef worker_pool;
+  auto status = WorkerPool::create(worker_pool, 4U);
+  ASSERT_TRUE(status.ok());
+
+  std::vector<std::size_t> call_count_list(32U, 0U);
+  std::atomic<std::size_t> caller_call_count{0U};
+
+  auto L_function = [&](std::size_t index) -> void {
+    ++call_count_list.at(index);
+
+    if (!worker_pool->isWorkerThread()) {
+      ++caller_call_count;
+    }
+  };
+
+  // Each index is owned by a single call, so the list is only read once
+  // parallelFor() has returned
+  worker_pool->parallelFor(call_count_list.size(), L_function);
+
+  for (auto call_count : call_count_list) {
+    EXPECT_EQ(call_count, 1U);
+  }
+
+  EXPECT_GE(caller_call_count, 1U);
+
+  worker_pool->parallelFor(0U, L_function);
+  EXPECT_EQ(call_count_list.front(), 1U);
+}
+} // namespace trailofbits
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "allocationcounter.h"
+#include "dnsdecoder.h"
+#include "dnspackets.h"
+
+#include <algorithm>
+#include <array>
+
+#include <benchmark/benchmark.h>
+
+namespace trailofbits {
+namespace {
+/// How many packets are decoded on each iteration
+const std::size_t kPacketsPerBatch{256U};
+
+/// The decoders used in the sweep, indexed by the first argument
+const std::array<DnsDecoderType, 2U> kDecoderTypeList = {
+    DnsDecoderType::Builtin, DnsDecoderType::PcapPlusPlus};
+} // namespace
+
+/// Decodes a batch of captured DNS responses into an arena, the way the
+/// DNS events publisher does for each UDP batch.
+///
+/// Arguments: decoder
+static void BM_DnsDecoder(benchmark::State& state) {
+  auto decoder_type =
+      kDecoderTypeList.at(static_cast<std::size_t>(state.range(0)));
+
+  auto packet_list = syntheticDnsPackets(kPacketsPerBatch);
+
+  EventArena arena;
+  std::size_t decoded_packet_count{0U};
+  std::size_t decoded_byte_count{0U};
+
+  auto initial_allocation_count = allocationCount();
+
+  for (auto _ : state) {
+    {
+      DnsEventList event_list{ArenaAllocator<DnsEvent>(arena)};
+      event_list.reserve(packet_list.size());
+
+      for (const auto& packet : packet_list) {
+        event_list.emplace_back(arena);
+
+        if (!decodeDnsPacket(decoder_type,
+                             arena,
+                             event_list.back(),
+                             packet.data(),
+                             packet.size(),
+                             pcpp::LINKTYPE_ETHERNET)) {
+          state.SkipWithError("Failed to decode a synthetic packet");
+          return;
+        }
+
+        decoded_byte_count += packet.size();
+      }
+
+      decoded_packet_count += event_list.size();
+      benchmark::DoNotOptimize(event_list.data());
+    }
+
+    arena.reset();
+  }
+
+  auto allocation_count = allocationCount() - initial_allocation_count;
+
+  state.SetItemsProcessed(static_cast<std::int64_t>(decoded_packet_count));
+  state.SetBytesProcessed(static_cast<std::int64_t>(decoded_byte_count));
+
+  state.counters["allocs_per_packet"] =
+      static_cast<double>(allocation_count) /
+      static_cast<double>(std::max(decoded_packet_count, std::size_t{1U}));
+}
+
+BENCHMARK(BM_DnsDecoder)
+    ->ArgName("decoder")
+    ->DenseRange(0, static_cast<int>(kDecoderTypeList.size()) - 1)
+    ->Unit(benchmark::kMicrosecond);
+} // namespace trailofbits
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dnspackets.h"
+
+#include <algorithm>
+#include <array>
+#include <random>
+
+namespace trailofbits {
+void appendUInt16(ByteVector& buffer, std::uint16_t value) {
+  buffer.push_back(static_cast<std::uint8_t>(value >> 8U));
+  buffer.push_back(static_cast<std::uint8_t>(value & 0xFFU));
+}
+
+void appendDnsName(ByteVector& buffer, const std::string& name) {
+  std::size_t label_start{0U};
+
+  while (label_start < name.size()) {
+    auto label_end = std::min(name.find('.', label_start), name.size());
+
+    buffer.push_back(static_cast<std::uint8_t>(label_end - label_start));
+    buffer.insert(buffer.end(),
+                  name.begin() + static_cast<std::ptrdiff_t>(label_start),
+                  name.begin() + static_cast<std::ptrdiff_t>(label_end));
+
+    label_start = label_end + 1U;
+  }
+
+  buffer.push_back(0U);
+}
+
+ByteVector createDnsResponsePacket(std::uint16_t id, const std::string& name) {
+  ByteVector message;
+  appendUInt16(message, id);
+  appendUInt16(message, 0x8180U);
+  appendUInt16(message, 1U);
+  appendUInt16(message, 2U);
+  appendUInt16(message, 0U);
+  appendUInt16(message, 0U);
+
+  appendDnsName(message, name);
+  appendUInt16(message, 1U);
+  appendUInt16(message, 1U);
+
+  // CNAME answer, pointing to "cdn." followed by the question name
+  message.insert(message.end(), {0xC0U, 0x0CU});
+  appendUInt16(message, 5U);
+  appendUInt16(message, 1U);
+  appendUInt16(message, 0U);
+  appendUInt16(message, 300U);
+  appendUInt16(message, 6U);
+  message.insert(message.end(), {3U, 'c', 'd', 'n', 0xC0U, 0x0CU});
+
+  // A answer for the question name
+  message.insert(message.end(), {0xC0U, 0x0CU});
+  appendUInt16(message, 1U);
+  appendUInt16(message, 1U);
+  appendUInt16(message, 0U);
+  appendUInt16(message, 300U);
+  appendUInt16(message, 4U);
+  message.insert(message.end(),
+                 {192U, 0U, 2U, static_cast<std::uint8_t>(id & 0xFFU)});
+
+  ByteVector packet(12U, 0U);
+  appendUInt16(packet, 0x0800U);
+
+  auto udp_size = static_cast<std::uint16_t>(8U + message.size());
+  auto ip_size = static_cast<std::uint16_t>(20U + udp_size);
+
+  packet.insert(packet.end(), {0x45U, 0U});
+  appendUInt16(packet, ip_size);
+  packet.insert(packet.end(), {0U, 0U, 0U, 0U, 64U, 17U, 0U, 0U});
+  packet.insert(packet.end(), {192U, 0U, 2U, 53U, 10U, 0U, 0U, 1U});
+
+  appendUInt16(packet, 53U);
+  appendUInt16(packet, static_cast<std::uint16_t>(32768U + (id % 1024U)));
+  appendUInt16(packet, udp_size);
+  appendUInt16(packet, 0U);
+
+  packet.insert(packet.end(), message.begin(), message.end());
+  return packet;
+}
+
+std::vector<ByteVector> syntheticDnsPackets(std::size_t packet_count) {
+  const std::array<const char*, 4U> label_list = {"www", "mail", "api", "cdn"};
+
+  const std::array<const char*, 4U> domain_list = {
+      "example.com", "example.org", "test.net", "localdomain"};
+
+  std::mt19937 generator(0x646e7331U);
+  std::uniform_int_distribution<std::size_t> index_distribution(0U, 3U);
+
+  std::vector<ByteVector> packet_list;
+  for (std::size_t i = 0U; i < packet_count; ++i) {
+    auto name = std::string(label_list.at(index_distribution(generator))) +
+                "." + domain_list.at(index_distribution(generator));
+
+    packet_list.push_back(
+        createDnsResponsePacket(static_cast<std::uint16_t>(i), name));
+  }
+
+  return packet_list;
+}
+} // namespace trailofbits
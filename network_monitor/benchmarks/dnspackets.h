@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace trailofbits {
+/// A byte buffer
+using ByteVector = std::vector<std::uint8_t>;
+
+/// Appends a 16-bit value in network byte order
+void appendUInt16(ByteVector& buffer, std::uint16_t value);
+
+/// Appends a domain name, without compression
+void appendDnsName(ByteVector& buffer, const std::string& name);
+
+/// Builds an Ethernet/IPv4/UDP DNS response, with one question, a CNAME
+/// answer and an A answer; both answers use name compression
+ByteVector createDnsResponsePacket(std::uint16_t id, const std::string& name);
+
+/// Returns the given amount of DNS responses for random names; the generator
+/// is seeded with a constant, so that every run decodes the same data
+std::vector<ByteVector> syntheticDnsPackets(std::size_t packet_count);
+} // namespace trailofbits
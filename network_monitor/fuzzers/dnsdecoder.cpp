@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dnsdecoder.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace {
+/// The link types tried by the fuzzer, selected by the first input byte
+const std::array<pcpp::LinkLayerType, 5U> kLinkTypeList = {
+    pcpp::LINKTYPE_ETHERNET,
+    pcpp::LINKTYPE_LINUX_SLL,
+    pcpp::LINKTYPE_RAW,
+    pcpp::LINKTYPE_IPV4,
+    pcpp::LINKTYPE_IPV6};
+} // namespace
+
+/// Feeds the input to the builtin decoder, both as a captured packet and as
+/// a bare DNS message (as found in TCP streams)
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data,
+                                      std::size_t size) {
+  using namespace trailofbits;
+
+  if (size == 0U) {
+    return 0;
+  }
+
+  auto link_type = kLinkTypeList.at(data[0] % kLinkTypeList.size());
+
+  EventArena arena;
+
+  {
+    DnsEvent dns_event(arena);
+    decodeDnsPacket(DnsDecoderType::Builtin,
+                    arena,
+                    dns_event,
+                    data + 1U,
+                    size - 1U,
+                    link_type);
+  }
+
+  {
+    DnsEvent dns_event(arena);
+    decodeDnsMessage(DnsDecoderType::Builtin,
+                     arena,
+                     dns_event,
+                     data + 1U,
+                     size - 1U,
+                     pcpp::TCP);
+  }
+
+  return 0;
+}
@@ -0,0 +1,788 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dnsdecoder.h"
+
+#include <osquery/logger.h>
+
+#include <IPv4Layer.h>
+#include <IPv6Layer.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <arpa/inet.h>
+
+namespace trailofbits {
+namespace {
+/// Size of the ethernet header, without VLAN tags
+const std::size_t kEthernetHeaderSize = 14U;
+
+/// Size of a VLAN tag
+const std::size_t kVlanTagSize = 4U;
+
+/// Size of the Linux cooked capture header (DLT_LINUX_SLL), used when
+/// capturing on the "any" interface; the protocol type is at its end
+const std::size_t kLinuxSllHeaderSize = 16U;
+
+/// Ether types
+const std::uint16_t kEtherTypeIPv4 = 0x0800U;
+const std::uint16_t kEtherTypeIPv6 = 0x86DDU;
+const std::uint16_t kEtherTypeVlan = 0x8100U;
+const std::uint16_t kEtherTypeQinQ = 0x88A8U;
+
+/// Minimum size of the IPv4 header
+const std::size_t kIPv4HeaderSize = 20U;
+
+/// Size of the fixed IPv6 header
+const std::size_t kIPv6HeaderSize = 40U;
+
+/// IP protocol numbers
+const std::uint8_t kIPProtocolTcp = 6U;
+const std::uint8_t kIPProtocolUdp = 17U;
+const std::uint8_t kIPv6HopByHopOptions = 0U;
+const std::uint8_t kIPv6Routing = 43U;
+const std::uint8_t kIPv6Fragment = 44U;
+const std::uint8_t kIPv6DestinationOptions = 60U;
+
+/// How many IPv6 extension headers are skipped, at most
+const std::size_t kMaxIPv6ExtensionHeaders = 8U;
+
+/// Size of the UDP header
+const std::size_t kUdpHeaderSize = 8U;
+
+/// Size of the DNS header
+const std::size_t kDnsHeaderSize = 12U;
+
+/// Size of the fixed part of a question, after the name
+const std::size_t kDnsQuestionSize = 4U;
+
+/// Size of the fixed part of a resource record, after the name
+const std::size_t kDnsResourceSize = 10U;
+
+/// Max length of a domain name, in text form
+const std::size_t kMaxDnsNameLength = 255U;
+
+/// How many compression pointers can be followed while decoding a name
+const std::size_t kMaxDnsCompressionPointers = 64U;
+
+/// Record types whose data is formatted
+const std::uint16_t kDnsTypeA = 1U;
+const std::uint16_t kDnsTypeNS = 2U;
+const std::uint16_t kDnsTypeCNAME = 5U;
+const std::uint16_t kDnsTypePTR = 12U;
+const std::uint16_t kDnsTypeMX = 15U;
+const std::uint16_t kDnsTypeAAAA = 28U;
+const std::uint16_t kDnsTypeDNAME = 39U;
+
+/// A buffer large enough to hold a decoded domain name
+using DnsNameBuffer = char[kMaxDnsNameLength + 1U];
+
+/// Reads a big endian 16-bit value; bounds are checked by the caller
+std::uint16_t readUInt16(const std::uint8_t* ptr) {
+  return static_cast<std::uint16_t>((ptr[0] << 8U) | ptr[1]);
+}
+
+/// Reads a big endian 32-bit value; bounds are checked by the caller
+std::uint32_t readUInt32(const std::uint8_t* ptr) {
+  return (static_cast<std::uint32_t>(ptr[0]) << 24U) |
+         (static_cast<std::uint32_t>(ptr[1]) << 16U) |
+         (static_cast<std::uint32_t>(ptr[2]) << 8U) |
+         static_cast<std::uint32_t>(ptr[3]);
+}
+
+/// Returns true if the given port is used by DNS (including mDNS and
+/// LLMNR), like Pcap++ does
+bool isDnsPort(std::uint16_t port) {
+  return port == 53U || port == 5353U || port == 5355U;
+}
+
+/// Copies the given string into an arena string
+void setArenaString(ArenaString& destination, const std::string& source) {
+  destination.assign(source.data(), source.size());
+}
+
+/// Formats the given address into an arena string; IPv4 addresses are
+/// formatted directly, since inet_ntop goes through sprintf
+bool setArenaAddress(ArenaString& destination,
+                     int address_family,
+                     const std::uint8_t* address) {
+  char buffer[INET6_ADDRSTRLEN] = {};
+
+  if (address_family == AF_INET) {
+    std::size_t length = 0U;
+
+    for (std::size_t i = 0U; i < 4U; ++i) {
+      auto octet = address[i];
+      if (octet >= 100U) {
+        buffer[length++] = static_cast<char>('0' + octet / 100U);
+      }
+
+      if (octet >= 10U) {
+        buffer[length++] = static_cast<char>('0' + (octet / 10U) % 10U);
+      }
+
+      buffer[length++] = static_cast<char>('0' + octet % 10U);
+      if (i != 3U) {
+        buffer[length++] = '.';
+      }
+    }
+
+    destination.assign(buffer, length);
+    return true;
+  }
+
+  if (inet_ntop(address_family, address, buffer, sizeof(buffer)) == nullptr) {
+    return false;
+  }
+
+  destination.assign(buffer);
+  return true;
+}
+
+/// Decodes the domain name found at `offset`, following the compression
+/// pointers; `offset` is then moved past the name. Pointers may only point
+/// backwards, and their amount is limited, so that loops are rejected
+bool decodeDnsName(DnsNameBuffer& name,
+                   std::size_t& name_length,
+                   const std::uint8_t* message_data,
+                   std::size_t message_size,
+                   std::size_t& offset) {
+  name_length = 0U;
+
+  auto position = offset;
+  bool pointer_followed = false;
+  std::size_t pointer_count = 0U;
+
+  for (;;) {
+    if (position >= message_size) {
+      return false;
+    }
+
+    auto label_length = static_cast<std::size_t>(message_data[position]);
+
+    if ((label_length & 0xC0U) == 0xC0U) {
+      if (position + 1U >= message_size) {
+        return false;
+      }
+
+      auto target =
+          ((label_length & 0x3FU) << 8U) | message_data[position + 1U];
+      if (target >= position || ++pointer_count > kMaxDnsCompressionPointers) {
+        return false;
+      }
+
+      if (!pointer_followed) {
+        offset = position + 2U;
+        pointer_followed = true;
+      }
+
+      position = target;
+      continue;
+    }
+
+    // The extended label types have never been deployed
+    if ((label_length & 0xC0U) != 0U) {
+      return false;
+    }
+
+    if (label_length == 0U) {
+      if (!pointer_followed) {
+        offset = position + 1U;
+      }
+
+      name[name_length] = '\0';
+      return true;
+    }
+
+    if (position + 1U + label_length > message_size) {
+      return false;
+    }
+
+    auto separator_length = (name_length != 0U) ? 1U : 0U;
+    if (name_length + separator_length + label_length > kMaxDnsNameLength) {
+      return false;
+    }
+
+    if (separator_length != 0U) {
+      name[name_length++] = '.';
+    }
+
+    std::memcpy(name + name_length, message_data + position + 1U, label_length);
+    name_length += label_length;
+
+    position += 1U + label_length;
+  }
+}
+
+/// Formats the record data like Pcap++ does: addresses and names are
+/// converted to text, while unknown records are dumped in hex. Names may
+/// point anywhere in the message, but their own labels must fit inside the
+/// record data
+bool formatDnsRecordData(ArenaString& record_data,
+                         std::uint16_t record_type,
+                         const std::uint8_t* message_data,
+                         std::size_t message_size,
+                         std::size_t data_offset,
+                         std::size_t data_size) {
+  const auto data = message_data + data_offset;
+
+  if (record_type == kDnsTypeA && data_size == 4U) {
+    return setArenaAddress(record_data, AF_INET, data);
+
+  } else if (record_type == kDnsTypeAAAA && data_size == 16U) {
+    return setArenaAddress(record_data, AF_INET6, data);
+
+  } else if (record_type == kDnsTypeNS || record_type == kDnsTypeCNAME ||
+             record_type == kDnsTypePTR || record_type == kDnsTypeDNAME) {
+    // Names can be compressed using any part of the message
+    DnsNameBuffer name;
+    std::size_t name_length = 0U;
+
+    auto name_offset = data_offset;
+    if (!decodeDnsName(
+            name, name_length, message_data, message_size, name_offset) ||
+        name_offset > data_offset + data_size) {
+      return false;
+    }
+
+    record_data.assign(name, name_length);
+    return true;
+
+  } else if (record_type == kDnsTypeMX && data_size > 2U) {
+    DnsNameBuffer name;
+    std::size_t name_length = 0U;
+
+    auto name_offset = data_offset + 2U;
+    if (!decodeDnsName(
+            name, name_length, message_data, message_size, name_offset) ||
+        name_offset > data_offset + data_size) {
+      return false;
+    }
+
+    char buffer[sizeof("pref: 65535; mx: ") + kMaxDnsNameLength];
+    auto length = std::snprintf(buffer,
+                                sizeof(buffer),
+                                "pref: %u; mx: %s",
+                                static_cast<unsigned int>(readUInt16(data)),
+                                name);
+
+    if (length < 0) {
+      return false;
+    }
+
+    record_data.assign(buffer, static_cast<std::size_t>(length));
+    return true;
+  }
+
+  static const char kHexDigits[] = "0123456789abcdef";
+
+  record_data.resize(data_size * 2U);
+  for (std::size_t i = 0U; i < data_size; ++i) {
+    record_data[i * 2U] = kHexDigits[data[i] >> 4U];
+    record_data[i * 2U + 1U] = kHexDigits[data[i] & 0x0FU];
+  }
+
+  return true;
+}
+
+/// Decodes a DNS message without going through Pcap++. Like the DnsLayer,
+/// decoding stops at the first malformed record, and the records decoded
+/// so far are kept
+bool decodeBuiltinDnsMessage(EventArena& arena,
+                             DnsEvent& dns_event,
+                             const std::uint8_t* message_data,
+                             std::size_t message_size,
+                             pcpp::ProtocolType protocol) {
+  if (message_size < kDnsHeaderSize) {
+    return false;
+  }
+
+  // The transaction id is kept in network byte order, matching what the
+  // Pcap++ decoder has always reported
+  std::memcpy(&dns_event.id, message_data, sizeof(dns_event.id));
+
+  auto flags = readUInt16(message_data + 2U);
+  auto question_count = readUInt16(message_data + 4U);
+  auto answer_count = readUInt16(message_data + 6U);
+
+  bool response = (flags & 0x8000U) != 0U;
+
+  dns_event.protocol = protocol;
+  dns_event.truncated = (flags & 0x0200U) != 0U;
+  dns_event.type = response ? DnsEvent::Type::Response : DnsEvent::Type::Query;
+
+  // Each record takes at least one byte for the name, so corrupted counters
+  // can't cause large reservations
+  auto max_record_count = (message_size - kDnsHeaderSize) / 5U;
+
+  DnsNameBuffer name;
+  std::size_t name_length = 0U;
+  auto offset = kDnsHeaderSize;
+
+  dns_event.question.reserve(
+      std::min<std::size_t>(question_count, max_record_count));
+
+  for (std::size_t i = 0U; i < question_count; ++i) {
+    if (!decodeDnsName(name, name_length, message_data, message_size, offset) ||
+        offset + kDnsQuestionSize > message_size) {
+      return true;
+    }
+
+    DnsEvent::Question question(arena);
+    question.record_name.assign(name, name_length);
+    question.record_type =
+        static_cast<pcpp::DnsType>(readUInt16(message_data + offset));
+    question.record_class =
+        static_cast<pcpp::DnsClass>(readUInt16(message_data + offset + 2U));
+
+    dns_event.question.push_back(std::move(question));
+    offset += kDnsQuestionSize;
+  }
+
+  if (!response) {
+    return true;
+  }
+
+  dns_event.answer.reserve(
+      std::min<std::size_t>(answer_count, max_record_count));
+
+  for (std::size_t i = 0U; i < answer_count; ++i) {
+    if (!decodeDnsName(name, name_length, message_data, message_size, offset) ||
+        offset + kDnsResourceSize > message_size) {
+      return true;
+    }
+
+    const auto record = message_data + offset;
+    auto record_type = readUInt16(record);
+    auto data_size = static_cast<std::size_t>(readUInt16(record + 8U));
+
+    auto data_offset = offset + kDnsResourceSize;
+    if (data_offset + data_size > message_size) {
+      return true;
+    }
+
+    DnsEvent::Answer answer(arena);
+    if (!formatDnsRecordData(answer.record_data,
+                             record_type,
+                             message_data,
+                             message_size,
+                             data_offset,
+                             data_size)) {
+      return true;
+    }
+
+    answer.record_name.assign(name, name_length);
+    answer.record_type = static_cast<pcpp::DnsType>(record_type);
+    answer.record_class = static_cast<pcpp::DnsClass>(readUInt16(record + 2U));
+    answer.ttl = readUInt32(record + 4U);
+
+    dns_event.answer.push_back(std::move(answer));
+    offset = data_offset + data_size;
+  }
+
+  return true;
+}
+
+/// Returns the transport protocol matching the given IP protocol number
+pcpp::ProtocolType getTransportProtocol(std::uint8_t ip_protocol) {
+  if (ip_protocol == kIPProtocolUdp) {
+    return pcpp::UDP;
+  } else if (ip_protocol == kIPProtocolTcp) {
+    return pcpp::TCP;
+  } else {
+    return pcpp::UnknownProtocol;
+  }
+}
+
+/// Locates the transport header inside an IPv4 packet
+bool locateIPv4TransportLayer(TransportLayerInfo& transport_layer,
+                              const std::uint8_t* header,
+                              std::size_t packet_size) {
+  if (packet_size < kIPv4HeaderSize || (header[0] >> 4U) != 4U) {
+    return false;
+  }
+
+  auto header_size = static_cast<std::size_t>(header[0] & 0x0FU) * 4U;
+  if (header_size < kIPv4HeaderSize || header_size > packet_size) {
+    return false;
+  }
+
+  // Only the first fragment contains the transport header
+  auto protocol = getTransportProtocol(header[9]);
+  if ((readUInt16(header + 6U) & 0x1FFFU) != 0U ||
+      protocol == pcpp::UnknownProtocol) {
+    return false;
+  }
+
+  // Ignore the ethernet padding
+  auto total_length = static_cast<std::size_t>(readUInt16(header + 2U));
+  if (total_length >= header_size && total_length < packet_size) {
+    packet_size = total_length;
+  }
+
+  transport_layer.protocol = protocol;
+  transport_layer.address_family = AF_INET;
+  transport_layer.source_address = header + 12U;
+  transport_layer.destination_address = header + 16U;
+  transport_layer.header = header + header_size;
+  transport_layer.size = packet_size - header_size;
+
+  return true;
+}
+
+/// Locates the transport header inside an IPv6 packet, skipping the
+/// extension headers
+bool locateIPv6TransportLayer(TransportLayerInfo& transport_layer,
+                              const std::uint8_t* header,
+                              std::size_t packet_size) {
+  if (packet_size < kIPv6HeaderSize || (header[0] >> 4U) != 6U) {
+    return false;
+  }
+
+  // A payload length of zero is used by jumbograms
+  auto ip_packet_size =
+      kIPv6HeaderSize + static_cast<std::size_t>(readUInt16(header + 4U));
+  if (ip_packet_size > kIPv6HeaderSize && ip_packet_size < packet_size) {
+    packet_size = ip_packet_size;
+  }
+
+  auto next_header = header[6];
+  auto offset = kIPv6HeaderSize;
+
+  for (std::size_t i = 0U;
+       getTransportProtocol(next_header) == pcpp::UnknownProtocol;
+       ++i) {
+    if (i == kMaxIPv6ExtensionHeaders || offset + 8U > packet_size) {
+      return false;
+    }
+
+    const auto extension_header = header + offset;
+
+    if (next_header == kIPv6Fragment) {
+      if ((readUInt16(extension_header + 2U) >> 3U) != 0U) {
+        return false;
+      }
+
+      offset += 8U;
+
+    } else if (next_header == kIPv6HopByHopOptions ||
+               next_header == kIPv6Routing ||
+               next_header == kIPv6DestinationOptions) {
+      offset += (static_cast<std::size_t>(extension_header[1]) + 1U) * 8U;
+
+    } else {
+      return false;
+    }
+
+    next_header = extension_header[0];
+  }
+
+  if (offset > packet_size) {
+    return false;
+  }
+
+  transport_layer.protocol = getTransportProtocol(next_header);
+  transport_layer.address_family = AF_INET6;
+  transport_layer.source_address = header + 8U;
+  transport_layer.destination_address = header + 24U;
+  transport_layer.header = header + offset;
+  transport_layer.size = packet_size - offset;
+
+  return true;
+}
+
+/// Decodes a captured UDP packet without going through Pcap++
+bool decodeBuiltinDnsPacket(EventArena& arena,
+                            DnsEvent& dns_event,
+                            const std::uint8_t* packet_data,
+                            std::size_t packet_size,
+                            pcpp::LinkLayerType link_type) {
+  TransportLayerInfo transport_layer;
+  if (!locateTransportLayer(
+          transport_layer, packet_data, packet_size, link_type) ||
+      transport_layer.protocol != pcpp::UDP) {
+    return false;
+  }
+
+  auto payload = transport_layer.header;
+  auto payload_size = transport_layer.size;
+
+  if (payload_size < kUdpHeaderSize) {
+    return false;
+  }
+
+  auto source_port = readUInt16(payload);
+  auto destination_port = readUInt16(payload + 2U);
+  if (!isDnsPort(source_port) && !isDnsPort(destination_port)) {
+    return false;
+  }
+
+  auto udp_length = static_cast<std::size_t>(readUInt16(payload + 4U));
+  if (udp_length >= kUdpHeaderSize && udp_length < payload_size) {
+    payload_size = udp_length;
+  }
+
+  if (!setArenaAddress(dns_event.source_address,
+                       transport_layer.address_family,
+                       transport_layer.source_address) ||
+      !setArenaAddress(dns_event.destination_address,
+                       transport_layer.address_family,
+                       transport_layer.destination_address)) {
+    return false;
+  }
+
+  return decodeBuiltinDnsMessage(arena,
+                                 dns_event,
+                                 payload + kUdpHeaderSize,
+                                 payload_size - kUdpHeaderSize,
+                                 pcpp::UDP);
+}
+
+/// Appends the questions found in the given DnsLayer to the event
+/// We can't use const as the methods we need in DnsLayer are not marked const
+void appendDnsQuestionList(EventArena& arena,
+                           DnsEvent& dns_event,
+                           pcpp::DnsLayer* dns_layer) {
+  for (auto query = dns_layer->getFirstQuery(); query != nullptr;
+       query = dns_layer->getNextQuery(query)) {
+    DnsEvent::Question question(arena);
+
+    question.record_type = query->getDnsType();
+    question.record_class = query->getDnsClass();
+    setArenaString(question.record_name, query->getName());
+
+    dns_event.question.push_back(std::move(question));
+  }
+}
+
+/// Appends the answers found in the given DnsLayer to the event
+/// We can't use const as the methods we need in DnsLayer are not marked const
+void appendDnsAnswerList(EventArena& arena,
+                         DnsEvent& dns_event,
+                         pcpp::DnsLayer* dns_layer) {
+  for (auto raw_answer = dns_layer->getFirstAnswer(); raw_answer != nullptr;
+       raw_answer = dns_layer->getNextAnswer(raw_answer)) {
+    DnsEvent::Answer answer(arena);
+
+    answer.ttl = raw_answer->getTTL();
+    setArenaString(answer.record_data, raw_answer->getData()->toString());
+    answer.record_type = raw_answer->getDnsType();
+    answer.record_class = raw_answer->getDnsClass();
+    setArenaString(answer.record_name, raw_answer->getName());
+
+    dns_event.answer.push_back(std::move(answer));
+  }
+}
+
+/// Fills the event with the contents of the given DNS layer
+/// Notes: we can't use const because the methods we need in pcpp::DnsLayer are
+/// not marked as const
+void generateDnsEvent(EventArena& arena,
+                      DnsEvent& dns_event,
+                      pcpp::ProtocolType protocol,
+                      pcpp::DnsLayer* dns_layer) {
+  const auto& dns_header = *dns_layer->getDnsHeader();
+
+  dns_event.id = dns_header.transactionID;
+  dns_event.protocol = protocol;
+  dns_event.truncated = (dns_header.truncation != 0U);
+  dns_event.type = (dns_header.queryOrResponse == 0) ? DnsEvent::Type::Query
+                                                     : DnsEvent::Type::Response;
+
+  appendDnsQuestionList(arena, dns_event, dns_layer);
+  if (dns_header.queryOrResponse == 0) {
+    return;
+  }
+
+  appendDnsAnswerList(arena, dns_event, dns_layer);
+}
+
+/// Decodes a DNS message through the Pcap++ DnsLayer
+bool decodePcapPlusPlusDnsMessage(EventArena& arena,
+                                  DnsEvent& dns_event,
+                                  const std::uint8_t* message_data,
+                                  std::size_t message_size,
+                                  pcpp::ProtocolType protocol) {
+  if (message_size < sizeof(pcpp::dnshdr)) {
+    return false;
+  }
+
+  // The DnsLayer will always attempt to free the buffer
+  auto* temp_buffer = new std::uint8_t[message_size];
+  std::memcpy(temp_buffer, message_data, message_size);
+
+  pcpp::DnsLayer dns_layer(temp_buffer, message_size, nullptr, nullptr);
+  generateDnsEvent(arena, dns_event, protocol, &dns_layer);
+
+  return true;
+}
+
+/// Decodes a captured UDP packet through Pcap++
+bool decodePcapPlusPlusDnsPacket(EventArena& arena,
+                                 DnsEvent& dns_event,
+                                 const std::uint8_t* packet_data,
+                                 std::size_t packet_size,
+                                 pcpp::LinkLayerType link_type) {
+  pcpp::RawPacket raw_packet(packet_data,
+                             static_cast<int>(packet_size),
+                             timeval{},
+                             false,
+                             link_type);
+
+  pcpp::Packet packet(&raw_packet);
+  auto dns_layer = packet.getLayerOfType<pcpp::DnsLayer>();
+  if (dns_layer == nullptr) {
+    return false;
+  }
+
+  generateDnsEvent(arena, dns_event, pcpp::UDP, dns_layer);
+
+  auto ipv4_layer = packet.getLayerOfType<pcpp::IPv4Layer>();
+  if (ipv4_layer != nullptr) {
+    setArenaString(dns_event.source_address,
+                   ipv4_layer->getSrcIpAddress().toString());
+
+    setArenaString(dns_event.destination_address,
+                   ipv4_layer->getDstIpAddress().toString());
+
+  } else {
+    auto ipv6_layer = packet.getLayerOfType<pcpp::IPv6Layer>();
+    if (ipv6_layer != nullptr) {
+      setArenaString(dns_event.source_address,
+                     ipv6_layer->getSrcIpAddress().toString());
+
+      setArenaString(dns_event.destination_address,
+                     ipv6_layer->getDstIpAddress().toString());
+
+    } else {
+      LOG(ERROR)
+          << "Failed to determine the source and destination IP addresses";
+    }
+  }
+
+  return true;
+}
+} // namespace
+
+bool locateTransportLayer(TransportLayerInfo& transport_layer,
+                          const std::uint8_t* packet_data,
+                          std::size_t packet_size,
+                          pcpp::LinkLayerType link_type) {
+  transport_layer = {};
+
+  auto payload = packet_data;
+  auto payload_size = packet_size;
+
+  std::uint16_t ether_type = 0U;
+
+  switch (link_type) {
+  case pcpp::LINKTYPE_ETHERNET: {
+    if (payload_size < kEthernetHeaderSize) {
+      return false;
+    }
+
+    auto offset = kEthernetHeaderSize - 2U;
+    ether_type = readUInt16(payload + offset);
+
+    while (ether_type == kEtherTypeVlan || ether_type == kEtherTypeQinQ) {
+      offset += kVlanTagSize;
+      if (offset + 2U > payload_size) {
+        return false;
+      }
+
+      ether_type = readUInt16(payload + offset);
+    }
+
+    payload += offset + 2U;
+    payload_size -= offset + 2U;
+    break;
+  }
+
+  case pcpp::LINKTYPE_LINUX_SLL:
+    if (payload_size < kLinuxSllHeaderSize) {
+      return false;
+    }
+
+    ether_type = readUInt16(payload + kLinuxSllHeaderSize - 2U);
+
+    payload += kLinuxSllHeaderSize;
+    payload_size -= kLinuxSllHeaderSize;
+    break;
+
+  case pcpp::LINKTYPE_RAW:
+  case pcpp::LINKTYPE_DLT_RAW1:
+  case pcpp::LINKTYPE_DLT_RAW2:
+    // Raw captures may carry both IP versions
+    if (payload_size == 0U) {
+      return false;
+    }
+
+    ether_type = ((payload[0] >> 4U) == 6U) ? kEtherTypeIPv6 : kEtherTypeIPv4;
+    break;
+
+  case pcpp::LINKTYPE_IPV4:
+    ether_type = kEtherTypeIPv4;
+    break;
+
+  case pcpp::LINKTYPE_IPV6:
+    ether_type = kEtherTypeIPv6;
+    break;
+
+  default:
+    return false;
+  }
+
+  if (ether_type == kEtherTypeIPv4) {
+    return locateIPv4TransportLayer(transport_layer, payload, payload_size);
+  } else if (ether_type == kEtherTypeIPv6) {
+    return locateIPv6TransportLayer(transport_layer, payload, payload_size);
+  } else {
+    return false;
+  }
+}
+
+bool decodeDnsPacket(DnsDecoderType decoder_type,
+                     EventArena& arena,
+                     DnsEvent& dns_event,
+                     const std::uint8_t* packet_data,
+                     std::size_t packet_size,
+                     pcpp::LinkLayerType link_type) {
+  if (decoder_type == DnsDecoderType::Builtin) {
+    return decodeBuiltinDnsPacket(
+        arena, dns_event, packet_data, packet_size, link_type);
+  }
+
+  return decodePcapPlusPlusDnsPacket(
+      arena, dns_event, packet_data, packet_size, link_type);
+}
+
+bool decodeDnsMessage(DnsDecoderType decoder_type,
+                      EventArena& arena,
+                      DnsEvent& dns_event,
+                      const std::uint8_t* message_data,
+                      std::size_t message_size,
+                      pcpp::ProtocolType protocol) {
+  if (decoder_type == DnsDecoderType::Builtin) {
+    return decodeBuiltinDnsMessage(
+        arena, dns_event, message_data, message_size, protocol);
+  }
+
+  return decodePcapPlusPlusDnsMessage(
+      arena, dns_event, message_data, message_size, protocol);
+}
+} // namespace trailofbits
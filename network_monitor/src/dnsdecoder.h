@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "dnsevent.h"
+
+#include <pubsub/eventarena.h>
+
+#include <ProtocolType.h>
+#include <RawPacket.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace trailofbits {
+/// The decoders that can be used to parse DNS packets
+enum class DnsDecoderType {
+  /// Parses the packets in place, without allocating anything outside of
+  /// the event arena
+  Builtin,
+
+  /// Builds a full pcpp::Packet, and reads the DnsLayer
+  PcapPlusPlus
+};
+
+/// The transport layer of a captured packet, as found by
+/// ::locateTransportLayer(); all the pointers reference the packet data
+struct TransportLayerInfo final {
+  /// Either pcpp::UDP or pcpp::TCP
+  pcpp::ProtocolType protocol{pcpp::UnknownProtocol};
+
+  /// AF_INET or AF_INET6, depending on the IP version
+  int address_family{0};
+
+  /// The IP addresses, in network byte order
+  const std::uint8_t* source_address{nullptr};
+  const std::uint8_t* destination_address{nullptr};
+
+  /// The transport header, followed by its payload
+  const std::uint8_t* header{nullptr};
+
+  /// Size of the transport header and payload, excluding the link layer
+  /// padding
+  std::size_t size{0U};
+};
+
+/// Walks the link layer (ethernet with its VLAN tags, Linux cooked capture
+/// or raw IP) and the IPv4/IPv6 headers of a captured packet, without
+/// allocating anything; returns false if the packet is not a UDP or TCP
+/// one. Fragments other than the first one are rejected, as they have no
+/// transport header
+bool locateTransportLayer(TransportLayerInfo& transport_layer,
+                          const std::uint8_t* packet_data,
+                          std::size_t packet_size,
+                          pcpp::LinkLayerType link_type);
+
+/// Decodes a captured UDP packet, starting from the link layer header, into
+/// the given event; returns false if the packet does not contain a DNS
+/// message. The event time is not set
+bool decodeDnsPacket(DnsDecoderType decoder_type,
+                     EventArena& arena,
+                     DnsEvent& dns_event,
+                     const std::uint8_t* packet_data,
+                     std::size_t packet_size,
+                     pcpp::LinkLayerType link_type);
+
+/// Decodes a single DNS message (such as the ones found in TCP streams)
+/// into the given event; returns false if the header is incomplete. The
+/// addresses and the event time are not set
+bool decodeDnsMessage(DnsDecoderType decoder_type,
+                      EventArena& arena,
+                      DnsEvent& dns_event,
+                      const std::uint8_t* message_data,
+                      std::size_t message_size,
+                      pcpp::ProtocolType protocol);
+} // namespace trailofbits
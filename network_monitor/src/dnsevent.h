@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <pubsub/eventarena.h>
+
+#include <DnsLayer.h>
+#include <ProtocolType.h>
+
+#include <cstdint>
+
+#include <sys/time.h>
+
+namespace trailofbits {
+/// A single DNS event; strings and lists are allocated from the arena of
+/// the event context
+struct DnsEvent final {
+  /// Constructor
+  explicit DnsEvent(EventArena& arena)
+      : source_address(ArenaAllocator<char>(arena)),
+        destination_address(ArenaAllocator<char>(arena)),
+        question(ArenaAllocator<Question>(arena)),
+        answer(ArenaAllocator<Answer>(arena)) {}
+
+  /// Event time
+  timeval event_time{};
+
+  /// Source address
+  ArenaString source_address;
+
+  /// Destination address
+  ArenaString destination_address;
+
+  /// Request type, taken from the qr bit of the header
+  enum class Type { Query, Response };
+
+  /// Describes a single question in the DNS request
+  struct Question final {
+    /// Constructor
+    explicit Question(EventArena& arena)
+        : record_name(ArenaAllocator<char>(arena)) {}
+
+    /// Record type (i.e.: A, NS, CNAME, etc...)
+    pcpp::DnsType record_type{};
+
+    /// DNS class (i.e.: IN, CH, etc...)
+    pcpp::DnsClass record_class{};
+
+    /// The domain name
+    ArenaString record_name;
+  };
+
+  /// A list of questions sent to the DNS server
+  using QuestionList = ArenaVector<Question>;
+
+  /// Answer data
+  struct Answer final {
+    /// Constructor
+    explicit Answer(EventArena& arena)
+        : record_data(ArenaAllocator<char>(arena)),
+          record_name(ArenaAllocator<char>(arena)) {}
+
+    /// The time to live for this record
+    std::uint32_t ttl{0U};
+
+    /// The record data
+    ArenaString record_data;
+
+    /// The record type (i.e.: A, NS or CNAME)
+    pcpp::DnsType record_type{};
+
+    /// The class for this record (such as IN, CH or ANY)
+    pcpp::DnsClass record_class{};
+
+    /// The record name
+    ArenaString record_name;
+  };
+
+  /// A list of answers received from the DNS server
+  using AnswerList = ArenaVector<Answer>;
+
+  /// Request type; either a query or a response
+  Type type{Type::Query};
+
+  /// List of questions sent or received (copied from the client request) from
+  /// the DNS server
+  QuestionList question;
+
+  /// List of answers received from the DNS server
+  AnswerList answer;
+
+  /// Request identifier
+  std::uint16_t id{0U};
+
+  /// Protocol type; either UDP or TCP
+  pcpp::ProtocolType protocol{pcpp::UDP};
+
+  /// True if the request was truncated; only valid when the protocol is set to
+  /// UDP
+  bool truncated{false};
+};
+
+/// A list of DNS events
+using DnsEventList = ArenaVector<DnsEvent>;
+} // namespace trailofbits
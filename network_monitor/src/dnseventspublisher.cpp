@@ -15,8 +15,11 @@
  */
 
 #include "dnseventspublisher.h"
+#include "dnsdecoder.h"
 #include "pcapreaderservice.h"
 
+#include <pubsub/settingsutils.h>
+
 #include <osquery/sql.h>
 
 #include <IPv4Layer.h>
@@ -24,13 +27,41 @@
 
 #include <grp.h>
 #include <pwd.h>
+#include <sys/eventfd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <mutex>
 
 namespace trailofbits {
 namespace {
 bool privileges_dropped = false;
 
+/// How many UDP requests each parse task receives, at least; smaller
+/// batches are parsed on the publisher thread
+const std::size_t kMinParseChunkSize = 128U;
+
+/// How many capture workers each interface can have; each one runs its
+/// own thread and maps its own capture ring
+const std::size_t kMaxCaptureWorkerCount = 64U;
+
+/// How many DNS parse workers can be started
+const std::size_t kMaxParseWorkerCount = 64U;
+
+/// The user we have dropped privileges to
+std::string unprivileged_user_name;
+
+/// Flushes the event buffers and terminates the extension; the osquery
+/// watchdog will then restart it with the new configuration
+[[noreturn]] void requestRestart() {
+  EventBufferLibrary::instance().flush();
+  exit(1);
+}
+
 /// Returns the UID and primary GID for the nobody user
 bool getUserAndGroupIDs(uid_t& uid, gid_t& gid, const std::string& username) {
   auto s =
@@ -114,76 +145,19 @@ bool dropToUser(const std::string& unprivileged_username) {
   return true;
 }
 
-/// Generates a list of questions from the given DnsLayer
-/// We can't use const as the methods we need in DnsLayer are not marked const
-DnsEvent::QuestionList generateDnsQuestionList(pcpp::DnsLayer* dns_layer) {
-  DnsEvent::QuestionList question_list;
-
-  for (auto query = dns_layer->getFirstQuery(); query != nullptr;
-       query = dns_layer->getNextQuery(query)) {
-    DnsEvent::Question question = {};
-
-    question.record_type = query->getDnsType();
-    question.record_class = query->getDnsClass();
-    question.record_name = query->getName();
-
-    question_list.push_back(question);
-  }
-
-  return question_list;
-}
-
-/// Generates a list of answers from the given DnsLayer
-/// We can't use const as the methods we need in DnsLayer are not marked const
-DnsEvent::AnswerList generateDnsAnswerList(pcpp::DnsLayer* dns_layer) {
-  DnsEvent::AnswerList answer_list;
-
-  for (auto raw_answer = dns_layer->getFirstAnswer(); raw_answer != nullptr;
-       raw_answer = dns_layer->getNextAnswer(raw_answer)) {
-    DnsEvent::Answer answer = {};
-
-    answer.ttl = raw_answer->getTTL();
-    answer.record_data = raw_answer->getData()->toString();
-    answer.record_type = raw_answer->getDnsType();
-    answer.record_class = raw_answer->getDnsClass();
-    answer.record_name = raw_answer->getName();
-
-    answer_list.push_back(answer);
-  }
-
-  return answer_list;
-}
-
-/// Generates a new DNS event from the given DNS layer
-/// Notes: we can't use const because the methods we need in pcpp::DnsLayer are
-/// not marked as const
-DnsEvent generateDnsEvent(pcpp::ProtocolType protocol,
-                          pcpp::DnsLayer* dns_layer) {
-  DnsEvent dns_event = {};
-
-  const auto& dns_header = *dns_layer->getDnsHeader();
-
-  dns_event.id = dns_header.transactionID;
-  dns_event.protocol = protocol;
-  dns_event.truncated = (dns_header.truncation != 0U);
-  dns_event.type = (dns_header.queryOrResponse == 0) ? DnsEvent::Type::Query
-                                                     : DnsEvent::Type::Response;
-
-  dns_event.question = generateDnsQuestionList(dns_layer);
-  if (dns_header.queryOrResponse == 0) {
-    return dns_event;
-  }
-
-  dns_event.answer = generateDnsAnswerList(dns_layer);
-  return dns_event;
+/// Copies the given string into an arena string
+void setArenaString(ArenaString& destination, const std::string& source) {
+  destination.assign(source.data(), source.size());
 }
 
 /// Generates new DNS events from the given TCP stream
-/// Notes: we can't use const since Pcap++ expects writable buffers
-osquery::Status generateDnsEventListFromTCPStream(DnsEventList& dns_event_list,
-                                                  ByteVector& tcp_stream) {
+osquery::Status generateDnsEventListFromTCPStream(
+    DnsDecoderType decoder_type,
+    EventArena& arena,
+    DnsEventList& dns_event_list,
+    const ByteVector& tcp_stream) {
   try {
-    dns_event_list = {};
+    dns_event_list.clear();
 
     auto buffer_ptr = tcp_stream.data();
     auto buffer_end = buffer_ptr + tcp_stream.size();
@@ -203,14 +177,15 @@ osquery::Status generateDnsEventListFromTCPStream(DnsEventList& dns_event_list,
         return osquery::Status::failure("Invalid request size in TCP stream");
       }
 
-      // The DnsLayer will always attempt to free the buffer
-      auto* temp_buffer = new std::uint8_t[chunk_size];
-      std::memcpy(temp_buffer, chunk_start, chunk_size);
-
-      pcpp::DnsLayer dns_layer(temp_buffer, chunk_size, nullptr, nullptr);
-
-      auto dns_event = generateDnsEvent(pcpp::TCP, &dns_layer);
-      dns_event_list.push_back(dns_event);
+      DnsEvent dns_event(arena);
+      if (decodeDnsMessage(decoder_type,
+                           arena,
+                           dns_event,
+                           chunk_start,
+                           chunk_size,
+                           pcpp::TCP)) {
+        dns_event_list.push_back(std::move(dns_event));
+      }
 
       buffer_ptr = chunk_end;
     }
@@ -222,7 +197,184 @@ osquery::Status generateDnsEventListFromTCPStream(DnsEventList& dns_event_list,
   }
 }
 
-void appendDnsEventListFromTCPConversation(DnsEventList& dns_event_list,
+/// The interfaces to capture, and how many workers each of them gets
+struct CaptureLayout final {
+  /// Captured interfaces
+  std::vector<std::string> interface_list;
+
+  /// How many workers capture each interface
+  std::size_t worker_count{1U};
+
+  /// True if the interfaces are in promiscuous mode
+  bool promiscuous_mode{false};
+};
+
+/// Returns true if the given capture layouts are the same
+bool operator==(const CaptureLayout& lhs, const CaptureLayout& rhs) {
+  return lhs.interface_list == rhs.interface_list &&
+         lhs.worker_count == rhs.worker_count &&
+         lhs.promiscuous_mode == rhs.promiscuous_mode;
+}
+
+/// Reads the capture layout from the 'dns_events' section
+osquery::Status getCaptureLayout(CaptureLayout& capture_layout,
+                                 const json11::Json& configuration) {
+  capture_layout = {};
+
+  const auto& dns_event_configuration = configuration["dns_events"];
+
+  // Capture files are replayed by a single worker, which does not use any
+  // interface
+  if (dns_event_configuration["capture_engine"].string_value() == "file") {
+    std::size_t worker_count{1U};
+    auto status = getSizeSetting(worker_count,
+                                 dns_event_configuration,
+                                 "capture_workers",
+                                 1U,
+                                 kMaxCaptureWorkerCount);
+    if (!status.ok()) {
+      return status;
+    }
+
+    if (worker_count != 1U) {
+      return osquery::Status::failure(
+          "The file capture engine only supports a single capture worker");
+    }
+
+    capture_layout.interface_list.push_back(std::string());
+    return osquery::Status(0);
+  }
+
+  // Either a single interface name or a list of them
+  const auto& interface_obj = dns_event_configuration["interface"];
+  if (interface_obj.is_string()) {
+    capture_layout.interface_list.push_back(interface_obj.string_value());
+
+  } else if (interface_obj.is_array()) {
+    for (const auto& interface_name_obj : interface_obj.array_items()) {
+      const auto& interface_name = interface_name_obj.string_value();
+      if (interface_name.empty()) {
+        return osquery::Status::failure("Invalid interface name");
+      }
+
+      auto& interface_list = capture_layout.interface_list;
+      if (std::find(interface_list.begin(),
+                    interface_list.end(),
+                    interface_name) != interface_list.end()) {
+        return osquery::Status::failure("The '" + interface_name +
+                                        "' interface is listed twice");
+      }
+
+      interface_list.push_back(interface_name);
+    }
+  }
+
+  if (capture_layout.interface_list.empty()) {
+    return osquery::Status::failure(
+        "The 'interface' value is missing from the 'dns_events' section");
+  }
+
+  if (capture_layout.interface_list.size() > 1U &&
+      !dns_event_configuration["preopened_interfaces"].array_items().empty()) {
+    return osquery::Status::failure(
+        "The 'preopened_interfaces' setting can only be used with a single "
+        "interface");
+  }
+
+  auto status = getSizeSetting(capture_layout.worker_count,
+                               dns_event_configuration,
+                               "capture_workers",
+                               1U,
+                               kMaxCaptureWorkerCount);
+  if (!status.ok()) {
+    return status;
+  }
+
+  capture_layout.promiscuous_mode =
+      dns_event_configuration["promiscuous"].bool_value();
+
+  return osquery::Status(0);
+}
+
+/// Parses the given UDP request, appending the DNS event (if any) to the
+/// list
+void appendDnsEventFromUDPRequest(DnsDecoderType decoder_type,
+                                  EventArena& arena,
+                                  DnsEventList& dns_event_list,
+                                  const UDPRequest& udp_request) {
+  DnsEvent dns_event(arena);
+  if (!decodeDnsPacket(decoder_type,
+                       arena,
+                       dns_event,
+                       udp_request.packet_data,
+                       udp_request.packet_size,
+                       udp_request.link_type)) {
+    return;
+  }
+
+  dns_event.event_time = udp_request.timestamp;
+  dns_event_list.push_back(std::move(dns_event));
+}
+
+/// Parses the UDP requests on the given worker pool, appending the events
+/// to the event context in capture order. Each chunk of requests is parsed
+/// into its own arena, so that the workers never share one
+void parseUDPRequestListInParallel(WorkerPool& parse_pool,
+                                   DnsDecoderType decoder_type,
+                                   DNSEventData& event_context,
+                                   const UDPRequestList& udp_request_list) {
+  auto request_count = udp_request_list.size();
+
+  auto chunk_count = std::min(parse_pool.workerCount() + 1U,
+                              request_count / kMinParseChunkSize);
+  auto chunk_size = (request_count + chunk_count - 1U) / chunk_count;
+
+  auto& parse_arena_list = event_context.parse_arena_list;
+  while (parse_arena_list.size() < chunk_count) {
+    parse_arena_list.push_back(std::make_unique<EventArena>());
+  }
+
+  std::vector<DnsEventList> chunk_event_list;
+  chunk_event_list.reserve(chunk_count);
+
+  for (std::size_t i = 0U; i < chunk_count; ++i) {
+    chunk_event_list.emplace_back(
+        ArenaAllocator<DnsEvent>(*parse_arena_list.at(i)));
+  }
+
+  auto L_parseChunk = [&](std::size_t chunk_index) -> void {
+    auto& arena = *parse_arena_list.at(chunk_index);
+    auto& dns_event_list = chunk_event_list.at(chunk_index);
+
+    auto begin = chunk_index * chunk_size;
+    auto end = std::min(begin + chunk_size, request_count);
+
+    try {
+      for (auto i = begin; i < end; ++i) {
+        appendDnsEventFromUDPRequest(
+            decoder_type, arena, dns_event_list, udp_request_list.at(i));
+      }
+
+    } catch (const std::bad_alloc&) {
+      LOG(ERROR) << "Memory allocation failure while parsing DNS requests";
+    }
+  };
+
+  parse_pool.parallelFor(chunk_count, L_parseChunk);
+
+  // The events keep their own allocator, so moving them does not copy the
+  // strings out of the chunk arenas
+  auto& event_list = event_context.event_list;
+  for (auto& dns_event_list : chunk_event_list) {
+    event_list.insert(event_list.end(),
+                      std::make_move_iterator(dns_event_list.begin()),
+                      std::make_move_iterator(dns_event_list.end()));
+  }
+}
+
+void appendDnsEventListFromTCPConversation(DnsDecoderType decoder_type,
+                                           EventArena& arena,
+                                           DnsEventList& dns_event_list,
                                            TcpConversation& tcp_conversation) {
   std::vector<std::reference_wrapper<ByteVector>> stream_list = {
       tcp_conversation.sent_data, tcp_conversation.received_data};
@@ -231,8 +383,9 @@ void appendDnsEventListFromTCPConversation(DnsEventList& dns_event_list,
   std::size_t side = 0;
 
   for (auto& stream_data : stream_list) {
-    DnsEventList new_events = {};
-    auto status = generateDnsEventListFromTCPStream(new_events, stream_data);
+    DnsEventList new_events{ArenaAllocator<DnsEvent>(arena)};
+    auto status = generateDnsEventListFromTCPStream(
+        decoder_type, arena, new_events, stream_data);
 
     if (!status.ok()) {
       LOG(ERROR) << status.getMessage();
@@ -241,31 +394,69 @@ void appendDnsEventListFromTCPConversation(DnsEventList& dns_event_list,
 
     for (auto& event : new_events) {
       if (side == 0) {
-        event.source_address = connection_data.srcIP->toString();
-        event.destination_address = connection_data.dstIP->toString();
+        setArenaString(event.source_address,
+                       connection_data.srcIP->toString());
+        setArenaString(event.destination_address,
+                       connection_data.dstIP->toString());
       } else {
-        event.source_address = connection_data.dstIP->toString();
-        event.destination_address = connection_data.srcIP->toString();
+        setArenaString(event.source_address,
+                       connection_data.dstIP->toString());
+        setArenaString(event.destination_address,
+                       connection_data.srcIP->toString());
       }
 
       event.event_time = tcp_conversation.event_time;
     }
 
-    dns_event_list.insert(
-        dns_event_list.end(), new_events.begin(), new_events.end());
+    dns_event_list.insert(dns_event_list.end(),
+                          std::make_move_iterator(new_events.begin()),
+                          std::make_move_iterator(new_events.end()));
 
     side++;
   }
 }
 } // namespace
 
+void DNSEventData::reset() {
+  {
+    DnsEventList empty_event_list{ArenaAllocator<DnsEvent>(arena)};
+    event_list.swap(empty_event_list);
+  }
+
+  arena.reset();
+
+  for (auto& parse_arena : parse_arena_list) {
+    parse_arena->reset();
+  }
+}
+
 /// Private class data
 struct DNSEventsPublisher::PrivateData final {
-  /// The service that pulls data from pcap
-  PcapReaderServiceRef pcap_reader_service;
+  /// The services that pull data from pcap, one for each capture worker
+  std::vector<PcapReaderServiceRef> pcap_reader_service_list;
+
+  /// The capture layout used to start the services
+  CaptureLayout capture_layout;
 
   /// Data shared with the pcap reader service
   PcapReaderServiceData pcap_service_data;
+
+  /// Set by ::interrupt(); ::run() no longer waits for new data. Written
+  /// under the shared data mutex, so that the wake-up is never lost
+  std::atomic_bool interrupted{false};
+
+  /// The decoder used to parse the DNS messages
+  std::atomic<DnsDecoderType> decoder_type{DnsDecoderType::Builtin};
+
+  /// Parse worker count; zero if the requests are parsed by ::run()
+  std::size_t parse_worker_count{0U};
+
+  /// The pool used to parse the UDP requests; replaced when the worker
+  /// count changes, while ::run() keeps its own reference
+  WorkerPoolRef parse_pool;
+
+  /// Protects the parse worker pool reference
+  std::mutex parse_pool_mutex;
 };
 
 DNSEventsPublisher::DNSEventsPublisher() : d(new PrivateData) {}
@@ -286,11 +477,106 @@ osquery::Status DNSEventsPublisher::create(IEventPublisherRef& publisher) {
 }
 
 osquery::Status DNSEventsPublisher::initialize() noexcept {
-  return ServiceManager::instance().createService<PcapReaderService>(
-      d->pcap_reader_service, d->pcap_service_data);
+  d->pcap_service_data.notification_fd =
+      eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  if (d->pcap_service_data.notification_fd == -1) {
+    return osquery::Status::failure("Failed to create the eventfd descriptor");
+  }
+
+  // The pcap reader services are started by ::configure(), once the
+  // interfaces are known
+  return osquery::Status(0);
+}
+
+osquery::Status DNSEventsPublisher::configureCapture(
+    const json11::Json& configuration) {
+  CaptureLayout capture_layout;
+  auto status = getCaptureLayout(capture_layout, configuration);
+  if (!status.ok()) {
+    return status;
+  }
+
+  auto& service_list = d->pcap_reader_service_list;
+
+  if (service_list.empty()) {
+    auto interface_count = capture_layout.interface_list.size();
+    auto worker_count = interface_count * capture_layout.worker_count;
+
+    PcapFanoutGroupRef fanout_group;
+
+    for (std::size_t i = 0U; i < worker_count; ++i) {
+      auto interface_index = i / capture_layout.worker_count;
+
+      // Fanout group identifiers are shared by all the processes of the
+      // system; the kernel assigns a new one to each interface
+      if (i % capture_layout.worker_count == 0U) {
+        fanout_group = std::make_shared<PcapFanoutGroup>();
+      }
+
+      PcapReaderWorkerSettings worker_settings;
+      worker_settings.worker_index = i;
+      worker_settings.worker_count = worker_count;
+      worker_settings.fanout_size = capture_layout.worker_count;
+      worker_settings.fanout_group = fanout_group;
+
+      PcapReaderServiceRef service;
+      status = ServiceManager::instance().createService<PcapReaderService>(
+          service, d->pcap_service_data, worker_settings);
+
+      if (!status.ok()) {
+        return status;
+      }
+
+      service_list.push_back(service);
+
+      status = service->configure(
+          configuration, capture_layout.interface_list.at(interface_index));
+
+      if (!status.ok()) {
+        return status;
+      }
+    }
+
+    d->capture_layout = capture_layout;
+    return osquery::Status(0);
+  }
+
+  // A single capture can still be moved to a different interface; workers
+  // in a fanout group are bound for good
+  bool single_capture = service_list.size() == 1U &&
+                        capture_layout.interface_list.size() == 1U &&
+                        capture_layout.worker_count == 1U;
+
+  if (!single_capture && !(capture_layout == d->capture_layout)) {
+    return osquery::Status::failure(
+        "The capture interfaces and workers can't be changed while the "
+        "extension is running");
+  }
+
+  for (std::size_t i = 0U; i < service_list.size(); ++i) {
+    auto interface_index = i / capture_layout.worker_count;
+
+    status = service_list.at(i)->configure(
+        configuration, capture_layout.interface_list.at(interface_index));
+
+    if (!status.ok()) {
+      return status;
+    }
+  }
+
+  d->capture_layout = capture_layout;
+  return osquery::Status(0);
 }
 
 osquery::Status DNSEventsPublisher::release() noexcept {
+  std::lock_guard<std::mutex> lock(d->pcap_service_data.mutex);
+
+  if (d->pcap_service_data.notification_fd != -1) {
+    close(d->pcap_service_data.notification_fd);
+    d->pcap_service_data.notification_fd = -1;
+  }
+
   return osquery::Status(0);
 }
 
@@ -308,45 +594,192 @@ osquery::Status DNSEventsPublisher::configure(
 
   auto unprivileged_user = unprivileged_user_obj.string_value();
 
+  // Settings that do not require root privileges are applied while running;
+  // a single pcap reader service can also switch to one of the handles that
+  // have been opened during startup
   if (privileges_dropped) {
-    LOG(WARNING) << "Configuration has changed; requesting a restart...";
-    exit(1);
+    if (unprivileged_user != unprivileged_user_name) {
+      LOG(WARNING) << "The unprivileged user has changed; requesting a "
+                      "restart...";
+
+      requestRestart();
+    }
+
+    auto status = configureCapture(configuration);
+    if (!status.ok()) {
+      LOG(WARNING) << "Failed to apply the new configuration ("
+                   << status.getMessage() << "); requesting a restart...";
+
+      requestRestart();
+    }
+
+    // The previous parse settings are kept if the new ones are not valid
+    status = configureParsing(configuration);
+    if (!status.ok()) {
+      LOG(WARNING) << "Failed to update the parse settings: "
+                   << status.getMessage();
+    }
+
+    LOG(INFO) << "The new configuration has been applied";
+    return osquery::Status(0);
+  }
+
+  auto status = configureCapture(configuration);
+  if (!status.ok()) {
+    return status;
   }
 
-  auto status = d->pcap_reader_service->configure(configuration);
+  // Started before dropping privileges, so that the thread settings that
+  // require them can still be applied
+  status = configureParsing(configuration);
   if (!status.ok()) {
     return status;
   }
 
-  if (!dropToUser(unprivileged_user)) {
+  // There is nothing to drop when the extension is started by a regular
+  // user, such as when replaying capture files
+  if (geteuid() != 0) {
+    LOG(INFO) << "Not running as root; privileges will not be dropped";
+
+  } else if (!dropToUser(unprivileged_user)) {
     return osquery::Status::failure("Failed to drop privileges");
   }
 
   privileges_dropped = true;
+  unprivileged_user_name = unprivileged_user;
+
   return osquery::Status(0);
 }
 
+osquery::Status DNSEventsPublisher::configureParsing(
+    const json11::Json& configuration) {
+  auto decoder_type = DnsDecoderType::Builtin;
+
+  const auto& decoder_obj = configuration["dns_events"]["decoder"];
+  if (decoder_obj != json11::Json()) {
+    const auto& decoder_name = decoder_obj.string_value();
+
+    if (decoder_name == "pcpp") {
+      decoder_type = DnsDecoderType::PcapPlusPlus;
+
+    } else if (decoder_name != "builtin") {
+      return osquery::Status::failure("Invalid DNS decoder: '" +
+                                      decoder_name + "'");
+    }
+  }
+
+  std::size_t parse_worker_count = 0U;
+
+  auto status = getSizeSetting(parse_worker_count,
+                               configuration["dns_events"],
+                               "parse_workers",
+                               0U,
+                               kMaxParseWorkerCount);
+  if (!status.ok()) {
+    return status;
+  }
+
+  d->decoder_type = decoder_type;
+
+  if (parse_worker_count == d->parse_worker_count) {
+    return osquery::Status(0);
+  }
+
+  WorkerPoolRef parse_pool;
+  if (parse_worker_count != 0U) {
+    // Invalid thread settings are already reported by the scheduler
+    ThreadSettingsMap thread_settings_map;
+    static_cast<void>(parseThreadSettingsMap(
+        thread_settings_map, configuration["pubsub"]["threads"]));
+
+    status =
+        WorkerPool::create(parse_pool,
+                           parse_worker_count,
+                           getThreadSettings(thread_settings_map, "dns_parse"));
+    if (!status.ok()) {
+      return status;
+    }
+  }
+
+  d->parse_worker_count = parse_worker_count;
+
+  std::lock_guard<std::mutex> lock(d->parse_pool_mutex);
+  d->parse_pool = std::move(parse_pool);
+
+  return osquery::Status(0);
+}
+
+WorkerPoolRef DNSEventsPublisher::parseWorkerPool() {
+  std::lock_guard<std::mutex> lock(d->parse_pool_mutex);
+  return d->parse_pool;
+}
+
+void DNSEventsPublisher::backpressureChanged(bool active) noexcept {
+  if (active) {
+    LOG(WARNING) << "The DNS event buffers are full; TCP requests will be "
+                    "ignored until they are drained";
+  } else {
+    LOG(WARNING) << "The DNS event buffers have been drained; resuming the "
+                    "TCP reassembly";
+  }
+
+  d->pcap_service_data.shed_tcp_reassembly = active;
+}
+
+void DNSEventsPublisher::interrupt() noexcept {
+  {
+    std::lock_guard<std::mutex> lock(d->pcap_service_data.mutex);
+    d->interrupted = true;
+  }
+
+  d->pcap_service_data.cv.notify_all();
+}
+
+int DNSEventsPublisher::readinessDescriptor() noexcept {
+  return d->pcap_service_data.notification_fd;
+}
+
 osquery::Status DNSEventsPublisher::run() noexcept {
   UDPRequestList udp_request_list;
   TcpConversationMap completed_tcp_conversation_map;
-  pcpp::LinkLayerType link_type{pcpp::LINKTYPE_NULL};
 
   {
     std::unique_lock<std::mutex> lock(d->pcap_service_data.mutex);
 
-    if (d->pcap_service_data.cv.wait_for(lock, std::chrono::seconds(1)) !=
-        std::cv_status::no_timeout) {
+    auto L_dataAvailable = [this]() -> bool {
+      return !d->pcap_service_data.udp_request_list.empty() ||
+             !d->pcap_service_data.completed_tcp_conversation_map.empty();
+    };
+
+    // Do not sleep past the deadline of the events held back by the
+    // coalescing policy
+    auto wait_deadline = std::min(
+        std::chrono::steady_clock::now() + std::chrono::seconds(1),
+        flushDeadline());
+
+    auto L_wakeUp = [this, &L_dataAvailable]() -> bool {
+      return d->interrupted || L_dataAvailable();
+    };
+
+    if (!d->pcap_service_data.cv.wait_until(lock, wait_deadline, L_wakeUp) ||
+        !L_dataAvailable()) {
       return osquery::Status(0);
     }
 
+    // The descriptor is signaled under the same lock, so it will only be
+    // readable again when new data is added
+    std::uint64_t counter;
+    while (read(d->pcap_service_data.notification_fd,
+                &counter,
+                sizeof(counter)) == sizeof(counter)) {
+    }
+
     udp_request_list = std::move(d->pcap_service_data.udp_request_list);
     completed_tcp_conversation_map =
         std::move(d->pcap_service_data.completed_tcp_conversation_map);
 
     d->pcap_service_data.udp_request_list.clear();
     d->pcap_service_data.completed_tcp_conversation_map.clear();
-
-    link_type = d->pcap_service_data.link_type;
   }
 
   EventContextRef event_context;
@@ -355,52 +788,30 @@ osquery::Status DNSEventsPublisher::run() noexcept {
     return status;
   }
 
-  // Process the UDP requests
-  for (const auto& udp_request : udp_request_list) {
-    const auto& timestamp = udp_request.first;
-    const auto& packet_data = udp_request.second;
-
-    auto packet_data_length = static_cast<int>(packet_data.size());
-
-    pcpp::RawPacket raw_packet(
-        packet_data.data(), packet_data_length, timestamp, false, link_type);
-
-    pcpp::Packet packet(&raw_packet);
-    auto dns_layer = packet.getLayerOfType<pcpp::DnsLayer>();
-    if (dns_layer == nullptr) {
-      continue;
+  DnsDecoderType decoder_type = d->decoder_type;
+
+  // Process the UDP requests; large batches are split among the parse
+  // workers, if enabled
+  auto parse_pool = parseWorkerPool();
+  if (parse_pool && udp_request_list.size() >= 2U * kMinParseChunkSize) {
+    parseUDPRequestListInParallel(
+        *parse_pool, decoder_type, *event_context, udp_request_list);
+
+  } else {
+    for (const auto& udp_request : udp_request_list) {
+      appendDnsEventFromUDPRequest(decoder_type,
+                                   event_context->arena,
+                                   event_context->event_list,
+                                   udp_request);
     }
-
-    auto dns_event = generateDnsEvent(pcpp::UDP, dns_layer);
-    dns_event.event_time = timestamp;
-
-    auto ipv4_layer = packet.getLayerOfType<pcpp::IPv4Layer>();
-    if (ipv4_layer != nullptr) {
-      dns_event.source_address = ipv4_layer->getSrcIpAddress().toString();
-
-      dns_event.destination_address = ipv4_layer->getDstIpAddress().toString();
-
-    } else {
-      auto ipv6_layer = packet.getLayerOfType<pcpp::IPv6Layer>();
-      if (ipv6_layer != nullptr) {
-        dns_event.source_address = ipv6_layer->getSrcIpAddress().toString();
-
-        dns_event.destination_address =
-            ipv6_layer->getDstIpAddress().toString();
-
-      } else {
-        LOG(ERROR)
-            << "Failed to determine the source and destination IP addresses";
-      }
-    }
-
-    event_context->event_list.push_back(std::move(dns_event));
   }
 
   // Process the TCP requests
   for (auto& p : completed_tcp_conversation_map) {
     auto& tcp_conversation = p.second;
-    appendDnsEventListFromTCPConversation(event_context->event_list,
+    appendDnsEventListFromTCPConversation(decoder_type,
+                                          event_context->arena,
+                                          event_context->event_list,
                                           tcp_conversation);
   }
 
@@ -16,93 +16,39 @@
 
 #pragma once
 
+#include "dnsevent.h"
+
+#include <pubsub/eventarena.h>
 #include <pubsub/publisherregistry.h>
 #include <pubsub/servicemanager.h>
-
-#include <DnsLayer.h>
+#include <pubsub/workerpool.h>
 
 namespace trailofbits {
 /// A reference to a DNSEventsPublisher object
 struct DNSEventSubscriptionContext final {};
 
-/// A single DNS event
-struct DnsEvent final {
-  /// Event time
-  timeval event_time{};
-
-  /// Source address
-  std::string source_address;
-
-  /// Destination address
-  std::string destination_address;
-
-  /// Request type, taken from the qr bit of the header
-  enum class Type { Query, Response };
-
-  /// Describes a single question in the DNS request
-  struct Question final {
-    /// Record type (i.e.: A, NS, CNAME, etc...)
-    pcpp::DnsType record_type;
-
-    /// DNS class (i.e.: IN, CH, etc...)
-    pcpp::DnsClass record_class;
-
-    /// The domain name
-    std::string record_name;
-  };
-
-  /// A list of questions sent to the DNS server
-  using QuestionList = std::vector<Question>;
-
-  /// Answer data
-  struct Answer final {
-    /// The time to live for this record
-    std::uint32_t ttl;
-
-    /// The record data
-    std::string record_data;
-
-    /// The record type (i.e.: A, NS or CNAME)
-    pcpp::DnsType record_type;
-
-    /// The class for this record (such as IN, CH or ANY)
-    pcpp::DnsClass record_class;
-
-    /// The record name
-    std::string record_name;
-  };
-
-  /// A list of answers received from the DNS server
-  using AnswerList = std::vector<Answer>;
-
-  /// Request type; either a query or a response
-  Type type{Type::Query};
-
-  /// List of questions sent or received (copied from the client request) from
-  /// the DNS server
-  QuestionList question;
-
-  /// List of answers received from the DNS server
-  AnswerList answer;
-
-  /// Request identifier
-  std::uint16_t id;
+/// The event object emitted by this publisher; objects are recycled by the
+/// publisher once all the subscribers have released them
+struct DNSEventData final {
+  /// The arena holding the events; it must be declared before them, so that
+  /// it is destroyed last
+  EventArena arena;
 
-  /// Protocol type; either UDP or TCP
-  pcpp::ProtocolType protocol{pcpp::UDP};
+  /// Additional arenas, one for each chunk of requests parsed in parallel;
+  /// the events parsed by a worker keep using the arena of their chunk
+  std::vector<std::unique_ptr<EventArena>> parse_arena_list;
 
-  /// True if the request was truncated; only valid when the protocol is set to
-  /// UDP
-  bool truncated{false};
-};
+  /// A list of DNS events
+  DnsEventList event_list{ArenaAllocator<DnsEvent>(arena)};
 
-/// A list of DNS events
-using DnsEventList = std::vector<DnsEvent>;
+  /// Releases the events and rewinds the arena; called before the object is
+  /// reused
+  void reset();
 
-/// The event object emitted by this publisher
-struct DNSEventData final {
-  /// A list of DNS events
-  DnsEventList event_list;
+  /// Returns the amount of events; used by the coalescing policy
+  std::size_t eventCount() const {
+    return event_list.size();
+  }
 };
 
 /// A network sniffer based on libcap
@@ -116,6 +62,18 @@ class DNSEventsPublisher final
   /// Private constructor; use the ::create() static function instead
   explicit DNSEventsPublisher();
 
+  /// Starts the pcap reader services on the first call, then forwards the
+  /// configuration to them
+  osquery::Status configureCapture(const json11::Json& configuration);
+
+  /// Selects the DNS decoder, and creates (or removes) the pool used to
+  /// parse the UDP requests
+  osquery::Status configureParsing(const json11::Json& configuration);
+
+  /// Returns the parse worker pool, or nullptr if the requests are parsed
+  /// on the publisher thread
+  WorkerPoolRef parseWorkerPool();
+
  public:
   /// Factory function used to create DNSEventsPublisher objects
   static osquery::Status create(IEventPublisherRef& publisher);
@@ -141,11 +99,21 @@ class DNSEventsPublisher final
   /// Worker method; should perform some work and then return
   osquery::Status run() noexcept override;
 
+  /// Wakes up ::run() when the scheduler is shutting down
+  void interrupt() noexcept override;
+
+  /// Returns the descriptor signaled by the pcap reader service
+  int readinessDescriptor() noexcept override;
+
   /// Disable the copy constructor
   DNSEventsPublisher(const DNSEventsPublisher& other) = delete;
 
   /// Disable the assignment operator
   DNSEventsPublisher& operator=(const DNSEventsPublisher& other) = delete;
+
+ protected:
+  /// Stops the TCP reassembly while the buffers are under backpressure
+  void backpressureChanged(bool active) noexcept override;
 };
 
 TOB_DECLARE_PUBLISHER(DNSEventsPublisher);
@@ -15,7 +15,8 @@
  */
 
 #include "dnseventssubscriber.h"
-#include <osquery/sql/dynamic_table_row.h>
+
+#include <pubsub/metricsregistry.h>
 
 namespace trailofbits {
 // clang-format off
@@ -42,9 +43,93 @@ BEGIN_TABLE(dns_events)
   TABLE_COLUMN(ttl, osquery::TEXT_TYPE)
   TABLE_COLUMN(record_data, osquery::TEXT_TYPE)
 END_TABLE(dns_events)
+
+// Runtime metrics for the publishers, subscribers and event buffers
+REGISTER_PUBSUB_METRICS_TABLE()
 // clang-format on
 
 namespace {
+/// Column indexes for the dns_events table
+struct DnsEventsColumns final {
+  std::size_t event_time{0U};
+  std::size_t source_address{0U};
+  std::size_t destination_address{0U};
+  std::size_t protocol{0U};
+  std::size_t truncated{0U};
+  std::size_t id{0U};
+  std::size_t type{0U};
+  std::size_t record_type{0U};
+  std::size_t record_class{0U};
+  std::size_t record_name{0U};
+  std::size_t ttl{0U};
+  std::size_t record_data{0U};
+};
+
+/// Returns the column indexes for the dns_events table
+const DnsEventsColumns& getDnsEventsColumns() {
+  static const DnsEventsColumns columns = []() -> DnsEventsColumns {
+    const auto& schema = dns_eventsTableSchema();
+
+    DnsEventsColumns indexes;
+    indexes.event_time = EventColumnBatch::columnIndex(schema, "event_time");
+    indexes.source_address =
+        EventColumnBatch::columnIndex(schema, "source_address");
+    indexes.destination_address =
+        EventColumnBatch::columnIndex(schema, "destination_address");
+    indexes.protocol = EventColumnBatch::columnIndex(schema, "protocol");
+    indexes.truncated = EventColumnBatch::columnIndex(schema, "truncated");
+    indexes.id = EventColumnBatch::columnIndex(schema, "id");
+    indexes.type = EventColumnBatch::columnIndex(schema, "type");
+    indexes.record_type = EventColumnBatch::columnIndex(schema, "record_type");
+    indexes.record_class =
+        EventColumnBatch::columnIndex(schema, "record_class");
+    indexes.record_name = EventColumnBatch::columnIndex(schema, "record_name");
+    indexes.ttl = EventColumnBatch::columnIndex(schema, "ttl");
+    indexes.record_data = EventColumnBatch::columnIndex(schema, "record_data");
+
+    return indexes;
+  }();
+
+  return columns;
+}
+
+/// Sets the columns that are shared by all the records of an event
+void setDnsEventHeader(EventColumnBatch& batch,
+                       std::size_t row,
+                       const DnsEvent& event) {
+  const auto& columns = getDnsEventsColumns();
+
+  batch.setInteger(row,
+                   columns.event_time,
+                   static_cast<std::int64_t>(event.event_time.tv_sec));
+
+  batch.setText(row,
+                columns.source_address,
+                event.source_address.data(),
+                event.source_address.size());
+
+  batch.setText(row,
+                columns.destination_address,
+                event.destination_address.data(),
+                event.destination_address.size());
+
+  batch.setInteger(row, columns.id, event.id);
+  if (event.protocol == pcpp::UDP) {
+    batch.setText(row, columns.protocol, "udp");
+    batch.setInteger(row, columns.truncated, event.truncated ? 1 : 0);
+  } else {
+    batch.setText(row, columns.protocol, "tcp");
+    batch.setInteger(row, columns.truncated, 0);
+  }
+
+  if (event.type == DnsEvent::Type::Query) {
+    batch.setText(row, columns.type, "query");
+  } else {
+    batch.setText(row, columns.type, "response");
+  }
+}
+} // namespace
+
 const char* getDnsRecordType(pcpp::DnsType type) {
   switch (type) {
   case pcpp::DNS_TYPE_A:
@@ -168,7 +253,6 @@ const char* getDnsClass(pcpp::DnsClass dns_class) {
     return "ANY";
   }
 }
-} // namespace
 
 osquery::Status DNSEventsSubscriber::create(IEventSubscriberRef& subscriber) {
   try {
@@ -204,52 +288,77 @@ osquery::Status DNSEventsSubscriber::callback(
     osquery::TableRows& new_events,
     DNSEventsPublisher::SubscriptionContextRef,
     DNSEventsPublisher::EventContextRef event_context) {
+  EventColumnBatchRef batch;
+  auto status = EventColumnBatch::create(batch, dns_eventsTableSchema());
+  if (!status.ok()) {
+    return status;
+  }
+
+  const auto& columns = getDnsEventsColumns();
+
   for (const auto& event : event_context->event_list) {
-    osquery::Row row = {};
+    // The first record of each event holds the header columns, and the
+    // following ones share its cells
+    auto header_row = batch->rowCount();
 
-    row["event_time"] = std::to_string(event.event_time.tv_sec);
+    auto L_addRow = [&batch, &event, header_row]() -> std::size_t {
+      auto row = batch->addRow();
 
-    row["source_address"] = event.source_address;
-    row["destination_address"] = event.destination_address;
+      if (row == header_row) {
+        setDnsEventHeader(*batch, row, event);
+      } else {
+        batch->copyRow(row, header_row);
+      }
 
-    row["id"] = std::to_string(event.id);
-    if (event.protocol == pcpp::UDP) {
-      row["protocol"] = "udp";
-      row["truncated"] = event.truncated ? "1" : "0";
-    } else {
-      row["protocol"] = "tcp";
-      row["truncated"] = "0";
-    }
+      return row;
+    };
 
     if (event.type == DnsEvent::Type::Query) {
-      row["type"] = "query";
-
       for (const auto& question_item : event.question) {
-        row["record_type"] = getDnsRecordType(question_item.record_type);
-        row["record_class"] = getDnsClass(question_item.record_class);
-        row["record_name"] = question_item.record_name;
+        auto row = L_addRow();
+
+        batch->setText(row,
+                       columns.record_type,
+                       getDnsRecordType(question_item.record_type));
+
+        batch->setText(row,
+                       columns.record_class,
+                       getDnsClass(question_item.record_class));
 
-        new_events.push_back(osquery::TableRowHolder(
-            new osquery::DynamicTableRow(std::move(row))));
+        batch->setText(row,
+                       columns.record_name,
+                       question_item.record_name.data(),
+                       question_item.record_name.size());
       }
 
     } else {
-      row["type"] = "response";
-
       for (const auto& answer_item : event.answer) {
-        row["record_type"] = getDnsRecordType(answer_item.record_type);
-        row["record_class"] = getDnsClass(answer_item.record_class);
-        row["record_name"] = answer_item.record_name;
+        auto row = L_addRow();
+
+        batch->setText(row,
+                       columns.record_type,
+                       getDnsRecordType(answer_item.record_type));
+
+        batch->setText(row,
+                       columns.record_class,
+                       getDnsClass(answer_item.record_class));
+
+        batch->setText(row,
+                       columns.record_name,
+                       answer_item.record_name.data(),
+                       answer_item.record_name.size());
 
-        row["ttl"] = std::to_string(answer_item.ttl);
-        row["record_data"] = answer_item.record_data;
+        batch->setInteger(row, columns.ttl, answer_item.ttl);
 
-        new_events.push_back(osquery::TableRowHolder(
-            new osquery::DynamicTableRow(std::move(row))));
+        batch->setText(row,
+                       columns.record_data,
+                       answer_item.record_data.data(),
+                       answer_item.record_data.size());
       }
     }
   }
 
+  EventColumnBatch::appendTableRows(new_events, batch);
   return osquery::Status(0);
 }
 } // namespace trailofbits
@@ -22,6 +22,12 @@
 #include <pubsub/table_generator.h>
 
 namespace trailofbits {
+/// Returns the name of the given DNS record type (i.e.: A, NS, CNAME)
+const char* getDnsRecordType(pcpp::DnsType type);
+
+/// Returns the name of the given DNS class (i.e.: IN, CH)
+const char* getDnsClass(pcpp::DnsClass dns_class);
+
 class DNSEventsSubscriber final
     : public BaseEventSubscriber<DNSEventsPublisher> {
  public:
@@ -50,5 +56,6 @@ class DNSEventsSubscriber final
       DNSEventsPublisher::EventContextRef event_context) override;
 };
 
+DECLARE_TABLE_SCHEMA(dns_events);
 DECLARE_SUBSCRIBER(DNSEventsPublisher, DNSEventsSubscriber);
 } // namespace trailofbits
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dnssummarysubscriber.h"
+#include "dnseventssubscriber.h"
+
+namespace trailofbits {
+// clang-format off
+BEGIN_TABLE(dns_summary)
+  // The time window, as UNIX timestamps
+  TABLE_COLUMN(window_start, osquery::BIGINT_TYPE)
+  TABLE_COLUMN(window_end, osquery::BIGINT_TYPE)
+
+  // Group key
+  TABLE_COLUMN(source_address, osquery::TEXT_TYPE)
+  TABLE_COLUMN(record_name, osquery::TEXT_TYPE)
+  TABLE_COLUMN(record_type, osquery::TEXT_TYPE)
+
+  // How many queries have been sent in the window, and by how much the
+  // count may have been overestimated
+  TABLE_COLUMN(count, osquery::BIGINT_TYPE)
+  TABLE_COLUMN(count_error, osquery::BIGINT_TYPE)
+END_TABLE(dns_summary)
+// clang-format on
+
+DNSSummarySubscriber::DNSSummarySubscriber()
+    : BaseAggregatingSubscriber<DNSEventsPublisher>(name(),
+                                                    dns_summaryTableSchema()) {}
+
+osquery::Status DNSSummarySubscriber::create(IEventSubscriberRef& subscriber) {
+  try {
+    auto ptr = new DNSSummarySubscriber();
+    subscriber.reset(ptr);
+
+    return osquery::Status(0);
+
+  } catch (const std::bad_alloc&) {
+    return osquery::Status::failure("Memory allocation failure");
+
+  } catch (const osquery::Status& status) {
+    return status;
+  }
+}
+
+osquery::Status DNSSummarySubscriber::initialize() noexcept {
+  return osquery::Status(0);
+}
+
+osquery::Status DNSSummarySubscriber::aggregate(
+    EventAggregator& event_aggregator,
+    DNSEventsPublisher::SubscriptionContextRef,
+    DNSEventsPublisher::EventContextRef event_context) {
+  // Source address, record name and record type
+  std::vector<std::string> key_values(3U);
+
+  for (const auto& event : event_context->event_list) {
+    if (event.type != DnsEvent::Type::Query) {
+      continue;
+    }
+
+    key_values[0].assign(event.source_address.data(),
+                         event.source_address.size());
+
+    for (const auto& question_item : event.question) {
+      key_values[1].assign(question_item.record_name.data(),
+                           question_item.record_name.size());
+
+      key_values[2] = getDnsRecordType(question_item.record_type);
+
+      event_aggregator.add(key_values, event.event_time.tv_sec);
+    }
+  }
+
+  return osquery::Status(0);
+}
+} // namespace trailofbits
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "dnseventspublisher.h"
+
+#include <pubsub/baseaggregatingsubscriber.h>
+#include <pubsub/subscriberregistry.h>
+#include <pubsub/table_generator.h>
+
+namespace trailofbits {
+/// Counts the DNS queries by source address and record name; rows are
+/// generated once per window instead of once per query
+class DNSSummarySubscriber final
+    : public BaseAggregatingSubscriber<DNSEventsPublisher> {
+  /// Private constructor; use the ::create() static function instead
+  DNSSummarySubscriber();
+
+ public:
+  /// Returns the friendly subscriber name
+  static const char* name() {
+    return "dns_summary";
+  }
+
+  /// Factory function
+  static osquery::Status create(IEventSubscriberRef& subscriber);
+
+  /// One-time initialization
+  virtual osquery::Status initialize() noexcept override;
+
+ protected:
+  /// Counts the questions of each query
+  virtual osquery::Status aggregate(
+      EventAggregator& event_aggregator,
+      DNSEventsPublisher::SubscriptionContextRef subscription_context,
+      DNSEventsPublisher::EventContextRef event_context) override;
+};
+
+DECLARE_TABLE_SCHEMA(dns_summary);
+DECLARE_SUBSCRIBER(DNSEventsPublisher, DNSSummarySubscriber);
+} // namespace trailofbits
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <pubsub/eventbufferlibrary.h>
 #include <pubsub/publisherregistry.h>
 #include <pubsub/publisherscheduler.h>
 #include <pubsub/servicemanager.h>
@@ -26,11 +27,15 @@
 #include <osquery/sdk/sdk.h>
 #include <osquery/system.h>
 
+#include <chrono>
 #include <iostream>
 
 const std::string kConfigurationFile =
     "/var/osquery/extensions/com/trailofbits/network_monitor.json";
 
+/// How long the services and the publishers (each) are given to stop
+const std::chrono::milliseconds kShutdownTimeout(2500);
+
 int main(int argc, char* argv[]) {
   osquery::Initializer runner(argc, argv, osquery::ToolType::EXTENSION);
 
@@ -81,9 +86,15 @@ int main(int argc, char* argv[]) {
   GFLAGS_NAMESPACE::ShutDownCommandLineFlags();
   osquery::DatabasePlugin::shutdown();
 
-  scheduler->stop();
+  // The services are stopped first, so that the final publisher run can
+  // drain the packets they have captured while shutting down
+  trailofbits::ServiceManager::instance().stop(kShutdownTimeout);
+
+  scheduler->stop(kShutdownTimeout);
   scheduler.reset();
-  trailofbits::ServiceManager::instance().stop();
+
+  // Persistent buffers keep their rows across restarts
+  trailofbits::EventBufferLibrary::instance().flush();
 
   status = trailofbits::SubscriberRegistry::instance().release();
   if (!status.ok()) {
@@ -61,6 +61,84 @@ osquery::Status createPcap(PcapRef& ref,
   return osquery::Status(0);
 }
 
+osquery::Status openPcapFile(PcapRef& ref, const std::string& path) {
+  ref.reset();
+
+  char error_message[PCAP_ERRBUF_SIZE] = {};
+
+  // Also reads pcapng files, as long as they only contain one link type
+  auto ptr = pcap_open_offline(path.c_str(), error_message);
+  if (ptr == nullptr) {
+    return osquery::Status::failure(error_message);
+  }
+
+  ref.reset(ptr);
+  return osquery::Status(0);
+}
+
+osquery::Status getPcapLinkType(pcpp::LinkLayerType& link_type,
+                                PcapRef& ref) {
+  link_type = pcpp::LINKTYPE_NULL;
+
+  auto pcap_link_type = pcap_datalink(ref.get());
+  if (pcap_link_type == PCAP_ERROR_NOT_ACTIVATED) {
+    return osquery::Status::failure(
+        "Failed to acquire the link-layer header type");
+  }
+
+  switch (pcap_link_type) {
+  case DLT_IPV4:
+    link_type = pcpp::LINKTYPE_IPV4;
+    return osquery::Status(0);
+
+  case DLT_IPV6:
+    link_type = pcpp::LINKTYPE_IPV6;
+    return osquery::Status(0);
+
+  case DLT_EN10MB:
+    link_type = pcpp::LINKTYPE_ETHERNET;
+    return osquery::Status(0);
+
+  case DLT_LINUX_SLL:
+    link_type = pcpp::LINKTYPE_LINUX_SLL;
+    return osquery::Status(0);
+
+  case DLT_RAW:
+    link_type = pcpp::LINKTYPE_RAW;
+    return osquery::Status(0);
+
+  default:
+    return osquery::Status::failure("Invalid link-layer header type");
+  }
+}
+
+osquery::Status setPcapFilter(PcapRef& ref, const std::string& filter_rules) {
+  struct bpf_program ebpf_filter_program {};
+  if (pcap_compile(ref.get(),
+                   &ebpf_filter_program,
+                   filter_rules.c_str(),
+                   1,
+                   PCAP_NETMASK_UNKNOWN) != 0) {
+    auto error_message = std::string("Failed to compile the eBPF filter: ") +
+                         pcap_geterr(ref.get());
+
+    return osquery::Status::failure(error_message);
+  }
+
+  auto filter_error = pcap_setfilter(ref.get(), &ebpf_filter_program);
+  pcap_freecode(&ebpf_filter_program);
+
+  if (filter_error != 0) {
+    auto error_message =
+        std::string("Failed to enable the eBPF filter program: ") +
+        pcap_geterr(ref.get());
+
+    return osquery::Status::failure(error_message);
+  }
+
+  return osquery::Status(0);
+}
+
 void pcapRefDeleter(pcap_t* handle) {
   if (handle == nullptr) {
     return;
@@ -152,7 +230,8 @@ osquery::Status getNetworkDeviceInformation(NetworkDeviceInformation& dev_info,
 
 osquery::Status waitForNewPackets(bool& timed_out,
                                   PcapRef& ref,
-                                  std::size_t msecs) {
+                                  std::size_t msecs,
+                                  int wakeup_fd) {
   timed_out = false;
 
   auto pcap_fd = pcap_get_selectable_fd(ref.get());
@@ -160,9 +239,19 @@ osquery::Status waitForNewPackets(bool& timed_out,
     return osquery::Status::failure("Not supported on this platform");
   }
 
-  pollfd fds[] = {{pcap_fd, POLLIN, 0}};
+  return waitForDescriptor(timed_out, pcap_fd, msecs, wakeup_fd);
+}
+
+osquery::Status waitForDescriptor(bool& timed_out,
+                                  int fd,
+                                  std::size_t msecs,
+                                  int wakeup_fd) {
+  timed_out = false;
+
+  // Negative descriptors are ignored by poll()
+  pollfd fds[] = {{fd, POLLIN, 0}, {wakeup_fd, POLLIN, 0}};
 
-  int poll_status = ::poll(fds, 1, static_cast<int>(msecs));
+  int poll_status = ::poll(fds, 2, static_cast<int>(msecs));
   if (poll_status == 0) {
     timed_out = true;
     return osquery::Status(0);
@@ -21,6 +21,7 @@
 #include <memory>
 #include <vector>
 
+#include <RawPacket.h>
 #include <pcap.h>
 
 namespace trailofbits {
@@ -60,12 +61,32 @@ osquery::Status createPcap(PcapRef& ref,
                            int packet_capture_timeout,
                            bool promiscuous_mode);
 
+/// Opens a pcap or pcapng capture file
+osquery::Status openPcapFile(PcapRef& ref, const std::string& path);
+
+/// Determines the link type of the given handle; only the link types
+/// supported by the DNS decoders are accepted
+osquery::Status getPcapLinkType(pcpp::LinkLayerType& link_type,
+                                PcapRef& ref);
+
+/// Compiles and installs the given filter on the pcap handle
+osquery::Status setPcapFilter(PcapRef& ref, const std::string& filter_rules);
+
 /// Returns the device information for the specified network interface
 osquery::Status getNetworkDeviceInformation(NetworkDeviceInformation& dev_info,
                                             const std::string& device_name);
 
-/// Performs a poll() on the given pcap handle, waiting for new packets
+/// Performs a poll() on the given pcap handle, waiting for new packets; if
+/// a wake-up descriptor is given, the wait also ends (with `timed_out` set)
+/// as soon as it becomes readable
 osquery::Status waitForNewPackets(bool& timed_out,
                                   PcapRef& ref,
-                                  std::size_t msecs);
+                                  std::size_t msecs,
+                                  int wakeup_fd = -1);
+
+/// Same as ::waitForNewPackets(), for any pollable descriptor
+osquery::Status waitForDescriptor(bool& timed_out,
+                                  int fd,
+                                  std::size_t msecs,
+                                  int wakeup_fd = -1);
 } // namespace trailofbits
@@ -0,0 +1,383 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pcapfilesource.h"
+
+#include <osquery/logger.h>
+
+#include <algorithm>
+#include <cctype>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace trailofbits {
+namespace {
+/// Returns true if the given path is a regular file
+bool isRegularFile(const std::string& path) {
+  struct stat file_information {};
+  if (stat(path.c_str(), &file_information) != 0) {
+    return false;
+  }
+
+  return S_ISREG(file_information.st_mode);
+}
+
+/// Compares two file names, treating runs of digits as numbers; rotated
+/// captures are then read in the order they have been written
+bool naturalLess(const std::string& lhs, const std::string& rhs) {
+  std::size_t lhs_index = 0U;
+  std::size_t rhs_index = 0U;
+
+  auto L_isDigit = [](char c) -> bool {
+    return std::isdigit(static_cast<unsigned char>(c)) != 0;
+  };
+
+  while (lhs_index < lhs.size() && rhs_index < rhs.size()) {
+    if (!L_isDigit(lhs[lhs_index]) || !L_isDigit(rhs[rhs_index])) {
+      if (lhs[lhs_index] != rhs[rhs_index]) {
+        return lhs[lhs_index] < rhs[rhs_index];
+      }
+
+      ++lhs_index;
+      ++rhs_index;
+      continue;
+    }
+
+    // Compare the numbers without their leading zeroes: the longer one is
+    // the greater, otherwise the first different digit decides
+    while (lhs_index < lhs.size() && lhs[lhs_index] == '0') {
+      ++lhs_index;
+    }
+
+    while (rhs_index < rhs.size() && rhs[rhs_index] == '0') {
+      ++rhs_index;
+    }
+
+    auto lhs_end = lhs_index;
+    while (lhs_end < lhs.size() && L_isDigit(lhs[lhs_end])) {
+      ++lhs_end;
+    }
+
+    auto rhs_end = rhs_index;
+    while (rhs_end < rhs.size() && L_isDigit(rhs[rhs_end])) {
+      ++rhs_end;
+    }
+
+    if (lhs_end - lhs_index != rhs_end - rhs_index) {
+      return lhs_end - lhs_index < rhs_end - rhs_index;
+    }
+
+    auto comparison = lhs.compare(
+        lhs_index, lhs_end - lhs_index, rhs, rhs_index, rhs_end - rhs_index);
+
+    if (comparison != 0) {
+      return comparison < 0;
+    }
+
+    lhs_index = lhs_end;
+    rhs_index = rhs_end;
+  }
+
+  if (lhs.size() - lhs_index != rhs.size() - rhs_index) {
+    return lhs.size() - lhs_index < rhs.size() - rhs_index;
+  }
+
+  return lhs < rhs;
+}
+
+/// Lists the capture files found at the given path, which is either a file
+/// or a folder; hidden files and subfolders are ignored
+osquery::Status listCaptureFiles(std::vector<std::string>& file_list,
+                                 const std::string& path) {
+  file_list.clear();
+
+  if (isRegularFile(path)) {
+    file_list.push_back(path);
+    return osquery::Status(0);
+  }
+
+  auto directory = opendir(path.c_str());
+  if (directory == nullptr) {
+    return osquery::Status::failure("Failed to open the capture path: '" +
+                                    path + "'");
+  }
+
+  std::vector<std::string> name_list;
+
+  for (auto entry = readdir(directory); entry != nullptr;
+       entry = readdir(directory)) {
+    std::string file_name = entry->d_name;
+    if (file_name.empty() || file_name.front() == '.') {
+      continue;
+    }
+
+    if (isRegularFile(path + "/" + file_name)) {
+      name_list.push_back(std::move(file_name));
+    }
+  }
+
+  closedir(directory);
+
+  std::sort(name_list.begin(), name_list.end(), naturalLess);
+
+  for (const auto& file_name : name_list) {
+    file_list.push_back(path + "/" + file_name);
+  }
+
+  if (file_list.empty()) {
+    return osquery::Status::failure("No capture file found in '" + path +
+                                    "'");
+  }
+
+  return osquery::Status(0);
+}
+} // namespace
+
+/// Private class data
+struct PcapFileSource::PrivateData final {
+  /// Settings
+  PcapFileSourceSettings settings;
+
+  /// The filter installed on each file
+  std::string filter_rules;
+
+  /// The files to replay, in order
+  std::vector<std::string> file_list;
+
+  /// The next file to open
+  std::size_t next_file_index{0U};
+
+  /// The file that is being read
+  DeclarePcapRef(handle);
+
+  /// Link type of the current file
+  pcpp::LinkLayerType link_type{pcpp::LINKTYPE_NULL};
+
+  /// A packet that has been read but not returned yet, because it was not
+  /// due; the data stays valid until the next read
+  bool packet_pending{false};
+
+  /// Header of the pending packet
+  pcap_pkthdr* pending_header{nullptr};
+
+  /// Data of the pending packet
+  const std::uint8_t* pending_data{nullptr};
+
+  /// True once the first packet has been read
+  bool replay_started{false};
+
+  /// Capture time of the first packet
+  timeval capture_origin{};
+
+  /// When the first packet has been returned
+  std::chrono::steady_clock::time_point replay_origin;
+
+  /// How many files have been opened
+  std::size_t file_count{0U};
+
+  /// How many packets have been returned
+  std::uint64_t packet_count{0U};
+};
+
+bool operator==(const PcapFileSourceSettings& lhs,
+                const PcapFileSourceSettings& rhs) {
+  return lhs.path == rhs.path && lhs.timing == rhs.timing;
+}
+
+PcapFileSource::PcapFileSource(const PcapFileSourceSettings& settings,
+                               const std::string& filter_rules)
+    : d(new PrivateData) {
+  d->settings = settings;
+  d->filter_rules = filter_rules;
+
+  auto status = listCaptureFiles(d->file_list, settings.path);
+  if (!status.ok()) {
+    throw status;
+  }
+}
+
+bool PcapFileSource::openNextFile() {
+  d->handle.reset();
+
+  while (d->next_file_index < d->file_list.size()) {
+    const auto& path = d->file_list.at(d->next_file_index);
+    ++d->next_file_index;
+
+    DeclarePcapRef(handle);
+    auto status = openPcapFile(handle, path);
+
+    if (status.ok()) {
+      status = getPcapLinkType(d->link_type, handle);
+    }
+
+    if (status.ok()) {
+      status = setPcapFilter(handle, d->filter_rules);
+    }
+
+    if (!status.ok()) {
+      LOG(WARNING) << "Skipping the '" << path
+                   << "' capture file: " << status.getMessage();
+
+      continue;
+    }
+
+    LOG(INFO) << "Replaying DNS traffic from the '" << path
+              << "' capture file";
+
+    d->handle = std::move(handle);
+    ++d->file_count;
+
+    return true;
+  }
+
+  return false;
+}
+
+osquery::Status PcapFileSource::create(PcapFileSourceRef& obj,
+                                       const PcapFileSourceSettings& settings,
+                                       const std::string& filter_rules) {
+  obj.reset();
+
+  try {
+    auto ptr = new PcapFileSource(settings, filter_rules);
+    obj.reset(ptr);
+
+    return osquery::Status(0);
+
+  } catch (const std::bad_alloc&) {
+    return osquery::Status::failure("Memory allocation failure");
+
+  } catch (const osquery::Status& status) {
+    return status;
+  }
+}
+
+osquery::Status PcapFileSource::parseSettings(
+    PcapFileSourceSettings& settings, const json11::Json& configuration) {
+  settings = {};
+
+  if (!configuration.is_object()) {
+    return osquery::Status::failure(
+        "The 'capture_file' section is missing from the 'dns_events' "
+        "section");
+  }
+
+  settings.path = configuration["path"].string_value();
+  if (settings.path.empty()) {
+    return osquery::Status::failure("The capture file path is missing");
+  }
+
+  const auto& timing_obj = configuration["timing"];
+  if (timing_obj != json11::Json()) {
+    const auto& timing_name = timing_obj.string_value();
+
+    if (timing_name == "original") {
+      settings.timing = PcapReplayTiming::Original;
+
+    } else if (timing_name != "max") {
+      return osquery::Status::failure("Invalid replay timing: '" +
+                                      timing_name + "'");
+    }
+  }
+
+  return osquery::Status(0);
+}
+
+PcapFileSource::~PcapFileSource() {}
+
+const PcapFileSourceSettings& PcapFileSource::settings() const {
+  return d->settings;
+}
+
+PcapFileReadResult PcapFileSource::nextPacket(
+    PcapFilePacket& packet, std::chrono::milliseconds& wait_time) {
+  packet = {};
+  wait_time = std::chrono::milliseconds(0);
+
+  while (!d->packet_pending) {
+    if (!d->handle && !openNextFile()) {
+      return PcapFileReadResult::EndOfReplay;
+    }
+
+    auto read_status =
+        pcap_next_ex(d->handle.get(), &d->pending_header, &d->pending_data);
+
+    if (read_status == 1) {
+      d->packet_pending = true;
+      break;
+    }
+
+    // Truncated files (such as the one tcpdump is still writing) end with
+    // an error; the packets read so far are kept
+    if (read_status == PCAP_ERROR) {
+      LOG(WARNING) << "Failed to read the next packet from the '"
+                   << d->file_list.at(d->next_file_index - 1U)
+                   << "' capture file: " << pcap_geterr(d->handle.get());
+    }
+
+    d->handle.reset();
+  }
+
+  const auto& timestamp = d->pending_header->ts;
+
+  if (d->settings.timing == PcapReplayTiming::Original) {
+    auto now = std::chrono::steady_clock::now();
+
+    if (!d->replay_started) {
+      d->capture_origin = timestamp;
+      d->replay_origin = now;
+    }
+
+    // Packets that go back in time (such as the ones at the start of a
+    // file that overlaps the previous one) are returned immediately
+    auto capture_offset = std::chrono::seconds(timestamp.tv_sec -
+                                               d->capture_origin.tv_sec) +
+                          std::chrono::microseconds(timestamp.tv_usec -
+                                                    d->capture_origin.tv_usec);
+
+    auto due_time = d->replay_origin + capture_offset;
+    if (due_time > now) {
+      wait_time =
+          std::chrono::duration_cast<std::chrono::milliseconds>(due_time -
+                                                                now) +
+          std::chrono::milliseconds(1);
+
+      return PcapFileReadResult::Pending;
+    }
+  }
+
+  d->replay_started = true;
+  d->packet_pending = false;
+  ++d->packet_count;
+
+  packet.timestamp = timestamp;
+  packet.link_type = d->link_type;
+  packet.data = d->pending_data;
+  packet.size = d->pending_header->caplen;
+
+  return PcapFileReadResult::Packet;
+}
+
+std::size_t PcapFileSource::fileCount() const {
+  return d->file_count;
+}
+
+std::uint64_t PcapFileSource::packetCount() const {
+  return d->packet_count;
+}
+} // namespace trailofbits
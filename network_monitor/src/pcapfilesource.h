@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "pcap_utils.h"
+
+#include <json11.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <sys/time.h>
+
+namespace trailofbits {
+class PcapFileSource;
+
+/// A reference to a PcapFileSource object
+using PcapFileSourceRef = std::unique_ptr<PcapFileSource>;
+
+/// How the packets of a capture file are paced
+enum class PcapReplayTiming {
+  /// Packets are read as fast as the pipeline can process them
+  Max,
+
+  /// Packets are read with the same intervals they were captured with
+  Original
+};
+
+/// File source settings
+struct PcapFileSourceSettings final {
+  /// A capture file, or a folder of rotated captures
+  std::string path;
+
+  /// Replay timing
+  PcapReplayTiming timing{PcapReplayTiming::Max};
+};
+
+/// Returns true if the given settings are the same
+bool operator==(const PcapFileSourceSettings& lhs,
+                const PcapFileSourceSettings& rhs);
+
+/// A packet read from a capture file
+struct PcapFilePacket final {
+  /// When the packet has been captured
+  timeval timestamp{};
+
+  /// Link type of the file the packet has been read from
+  pcpp::LinkLayerType link_type{pcpp::LINKTYPE_NULL};
+
+  /// Packet data; only valid until the next packet is read
+  const std::uint8_t* data{nullptr};
+
+  /// Captured size, in bytes
+  std::size_t size{0U};
+};
+
+/// The outcome of PcapFileSource::nextPacket()
+enum class PcapFileReadResult {
+  /// A packet has been read
+  Packet,
+
+  /// The next packet is not due yet; it is returned by a later call
+  Pending,
+
+  /// All the files have been read
+  EndOfReplay
+};
+
+/// Replays a pcap or pcapng file, or all the capture files inside a folder
+/// (in natural name order, so that "dns.pcap2" comes before "dns.pcap10").
+/// Files that can't be read are skipped
+class PcapFileSource final {
+  struct PrivateData;
+
+  /// Private class data
+  std::unique_ptr<PrivateData> d;
+
+  /// Private constructor; use the ::create() static function instead
+  PcapFileSource(const PcapFileSourceSettings& settings,
+                 const std::string& filter_rules);
+
+  /// Opens the next file in the list; returns false when there are no
+  /// more files to read
+  bool openNextFile();
+
+ public:
+  /// Factory function used to create PcapFileSource objects; the folder is
+  /// listed immediately, while the files are opened one at a time
+  static osquery::Status create(PcapFileSourceRef& obj,
+                                const PcapFileSourceSettings& settings,
+                                const std::string& filter_rules);
+
+  /// Reads the settings from the given JSON object
+  static osquery::Status parseSettings(PcapFileSourceSettings& settings,
+                                       const json11::Json& configuration);
+
+  /// Destructor
+  ~PcapFileSource();
+
+  /// Returns the settings used to create the source
+  const PcapFileSourceSettings& settings() const;
+
+  /// Reads the next packet. When replaying with the original timing and
+  /// the packet is not due yet, `wait_time` is set to how long the caller
+  /// should wait before trying again
+  PcapFileReadResult nextPacket(PcapFilePacket& packet,
+                                std::chrono::milliseconds& wait_time);
+
+  /// Returns how many files have been opened so far
+  std::size_t fileCount() const;
+
+  /// Returns how many packets have been read so far
+  std::uint64_t packetCount() const;
+
+  /// Disable the copy constructor
+  PcapFileSource(const PcapFileSource& other) = delete;
+
+  /// Disable the assignment operator
+  PcapFileSource& operator=(const PcapFileSource& other) = delete;
+};
+} // namespace trailofbits
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pcaphandlepool.h"
+
+#include <osquery/logger.h>
+
+#include <map>
+#include <mutex>
+#include <utility>
+
+namespace trailofbits {
+namespace {
+/// Handles are indexed by interface name and promiscuous mode
+using PcapHandleKey = std::pair<std::string, bool>;
+
+/// Mutes the given handle by installing a filter that rejects all packets
+bool mutePcapHandle(PcapRef& handle) {
+  struct bpf_insn reject_all_instruction = BPF_STMT(BPF_RET | BPF_K, 0);
+  struct bpf_program reject_all_program = {1U, &reject_all_instruction};
+
+  return pcap_setfilter(handle.get(), &reject_all_program) == 0;
+}
+} // namespace
+
+/// Private class data
+struct PcapHandlePool::PrivateData final {
+  /// Capture buffer size used for new handles
+  int capture_buffer_size{0};
+
+  /// Capture timeout used for new handles
+  int capture_timeout{0};
+
+  /// Mutex used to protect the handle map
+  mutable std::mutex mutex;
+
+  /// Idle handles
+  std::multimap<PcapHandleKey, PcapRef> handle_map;
+};
+
+PcapHandlePool::PcapHandlePool(int capture_buffer_size, int capture_timeout)
+    : d(new PrivateData) {
+  d->capture_buffer_size = capture_buffer_size;
+  d->capture_timeout = capture_timeout;
+}
+
+osquery::Status PcapHandlePool::create(PcapHandlePoolRef& obj,
+                                       int capture_buffer_size,
+                                       int capture_timeout) {
+  try {
+    auto ptr = new PcapHandlePool(capture_buffer_size, capture_timeout);
+    obj.reset(ptr);
+
+    return osquery::Status(0);
+
+  } catch (const std::bad_alloc&) {
+    return osquery::Status::failure("Memory allocation failure");
+
+  } catch (const osquery::Status& status) {
+    return status;
+  }
+}
+
+PcapHandlePool::~PcapHandlePool() {}
+
+osquery::Status PcapHandlePool::preopen(
+    const std::vector<std::string>& interface_list, bool promiscuous_mode) {
+  for (const auto& interface_name : interface_list) {
+    {
+      std::lock_guard<std::mutex> lock(d->mutex);
+
+      auto key = std::make_pair(interface_name, promiscuous_mode);
+      if (d->handle_map.count(key) != 0U) {
+        continue;
+      }
+    }
+
+    DeclarePcapRef(handle);
+    auto status = createPcap(handle,
+                             interface_name,
+                             d->capture_buffer_size,
+                             d->capture_timeout,
+                             promiscuous_mode);
+
+    if (!status.ok()) {
+      return osquery::Status::failure("Failed to open the '" + interface_name +
+                                      "' interface: " + status.getMessage());
+    }
+
+    release(std::move(handle), interface_name, promiscuous_mode);
+  }
+
+  return osquery::Status(0);
+}
+
+osquery::Status PcapHandlePool::acquire(PcapRef& handle,
+                                        const std::string& interface_name,
+                                        bool promiscuous_mode) {
+  {
+    std::lock_guard<std::mutex> lock(d->mutex);
+
+    auto key = std::make_pair(interface_name, promiscuous_mode);
+
+    auto it = d->handle_map.find(key);
+    if (it != d->handle_map.end()) {
+      handle = std::move(it->second);
+      d->handle_map.erase(it);
+
+      return osquery::Status(0);
+    }
+  }
+
+  return createPcap(handle,
+                    interface_name,
+                    d->capture_buffer_size,
+                    d->capture_timeout,
+                    promiscuous_mode);
+}
+
+void PcapHandlePool::release(PcapRef handle,
+                             const std::string& interface_name,
+                             bool promiscuous_mode) {
+  if (!handle) {
+    return;
+  }
+
+  if (!mutePcapHandle(handle)) {
+    LOG(WARNING) << "Failed to mute the pcap handle for the '" << interface_name
+                 << "' interface; it will be closed";
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(d->mutex);
+
+  d->handle_map.insert(
+      {std::make_pair(interface_name, promiscuous_mode), std::move(handle)});
+}
+
+std::size_t PcapHandlePool::idleHandleCount() const {
+  std::lock_guard<std::mutex> lock(d->mutex);
+  return d->handle_map.size();
+}
+} // namespace trailofbits
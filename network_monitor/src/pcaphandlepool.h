@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "pcap_utils.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace trailofbits {
+class PcapHandlePool;
+
+/// A reference to a PcapHandlePool object
+using PcapHandlePoolRef = std::unique_ptr<PcapHandlePool>;
+
+/// Keeps pcap handles that have been opened while the extension was still
+/// running as root, so that the capture can be moved to a different interface
+/// after privileges have been dropped
+class PcapHandlePool final {
+  struct PrivateData;
+
+  /// Private class data
+  std::unique_ptr<PrivateData> d;
+
+  /// Private constructor; use the ::create() static function instead
+  PcapHandlePool(int capture_buffer_size, int capture_timeout);
+
+ public:
+  /// Factory function used to create PcapHandlePool objects
+  static osquery::Status create(PcapHandlePoolRef& obj,
+                                int capture_buffer_size,
+                                int capture_timeout);
+
+  /// Destructor
+  ~PcapHandlePool();
+
+  /// Opens a handle for each one of the given interfaces; this requires
+  /// root privileges
+  osquery::Status preopen(const std::vector<std::string>& interface_list,
+                          bool promiscuous_mode);
+
+  /// Returns a pre-opened handle for the given interface, or opens a new one
+  /// if none is available
+  osquery::Status acquire(PcapRef& handle,
+                          const std::string& interface_name,
+                          bool promiscuous_mode);
+
+  /// Returns a handle to the pool; a filter that rejects all packets is
+  /// installed, so that it will not consume memory while it is not used
+  void release(PcapRef handle,
+               const std::string& interface_name,
+               bool promiscuous_mode);
+
+  /// Returns the amount of idle handles
+  std::size_t idleHandleCount() const;
+
+  /// Disable the copy constructor
+  PcapHandlePool(const PcapHandlePool& other) = delete;
+
+  /// Disable the assignment operator
+  PcapHandlePool& operator=(const PcapHandlePool& other) = delete;
+};
+} // namespace trailofbits
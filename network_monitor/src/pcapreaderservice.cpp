@@ -15,15 +15,18 @@
  */
 
 #include "pcapreaderservice.h"
+#include "dnsdecoder.h"
 
+#include <algorithm>
+#include <chrono>
 #include <sstream>
 
-#include <IPv4Layer.h>
-#include <IPv6Layer.h>
-#include <TcpLayer.h>
+#include <pubsub/settingsutils.h>
 
 #include <osquery/logger.h>
 
+#include <unistd.h>
+
 namespace trailofbits {
 namespace {
 /// Capture buffer size
@@ -34,6 +37,58 @@ const int kCaptureBufferTimeout = 1000;
 
 /// The eBPF program used to filter the packets
 const std::string kFilterRules = "port 53 and (tcp or udp)";
+
+/// How many of the packets already queued in the capture buffer are still
+/// read once the service has been asked to terminate
+const std::size_t kMaxShutdownPacketCount = 65536U;
+
+/// Default size of the TPACKET_V3 capture ring, in MiB (one block per MiB)
+const std::size_t kDefaultCaptureRingSize = 64U;
+
+/// Largest TPACKET_V3 capture ring, in MiB; each capture worker maps its own
+const std::size_t kMaxCaptureRingSize = 1024U;
+
+/// How long the reader sleeps when the next ring block is still referenced
+/// by requests that the publisher has not processed yet
+const std::chrono::milliseconds kCaptureRingBackoffTime(10);
+
+/// How many packets are read from the capture files before they are handed
+/// over to the publisher
+const std::size_t kFileReplayBatchSize = 4096U;
+
+/// How many UDP requests may be waiting for the publisher before the replay
+/// is paused
+const std::size_t kMaxFileReplayBacklog = 65536U;
+
+/// How long the replay is paused when the publisher is behind
+const std::chrono::milliseconds kFileReplayBackoffTime(10);
+
+/// Prints the addresses of the captured interface
+void logInterfaceAddresses(const NetworkDeviceInformation& device_information) {
+  if (!device_information.ipv4_address_list.empty()) {
+    std::stringstream log_message;
+
+    log_message << "Listening on the following IPv4 addresses:";
+    for (const auto& network_address : device_information.ipv4_address_list) {
+      log_message << " " << network_address.address << "/"
+                  << network_address.netmask;
+    }
+
+    LOG(INFO) << log_message.str();
+  }
+
+  if (!device_information.ipv6_address_list.empty()) {
+    std::stringstream log_message;
+
+    log_message << "Listening on the following IPv6 addresses:";
+    for (const auto& network_address : device_information.ipv6_address_list) {
+      log_message << " " << network_address.address << "/"
+                  << network_address.netmask;
+    }
+
+    LOG(INFO) << log_message.str();
+  }
+}
 } // namespace
 
 void PcapReaderService::onTcpMessageReady(int side,
@@ -76,7 +131,7 @@ void PcapReaderService::onTcpConnectionStart(
   auto& conversation = getPendingTcpConversation(conversation_id);
 
   conversation.connection_data = connection_data;
-  gettimeofday(&conversation.event_time, nullptr);
+  conversation.event_time = current_packet_timestamp;
 
   tcp_conversation_timestamp_map[conversation_id] = std::time(nullptr);
 }
@@ -111,15 +166,262 @@ TcpConversation& PcapReaderService::getPendingTcpConversation(
   return conversation;
 }
 
-PcapReaderService::PcapReaderService(PcapReaderServiceData& shared_data_)
-    : shared_data(shared_data_) {}
+void PcapReaderService::dropPendingTcpConversations() {
+  if (pending_tcp_conversation_map.empty()) {
+    return;
+  }
+
+  LOG(WARNING) << "Dropping " << pending_tcp_conversation_map.size()
+               << " pending TCP conversations";
+
+  // Clear the maps first, so that the connection end callbacks will not
+  // move the conversations to the completed list
+  pending_tcp_conversation_map.clear();
+  tcp_conversation_timestamp_map.clear();
+
+  tcp_reassembler->closeAllConnections();
+}
+
+osquery::Status PcapReaderService::setupPcapCapture(PcapCapture& new_capture) {
+  auto status = getPcapLinkType(new_capture.link_type, new_capture.handle);
+  if (!status.ok()) {
+    return status;
+  }
+
+  NetworkDeviceInformation device_information;
+  status = getNetworkDeviceInformation(device_information,
+                                       new_capture.interface_name);
+  if (!status.ok()) {
+    return status;
+  }
+
+  logInterfaceAddresses(device_information);
+
+  return setPcapFilter(new_capture.handle, kFilterRules);
+}
+
+osquery::Status PcapReaderService::configureCaptureRing(
+    const std::string& interface_name,
+    bool promiscuous_mode,
+    std::size_t ring_size) {
+  std::lock_guard<std::mutex> lock(pcap_mutex);
+
+  if (capture_ring) {
+    if (capture.interface_name == interface_name &&
+        capture.promiscuous_mode == promiscuous_mode) {
+      return osquery::Status(0);
+    }
+
+  } else {
+    // The socket can only be created while we are still running as root;
+    // binding it to a different interface later does not require privileges
+    TPacketRingSettings ring_settings;
+    ring_settings.block_count = ring_size;
+
+    auto status = TPacketRing::create(capture_ring, ring_settings);
+    if (!status.ok()) {
+      return status;
+    }
+
+    status = capture_ring->setFilter(kFilterRules);
+    if (!status.ok()) {
+      capture_ring.reset();
+      return status;
+    }
+  }
+
+  // Rings in a fanout group can't be bound again; the publisher requests a
+  // restart instead of changing the interfaces of multiple workers
+  auto status = capture_ring->bind(interface_name, promiscuous_mode);
+  if (!status.ok()) {
+    return status;
+  }
+
+  if (worker_settings.fanout_size > 1U) {
+    auto& fanout_group = *worker_settings.fanout_group;
+    std::lock_guard<std::mutex> fanout_group_lock(fanout_group.mutex);
+
+    if (fanout_group.created) {
+      status = capture_ring->joinFanoutGroup(fanout_group.id);
+    } else {
+      status = capture_ring->createFanoutGroup(fanout_group.id);
+      fanout_group.created = status.ok();
+    }
+
+    if (!status.ok()) {
+      return status;
+    }
+  }
+
+  capture.interface_name = interface_name;
+  capture.promiscuous_mode = promiscuous_mode;
+  capture.link_type = pcpp::LINKTYPE_ETHERNET;
+  capture_ring_rebound = true;
+
+  NetworkDeviceInformation device_information;
+  if (getNetworkDeviceInformation(device_information, interface_name).ok()) {
+    logInterfaceAddresses(device_information);
+  }
+
+  LOG(INFO) << "Capturing DNS traffic from the '" << interface_name
+            << "' interface (TPACKET_V3 ring, " << name() << ")";
+
+  return osquery::Status(0);
+}
+
+void PcapReaderService::processPacket(
+    UDPRequestList& new_udp_requests,
+    const timeval& timestamp,
+    const std::uint8_t* packet_data,
+    std::size_t packet_size,
+    pcpp::LinkLayerType link_type,
+    std::shared_ptr<const void> packet_owner) {
+  current_packet_timestamp = timestamp;
+
+  // Only TCP packets go through Pcap++; UDP packets are classified with a
+  // plain header walk, and are decoded later by the publisher
+  TransportLayerInfo transport_layer;
+  locateTransportLayer(transport_layer, packet_data, packet_size, link_type);
+
+  if (transport_layer.protocol == pcpp::UDP) {
+    // Packets read through libpcap are only valid until the next one is
+    // read, so they have to be copied
+    if (!packet_owner) {
+      auto packet_copy =
+          std::make_shared<ByteVector>(packet_data, packet_data + packet_size);
+
+      packet_data = packet_copy->data();
+      packet_owner = std::move(packet_copy);
+    }
+
+    UDPRequest udp_request;
+    udp_request.timestamp = timestamp;
+    udp_request.link_type = link_type;
+    udp_request.packet_data = packet_data;
+    udp_request.packet_size = packet_size;
+    udp_request.packet_owner = std::move(packet_owner);
+
+    new_udp_requests.push_back(std::move(udp_request));
+
+  } else if (shared_data.shed_tcp_reassembly && !replaying_file) {
+    // TCP reassembly is the most expensive step, so it is the first one
+    // to go when the publisher buffers are full
+    dropPendingTcpConversations();
+
+  } else if (transport_layer.protocol == pcpp::TCP) {
+    pcpp::RawPacket raw_packet(packet_data,
+                               static_cast<int>(packet_size),
+                               timestamp,
+                               false,
+                               link_type);
+
+    tcp_reassembler->reassemblePacket(&raw_packet);
+  }
+}
+
+osquery::Status PcapReaderService::configureFileSource(
+    const PcapFileSourceSettings& settings) {
+  {
+    std::lock_guard<std::mutex> lock(pcap_mutex);
+
+    const auto& requested_source =
+        pending_file_source ? pending_file_source : file_source;
+
+    if (requested_source && requested_source->settings() == settings) {
+      return osquery::Status(0);
+    }
+  }
+
+  PcapFileSourceRef new_file_source;
+  auto status =
+      PcapFileSource::create(new_file_source, settings, kFilterRules);
+
+  if (!status.ok()) {
+    return status;
+  }
+
+  std::lock_guard<std::mutex> lock(pcap_mutex);
+  pending_file_source = std::move(new_file_source);
 
-osquery::Status PcapReaderService::initialize() {
   return osquery::Status(0);
 }
 
+bool PcapReaderService::waitForReplayBacklog() {
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> lock(shared_data.mutex);
+
+      if (shared_data.udp_request_list.size() < kMaxFileReplayBacklog &&
+          !shared_data.shed_tcp_reassembly) {
+        return false;
+      }
+    }
+
+    if (waitForTermination(kFileReplayBackoffTime)) {
+      return true;
+    }
+  }
+}
+
+void PcapReaderService::updateCaptureRingMetrics() {
+  TPacketRingStatistics statistics;
+
+  {
+    std::lock_guard<std::mutex> lock(pcap_mutex);
+    if (!capture_ring) {
+      return;
+    }
+
+    statistics = capture_ring->statistics();
+  }
+
+  captured_packet_count->add(statistics.packet_count);
+  dropped_packet_count->add(statistics.drop_count);
+}
+
+PcapReaderService::PcapReaderService(
+    PcapReaderServiceData& shared_data_,
+    const PcapReaderWorkerSettings& worker_settings_)
+    : shared_data(shared_data_), worker_settings(worker_settings_) {
+  static auto L_onTcpMessageReady =
+      [](int side, pcpp::TcpStreamData tcp_data, void* user_cookie) -> void {
+    auto& service = *reinterpret_cast<PcapReaderService*>(user_cookie);
+    service.onTcpMessageReady(side, tcp_data);
+  };
+
+  static auto L_onTcpConnectionStart = [](pcpp::ConnectionData connection_data,
+                                          void* user_cookie) -> void {
+    auto& service = *reinterpret_cast<PcapReaderService*>(user_cookie);
+    service.onTcpConnectionStart(connection_data);
+  };
+
+  static auto L_onTcpConnectionEnd =
+      [](pcpp::ConnectionData connection_data,
+         pcpp::TcpReassembly::ConnectionEndReason reason,
+         void* user_cookie) -> void {
+    auto& service = *reinterpret_cast<PcapReaderService*>(user_cookie);
+    service.onTcpConnectionEnd(connection_data, reason);
+  };
+
+  tcp_reassembler = std::make_unique<pcpp::TcpReassembly>(
+      L_onTcpMessageReady, this, L_onTcpConnectionStart, L_onTcpConnectionEnd);
+
+  auto& metrics_registry = MetricsRegistry::instance();
+
+  captured_packet_count =
+      metrics_registry.counter("service", name(), "captured_packets");
+
+  dropped_packet_count =
+      metrics_registry.counter("service", name(), "dropped_packets");
+}
+
+osquery::Status PcapReaderService::initialize() {
+  return PcapHandlePool::create(
+      handle_pool, kCaptureBufferSize, kCaptureBufferTimeout);
+}
+
 osquery::Status PcapReaderService::configure(
-    const json11::Json& configuration) {
+    const json11::Json& configuration, const std::string& interface_name) {
   if (!configuration.is_object()) {
     LOG(ERROR) << "Invalid configuration";
     return osquery::Status(0);
@@ -131,18 +433,40 @@ osquery::Status PcapReaderService::configure(
     return osquery::Status(0);
   }
 
-  const auto& interface_name_obj = dns_event_configuration["interface"];
-  if (interface_name_obj == json11::Json()) {
-    LOG(ERROR)
-        << "The 'interface' value is missing from the 'dns_events' section";
+  auto requested_engine = CaptureEngine::Pcap;
 
-    return osquery::Status(0);
+  const auto& capture_engine_obj = dns_event_configuration["capture_engine"];
+  if (capture_engine_obj != json11::Json()) {
+    const auto& engine_name = capture_engine_obj.string_value();
+
+    if (engine_name == "tpacket_v3") {
+      requested_engine = CaptureEngine::TPacketV3;
+
+    } else if (engine_name == "file") {
+      requested_engine = CaptureEngine::File;
+
+    } else if (engine_name != "pcap") {
+      return osquery::Status::failure("Invalid capture engine: '" +
+                                      engine_name + "'");
+    }
   }
 
-  auto interface_name = interface_name_obj.string_value();
+  auto ring_size = kDefaultCaptureRingSize;
 
+  // The size becomes the block count of the ring, and the size of its mapping
+  auto status = getSizeSetting(ring_size,
+                               dns_event_configuration,
+                               "ring_size",
+                               1U,
+                               kMaxCaptureRingSize);
+  if (!status.ok()) {
+    return status;
+  }
+
+  // Replays do not capture any interface
   const auto& promiscuous_mode_obj = dns_event_configuration["promiscuous"];
-  if (promiscuous_mode_obj == json11::Json()) {
+  if (promiscuous_mode_obj == json11::Json() &&
+      requested_engine != CaptureEngine::File) {
     LOG(ERROR)
         << "The 'promiscuous' value is missing from the 'dns_events' section";
 
@@ -160,7 +484,7 @@ osquery::Status PcapReaderService::configure(
     return osquery::Status(0);
   }
 
-  max_tcp_conversation_length =
+  auto max_tcp_conv_length =
       static_cast<std::size_t>(max_tcp_conv_length_obj.int_value());
 
   const auto& max_tcp_conv_idle_time_obj =
@@ -172,160 +496,195 @@ osquery::Status PcapReaderService::configure(
     return osquery::Status(0);
   }
 
-  max_tcp_conversation_idle_time =
+  auto max_tcp_conv_idle_time =
       static_cast<std::size_t>(max_tcp_conv_idle_time_obj.int_value());
 
-  std::lock_guard<std::mutex> lock(pcap_mutex);
+  // Workers can only share an interface through an AF_PACKET fanout group
+  if (worker_settings.fanout_size > 1U &&
+      requested_engine != CaptureEngine::TPacketV3) {
+    return osquery::Status::failure(
+        "Multiple capture workers require the tpacket_v3 capture engine");
+  }
 
-  auto status = createPcap(pcap,
-                           interface_name,
-                           kCaptureBufferSize,
-                           kCaptureBufferTimeout,
-                           promiscuous_mode);
+  PcapFileSourceSettings file_source_settings;
+  if (requested_engine == CaptureEngine::File) {
+    status = PcapFileSource::parseSettings(
+        file_source_settings, dns_event_configuration["capture_file"]);
 
-  if (!status.ok()) {
-    return status;
+    if (!status.ok()) {
+      return status;
+    }
   }
 
-  auto pcap_link_type = pcap_datalink(pcap.get());
-  if (pcap_link_type == PCAP_ERROR_NOT_ACTIVATED) {
-    return osquery::Status::failure(
-        "Failed to acquire the link-layer header type");
-  }
+  {
+    std::lock_guard<std::mutex> lock(pcap_mutex);
 
-  bool valid_link_header_type = false;
-  switch (pcap_link_type) {
-  case DLT_IPV4: {
-    shared_data.link_type = pcpp::LINKTYPE_IPV4;
-    valid_link_header_type = true;
-    break;
+    // Handles (and the ring) can only be opened while we are still running
+    // as root, so the engine can't be changed later on
+    if (capture_engine_selected && requested_engine != capture_engine) {
+      return osquery::Status::failure(
+          "The capture engine can't be changed while the extension is "
+          "running");
+    }
   }
 
-  case DLT_IPV6: {
-    shared_data.link_type = pcpp::LINKTYPE_IPV6;
-    valid_link_header_type = true;
-    break;
-  }
+  // These settings do not require a new pcap handle, and are picked up by the
+  // reader thread immediately
+  max_tcp_conversation_length = max_tcp_conv_length;
+  max_tcp_conversation_idle_time = max_tcp_conv_idle_time;
 
-  case DLT_EN10MB: {
-    shared_data.link_type = pcpp::LINKTYPE_ETHERNET;
-    valid_link_header_type = true;
-    break;
-  }
+  if (requested_engine == CaptureEngine::File) {
+    status = configureFileSource(file_source_settings);
+    if (!status.ok()) {
+      return status;
+    }
 
-  default:
-    break;
-  }
+    std::lock_guard<std::mutex> lock(pcap_mutex);
+    capture_engine = requested_engine;
+    capture_engine_selected = true;
 
-  if (!valid_link_header_type) {
-    return osquery::Status::failure("Invalid link-layer header type");
+    return osquery::Status(0);
   }
 
-  status = getNetworkDeviceInformation(device_information, interface_name);
-  if (!status.ok()) {
-    return status;
+  if (requested_engine == CaptureEngine::TPacketV3) {
+    status = configureCaptureRing(interface_name, promiscuous_mode, ring_size);
+    if (!status.ok()) {
+      return status;
+    }
+
+    std::lock_guard<std::mutex> lock(pcap_mutex);
+    capture_engine = requested_engine;
+    capture_engine_selected = true;
+
+    return osquery::Status(0);
   }
 
-  if (!device_information.ipv4_address_list.empty()) {
-    std::stringstream log_message;
+  bool first_configuration = false;
 
-    log_message << "Listening on the following IPv4 addresses:";
-    for (const auto& network_address : device_information.ipv4_address_list) {
-      log_message << " " << network_address.address << "/"
-                  << network_address.netmask;
+  {
+    std::lock_guard<std::mutex> lock(pcap_mutex);
+
+    const auto& requested_capture =
+        pending_capture.handle ? pending_capture : capture;
+
+    if (requested_capture.handle &&
+        requested_capture.interface_name == interface_name &&
+        requested_capture.promiscuous_mode == promiscuous_mode) {
+      return osquery::Status(0);
     }
 
-    LOG(INFO) << log_message.str();
+    first_configuration = !requested_capture.handle;
   }
 
-  if (!device_information.ipv6_address_list.empty()) {
-    std::stringstream log_message;
-
-    log_message << "Listening on the following IPv6 addresses:";
-    for (const auto& network_address : device_information.ipv6_address_list) {
-      log_message << " " << network_address.address << "/"
-                  << network_address.netmask;
+  // New handles can only be opened while we are still running as root, so
+  // open all the interfaces we may be asked to switch to later
+  if (first_configuration) {
+    std::vector<std::string> interface_list = {interface_name};
+    for (const auto& interface_obj :
+         dns_event_configuration["preopened_interfaces"].array_items()) {
+      interface_list.push_back(interface_obj.string_value());
     }
 
-    LOG(INFO) << log_message.str();
+    status = handle_pool->preopen(interface_list, promiscuous_mode);
+    if (!status.ok()) {
+      return status;
+    }
   }
 
-  if (pcap_compile(pcap.get(),
-                   &ebpf_filter_program,
-                   kFilterRules.c_str(),
-                   1,
-                   PCAP_NETMASK_UNKNOWN) != 0) {
-    auto error_message = std::string("Failed to compile the eBPF filter: ") +
-                         pcap_geterr(pcap.get());
+  PcapCapture new_capture;
+  new_capture.interface_name = interface_name;
+  new_capture.promiscuous_mode = promiscuous_mode;
 
-    return osquery::Status::failure(error_message);
+  status = handle_pool->acquire(
+      new_capture.handle, interface_name, promiscuous_mode);
+  if (!status.ok()) {
+    return status;
   }
 
-  if (pcap_setfilter(pcap.get(), &ebpf_filter_program) != 0) {
-    auto error_message =
-        std::string("Failed to enable the eBPF filter program: ") +
-        pcap_geterr(pcap.get());
+  status = setupPcapCapture(new_capture);
+  if (!status.ok()) {
+    handle_pool->release(
+        std::move(new_capture.handle), interface_name, promiscuous_mode);
 
-    return osquery::Status::failure(error_message);
+    return status;
   }
 
-  static auto L_onTcpMessageReady =
-      [](int side, pcpp::TcpStreamData tcp_data, void* user_cookie) -> void {
-    auto& service = *reinterpret_cast<PcapReaderService*>(user_cookie);
-    service.onTcpMessageReady(side, tcp_data);
-  };
+  LOG(INFO) << "Capturing DNS traffic from the '" << interface_name
+            << "' interface";
 
-  static auto L_onTcpConnectionStart = [](pcpp::ConnectionData connection_data,
-                                          void* user_cookie) -> void {
-    auto& service = *reinterpret_cast<PcapReaderService*>(user_cookie);
-    service.onTcpConnectionStart(connection_data);
-  };
+  std::lock_guard<std::mutex> lock(pcap_mutex);
 
-  static auto L_onTcpConnectionEnd =
-      [](pcpp::ConnectionData connection_data,
-         pcpp::TcpReassembly::ConnectionEndReason reason,
-         void* user_cookie) -> void {
-    auto& service = *reinterpret_cast<PcapReaderService*>(user_cookie);
-    service.onTcpConnectionEnd(connection_data, reason);
-  };
+  handle_pool->release(std::move(pending_capture.handle),
+                       pending_capture.interface_name,
+                       pending_capture.promiscuous_mode);
 
-  tcp_reassembler = std::make_unique<pcpp::TcpReassembly>(
-      L_onTcpMessageReady, this, L_onTcpConnectionStart, L_onTcpConnectionEnd);
+  pending_capture = std::move(new_capture);
+
+  capture_engine = requested_engine;
+  capture_engine_selected = true;
 
   return osquery::Status(0);
 }
 
 void PcapReaderService::release() {}
 
-void PcapReaderService::run() {
-  while (!shouldTerminate()) {
-    // Acquire as many packets as we can
-    UDPRequestList new_udp_requests = {};
+std::string PcapReaderService::name() const {
+  if (worker_settings.worker_count == 1U) {
+    return "pcap_reader";
+  }
 
-    while (!shouldTerminate()) {
-      pcap_pkthdr* packet_header = nullptr;
-      const std::uint8_t* packet_data_buffer = nullptr;
-      bool uninitialized = true;
+  return "pcap_reader_" + std::to_string(worker_settings.worker_index);
+}
 
-      {
-        std::lock_guard<std::mutex> lock(pcap_mutex);
+bool PcapReaderService::runPcapCapture(UDPRequestList& new_udp_requests) {
+  std::size_t shutdown_packet_count{0U};
 
-        if (pcap) {
-          uninitialized = false;
+  for (;;) {
+    // When terminating, only drain what has already been captured
+    bool terminating = shouldTerminate();
+    if (terminating && shutdown_packet_count++ >= kMaxShutdownPacketCount) {
+      return true;
+    }
 
-          bool timed_out = false;
-          auto status = waitForNewPackets(timed_out, pcap, 1000U);
-          if (!status.ok()) {
-            LOG(ERROR) << "Failed to capture the next packet: "
-                       << status.getMessage();
+    pcap_pkthdr* packet_header = nullptr;
+    const std::uint8_t* packet_data_buffer = nullptr;
+    pcpp::LinkLayerType link_type{pcpp::LINKTYPE_NULL};
+    bool uninitialized = true;
+    bool timed_out = false;
+    bool capture_changed = false;
+
+    {
+      std::lock_guard<std::mutex> lock(pcap_mutex);
+
+      if (pending_capture.handle) {
+        // Switch to the new capture handle; the old one is returned to the
+        // pool, so that we can go back to it later
+        capture_changed = static_cast<bool>(capture.handle);
+        std::swap(capture, pending_capture);
+
+        handle_pool->release(std::move(pending_capture.handle),
+                             pending_capture.interface_name,
+                             pending_capture.promiscuous_mode);
+      }
 
-            return;
-          }
+      if (capture.handle) {
+        uninitialized = false;
+        link_type = capture.link_type;
 
-          if (timed_out) {
-            break;
-          }
+        auto& pcap = capture.handle;
+
+        auto status =
+            terminating
+                ? waitForNewPackets(timed_out, pcap, 0U)
+                : waitForNewPackets(timed_out, pcap, 1000U, wakeupDescriptor());
+        if (!status.ok()) {
+          LOG(ERROR) << "Failed to capture the next packet: "
+                     << status.getMessage();
+
+          return false;
+        }
 
+        if (!timed_out) {
           auto capture_error =
               pcap_next_ex(pcap.get(), &packet_header, &packet_data_buffer);
 
@@ -333,108 +692,349 @@ void PcapReaderService::run() {
             LOG(ERROR) << "Failed to capture the next packet: "
                        << pcap_geterr(pcap.get()) << ". Halting...";
 
-            return;
+            return false;
           }
+
+          // The timeout has expired before a packet could be read
+          timed_out = (capture_error == 0);
         }
       }
+    }
+
+    // Conversations from the previous interface can't be completed anymore
+    if (capture_changed) {
+      dropPendingTcpConversations();
+    }
+
+    if (uninitialized) {
+      waitForTermination(std::chrono::seconds(2));
+      return true;
+    }
 
-      if (uninitialized) {
-        std::this_thread::sleep_for(std::chrono::seconds(2));
+    if (timed_out) {
+      // Woken up by the service manager; drain the capture buffer
+      if (!terminating && shouldTerminate()) {
         continue;
       }
 
-      pcpp::RawPacket raw_packet(packet_data_buffer,
-                                 static_cast<int>(packet_header->len),
-                                 packet_header->ts,
-                                 false,
-                                 shared_data.link_type);
+      return true;
+    }
 
-      pcpp::Packet packet(&raw_packet);
+    processPacket(new_udp_requests,
+                  packet_header->ts,
+                  packet_data_buffer,
+                  packet_header->caplen,
+                  link_type,
+                  nullptr);
+  }
+}
 
-      if (packet.isPacketOfType(pcpp::UDP)) {
-        ByteVector udp_request_data(packet_header->len);
-        udp_request_data.assign(packet_data_buffer,
-                                packet_data_buffer + packet_header->len);
+bool PcapReaderService::runRingCapture(UDPRequestList& new_udp_requests) {
+  std::size_t shutdown_packet_count{0U};
+  bool capture_ring_readable = false;
 
-        auto udp_request =
-            std::make_pair(packet_header->ts, std::move(udp_request_data));
+  for (;;) {
+    // When terminating, only drain what has already been captured
+    bool terminating = shouldTerminate();
+    if (terminating && shutdown_packet_count++ >= kMaxShutdownPacketCount) {
+      return true;
+    }
 
-        new_udp_requests.push_back(std::move(udp_request));
+    pcpp::LinkLayerType link_type{pcpp::LINKTYPE_NULL};
+    bool capture_changed = false;
 
-      } else {
-        bool process_packet = false;
-        if (packet.isPacketOfType(pcpp::IPv4) ||
-            packet.isPacketOfType(pcpp::IPv6)) {
-          process_packet = (packet.getLayerOfType<pcpp::TcpLayer>() != nullptr);
-        }
+    TPacketBlockRef ring_block;
+    int ring_fd{-1};
 
-        if (process_packet) {
-          tcp_reassembler->reassemblePacket(&raw_packet);
-        }
+    {
+      std::lock_guard<std::mutex> lock(pcap_mutex);
+
+      // The ring is never destroyed while the service is running, so its
+      // descriptor can be polled without holding the mutex
+      if (capture_ring) {
+        link_type = capture.link_type;
+
+        capture_changed = capture_ring_rebound;
+        capture_ring_rebound = false;
+
+        ring_fd = capture_ring->descriptor();
+        ring_block = capture_ring->nextBlock();
       }
     }
 
-    // Move new data into the shared structure so that the publisher can start
-    // emitting new rows into the table
-    if (!new_udp_requests.empty() || !completed_tcp_conversation_map.empty()) {
-      std::lock_guard<std::mutex> lock(shared_data.mutex);
+    // Conversations from the previous interface can't be completed anymore
+    if (capture_changed) {
+      dropPendingTcpConversations();
+    }
 
-      auto& udp_request_buffer = shared_data.udp_request_list;
-      if (!new_udp_requests.empty()) {
-        if (udp_request_buffer.empty()) {
-          udp_request_buffer = std::move(new_udp_requests);
-        } else {
-          udp_request_buffer.reserve(udp_request_buffer.size() +
-                                     new_udp_requests.size());
-
-          std::move(new_udp_requests.begin(),
-                    new_udp_requests.end(),
-                    std::back_inserter(udp_request_buffer));
-        }
+    if (ring_fd == -1) {
+      waitForTermination(std::chrono::seconds(2));
+      return true;
+    }
+
+    if (ring_block) {
+      // The UDP requests keep the block alive; it is returned to the
+      // kernel once the publisher has processed all of them
+      auto L_processPacket = [&](const timeval& timestamp,
+                                 const std::uint8_t* data,
+                                 std::size_t size) -> void {
+        processPacket(
+            new_udp_requests, timestamp, data, size, link_type, ring_block);
+      };
+
+      ring_block->forEachPacket(L_processPacket);
+      capture_ring_readable = false;
+
+      // Hand the block over right away, so that it can be released as soon
+      // as possible
+      if (terminating) {
+        continue;
+      }
+
+      return true;
+    }
+
+    // Only blocks that are ready are drained during shutdown
+    if (terminating) {
+      return true;
+    }
 
-        new_udp_requests.clear();
+    // The descriptor was readable, but the next block is still held by the
+    // publisher; wait for it instead of polling in a loop
+    if (capture_ring_readable) {
+      capture_ring_readable = false;
+
+      if (waitForTermination(kCaptureRingBackoffTime)) {
+        continue;
       }
 
-      auto& tcp_conversation_buffer =
-          shared_data.completed_tcp_conversation_map;
+      return true;
+    }
 
-      if (!completed_tcp_conversation_map.empty()) {
-        if (tcp_conversation_buffer.empty()) {
-          tcp_conversation_buffer = std::move(completed_tcp_conversation_map);
-        } else {
-          tcp_conversation_buffer.reserve(
-              tcp_conversation_buffer.size() +
-              completed_tcp_conversation_map.size());
+    bool timed_out = false;
+    auto status =
+        waitForDescriptor(timed_out, ring_fd, 1000U, wakeupDescriptor());
+    if (!status.ok()) {
+      LOG(ERROR) << "Failed to capture the next packet block: "
+                 << status.getMessage();
 
-          tcp_conversation_buffer.insert(completed_tcp_conversation_map.begin(),
-                                         completed_tcp_conversation_map.end());
-        }
+      return false;
+    }
 
-        completed_tcp_conversation_map.clear();
+    capture_ring_readable = !timed_out;
+    if (!timed_out || shouldTerminate()) {
+      continue;
+    }
+
+    return true;
+  }
+}
+
+bool PcapReaderService::runFileReplay(UDPRequestList& new_udp_requests) {
+  // Capture files are not limited by the capture rate; instead of letting
+  // the queue grow (or shedding events), wait for the publisher
+  if (replaying_file && waitForReplayBacklog()) {
+    return true;
+  }
+
+  std::size_t replayed_packet_count{0U};
+
+  // The files can be replayed again, so nothing is drained during shutdown
+  while (!shouldTerminate()) {
+    bool capture_changed = false;
+    auto file_read_result = PcapFileReadResult::Pending;
+    PcapFilePacket file_packet;
+    std::chrono::milliseconds file_wait_time(0);
+    bool uninitialized = true;
+
+    {
+      std::lock_guard<std::mutex> lock(pcap_mutex);
+
+      // A new file source restarts the replay from the beginning
+      if (pending_file_source) {
+        capture_changed = static_cast<bool>(file_source);
+        file_source = std::move(pending_file_source);
+        file_replay_completed = false;
       }
 
-      shared_data.cv.notify_all();
+      if (file_source) {
+        uninitialized = false;
+        file_read_result = file_source->nextPacket(file_packet, file_wait_time);
+      }
     }
 
-    auto current_time = std::time(nullptr);
+    if (capture_changed) {
+      dropPendingTcpConversations();
+    }
 
-    for (auto it = tcp_conversation_timestamp_map.begin();
-         it != tcp_conversation_timestamp_map.end();) {
-      const auto& conversation_id = it->first;
-      const auto& last_update = it->second;
+    if (uninitialized) {
+      waitForTermination(std::chrono::seconds(2));
+      break;
+    }
 
-      auto elapsed_time = static_cast<std::size_t>(current_time - last_update);
-      if (elapsed_time > max_tcp_conversation_idle_time) {
-        it = tcp_conversation_timestamp_map.erase(it);
+    replaying_file = true;
 
-        pending_tcp_conversation_map.erase(conversation_id);
-        tcp_reassembler->closeConnection(conversation_id);
+    if (file_read_result == PcapFileReadResult::Packet) {
+      processPacket(new_udp_requests,
+                    file_packet.timestamp,
+                    file_packet.data,
+                    file_packet.size,
+                    file_packet.link_type,
+                    nullptr);
 
-        LOG(WARNING) << "Dropping connection " << conversation_id;
-      } else {
-        ++it;
+      if (++replayed_packet_count < kFileReplayBatchSize) {
+        continue;
       }
+
+      break;
+    }
+
+    if (file_read_result == PcapFileReadResult::EndOfReplay &&
+        !file_replay_completed) {
+      file_replay_completed = true;
+
+      // Conversations still open at the end of the captures will not
+      // receive any more data; emit what they contain
+      tcp_reassembler->closeAllConnections();
+
+      LOG(INFO) << "The replay has been completed: "
+                << file_source->packetCount() << " packets read from "
+                << file_source->fileCount() << " capture files";
+    }
+
+    // Hand over what has been read so far before waiting
+    if (!new_udp_requests.empty() || !completed_tcp_conversation_map.empty()) {
+      break;
+    }
+
+    auto wait_time = std::chrono::milliseconds(1000);
+    if (file_read_result == PcapFileReadResult::Pending) {
+      wait_time = std::min(wait_time, file_wait_time);
+    }
+
+    if (waitForTermination(wait_time)) {
+      break;
+    }
+  }
+
+  if (replayed_packet_count != 0U) {
+    captured_packet_count->add(replayed_packet_count);
+  }
+
+  return true;
+}
+
+void PcapReaderService::handOverCapturedData(
+    UDPRequestList& new_udp_requests) {
+  if (new_udp_requests.empty() && completed_tcp_conversation_map.empty()) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(shared_data.mutex);
+
+  auto& udp_request_buffer = shared_data.udp_request_list;
+  if (!new_udp_requests.empty()) {
+    if (udp_request_buffer.empty()) {
+      udp_request_buffer = std::move(new_udp_requests);
+    } else {
+      udp_request_buffer.reserve(udp_request_buffer.size() +
+                                 new_udp_requests.size());
+
+      std::move(new_udp_requests.begin(),
+                new_udp_requests.end(),
+                std::back_inserter(udp_request_buffer));
+    }
+
+    new_udp_requests.clear();
+  }
+
+  auto& tcp_conversation_buffer = shared_data.completed_tcp_conversation_map;
+
+  if (!completed_tcp_conversation_map.empty()) {
+    if (tcp_conversation_buffer.empty()) {
+      tcp_conversation_buffer = std::move(completed_tcp_conversation_map);
+    } else {
+      tcp_conversation_buffer.reserve(tcp_conversation_buffer.size() +
+                                      completed_tcp_conversation_map.size());
+
+      tcp_conversation_buffer.insert(completed_tcp_conversation_map.begin(),
+                                     completed_tcp_conversation_map.end());
+    }
+
+    completed_tcp_conversation_map.clear();
+  }
+
+  shared_data.cv.notify_all();
+
+  if (shared_data.notification_fd != -1) {
+    std::uint64_t counter{1U};
+    if (write(shared_data.notification_fd, &counter, sizeof(counter)) !=
+        sizeof(counter)) {
+      LOG(ERROR) << "Failed to signal the DNS events publisher";
+    }
+  }
+}
+
+void PcapReaderService::dropIdleTcpConversations() {
+  auto current_time = std::time(nullptr);
+
+  for (auto it = tcp_conversation_timestamp_map.begin();
+       it != tcp_conversation_timestamp_map.end();) {
+    const auto& conversation_id = it->first;
+    const auto& last_update = it->second;
+
+    auto elapsed_time = static_cast<std::size_t>(current_time - last_update);
+    if (elapsed_time > max_tcp_conversation_idle_time) {
+      it = tcp_conversation_timestamp_map.erase(it);
+
+      pending_tcp_conversation_map.erase(conversation_id);
+      tcp_reassembler->closeConnection(conversation_id);
+
+      LOG(WARNING) << "Dropping connection " << conversation_id;
+    } else {
+      ++it;
+    }
+  }
+}
+
+void PcapReaderService::run() {
+  while (!shouldTerminate()) {
+    // The engine can't be changed once it has been selected; until then,
+    // the default one waits for the first configuration
+    auto engine = CaptureEngine::Pcap;
+
+    {
+      std::lock_guard<std::mutex> lock(pcap_mutex);
+      engine = capture_engine;
     }
+
+    UDPRequestList new_udp_requests = {};
+    bool succeeded = false;
+
+    switch (engine) {
+    case CaptureEngine::Pcap:
+      succeeded = runPcapCapture(new_udp_requests);
+      break;
+
+    case CaptureEngine::TPacketV3:
+      succeeded = runRingCapture(new_udp_requests);
+      break;
+
+    case CaptureEngine::File:
+      succeeded = runFileReplay(new_udp_requests);
+      break;
+    }
+
+    if (!succeeded) {
+      return;
+    }
+
+    updateCaptureRingMetrics();
+
+    // Move new data into the shared structure so that the publisher can
+    // start emitting new rows into the table
+    handOverCapturedData(new_udp_requests);
+    dropIdleTcpConversations();
   }
 }
 } // namespace trailofbits
@@ -17,15 +17,21 @@
 #pragma once
 
 #include "pcap_utils.h"
+#include "pcapfilesource.h"
+#include "pcaphandlepool.h"
+#include "tpacketring.h"
 
+#include <pubsub/metricsregistry.h>
 #include <pubsub/servicemanager.h>
 
 #include <DnsLayer.h>
 #include <TcpReassembly.h>
 #include <json11.hpp>
 
+#include <atomic>
 #include <cstdint>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -58,8 +64,24 @@ using TcpConversationId = std::uint32_t;
 using TcpConversationMap =
     std::unordered_map<TcpConversationId, TcpConversation>;
 
-/// A UDP request with its timestamp
-using UDPRequest = std::pair<timeval, ByteVector>;
+/// A raw UDP request
+struct UDPRequest final {
+  /// When the packet has been captured
+  timeval timestamp{};
+
+  /// Link type of the capture handle that received the packet
+  pcpp::LinkLayerType link_type{pcpp::LINKTYPE_NULL};
+
+  /// Packet data; it points either inside a capture ring block or inside a
+  /// private copy, and stays valid as long as `packet_owner` is alive
+  const std::uint8_t* packet_data{nullptr};
+
+  /// Packet size, in bytes
+  std::size_t packet_size{0U};
+
+  /// Keeps the packet data alive
+  std::shared_ptr<const void> packet_owner;
+};
 
 /// A list of UDP requests
 using UDPRequestList = std::vector<UDPRequest>;
@@ -72,35 +94,136 @@ struct PcapReaderServiceData final {
   /// Condition variable, used to wake up the publisher thread
   std::condition_variable cv;
 
+  /// An eventfd descriptor, signaled together with the condition variable;
+  /// it is readable while there is data waiting to be processed
+  int notification_fd{-1};
+
   /// A list of raw UDP requests, ready to be processed
   UDPRequestList udp_request_list;
 
   /// Completed TCP requests
   TcpConversationMap completed_tcp_conversation_map;
 
-  /// Link type
-  pcpp::LinkLayerType link_type;
+  /// Set by the publisher when its buffers are under backpressure; TCP
+  /// packets are then discarded without being reassembled
+  std::atomic_bool shed_tcp_reassembly{false};
 };
 
 /// A reference to a TCP reassembler object
 using TcpReassemblyRef = std::unique_ptr<pcpp::TcpReassembly>;
 
+/// A pcap handle, along with the settings used to open it
+struct PcapCapture final {
+  /// The pcap handle
+  DeclarePcapRef(handle);
+
+  /// Name of the captured interface
+  std::string interface_name;
+
+  /// True if the handle is in promiscuous mode
+  bool promiscuous_mode{false};
+
+  /// Link type
+  pcpp::LinkLayerType link_type{pcpp::LINKTYPE_NULL};
+};
+
+/// The capture engines supported by the reader service
+enum class CaptureEngine { Pcap, TPacketV3, File };
+
+/// The fanout group shared by the capture workers of an interface
+struct PcapFanoutGroup final {
+  /// Serializes the workers joining the group
+  std::mutex mutex;
+
+  /// True once the first worker has created the group
+  bool created{false};
+
+  /// Group identifier, assigned by the kernel when the group is created
+  std::uint16_t id{0U};
+};
+
+/// A reference to a fanout group
+using PcapFanoutGroupRef = std::shared_ptr<PcapFanoutGroup>;
+
+/// Describes the position of a reader service among the capture workers
+struct PcapReaderWorkerSettings final {
+  /// Worker index, across all the captured interfaces
+  std::size_t worker_index{0U};
+
+  /// How many workers there are, across all the captured interfaces
+  std::size_t worker_count{1U};
+
+  /// How many workers share the traffic of the same interface; when more
+  /// than one, they join the same fanout group
+  std::size_t fanout_size{1U};
+
+  /// The fanout group of the interface; the first worker that binds its
+  /// ring creates it, and the other ones join it
+  PcapFanoutGroupRef fanout_group;
+};
+
 /// This service pulls data from the pcap handle
 class PcapReaderService final : public IService {
   /// Data shared with the publisher
   PcapReaderServiceData& shared_data;
 
-  /// Contains device information such as IP addresses and netmasks
-  NetworkDeviceInformation device_information;
+  /// Worker settings
+  const PcapReaderWorkerSettings worker_settings;
 
-  /// The pcap handle
-  DeclarePcapRef(pcap);
+  /// Pcap handles opened while the extension was still running as root
+  PcapHandlePoolRef handle_pool;
+
+  /// The active capture
+  PcapCapture capture;
 
-  /// pcap mutex
+  /// A new capture, waiting to replace the active one; this is swapped by the
+  /// reader thread, so that the handle is never closed while in use
+  PcapCapture pending_capture;
+
+  /// pcap mutex; protects both the active and the pending capture, the
+  /// capture ring and the pending file source
   std::mutex pcap_mutex;
 
-  /// The eBPF program used to filter the network traffic
-  struct bpf_program ebpf_filter_program {};
+  /// The capture engine selected by the first configuration; it can't be
+  /// changed afterwards
+  CaptureEngine capture_engine{CaptureEngine::Pcap};
+
+  /// True once the capture engine has been selected
+  bool capture_engine_selected{false};
+
+  /// The TPACKET_V3 ring, used instead of the pcap handles by the tpacket_v3
+  /// engine
+  TPacketRingRef capture_ring;
+
+  /// Set when the capture ring has been bound to a new interface
+  bool capture_ring_rebound{false};
+
+  /// The capture files replayed by the file engine
+  PcapFileSourceRef file_source;
+
+  /// A new file source, waiting to replace the active one; like the pending
+  /// capture, it is swapped by the reader thread
+  PcapFileSourceRef pending_file_source;
+
+  /// Set once the active file source has been read completely; only used
+  /// by the reader thread
+  bool file_replay_completed{false};
+
+  /// True while packets are replayed from capture files; the reader then
+  /// waits for the publisher instead of shedding the TCP reassembly. Only
+  /// used by the reader thread
+  bool replaying_file{false};
+
+  /// Capture time of the packet being processed, used as the start time of
+  /// new TCP conversations
+  timeval current_packet_timestamp{};
+
+  /// Captured packets, as counted by the capture ring (or read from the
+  /// capture files)
+  StripedCounterRef captured_packet_count;
+
+  /// Packets dropped by the kernel because the capture ring was full
+  StripedCounterRef dropped_packet_count;
 
   /// This class instance is used to reassemble TCP packets
   TcpReassemblyRef tcp_reassembler;
@@ -114,11 +237,12 @@ class PcapReaderService final : public IService {
   /// When the last update on each TCP conversation has happened
   std::map<TcpConversationId, std::time_t> tcp_conversation_timestamp_map;
 
-  /// Max TCP conversation size
-  std::size_t max_tcp_conversation_length{10240U};
+  /// Max TCP conversation size; can be changed while the service is running
+  std::atomic<std::size_t> max_tcp_conversation_length{10240U};
 
-  /// When an inactive connection should be dropped
-  std::size_t max_tcp_conversation_idle_time{300U};
+  /// When an inactive connection should be dropped; can be changed while the
+  /// service is running
+  std::atomic<std::size_t> max_tcp_conversation_idle_time{300U};
 
   /// Automatically called by the TCP reassembler when new data is available
   void onTcpMessageReady(int side, pcpp::TcpStreamData tcp_data);
@@ -133,9 +257,61 @@ class PcapReaderService final : public IService {
   /// Returns the specified pending TCP conversation (or creates a new one)
   TcpConversation& getPendingTcpConversation(TcpConversationId identifier);
 
+  /// Discards all the pending TCP conversations
+  void dropPendingTcpConversations();
+
+  /// Determines the link type and installs the DNS filter on a new handle
+  osquery::Status setupPcapCapture(PcapCapture& new_capture);
+
+  /// Creates the capture ring (if needed) and binds it to the given
+  /// interface
+  osquery::Status configureCaptureRing(const std::string& interface_name,
+                                       bool promiscuous_mode,
+                                       std::size_t ring_size);
+
+  /// Replaces the file source if the settings have changed; the replay
+  /// then starts over
+  osquery::Status configureFileSource(const PcapFileSourceSettings& settings);
+
+  /// Waits until the publisher has caught up with the replay; returns true
+  /// if the service has been asked to terminate in the meantime
+  bool waitForReplayBacklog();
+
+  /// Queues UDP packets for the publisher, and hands TCP packets to the
+  /// reassembler; `packet_owner` is set when the packet data is owned by a
+  /// capture ring block, and does not need to be copied
+  void processPacket(UDPRequestList& new_udp_requests,
+                     const timeval& timestamp,
+                     const std::uint8_t* packet_data,
+                     std::size_t packet_size,
+                     pcpp::LinkLayerType link_type,
+                     std::shared_ptr<const void> packet_owner);
+
+  /// Updates the capture ring metrics
+  void updateCaptureRingMetrics();
+
+  /// Reads packets from the pcap handle until the capture buffer is empty;
+  /// returns false if the capture has failed
+  bool runPcapCapture(UDPRequestList& new_udp_requests);
+
+  /// Reads the next ready block from the capture ring; returns false if the
+  /// capture has failed
+  bool runRingCapture(UDPRequestList& new_udp_requests);
+
+  /// Replays the next batch of packets from the capture files
+  bool runFileReplay(UDPRequestList& new_udp_requests);
+
+  /// Moves the captured requests and the completed TCP conversations to
+  /// the publisher, and wakes it up
+  void handOverCapturedData(UDPRequestList& new_udp_requests);
+
+  /// Closes the TCP conversations that have been idle for too long
+  void dropIdleTcpConversations();
+
  public:
   /// Constructor
-  PcapReaderService(PcapReaderServiceData& shared_data_);
+  PcapReaderService(PcapReaderServiceData& shared_data_,
+                    const PcapReaderWorkerSettings& worker_settings_ = {});
 
   /// Destructor
   virtual ~PcapReaderService() override = default;
@@ -143,14 +319,21 @@ class PcapReaderService final : public IService {
   /// Initialization callback; optional
   virtual osquery::Status initialize() override;
 
-  /// Configuration change
-  virtual osquery::Status configure(const json11::Json& configuration);
+  /// Configuration change; the TCP limits are applied immediately, while a
+  /// new capture handle is only opened if the interface settings have
+  /// changed. The interface name is not used by the file engine
+  virtual osquery::Status configure(const json11::Json& configuration,
+                                    const std::string& interface_name);
 
   /// Cleanup callback; optional
   virtual void release() override;
 
   /// This is the service entry point
   virtual void run() override;
+
+  /// Returns the service name; workers are numbered when there are more
+  /// than one
+  virtual std::string name() const override;
 };
 
 /// A reference to a PcapReaderService object
@@ -0,0 +1,462 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "tpacketring.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <pcap.h>
+
+namespace trailofbits {
+namespace {
+/// Size of the (unused) frames; TPACKET_V3 stores variable-length packets,
+/// but the kernel still validates this value
+const unsigned int kFrameSize = 2048U;
+
+/// Snapshot length used to compile the filters
+const int kFilterSnapshotLength = 65535;
+
+/// Returns an error status that includes the errno description
+osquery::Status errnoStatus(const std::string& message) {
+  return osquery::Status::failure(message + ": " + std::strerror(errno));
+}
+
+/// Returns the block header of the given block descriptor
+tpacket_hdr_v1& blockHeader(void* block_descriptor) {
+  return static_cast<tpacket_block_desc*>(block_descriptor)->hdr.bh1;
+}
+} // namespace
+
+struct TPacketRingMapping final {
+  /// The AF_PACKET socket
+  int socket_fd{-1};
+
+  /// Base address of the ring
+  std::uint8_t* ring{nullptr};
+
+  /// Size of the ring, in bytes
+  std::size_t ring_size{0U};
+
+  /// Set while a block is referenced by a TPacketBlock object; the kernel
+  /// does not touch these blocks, but they must not be handed over twice
+  /// when the ring wraps around
+  std::unique_ptr<std::atomic_bool[]> block_in_use;
+
+  /// Destructor
+  ~TPacketRingMapping() {
+    if (ring != nullptr) {
+      munmap(ring, ring_size);
+    }
+
+    if (socket_fd != -1) {
+      close(socket_fd);
+    }
+  }
+};
+
+TPacketBlock::TPacketBlock(std::shared_ptr<TPacketRingMapping> mapping_,
+                           std::size_t block_index_,
+                           void* block_descriptor_)
+    : mapping(std::move(mapping_)),
+      block_index(block_index_),
+      block_descriptor(block_descriptor_) {}
+
+TPacketBlock::~TPacketBlock() {
+  // Make sure we are done reading the block before the kernel can reuse it
+  __atomic_store_n(&blockHeader(block_descriptor).block_status,
+                   static_cast<std::uint32_t>(TP_STATUS_KERNEL),
+                   __ATOMIC_RELEASE);
+
+  mapping->block_in_use[block_index] = false;
+}
+
+std::size_t TPacketBlock::packetCount() const {
+  return blockHeader(block_descriptor).num_pkts;
+}
+
+void TPacketBlock::forEachPacket(const PacketCallback& callback) const {
+  const auto& block_header = blockHeader(block_descriptor);
+
+  auto packet_address = static_cast<const std::uint8_t*>(block_descriptor) +
+                        block_header.offset_to_first_pkt;
+
+  for (std::uint32_t i = 0U; i < block_header.num_pkts; ++i) {
+    const auto& packet_header =
+        *reinterpret_cast<const tpacket3_hdr*>(packet_address);
+
+    timeval timestamp{};
+    timestamp.tv_sec = static_cast<time_t>(packet_header.tp_sec);
+    timestamp.tv_usec =
+        static_cast<suseconds_t>(packet_header.tp_nsec / 1000U);
+
+    callback(timestamp,
+             packet_address + packet_header.tp_mac,
+             packet_header.tp_snaplen);
+
+    packet_address += packet_header.tp_next_offset;
+  }
+}
+
+/// Private class data
+struct TPacketRing::PrivateData final {
+  /// Ring settings
+  TPacketRingSettings settings;
+
+  /// The socket and the ring mapping, shared with the blocks
+  std::shared_ptr<TPacketRingMapping> mapping;
+
+  /// Index of the next block to hand over
+  std::size_t next_block_index{0U};
+
+  /// The interface the ring is bound to, or zero
+  int interface_index{0};
+
+  /// True if the promiscuous mode has been enabled on the bound interface
+  bool promiscuous_mode{false};
+};
+
+TPacketRing::TPacketRing(const TPacketRingSettings& settings)
+    : d(new PrivateData) {
+  d->settings = settings;
+
+  auto page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  if (settings.block_size < kFrameSize || settings.block_count == 0U ||
+      settings.block_size % page_size != 0U) {
+    throw osquery::Status::failure(
+        "The ring block size must be a multiple of the page size");
+  }
+
+  d->mapping = std::make_shared<TPacketRingMapping>();
+  auto& mapping = *d->mapping;
+
+  // A protocol of zero means that nothing is received until ::bind()
+  mapping.socket_fd = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, 0);
+  if (mapping.socket_fd == -1) {
+    throw errnoStatus("Failed to create the AF_PACKET socket");
+  }
+
+  int version = TPACKET_V3;
+  if (setsockopt(mapping.socket_fd,
+                 SOL_PACKET,
+                 PACKET_VERSION,
+                 &version,
+                 sizeof(version)) != 0) {
+    throw errnoStatus("TPACKET_V3 is not supported");
+  }
+
+  tpacket_req3 ring_request{};
+  ring_request.tp_block_size = static_cast<unsigned int>(settings.block_size);
+  ring_request.tp_block_nr = static_cast<unsigned int>(settings.block_count);
+  ring_request.tp_frame_size = kFrameSize;
+  ring_request.tp_frame_nr = static_cast<unsigned int>(
+      (settings.block_size * settings.block_count) / kFrameSize);
+  ring_request.tp_retire_blk_tov = settings.block_timeout;
+
+  if (setsockopt(mapping.socket_fd,
+                 SOL_PACKET,
+                 PACKET_RX_RING,
+                 &ring_request,
+                 sizeof(ring_request)) != 0) {
+    throw errnoStatus("Failed to allocate the capture ring");
+  }
+
+  mapping.ring_size = settings.block_size * settings.block_count;
+
+  mapping.block_in_use.reset(new std::atomic_bool[settings.block_count]);
+  for (std::size_t i = 0U; i < settings.block_count; ++i) {
+    mapping.block_in_use[i] = false;
+  }
+
+  auto ring = mmap(nullptr,
+                   mapping.ring_size,
+                   PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE,
+                   mapping.socket_fd,
+                   0);
+
+  if (ring == MAP_FAILED) {
+    throw errnoStatus("Failed to map the capture ring");
+  }
+
+  mapping.ring = static_cast<std::uint8_t*>(ring);
+}
+
+osquery::Status TPacketRing::create(TPacketRingRef& obj,
+                                    const TPacketRingSettings& settings) {
+  try {
+    auto ptr = new TPacketRing(settings);
+    obj.reset(ptr);
+
+    return osquery::Status(0);
+
+  } catch (const std::bad_alloc&) {
+    return osquery::Status::failure("Memory allocation failure");
+
+  } catch (const osquery::Status& status) {
+    return status;
+  }
+}
+
+TPacketRing::~TPacketRing() {}
+
+osquery::Status TPacketRing::setFilter(const std::string& filter) {
+  auto pcap = pcap_open_dead(DLT_EN10MB, kFilterSnapshotLength);
+  if (pcap == nullptr) {
+    return osquery::Status::failure("Failed to compile the filter");
+  }
+
+  struct bpf_program filter_program {};
+  if (pcap_compile(
+          pcap, &filter_program, filter.c_str(), 1, PCAP_NETMASK_UNKNOWN) !=
+      0) {
+    auto error_message =
+        std::string("Failed to compile the filter: ") + pcap_geterr(pcap);
+
+    pcap_close(pcap);
+    return osquery::Status::failure(error_message);
+  }
+
+  pcap_close(pcap);
+
+  // The classic BPF instructions have the same layout in both libpcap and
+  // the kernel
+  sock_fprog socket_filter{};
+  socket_filter.len = static_cast<unsigned short>(filter_program.bf_len);
+  socket_filter.filter =
+      reinterpret_cast<sock_filter*>(filter_program.bf_insns);
+
+  auto error = setsockopt(d->mapping->socket_fd,
+                          SOL_SOCKET,
+                          SO_ATTACH_FILTER,
+                          &socket_filter,
+                          sizeof(socket_filter));
+
+  pcap_freecode(&filter_program);
+
+  if (error != 0) {
+    return errnoStatus("Failed to attach the filter");
+  }
+
+  return osquery::Status(0);
+}
+
+osquery::Status TPacketRing::bind(const std::string& interface_name,
+                                  bool promiscuous_mode) {
+  auto socket_fd = d->mapping->socket_fd;
+
+  auto interface_index =
+      static_cast<int>(if_nametoindex(interface_name.c_str()));
+  if (interface_index == 0) {
+    return osquery::Status::failure("The '" + interface_name +
+                                    "' interface was not found");
+  }
+
+  ifreq interface_request{};
+  std::strncpy(interface_request.ifr_name,
+               interface_name.c_str(),
+               sizeof(interface_request.ifr_name) - 1U);
+
+  if (ioctl(socket_fd, SIOCGIFHWADDR, &interface_request) != 0) {
+    return errnoStatus("Failed to query the '" + interface_name +
+                       "' interface");
+  }
+
+  // The loopback interface also uses (fake) ethernet headers
+  auto hardware_type = interface_request.ifr_hwaddr.sa_family;
+  if (hardware_type != ARPHRD_ETHER && hardware_type != ARPHRD_LOOPBACK) {
+    return osquery::Status::failure(
+        "The '" + interface_name +
+        "' interface does not have an ethernet link layer");
+  }
+
+  if (d->promiscuous_mode) {
+    packet_mreq membership_request{};
+    membership_request.mr_ifindex = d->interface_index;
+    membership_request.mr_type = PACKET_MR_PROMISC;
+
+    setsockopt(socket_fd,
+               SOL_PACKET,
+               PACKET_DROP_MEMBERSHIP,
+               &membership_request,
+               sizeof(membership_request));
+
+    d->promiscuous_mode = false;
+  }
+
+  sockaddr_ll address{};
+  address.sll_family = AF_PACKET;
+  address.sll_protocol = htons(ETH_P_ALL);
+  address.sll_ifindex = interface_index;
+
+  if (::bind(socket_fd,
+             reinterpret_cast<const sockaddr*>(&address),
+             sizeof(address)) != 0) {
+    d->interface_index = 0;
+    return errnoStatus("Failed to bind the capture ring to the '" +
+                       interface_name + "' interface");
+  }
+
+  d->interface_index = interface_index;
+
+  if (promiscuous_mode) {
+    packet_mreq membership_request{};
+    membership_request.mr_ifindex = interface_index;
+    membership_request.mr_type = PACKET_MR_PROMISC;
+
+    if (setsockopt(socket_fd,
+                   SOL_PACKET,
+                   PACKET_ADD_MEMBERSHIP,
+                   &membership_request,
+                   sizeof(membership_request)) != 0) {
+      return errnoStatus("Failed to enable the promiscuous mode");
+    }
+
+    d->promiscuous_mode = true;
+  }
+
+  return osquery::Status(0);
+}
+
+osquery::Status TPacketRing::joinFanoutGroup(std::uint16_t group_id) {
+  if (d->interface_index == 0) {
+    return osquery::Status::failure(
+        "The capture ring must be bound before joining a fanout group");
+  }
+
+  // Fragments are reassembled first, so that they are hashed like the rest
+  // of their flow
+  int fanout_settings =
+      static_cast<int>(group_id) |
+      ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+
+  if (setsockopt(d->mapping->socket_fd,
+                 SOL_PACKET,
+                 PACKET_FANOUT,
+                 &fanout_settings,
+                 sizeof(fanout_settings)) != 0) {
+    return errnoStatus("Failed to join the fanout group " +
+                       std::to_string(group_id));
+  }
+
+  return osquery::Status(0);
+}
+
+osquery::Status TPacketRing::createFanoutGroup(std::uint16_t& group_id) {
+  group_id = 0U;
+
+  if (d->interface_index == 0) {
+    return osquery::Status::failure(
+        "The capture ring must be bound before creating a fanout group");
+  }
+
+  // The group identifier must be zero; the kernel picks one that is not in
+  // use, and it can then be read back
+  int fanout_settings =
+      (PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG |
+       PACKET_FANOUT_FLAG_UNIQUEID)
+      << 16;
+
+  if (setsockopt(d->mapping->socket_fd,
+                 SOL_PACKET,
+                 PACKET_FANOUT,
+                 &fanout_settings,
+                 sizeof(fanout_settings)) != 0) {
+    return errnoStatus("Failed to create a new fanout group");
+  }
+
+  fanout_settings = 0;
+  socklen_t option_size = sizeof(fanout_settings);
+
+  if (getsockopt(d->mapping->socket_fd,
+                 SOL_PACKET,
+                 PACKET_FANOUT,
+                 &fanout_settings,
+                 &option_size) != 0) {
+    return errnoStatus("Failed to read the fanout group identifier");
+  }
+
+  group_id = static_cast<std::uint16_t>(fanout_settings & 0xFFFF);
+  return osquery::Status(0);
+}
+
+int TPacketRing::descriptor() const {
+  return d->mapping->socket_fd;
+}
+
+TPacketBlockRef TPacketRing::nextBlock() {
+  auto& mapping = *d->mapping;
+
+  auto block_index = d->next_block_index;
+  if (mapping.block_in_use[block_index]) {
+    return nullptr;
+  }
+
+  auto block_descriptor = mapping.ring + block_index * d->settings.block_size;
+  auto& block_header = blockHeader(block_descriptor);
+
+  auto block_status =
+      __atomic_load_n(&block_header.block_status, __ATOMIC_ACQUIRE);
+
+  if ((block_status & TP_STATUS_USER) == 0U) {
+    return nullptr;
+  }
+
+  try {
+    TPacketBlockRef block(
+        new TPacketBlock(d->mapping, block_index, block_descriptor));
+
+    mapping.block_in_use[block_index] = true;
+    d->next_block_index = (block_index + 1U) % d->settings.block_count;
+
+    return block;
+
+  } catch (const std::bad_alloc&) {
+    return nullptr;
+  }
+}
+
+TPacketRingStatistics TPacketRing::statistics() {
+  TPacketRingStatistics statistics;
+
+  tpacket_stats_v3 kernel_statistics{};
+  socklen_t size = sizeof(kernel_statistics);
+
+  if (getsockopt(d->mapping->socket_fd,
+                 SOL_PACKET,
+                 PACKET_STATISTICS,
+                 &kernel_statistics,
+                 &size) == 0) {
+    statistics.packet_count = kernel_statistics.tp_packets;
+    statistics.drop_count = kernel_statistics.tp_drops;
+  }
+
+  return statistics;
+}
+} // namespace trailofbits
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <osquery/flags.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <sys/time.h>
+
+namespace trailofbits {
+class TPacketRing;
+class TPacketBlock;
+
+/// A reference to a TPacketRing object
+using TPacketRingRef = std::unique_ptr<TPacketRing>;
+
+/// A reference to a ring block; the block is returned to the kernel when
+/// the last reference is dropped
+using TPacketBlockRef = std::shared_ptr<const TPacketBlock>;
+
+/// Ring settings
+struct TPacketRingSettings final {
+  /// Size of each block, in bytes; it must be a multiple of the page size
+  std::size_t block_size{1U << 20U};
+
+  /// How many blocks the ring contains
+  std::size_t block_count{64U};
+
+  /// How long the kernel waits before handing over a block that is not
+  /// full, in milliseconds
+  unsigned int block_timeout{100U};
+};
+
+/// Ring counters, reset each time they are read
+struct TPacketRingStatistics final {
+  /// Packets that have been accepted by the filter
+  std::uint64_t packet_count{0U};
+
+  /// Packets that have been dropped because the ring was full
+  std::uint64_t drop_count{0U};
+};
+
+/// Shared state between the ring and its blocks; it keeps the ring mapped
+/// until all the blocks have been released
+struct TPacketRingMapping;
+
+/// A block of packets, handed over by the kernel. The packet data is read
+/// in place from the ring, and stays valid until the block is released
+class TPacketBlock final {
+  /// The ring mapping
+  std::shared_ptr<TPacketRingMapping> mapping;
+
+  /// Index of the block inside the ring
+  std::size_t block_index{0U};
+
+  /// The block descriptor, inside the mapping
+  void* block_descriptor{nullptr};
+
+  /// Private constructor; blocks are only created by TPacketRing::nextBlock()
+  TPacketBlock(std::shared_ptr<TPacketRingMapping> mapping_,
+               std::size_t block_index_,
+               void* block_descriptor_);
+
+ public:
+  /// Called for each packet in the block
+  using PacketCallback = std::function<void(const timeval& timestamp,
+                                            const std::uint8_t* data,
+                                            std::size_t size)>;
+
+  /// Destructor; returns the block to the kernel
+  ~TPacketBlock();
+
+  /// Returns the amount of packets in this block
+  std::size_t packetCount() const;
+
+  /// Calls the given function for each packet in the block
+  void forEachPacket(const PacketCallback& callback) const;
+
+  /// Disable the copy constructor
+  TPacketBlock(const TPacketBlock& other) = delete;
+
+  /// Disable the assignment operator
+  TPacketBlock& operator=(const TPacketBlock& other) = delete;
+
+  friend class TPacketRing;
+};
+
+/// An AF_PACKET socket with a TPACKET_V3 receive ring. The kernel fills the
+/// ring blocks directly, and whole blocks are handed to user space without
+/// a system call or a copy for each packet
+class TPacketRing final {
+  struct PrivateData;
+
+  /// Private class data
+  std::unique_ptr<PrivateData> d;
+
+  /// Private constructor; use the ::create() static function instead
+  TPacketRing(const TPacketRingSettings& settings);
+
+ public:
+  /// Factory function used to create TPacketRing objects; this requires
+  /// the CAP_NET_RAW capability. The ring does not receive any packet
+  /// until it is bound to an interface
+  static osquery::Status create(TPacketRingRef& obj,
+                                const TPacketRingSettings& settings);
+
+  /// Destructor
+  ~TPacketRing();
+
+  /// Installs the given pcap filter expression
+  osquery::Status setFilter(const std::string& filter);
+
+  /// Binds the ring to the given interface, leaving the previous one (if
+  /// any). Only interfaces with an ethernet (or loopback) link layer are
+  /// supported
+  osquery::Status bind(const std::string& interface_name,
+                       bool promiscuous_mode);
+
+  /// Joins the given fanout group, so that the traffic of the interface is
+  /// split among all the rings in the group; packets of the same flow (in
+  /// both directions) always reach the same ring. This must be called after
+  /// ::bind(), which then can't be called anymore
+  osquery::Status joinFanoutGroup(std::uint16_t group_id);
+
+  /// Creates a new fanout group and joins it, like ::joinFanoutGroup();
+  /// the identifier is assigned by the kernel (Linux 4.8 or later), so it
+  /// never matches a group created by another process
+  osquery::Status createFanoutGroup(std::uint16_t& group_id);
+
+  /// Returns the socket descriptor; it becomes readable when the next block
+  /// has been handed over
+  int descriptor() const;
+
+  /// Returns the next block, or nullptr if the kernel has not handed it over
+  /// yet. Blocks are returned in ring order
+  TPacketBlockRef nextBlock();
+
+  /// Returns the counters accumulated since the last call
+  TPacketRingStatistics statistics();
+
+  /// Disable the copy constructor
+  TPacketRing(const TPacketRing& other) = delete;
+
+  /// Disable the assignment operator
+  TPacketRing& operator=(const TPacketRing& other) = delete;
+};
+} // namespace trailofbits
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2018 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dnsdecoder.h"
+#include "dnspackets.h"
+
+#include <gtest/gtest.h>
+
+namespace trailofbits {
+namespace {
+/// Decodes the given packet with both decoders, and compares the events
+void compareDecoders(const ByteVector& packet,
+                     pcpp::LinkLayerType link_type = pcpp::LINKTYPE_ETHERNET) {
+  EventArena arena;
+
+  DnsEvent builtin_event(arena);
+  ASSERT_TRUE(decodeDnsPacket(DnsDecoderType::Builtin,
+                              arena,
+                              builtin_event,
+                              packet.data(),
+                              packet.size(),
+                              link_type));
+
+  DnsEvent pcpp_event(arena);
+  ASSERT_TRUE(decodeDnsPacket(DnsDecoderType::PcapPlusPlus,
+                              arena,
+                              pcpp_event,
+                              packet.data(),
+                              packet.size(),
+                              link_type));
+
+  EXPECT_EQ(builtin_event.source_address, pcpp_event.source_address);
+  EXPECT_EQ(builtin_event.destination_address,
+            pcpp_event.destination_address);
+
+  EXPECT_EQ(builtin_event.type, pcpp_event.type);
+  EXPECT_EQ(builtin_event.id, pcpp_event.id);
+  EXPECT_EQ(builtin_event.protocol, pcpp_event.protocol);
+  EXPECT_EQ(builtin_event.truncated, pcpp_event.truncated);
+
+  ASSERT_EQ(builtin_event.question.size(), pcpp_event.question.size());
+  for (std::size_t i = 0U; i < builtin_event.question.size(); ++i) {
+    const auto& builtin_question = builtin_event.question.at(i);
+    const auto& pcpp_question = pcpp_event.question.at(i);
+
+    EXPECT_EQ(builtin_question.record_name, pcpp_question.record_name);
+    EXPECT_EQ(builtin_question.record_type, pcpp_question.record_type);
+    EXPECT_EQ(builtin_question.record_class, pcpp_question.record_class);
+  }
+
+  ASSERT_EQ(builtin_event.answer.size(), pcpp_event.answer.size());
+  for (std::size_t i = 0U; i < builtin_event.answer.size(); ++i) {
+    const auto& builtin_answer = builtin_event.answer.at(i);
+    const auto& pcpp_answer = pcpp_event.answer.at(i);
+
+    EXPECT_EQ(builtin_answer.record_name, pcpp_answer.record_name);
+    EXPECT_EQ(builtin_answer.record_type, pcpp_answer.record_type);
+    EXPECT_EQ(builtin_answer.record_class, pcpp_answer.record_class);
+    EXPECT_EQ(builtin_answer.ttl, pcpp_answer.ttl);
+    EXPECT_EQ(builtin_answer.record_data, pcpp_answer.record_data);
+  }
+}
+} // namespace
+
+TEST(DnsDecoderTests, SameOutput) {
+  for (const auto& packet : syntheticDnsPackets(256U)) {
+    compareDecoders(packet);
+
+    if (HasFatalFailure()) {
+      return;
+    }
+  }
+}
+
+TEST(DnsDecoderTests, LinkTypes) {
+  auto ethernet_packet = syntheticDnsPackets(1U).front();
+  ByteVector ip_packet(ethernet_packet.begin() + 14, ethernet_packet.end());
+
+  // Linux cooked capture, as produced by "tcpdump -i any"
+  ByteVector sll_packet = {0U, 0U, 0U, 1U, 0U, 6U};
+  sll_packet.resize(14U, 0U);
+  appendUInt16(sll_packet, 0x0800U);
+  sll_packet.insert(sll_packet.end(), ip_packet.begin(), ip_packet.end());
+
+  compareDecoders(sll_packet, pcpp::LINKTYPE_LINUX_SLL);
+  compareDecoders(ip_packet, pcpp::LINKTYPE_RAW);
+
+  TransportLayerInfo transport_layer;
+  EXPECT_TRUE(locateTransportLayer(transport_layer,
+                                   ip_packet.data(),
+                                   ip_packet.size(),
+                                   pcpp::LINKTYPE_RAW));
+  EXPECT_EQ(transport_layer.protocol, pcpp::UDP);
+  EXPECT_EQ(transport_layer.size, ip_packet.size() - 20U);
+
+  EXPECT_FALSE(locateTransportLayer(transport_layer,
+                                    sll_packet.data(),
+                                    15U,
+                                    pcpp::LINKTYPE_LINUX_SLL));
+}
+
+TEST(DnsDecoderTests, RecordDataBounds) {
+  // A response whose CNAME answer has an empty RDATA; its name must not be
+  // read from the A answer that follows
+  ByteVector message;
+  appendUInt16(message, 1U);
+  appendUInt16(message, 0x8180U);
+  appendUInt16(message, 1U);
+  appendUInt16(message, 2U);
+  appendUInt16(message, 0U);
+  appendUInt16(message, 0U);
+
+  appendDnsName(message, "www.example.com");
+  appendUInt16(message, 1U);
+  appendUInt16(message, 1U);
+
+  message.insert(message.end(), {0xC0U, 0x0CU});
+  appendUInt16(message, 5U);
+  appendUInt16(message, 1U);
+  appendUInt16(message, 0U);
+  appendUInt16(message, 300U);
+  appendUInt16(message, 0U);
+
+  message.insert(message.end(), {0xC0U, 0x0CU});
+  appendUInt16(message, 1U);
+  appendUInt16(message, 1U);
+  appendUInt16(message, 0U);
+  appendUInt16(message, 300U);
+  appendUInt16(message, 4U);
+  message.insert(message.end(), {192U, 0U, 2U, 1U});
+
+  EventArena arena;
+  DnsEvent dns_event(arena);
+
+  ASSERT_TRUE(decodeDnsMessage(DnsDecoderType::Builtin,
+                               arena,
+                               dns_event,
+                               message.data(),
+                               message.size(),
+                               pcpp::UDP));
+
+  ASSERT_EQ(dns_event.question.size(), 1U);
+  EXPECT_EQ(dns_event.question.front().record_name, "www.example.com");
+
+  // Decoding stops at the malformed record
+  EXPECT_TRUE(dns_event.answer.empty());
+}
+} // namespace trailofbits